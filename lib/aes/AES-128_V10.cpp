@@ -38,303 +38,223 @@
 //  - All other functions and variables were made static
 //  - Tabs were converted to 2 spaces
 //  - An #include and #if guard was added
-//  - S_Table is now stored in PROGMEM
+//  - S_Table was to be stored in PROGMEM, it is a const table (in RAM on ESP8266)
+//
+// For the 1ch gateway the byte oriented rounds were replaced by 32-bit table
+// lookups (one 1 KB table in flash, rotated for the other three columns), and the key
+// schedule can be expanded once with AES_Set_Key() and used for every block with
+// AES_Encrypt_Key(). On ESP32 the hardware AES is used through mbedtls, with the
+// software rounds as fallback. Define AES_SOFTWARE to always use software.
 
 
 
+
+#include <stdint.h>
+#include <string.h>
+#include "AES-128_V10.h"
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+#  include <pgmspace.h>
+#else
+#  define PROGMEM
+#endif
+
 /*
 ********************************************************************************************
 * Global Variables
 ********************************************************************************************
 */
 
-static unsigned char State[4][4];
+static const unsigned char S_Table[256] = {
+  0x63,0x7C,0x77,0x7B,0xF2,0x6B,0x6F,0xC5,0x30,0x01,0x67,0x2B,0xFE,0xD7,0xAB,0x76,
+  0xCA,0x82,0xC9,0x7D,0xFA,0x59,0x47,0xF0,0xAD,0xD4,0xA2,0xAF,0x9C,0xA4,0x72,0xC0,
+  0xB7,0xFD,0x93,0x26,0x36,0x3F,0xF7,0xCC,0x34,0xA5,0xE5,0xF1,0x71,0xD8,0x31,0x15,
+  0x04,0xC7,0x23,0xC3,0x18,0x96,0x05,0x9A,0x07,0x12,0x80,0xE2,0xEB,0x27,0xB2,0x75,
+  0x09,0x83,0x2C,0x1A,0x1B,0x6E,0x5A,0xA0,0x52,0x3B,0xD6,0xB3,0x29,0xE3,0x2F,0x84,
+  0x53,0xD1,0x00,0xED,0x20,0xFC,0xB1,0x5B,0x6A,0xCB,0xBE,0x39,0x4A,0x4C,0x58,0xCF,
+  0xD0,0xEF,0xAA,0xFB,0x43,0x4D,0x33,0x85,0x45,0xF9,0x02,0x7F,0x50,0x3C,0x9F,0xA8,
+  0x51,0xA3,0x40,0x8F,0x92,0x9D,0x38,0xF5,0xBC,0xB6,0xDA,0x21,0x10,0xFF,0xF3,0xD2,
+  0xCD,0x0C,0x13,0xEC,0x5F,0x97,0x44,0x17,0xC4,0xA7,0x7E,0x3D,0x64,0x5D,0x19,0x73,
+  0x60,0x81,0x4F,0xDC,0x22,0x2A,0x90,0x88,0x46,0xEE,0xB8,0x14,0xDE,0x5E,0x0B,0xDB,
+  0xE0,0x32,0x3A,0x0A,0x49,0x06,0x24,0x5C,0xC2,0xD3,0xAC,0x62,0x91,0x95,0xE4,0x79,
+  0xE7,0xC8,0x37,0x6D,0x8D,0xD5,0x4E,0xA9,0x6C,0x56,0xF4,0xEA,0x65,0x7A,0xAE,0x08,
+  0xBA,0x78,0x25,0x2E,0x1C,0xA6,0xB4,0xC6,0xE8,0xDD,0x74,0x1F,0x4B,0xBD,0x8B,0x8A,
+  0x70,0x3E,0xB5,0x66,0x48,0x03,0xF6,0x0E,0x61,0x35,0x57,0xB9,0x86,0xC1,0x1D,0x9E,
+  0xE1,0xF8,0x98,0x11,0x69,0xD9,0x8E,0x94,0x9B,0x1E,0x87,0xE9,0xCE,0x55,0x28,0xDF,
+  0x8C,0xA1,0x89,0x0D,0xBF,0xE6,0x42,0x68,0x41,0x99,0x2D,0x0F,0xB0,0x54,0xBB,0x16
+};
 
-//static CONST_TABLE(unsigned char, S_Table)[16][16] = {
-unsigned char S_Table[16][16] = {
-  {0x63,0x7C,0x77,0x7B,0xF2,0x6B,0x6F,0xC5,0x30,0x01,0x67,0x2B,0xFE,0xD7,0xAB,0x76},
-  {0xCA,0x82,0xC9,0x7D,0xFA,0x59,0x47,0xF0,0xAD,0xD4,0xA2,0xAF,0x9C,0xA4,0x72,0xC0},
-  {0xB7,0xFD,0x93,0x26,0x36,0x3F,0xF7,0xCC,0x34,0xA5,0xE5,0xF1,0x71,0xD8,0x31,0x15},
-  {0x04,0xC7,0x23,0xC3,0x18,0x96,0x05,0x9A,0x07,0x12,0x80,0xE2,0xEB,0x27,0xB2,0x75},
-  {0x09,0x83,0x2C,0x1A,0x1B,0x6E,0x5A,0xA0,0x52,0x3B,0xD6,0xB3,0x29,0xE3,0x2F,0x84},
-  {0x53,0xD1,0x00,0xED,0x20,0xFC,0xB1,0x5B,0x6A,0xCB,0xBE,0x39,0x4A,0x4C,0x58,0xCF},
-  {0xD0,0xEF,0xAA,0xFB,0x43,0x4D,0x33,0x85,0x45,0xF9,0x02,0x7F,0x50,0x3C,0x9F,0xA8},
-  {0x51,0xA3,0x40,0x8F,0x92,0x9D,0x38,0xF5,0xBC,0xB6,0xDA,0x21,0x10,0xFF,0xF3,0xD2},
-  {0xCD,0x0C,0x13,0xEC,0x5F,0x97,0x44,0x17,0xC4,0xA7,0x7E,0x3D,0x64,0x5D,0x19,0x73},
-  {0x60,0x81,0x4F,0xDC,0x22,0x2A,0x90,0x88,0x46,0xEE,0xB8,0x14,0xDE,0x5E,0x0B,0xDB},
-  {0xE0,0x32,0x3A,0x0A,0x49,0x06,0x24,0x5C,0xC2,0xD3,0xAC,0x62,0x91,0x95,0xE4,0x79},
-  {0xE7,0xC8,0x37,0x6D,0x8D,0xD5,0x4E,0xA9,0x6C,0x56,0xF4,0xEA,0x65,0x7A,0xAE,0x08},
-  {0xBA,0x78,0x25,0x2E,0x1C,0xA6,0xB4,0xC6,0xE8,0xDD,0x74,0x1F,0x4B,0xBD,0x8B,0x8A},
-  {0x70,0x3E,0xB5,0x66,0x48,0x03,0xF6,0x0E,0x61,0x35,0x57,0xB9,0x86,0xC1,0x1D,0x9E},
-  {0xE1,0xF8,0x98,0x11,0x69,0xD9,0x8E,0x94,0x9B,0x1E,0x87,0xE9,0xCE,0x55,0x28,0xDF},
-  {0x8C,0xA1,0x89,0x0D,0xBF,0xE6,0x42,0x68,0x41,0x99,0x2D,0x0F,0xB0,0x54,0xBB,0x16}
+// Te0[x] holds the column (2.S[x], S[x], S[x], 3.S[x]) of SubBytes and MixColumns.
+// The tables for the other three rows are the same words rotated by 8, 16 and 24 bits.
+// It is a constant table in flash, the ESP reads aligned 32-bit words from PROGMEM
+// directly, so it does not use 1 KB of RAM.
+static const uint32_t Te0[256] PROGMEM = {
+  0xC66363A5,0xF87C7C84,0xEE777799,0xF67B7B8D,0xFFF2F20D,0xD66B6BBD,0xDE6F6FB1,0x91C5C554,
+  0x60303050,0x02010103,0xCE6767A9,0x562B2B7D,0xE7FEFE19,0xB5D7D762,0x4DABABE6,0xEC76769A,
+  0x8FCACA45,0x1F82829D,0x89C9C940,0xFA7D7D87,0xEFFAFA15,0xB25959EB,0x8E4747C9,0xFBF0F00B,
+  0x41ADADEC,0xB3D4D467,0x5FA2A2FD,0x45AFAFEA,0x239C9CBF,0x53A4A4F7,0xE4727296,0x9BC0C05B,
+  0x75B7B7C2,0xE1FDFD1C,0x3D9393AE,0x4C26266A,0x6C36365A,0x7E3F3F41,0xF5F7F702,0x83CCCC4F,
+  0x6834345C,0x51A5A5F4,0xD1E5E534,0xF9F1F108,0xE2717193,0xABD8D873,0x62313153,0x2A15153F,
+  0x0804040C,0x95C7C752,0x46232365,0x9DC3C35E,0x30181828,0x379696A1,0x0A05050F,0x2F9A9AB5,
+  0x0E070709,0x24121236,0x1B80809B,0xDFE2E23D,0xCDEBEB26,0x4E272769,0x7FB2B2CD,0xEA75759F,
+  0x1209091B,0x1D83839E,0x582C2C74,0x341A1A2E,0x361B1B2D,0xDC6E6EB2,0xB45A5AEE,0x5BA0A0FB,
+  0xA45252F6,0x763B3B4D,0xB7D6D661,0x7DB3B3CE,0x5229297B,0xDDE3E33E,0x5E2F2F71,0x13848497,
+  0xA65353F5,0xB9D1D168,0x00000000,0xC1EDED2C,0x40202060,0xE3FCFC1F,0x79B1B1C8,0xB65B5BED,
+  0xD46A6ABE,0x8DCBCB46,0x67BEBED9,0x7239394B,0x944A4ADE,0x984C4CD4,0xB05858E8,0x85CFCF4A,
+  0xBBD0D06B,0xC5EFEF2A,0x4FAAAAE5,0xEDFBFB16,0x864343C5,0x9A4D4DD7,0x66333355,0x11858594,
+  0x8A4545CF,0xE9F9F910,0x04020206,0xFE7F7F81,0xA05050F0,0x783C3C44,0x259F9FBA,0x4BA8A8E3,
+  0xA25151F3,0x5DA3A3FE,0x804040C0,0x058F8F8A,0x3F9292AD,0x219D9DBC,0x70383848,0xF1F5F504,
+  0x63BCBCDF,0x77B6B6C1,0xAFDADA75,0x42212163,0x20101030,0xE5FFFF1A,0xFDF3F30E,0xBFD2D26D,
+  0x81CDCD4C,0x180C0C14,0x26131335,0xC3ECEC2F,0xBE5F5FE1,0x359797A2,0x884444CC,0x2E171739,
+  0x93C4C457,0x55A7A7F2,0xFC7E7E82,0x7A3D3D47,0xC86464AC,0xBA5D5DE7,0x3219192B,0xE6737395,
+  0xC06060A0,0x19818198,0x9E4F4FD1,0xA3DCDC7F,0x44222266,0x542A2A7E,0x3B9090AB,0x0B888883,
+  0x8C4646CA,0xC7EEEE29,0x6BB8B8D3,0x2814143C,0xA7DEDE79,0xBC5E5EE2,0x160B0B1D,0xADDBDB76,
+  0xDBE0E03B,0x64323256,0x743A3A4E,0x140A0A1E,0x924949DB,0x0C06060A,0x4824246C,0xB85C5CE4,
+  0x9FC2C25D,0xBDD3D36E,0x43ACACEF,0xC46262A6,0x399191A8,0x319595A4,0xD3E4E437,0xF279798B,
+  0xD5E7E732,0x8BC8C843,0x6E373759,0xDA6D6DB7,0x018D8D8C,0xB1D5D564,0x9C4E4ED2,0x49A9A9E0,
+  0xD86C6CB4,0xAC5656FA,0xF3F4F407,0xCFEAEA25,0xCA6565AF,0xF47A7A8E,0x47AEAEE9,0x10080818,
+  0x6FBABAD5,0xF0787888,0x4A25256F,0x5C2E2E72,0x381C1C24,0x57A6A6F1,0x73B4B4C7,0x97C6C651,
+  0xCBE8E823,0xA1DDDD7C,0xE874749C,0x3E1F1F21,0x964B4BDD,0x61BDBDDC,0x0D8B8B86,0x0F8A8A85,
+  0xE0707090,0x7C3E3E42,0x71B5B5C4,0xCC6666AA,0x904848D8,0x06030305,0xF7F6F601,0x1C0E0E12,
+  0xC26161A3,0x6A35355F,0xAE5757F9,0x69B9B9D0,0x17868691,0x99C1C158,0x3A1D1D27,0x279E9EB9,
+  0xD9E1E138,0xEBF8F813,0x2B9898B3,0x22111133,0xD26969BB,0xA9D9D970,0x078E8E89,0x339494A7,
+  0x2D9B9BB6,0x3C1E1E22,0x15878792,0xC9E9E920,0x87CECE49,0xAA5555FF,0x50282878,0xA5DFDF7A,
+  0x038C8C8F,0x59A1A1F8,0x09898980,0x1A0D0D17,0x65BFBFDA,0xD7E6E631,0x844242C6,0xD06868B8,
+  0x824141C3,0x299999B0,0x5A2D2D77,0x1E0F0F11,0x7BB0B0CB,0xA85454FC,0x6DBBBBD6,0x2C16163A
 };
 
-//extern "C" void AES_Encrypt(unsigned char *Data, unsigned char *Key);
-void AES_Encrypt(unsigned char *Data, unsigned char *Key);
-static void AES_Add_Round_Key(unsigned char *Round_Key);
-static unsigned char AES_Sub_Byte(unsigned char Byte);
-static void AES_Shift_Rows();
-static void AES_Mix_Collums();
-static void AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key);
-static void Send_State();
+#define AES_ROR(w,n)  (((w) >> (n)) | ((w) << (32-(n))))
+#define AES_GET32(p)  (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define AES_PUT32(p,w) { (p)[0] = (unsigned char)((w) >> 24); (p)[1] = (unsigned char)((w) >> 16); \
+                         (p)[2] = (unsigned char)((w) >> 8);  (p)[3] = (unsigned char)(w); }
 
 /*
 *****************************************************************************************
-* Description : Function for encrypting data using AES-128
+* Description : Expand the Key into the 11 round keys of the software rounds
 *
-* Arguments   : *Data   Data to encrypt is a 16 byte long arry
-*               *Key    Key to encrypt data with is a 16 byte long arry
+* Arguments   : *Ks     Key schedule to fill
+*               *Key    16 byte long key
 *****************************************************************************************
 */
-void AES_Encrypt(unsigned char *Data, unsigned char *Key)
+static void AES_Expand_Key(AES_Key *Ks, const unsigned char *Key)
 {
-  unsigned char i;
-  unsigned char Row,Collum;
-  unsigned char Round = 0x00;
-  unsigned char Round_Key[16];
+  uint32_t *rk = Ks->Round_Key;
+  uint32_t Rcon = 0x01000000;
 
-  //Copy input to State arry
-  for(Collum = 0; Collum < 4; Collum++)
+  for(int i = 0; i < 4; i++)
   {
-    for(Row = 0; Row < 4; Row++)
-    {
-      State[Row][Collum] = Data[Row + (4*Collum)];
-    }
+    rk[i] = AES_GET32(Key + 4*i);
   }
-
-  //Copy key to round key
-  for(i = 0; i < 16; i++)
+  for(int i = 4; i < 44; i++)
   {
-    Round_Key[i] = Key[i];
-  }
-
-  //Add round key
-  AES_Add_Round_Key(Round_Key);
-
-  //Preform 9 full rounds
-  for(Round = 1; Round < 10; Round++)
-  {
-    //Preform Byte substitution with S table
-    for(Collum = 0; Collum < 4; Collum++)
+    uint32_t t = rk[i-1];
+    if ((i % 4) == 0)
     {
-      for(Row = 0; Row < 4; Row++)
-      {
-        State[Row][Collum] = AES_Sub_Byte(State[Row][Collum]);
-      }
+      // RotWord, SubWord and Rcon
+      t = ((uint32_t)S_Table[(t >> 16) & 0xFF] << 24) ^ ((uint32_t)S_Table[(t >> 8) & 0xFF] << 16) ^
+          ((uint32_t)S_Table[t & 0xFF] << 8) ^ (uint32_t)S_Table[t >> 24] ^ Rcon;
+      Rcon = (Rcon << 1) ^ ((Rcon & 0x80000000) ? 0x1B000000 : 0);
     }
-
-    //Preform Row Shift
-    AES_Shift_Rows();
-
-    //Mix Collums
-    AES_Mix_Collums();
-
-    //Calculate new round key
-    AES_Calculate_Round_Key(Round,Round_Key);
-
-    //Add round key
-    AES_Add_Round_Key(Round_Key);
+    rk[i] = rk[i-4] ^ t;
   }
-
-  //Last round whitout mix collums
-  //Preform Byte substitution with S table
-  for(Collum = 0; Collum < 4; Collum++)
-  {
-    for(Row = 0; Row < 4; Row++)
-    {
-      State[Row][Collum] = AES_Sub_Byte(State[Row][Collum]);
-    }
-  }
-
-  //Shift rows
-  AES_Shift_Rows();
-
-  //Calculate new round key
-  AES_Calculate_Round_Key(Round,Round_Key);
-
-  //Add round Key
-  AES_Add_Round_Key(Round_Key);
-
-  //Copy the State into the data array
-  for(Collum = 0; Collum < 4; Collum++)
-  {
-    for(Row = 0; Row < 4; Row++)
-    {
-      Data[Row + (4*Collum)] = State[Row][Collum];
-    }
-  }
-
 }
 
 /*
 *****************************************************************************************
-* Description : Function that add's the round key for the current round
+* Description : Encrypt one block with the software rounds
 *
-* Arguments   : *Round_Key    16 byte long array holding the Round Key
+* Arguments   : *Data   Data to encrypt is a 16 byte long arry
+*               *rk     44 words of expanded round keys
 *****************************************************************************************
 */
-static void AES_Add_Round_Key(unsigned char *Round_Key)
+static void AES_Encrypt_Soft(unsigned char *Data, const uint32_t *rk)
 {
-  unsigned char Row,Collum;
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+
+  s0 = AES_GET32(Data     ) ^ rk[0];
+  s1 = AES_GET32(Data +  4) ^ rk[1];
+  s2 = AES_GET32(Data +  8) ^ rk[2];
+  s3 = AES_GET32(Data + 12) ^ rk[3];
 
-  for(Collum = 0; Collum < 4; Collum++)
+  //Preform 9 full rounds, SubBytes, ShiftRows and MixColumns in one lookup per byte
+  for(int Round = 1; Round < 10; Round++)
   {
-    for(Row = 0; Row < 4; Row++)
-    {
-      State[Row][Collum] = State[Row][Collum] ^ Round_Key[Row + (4*Collum)];
-    }
+    rk += 4;
+    t0 = Te0[s0 >> 24] ^ AES_ROR(Te0[(s1 >> 16) & 0xFF], 8) ^ AES_ROR(Te0[(s2 >> 8) & 0xFF], 16) ^ AES_ROR(Te0[s3 & 0xFF], 24) ^ rk[0];
+    t1 = Te0[s1 >> 24] ^ AES_ROR(Te0[(s2 >> 16) & 0xFF], 8) ^ AES_ROR(Te0[(s3 >> 8) & 0xFF], 16) ^ AES_ROR(Te0[s0 & 0xFF], 24) ^ rk[1];
+    t2 = Te0[s2 >> 24] ^ AES_ROR(Te0[(s3 >> 16) & 0xFF], 8) ^ AES_ROR(Te0[(s0 >> 8) & 0xFF], 16) ^ AES_ROR(Te0[s1 & 0xFF], 24) ^ rk[2];
+    t3 = Te0[s3 >> 24] ^ AES_ROR(Te0[(s0 >> 16) & 0xFF], 8) ^ AES_ROR(Te0[(s1 >> 8) & 0xFF], 16) ^ AES_ROR(Te0[s2 & 0xFF], 24) ^ rk[3];
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
   }
-}
 
-/*
-*****************************************************************************************
-* Description : Function that substitutes a byte with a byte from the S_Table
-*
-* Arguments   : Byte    The byte that will be substituted
-*
-* Return      : The return is the found byte in the S_Table
-*****************************************************************************************
-*/
-static unsigned char AES_Sub_Byte(unsigned char Byte)
-{
-  unsigned char S_Row,S_Collum;
-  unsigned char S_Byte;
-
-  //Split byte up in Row and Collum
-  S_Row = ((Byte >> 4) & 0x0F);
-  S_Collum = (Byte & 0x0F);
-
-  //Find the correct byte in the S_Table
-  S_Byte = S_Table[S_Row][S_Collum];
-
-  return S_Byte;
+  //Last round whitout mix collums
+  rk += 4;
+  t0 = ((uint32_t)S_Table[s0 >> 24] << 24) ^ ((uint32_t)S_Table[(s1 >> 16) & 0xFF] << 16) ^
+       ((uint32_t)S_Table[(s2 >> 8) & 0xFF] << 8) ^ (uint32_t)S_Table[s3 & 0xFF] ^ rk[0];
+  t1 = ((uint32_t)S_Table[s1 >> 24] << 24) ^ ((uint32_t)S_Table[(s2 >> 16) & 0xFF] << 16) ^
+       ((uint32_t)S_Table[(s3 >> 8) & 0xFF] << 8) ^ (uint32_t)S_Table[s0 & 0xFF] ^ rk[1];
+  t2 = ((uint32_t)S_Table[s2 >> 24] << 24) ^ ((uint32_t)S_Table[(s3 >> 16) & 0xFF] << 16) ^
+       ((uint32_t)S_Table[(s0 >> 8) & 0xFF] << 8) ^ (uint32_t)S_Table[s1 & 0xFF] ^ rk[2];
+  t3 = ((uint32_t)S_Table[s3 >> 24] << 24) ^ ((uint32_t)S_Table[(s0 >> 16) & 0xFF] << 16) ^
+       ((uint32_t)S_Table[(s1 >> 8) & 0xFF] << 8) ^ (uint32_t)S_Table[s2 & 0xFF] ^ rk[3];
+
+  AES_PUT32(Data     , t0);
+  AES_PUT32(Data +  4, t1);
+  AES_PUT32(Data +  8, t2);
+  AES_PUT32(Data + 12, t3);
 }
 
 /*
 *****************************************************************************************
-* Description : Function that preforms the shift row operation described in the AES standard
+* Description : Make the key schedule of a key, to be used by AES_Encrypt_Key()
+*
+* Arguments   : *Ks     Key schedule to fill
+*               *Key    Key is a 16 byte long arry
 *****************************************************************************************
 */
-static void AES_Shift_Rows()
+void AES_Set_Key(AES_Key *Ks, const unsigned char *Key)
 {
-  unsigned char Buffer;
+  AES_Expand_Key(Ks, Key);
 
-  //Row 0 doesn't change
-
-  //Shift Row 1 one left
-  //Store firt byte in buffer
-  Buffer = State[1][0];
-  //Shift all bytes
-  State[1][0] = State[1][1];
-  State[1][1] = State[1][2];
-  State[1][2] = State[1][3];
-  State[1][3] = Buffer;
-
-  //Shift row 2 two left
-  Buffer = State[2][0];
-  State[2][0] = State[2][2];
-  State[2][2] = Buffer;
-  Buffer = State[2][1];
-  State[2][1] = State[2][3];
-  State[2][3] = Buffer;
-
-  //Shift row 3 three left
-  Buffer = State[3][3];
-  State[3][3] = State[3][2];
-  State[3][2] = State[3][1];
-  State[3][1] = State[3][0];
-  State[3][0] = Buffer;
+#if AES_HW==1
+  mbedtls_aes_init(&Ks->Ctx);
+  Ks->Hw = (mbedtls_aes_setkey_enc(&Ks->Ctx, Key, 128) == 0);
+#endif
 }
 
 /*
 *****************************************************************************************
-* Description : Function that preforms the Mix Collums operation described in the AES standard
+* Description : Function for encrypting data using AES-128 with a key schedule
+*
+* Arguments   : *Data   Data to encrypt is a 16 byte long arry
+*               *Ks     Key schedule made by AES_Set_Key()
 *****************************************************************************************
 */
-static void AES_Mix_Collums()
+void AES_Encrypt_Key(unsigned char *Data, const AES_Key *Ks)
 {
-  unsigned char Row,Collum;
-  unsigned char a[4], b[4];
-  for(Collum = 0; Collum < 4; Collum++)
+#if AES_HW==1
+  if (Ks->Hw && (mbedtls_aes_crypt_ecb((mbedtls_aes_context *)&Ks->Ctx, MBEDTLS_AES_ENCRYPT, Data, Data) == 0))
   {
-    for(Row = 0; Row < 4; Row++)
-    {
-      a[Row] = State[Row][Collum];
-      b[Row] = (State[Row][Collum] << 1);
-
-      if((State[Row][Collum] & 0x80) == 0x80)
-      {
-        b[Row] = b[Row] ^ 0x1B;
-      }
-    }
-    State[0][Collum] = b[0] ^ a[1] ^ b[1] ^ a[2] ^ a[3];
-    State[1][Collum] = a[0] ^ b[1] ^ a[2] ^ b[2] ^ a[3];
-    State[2][Collum] = a[0] ^ a[1] ^ b[2] ^ a[3] ^ b[3];
-    State[3][Collum] = a[0] ^ b[0] ^ a[1] ^ a[2] ^ b[3];
+    return;
   }
+#endif
+  AES_Encrypt_Soft(Data, Ks->Round_Key);
 }
 
 /*
 *****************************************************************************************
-* Description : Function that calculaties the round key for the current round
+* Description : Function for encrypting data using AES-128
+*               The key is expanded for this block only, use AES_Set_Key() and
+*               AES_Encrypt_Key() when a key is used more than once.
 *
-* Arguments   :   Round         Number of current Round
-*                *Round_Key     16 byte long array holding the Round Key
+* Arguments   : *Data   Data to encrypt is a 16 byte long arry
+*               *Key    Key to encrypt data with is a 16 byte long arry
 *****************************************************************************************
 */
-static void AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key)
+void AES_Encrypt(unsigned char *Data, unsigned char *Key)
 {
-  unsigned char i,j;
-  unsigned char b;
-  unsigned char Temp[4];
-  unsigned char Buffer;
-  unsigned char Rcon;
-
-  //Calculate first Temp
-  //Copy laste byte from previous key
-  for(i = 0; i < 4; i++)
-  {
-    Temp[i] = Round_Key[i+12];
-  }
-
-  //Rotate Temp
-  Buffer = Temp[0];
-  Temp[0] = Temp[1];
-  Temp[1] = Temp[2];
-  Temp[2] = Temp[3];
-  Temp[3] = Buffer;
-
-  //Substitute Temp
-  for(i = 0; i < 4; i++)
-  {
-    Temp[i] = AES_Sub_Byte(Temp[i]);
-  }
-
-  //Calculate Rcon
-  Rcon = 0x01;
-  while(Round != 1)
-  {
-    b = Rcon & 0x80;
-    Rcon = Rcon << 1;
-    if(b == 0x80)
-    {
-      Rcon = Rcon ^ 0x1b;
-    }
-    Round--;
-  }
-
-  //XOR Rcon
-  Temp[0] = Temp[0] ^ Rcon;
+  AES_Key Ks;
 
-  //Calculate new key
-  for(i = 0; i < 4; i++)
-  {
-    for(j = 0; j < 4; j++)
-    {
-      Round_Key[j + (4*i)] = Round_Key[j + (4*i)] ^ Temp[j];
-      Temp[j] = Round_Key[j + (4*i)];
-    }
-  }
+  AES_Expand_Key(&Ks, Key);
+  AES_Encrypt_Soft(Data, Ks.Round_Key);
 }
-
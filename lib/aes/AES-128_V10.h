@@ -36,19 +36,41 @@
 #ifndef AES128_V10_H
 #define AES128_V10_H
 
+#include <stdint.h>
+
+// On ESP32 the hardware AES is used through mbedtls unless AES_SOFTWARE is defined
+#if defined(ARDUINO_ARCH_ESP32) && !defined(AES_SOFTWARE)
+#  define AES_HW 1
+#  include "mbedtls/aes.h"
+#else
+#  define AES_HW 0
+#endif
+
+/*
+********************************************************************************************
+* KEY SCHEDULE
+* Made once per key by AES_Set_Key(), after that every block is encrypted
+* with AES_Encrypt_Key() without expanding the key again.
+********************************************************************************************
+*/
+
+typedef struct {
+  uint32_t Round_Key[44];       // 11 round keys of the software rounds
+#if AES_HW==1
+  mbedtls_aes_context Ctx;      // Key loaded for the hardware AES
+  bool Hw;                      // Ctx is valid
+#endif
+} AES_Key;
+
 /*
 ********************************************************************************************
 * FUNCTION PORTOTYPES
 ********************************************************************************************
 */
 
+void AES_Set_Key(AES_Key *Ks, const unsigned char *Key);
+void AES_Encrypt_Key(unsigned char *Data, const AES_Key *Ks);
 void AES_Encrypt(unsigned char *Data, unsigned char *Key);
-void AES_Add_Round_Key(unsigned char *Round_Key);
-unsigned char AES_Sub_Byte(unsigned char Byte);
-void AES_Shift_Rows();
-void AES_Mix_Collums();
-void AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key);
-void Send_State();
 
 #else
 #error "AES128_V10_H not defined"
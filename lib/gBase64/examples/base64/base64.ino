@@ -47,9 +47,10 @@ void setup()
   int input2Len = sizeof(input2);
   
   int decodedLen = base64_dec_len(input2, input2Len);
-  char decoded[decodedLen];
+  char decoded[decodedLen + 1];
   
   base64_decode(decoded, input2, input2Len);
+  decoded[decodedLen] = '\0';
   
   Serial.print(input2); Serial.print(" = "); Serial.println(decoded);
 }
@@ -1,132 +1,169 @@
 #include "gBase64.h"
+#include <stdint.h>
+#include <string.h>
 //#include <avr/pgmspace.h>
 
+/* B64_PAIRS:
+ * 		Encode 12 bits at a time with a table of 4096 character pairs
+ * 		(8 KB, built by the first base64_encode()) instead of 6 bits at a
+ * 		time with b64_alphabet. Off for the ESP8266 where RAM is short.
+ */
+#if !defined B64_PAIRS
+#	if defined(ARDUINO_ARCH_ESP8266)
+#		define B64_PAIRS 0
+#	else
+#		define B64_PAIRS 1
+#	endif
+#endif
+
 const char b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 		"abcdefghijklmnopqrstuvwxyz"
 		"0123456789+/";
 
+/* The 6 bit value of every character, characters that are not in
+ * b64_alphabet decode as 0 */
+static const unsigned char b64_dec[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 62,  0,  0,  0, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61,  0,  0,  0,  0,  0,  0,
+	 0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,  0,  0,  0,  0,  0,
+	 0, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
+
+#if B64_PAIRS==1
+static uint16_t b64_pair[4096];
+static bool b64_pairInit = false;
+
+/* Fill b64_pair[] with the two characters of every 12 bit value, stored
+ * in memory order so that one 16 bit store writes both */
+static void b64_pairs() {
+	for (int i = 0; i < 4096; i++) {
+		char c[2] = { b64_alphabet[i >> 6], b64_alphabet[i & 0x3f] };
+		memcpy(&b64_pair[i], c, 2);
+	}
+	b64_pairInit = true;
+}
+#endif
+
 /* 'Private' declarations */
-inline void a3_to_a4(unsigned char * a4, unsigned char * a3);
-inline void a4_to_a3(unsigned char * a3, unsigned char * a4);
-inline unsigned char b64_lookup(char c);
+static inline void enc_word(char * out, uint32_t w);
+static inline uint32_t dec_word(const char * in);
 
 int base64_encode(char *output, char *input, int inputLen) {
-	int i = 0, j = 0;
+	const unsigned char *in = (const unsigned char *) input;
 	int encLen = 0;
-	unsigned char a3[3];
-	unsigned char a4[4];
 
-	while(inputLen--) {
-		a3[i++] = *(input++);
-		if(i == 3) {
-			a3_to_a4(a4, a3);
-
-			for(i = 0; i < 4; i++) {
-				output[encLen++] = b64_alphabet[a4[i]];
-			}
-
-			i = 0;
-		}
+#if B64_PAIRS==1
+	if (!b64_pairInit) {
+		b64_pairs();
 	}
+#endif
 
-	if(i) {
-		for(j = i; j < 3; j++) {
-			a3[j] = '\0';
-		}
-
-		a3_to_a4(a4, a3);
+	while (inputLen >= 3) {
+		enc_word(output + encLen, (uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2]);
+		in += 3;
+		inputLen -= 3;
+		encLen += 4;
+	}
 
-		for(j = 0; j < i + 1; j++) {
-			output[encLen++] = b64_alphabet[a4[j]];
+	if (inputLen > 0) {
+		uint32_t w = (uint32_t)in[0] << 16;
+		if (inputLen == 2) {
+			w |= (uint32_t)in[1] << 8;
 		}
-
-		while((i++ < 3)) {
-			output[encLen++] = '=';
+		enc_word(output + encLen, w);
+		output[encLen + 3] = '=';
+		if (inputLen == 1) {
+			output[encLen + 2] = '=';
 		}
+		encLen += 4;
 	}
 	output[encLen] = '\0';
 	return encLen;
 }
 
 int base64_decode(char * output, char * input, int inputLen) {
-	int i = 0, j = 0;
-	int decLen = 0;
-	unsigned char a3[3];
-	unsigned char a4[4];
-
-
-	while (inputLen--) {
-		if(*input == '=') {
-			break;
-		}
-
-		a4[i++] = *(input++);
-		if (i == 4) {
-			for (i = 0; i <4; i++) {
-				a4[i] = b64_lookup(a4[i]);
-			}
-
-			a4_to_a3(a3,a4);
-
-			for (i = 0; i < 3; i++) {
-				output[decLen++] = a3[i];
-			}
-			i = 0;
-		}
+	int decLen = base64_dec_len(input, inputLen);
+	int n = decLen / 3;
+	const char *in = input;
+	char *out = output;
+
+	while (n--) {
+		uint32_t w = dec_word(in);
+		out[0] = w >> 16;
+		out[1] = w >> 8;
+		out[2] = w;
+		in += 4;
+		out += 3;
 	}
 
-	if (i) {
-		for (j = i; j < 4; j++) {
-			a4[j] = '\0';
-		}
-
-		for (j = 0; j <4; j++) {
-			a4[j] = b64_lookup(a4[j]);
-		}
-
-		a4_to_a3(a3,a4);
-
-		for (j = 0; j < i - 1; j++) {
-			output[decLen++] = a3[j];
-		}
+	switch (decLen % 3) {
+		case 2:
+			out[1] = (b64_dec[(unsigned char) in[1]] << 4) | (b64_dec[(unsigned char) in[2]] >> 2);
+			// fall through
+		case 1:
+			out[0] = (b64_dec[(unsigned char) in[0]] << 2) | (b64_dec[(unsigned char) in[1]] >> 4);
 	}
-	output[decLen] = '\0';
 	return decLen;
 }
 
 int base64_enc_len(int plainLen) {
-	int n = plainLen;
-	return (n + 2 - ((n + 2) % 3)) / 3 * 4;
+	return (plainLen + 2) / 3 * 4;
 }
 
 int base64_dec_len(char * input, int inputLen) {
-	int i = 0;
-	int numEq = 0;
-	for(i = inputLen - 1; input[i] == '='; i--) {
-		numEq++;
+	if ((inputLen > 0) && (input[inputLen - 1] == '=')) {
+		inputLen--;
 	}
-
-	return ((6 * inputLen) / 8) - numEq;
+	if ((inputLen > 0) && (input[inputLen - 1] == '=')) {
+		inputLen--;
+	}
+	return inputLen * 3 / 4;
 }
 
-inline void a3_to_a4(unsigned char * a4, unsigned char * a3) {
-	a4[0] = (a3[0] & 0xfc) >> 2;
-	a4[1] = ((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4);
-	a4[2] = ((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6);
-	a4[3] = (a3[2] & 0x3f);
+int base64_dec_quad(unsigned char *output, const char *input, int inputLen) {
+	int n = base64_dec_len((char *) input, inputLen < 4 ? inputLen : 4);
+	if (n == 3) {
+		uint32_t w = dec_word(input);
+		output[0] = w >> 16;
+		output[1] = w >> 8;
+		output[2] = w;
+	}
+	else if (n > 0) {
+		char a4[4] = { input[0], input[1], n == 2 ? input[2] : 'A', 'A' };
+		uint32_t w = dec_word(a4);
+		output[0] = w >> 16;
+		output[1] = w >> 8;
+	}
+	return n;
 }
 
-inline void a4_to_a3(unsigned char * a3, unsigned char * a4) {
-	a3[0] = (a4[0] << 2) + ((a4[1] & 0x30) >> 4);
-	a3[1] = ((a4[1] & 0xf) << 4) + ((a4[2] & 0x3c) >> 2);
-	a3[2] = ((a4[2] & 0x3) << 6) + a4[3];
+static inline void enc_word(char * out, uint32_t w) {
+#if B64_PAIRS==1
+	memcpy(out, &b64_pair[w >> 12], 2);
+	memcpy(out + 2, &b64_pair[w & 0xfff], 2);
+#else
+	out[0] = b64_alphabet[w >> 18];
+	out[1] = b64_alphabet[(w >> 12) & 0x3f];
+	out[2] = b64_alphabet[(w >> 6) & 0x3f];
+	out[3] = b64_alphabet[w & 0x3f];
+#endif
 }
 
-inline unsigned char b64_lookup(char c) {
-	if(c >='A' && c <='Z') return c - 'A';
-	if(c >='a' && c <='z') return c - 71;
-	if(c >='0' && c <='9') return c + 4;
-	if(c == '+') return 62;
-	if(c == '/') return 63;
-	return -1;
+static inline uint32_t dec_word(const char * in) {
+	return (uint32_t)b64_dec[(unsigned char) in[0]] << 18 |
+		(uint32_t)b64_dec[(unsigned char) in[1]] << 12 |
+		(uint32_t)b64_dec[(unsigned char) in[2]] << 6 |
+		b64_dec[(unsigned char) in[3]];
 }
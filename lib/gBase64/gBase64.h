@@ -38,7 +38,8 @@ int base64_encode(char *output, char *input, int inputLen);
  * 				   stores the base64 string to be decoded
  * 			inputLen: the length of the input buffer, in bytes
  * 		Return value:
- * 			Returns the length of the decoded string
+ * 			Returns the length of the decoded string, base64_dec_len()
+ * 			bytes. The output is binary and not 0 terminated
  * 		Requirements:
  * 			1. output must not be null or empty
  * 			2. input must not be null
@@ -69,11 +70,30 @@ int base64_enc_len(int inputLen);
  * 			inputLen: the length of the base64 encoded string
  * 		Return value:
  * 			Returns the length of the decoded form of a
- * 			base64 encoded string
+ * 			base64 encoded string, with or without '=' padding.
+ * 			Only the last two characters are read
  * 		Requirements:
  * 			1. input must not be null
- * 			2. input must be greater than or equal to zero
+ * 			2. inputLen must be greater than or equal to zero
  */
 int base64_dec_len(char *input, int inputLen);
 
+/* base64_dec_quad:
+ * 		Description:
+ * 			Decode one group of 4 base64 characters, so that a caller
+ * 			can stream the decoded bytes without a buffer for all of them
+ * 		Parameters:
+ * 			output: the output buffer of 3 bytes for the decoded binary
+ * 			input: the base64 characters to decode
+ * 			inputLen: the number of characters left in input, only
+ * 					  the first 4 are used
+ * 		Return value:
+ * 			Returns the number of bytes decoded, 0 to 3. Less
+ * 			than 3 at the end of the string
+ * 		Requirements:
+ * 			1. output must hold 3 bytes
+ * 			2. input must not be null
+ */
+int base64_dec_quad(unsigned char *output, const char *input, int inputLen);
+
 #endif // _BASE64_H
@@ -54,12 +54,15 @@
 
 #include <SPI.h>											// For the RFM95 bus
 #include <TimeLib.h>										// http://playground.arduino.cc/code/time
-#include <ArduinoJson.h>
 #include <FS.h>												// ESP8266 Specific
 #include <WiFiUdp.h>
 #include <pins_arduino.h>
 #include <gBase64.h>										// https://github.com/adamvr/arduino-base64 (changed the name)
 
+#if (_GATEWAYNODE==1) || (_LOCALSERVER>=1)
+#	include "AES-128_V10.h"									// Before loraFiles.h, for AES_Key
+#endif
+
 // Local include files
 #include "loraModem.h"
 #include "loraFiles.h"
@@ -70,10 +73,6 @@ extern "C" {
 #	include "lwip/dns.h"
 }
 
-#if (_GATEWAYNODE==1) || (_LOCALSERVER>=1)
-#	include "AES-128_V10.h"
-#endif
-
 // ----------- Specific ESP32 stuff --------------
 #if defined(ESP32_ARCH)
 #	include <WiFi.h>
@@ -169,9 +168,6 @@ char platform[24]	= _PLATFORM; 							// platform definition
 char email[40]		= _EMAIL;    							// used for contact email
 char description[64]= _DESCRIPTION;							// used for free form description 
 
-// JSON definitions
-StaticJsonDocument<312> jsonBuffer;							// Use of arduinoJson version 6!
-	
 // define servers
 
 IPAddress ntpServer;										// IP address of NTP_TIMESERVER
@@ -188,6 +184,7 @@ uint32_t statTime = 0;										// last time we sent a stat message to server
 uint32_t pullTime = 0;										// last time we sent a pull_data request to server
 uint32_t rstTime  = 0;										// When to reset the timer
 uint32_t fileTime = 0;										// Write the configuration to file
+bool cfgDirty = false;										// gwayConfig changed, write it at fileTime
 
 #define TX_BUFF_SIZE  1024									// Upstream buffer to send to MQTT
 #define RX_BUFF_SIZE  1024									// Downstream received from MQTT
@@ -235,45 +232,115 @@ unsigned int remotePortNo;
 // Solution can also be to specify less STRICT compile options in Makefile
 // ----------------------------------------------------------------------------
 
+void ICACHE_RAM_ATTR pushEvent(uint8_t dio);
 void ICACHE_RAM_ATTR Interrupt_0();
 void ICACHE_RAM_ATTR Interrupt_1();
-
-int sendPacket(uint8_t *buf, uint8_t len);								// _txRx.ino forward
+void ICACHE_RAM_ATTR txGo();
+void ICACHE_RAM_ATTR writeRegisterIsr(uint8_t addr, uint8_t value);
+
+int txpkParse(char *js, uint16_t len, struct LoraDown *LoraDown, struct txpk *tx);	// _txRx.ino
+int sendPacket(uint8_t *buf, uint16_t len);								// _txRx.ino forward
+void txHeader(struct LoraDown *LoraDown);								// _txRx.ino
+int buildPacket(struct LoraUp *LoraUp, bool internal);					// _txRx.ino
+int writeRxpk(Print &out, struct LoraUp *LoraUp, uint8_t cnt, bool header);	// _txRx.ino
+int pushData(struct LoraUp *LoraUp, uint8_t cnt);						// _txRx.ino
+int receivePacket(struct LoraUp *LoraUp);								// _txRx.ino
+#if _DEDUP>=1
+bool dupCheck(struct LoraUp *LoraUp);									// _txRx.ino
+#endif
+int forwardQueue();														// _txRx.ino
+#if _RXBATCH>=1
+int batchAdd(struct LoraUp *LoraUp);									// _txRx.ino
+int batchFlush();														// _txRx.ino
+#endif
+#if _TRAFFIC>=1
+void trafficInit();														// _traffic.ino
+void trafficGen();														// _traffic.ino
+uint32_t fwdPercentile(uint8_t p);										// _traffic.ino
+#endif
+int txAdmit(struct LoraDown *LoraDown, uint8_t *buf);					// _txRx.ino
+int txDispatch();														// _txRx.ino
 
 void printIP(IPAddress ipa, const char sep, String & response);			// _wwwServer.ino
 void setupWWW();														// _wwwServer.ino forward
 
 void mPrint(String txt);												// _utils.ino
+void printInt(uint32_t i, String & response);							// _utils.ino
+void printDwn(struct LoraDown *LoraDown, String & response);			// _utils.ino
+void printHex(uint32_t hexa, const char sep, String & response);		// _utils.ino
+void ftoa(float f, char *val, int p);									// _utils.ino
+void die(String s);														// _utils.ino
+void gway_failed(const char *file, uint16_t line);						// _utils.ino
 int getNtpTime(time_t *t);												// _utils.ino
 int mStat(uint8_t intr, String & response);								// _utils.ino
 void SerialStat(uint8_t intr);											// _utils.ino
 void printHexDigit(uint8_t digit, String & response);					// _utils.ino
 int inDecodes(char * id);												// _utils.ino
+void initDevs();														// _utils.ino
+struct devReg * findDev(uint32_t id);									// _utils.ino
 static void stringTime(time_t t, String & response);					// _utils.ino
+uint32_t freeStack();													// _utils.ino
+struct stat_t * statNew();												// _utils.ino
+struct stat_t * statRec(uint8_t i);										// _utils.ino
+struct stat_t * statBegin();											// _utils.ino
+struct stat_t * statNext(struct stat_t *sr, uint8_t max);				// _utils.ino
+uint8_t * statData(struct stat_t *sr);									// _utils.ino
 
 int initMonitor(struct moniLine *monitor);								// _loraFiles.ino
 void initConfig(struct espGwayConfig *c);								// _loraFiles.ino
+int initSeen(struct nodeSeen *listSeen);								// _loraFiles.ino
 int printSeen(const char *fn, struct nodeSeen *listSeen);				// _loraFiles.ino
+struct nodeSeen * seenFind(uint32_t id, uint8_t upDown);				// _loraFiles.ino
+struct nodeSeen * seenLookup(uint32_t id, uint8_t upDown);				// _loraFiles.ino
 int readGwayCfg(const char *fn, struct espGwayConfig *c);				// _loraFiles.ino
+int readConfig(const char *fn, struct espGwayConfig *c);				// _loraFiles.ino
+int writeGwayCfg(const char *fn, struct espGwayConfig *c);				// _loraFiles.ino
+int writeConfig(const char *fn, struct espGwayConfig *c);				// _loraFiles.ino
+int readSeen(const char *fn, struct nodeSeen *listSeen);				// _loraFiles.ino
+int addLog(struct LoraUp *LoraUp);										// _loraFiles.ino
 
 void init_oLED();														// _oLED.ino
 void acti_oLED();														// _oLED.ino
 void addr_oLED();														// _oLED.ino
 void msg_oLED(String mesg);												// _oLED.ino
+void msg_lLED(String mesg, String mesg2);								// _oLED.ino
 
 void setupOta(char *hostname);											// _otaServer.ino
 
 void initLoraModem();													// _loraModem.ino
+void initDown(struct LoraDown *LoraDown);								// _loraModem.ino
+uint8_t readRegister(uint8_t addr);										// _loraModem.ino
 void rxLoraModem();														// _loraModem.ino
+bool regCached(uint8_t addr);											// _loraModem.ino
+void regInvalidate();													// _loraModem.ino
 void writeRegister(uint8_t addr, uint8_t value);						// _loraModem.ino
+void readBuffer(uint8_t addr, uint8_t *buf, uint8_t len);				// _loraModem.ino
+void writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len);			// _loraModem.ino
+uint16_t writeFifo64(const char *b64, uint16_t len);					// _loraModem.ino
+void applyProg(const struct regVal *prog, uint8_t len);					// _loraModem.ino
 void cadScanner();														// _loraModem.ino
 void startReceiver();													// _loraModem.ino
+int loraWait(struct LoraDown *LoraDown);								// _loraModem.ino
+void txArm(uint32_t due, struct LoraDown *LoraDown);					// _loraModem.ino
+void txCalib(uint32_t doneTime);										// _loraModem.ino
+uint32_t airTime(uint8_t sf, uint16_t bw, uint8_t size, uint8_t crc, uint8_t cr, uint8_t pre);	// _loraModem.ino
+uint32_t chanTime(uint32_t t);											// _loraModem.ino
+const struct loraTime * sfTime(uint8_t sf);								// _loraModem.ino
 
 void stateMachine();													// _stateMachine.ino
 
+int WlanConnect(int maxTry);											// _WiFi.ino
+IPAddress resolveHost(String svrName, int maxTry);						// _WiFi.ino
+
+#if (_GATEWAYNODE==1) || (_LOCALSERVER>=1)
+uint8_t encodePacket(uint8_t *Data, uint8_t DataLength, uint16_t FrameCount,
+	uint8_t *DevAddr, const AES_Key *AppSKey, uint8_t Direction);		// _sensor.ino
+#endif
+
 bool connectUdp();														// _udpSemtech.ino
 int readUdp(int packetSize);											// _udpSemtech.ino
 int sendUdp(IPAddress server, int port, uint8_t *msg, uint16_t length);	// _udpSemtech.ino
+int sendRxpk(IPAddress server, int port, struct LoraUp *LoraUp, uint8_t cnt);	// _udpSemtech.ino
 void sendStat();														// _udpSemtech.ino
 void pullData();														// _udpSemtech.ino
 
@@ -604,7 +671,11 @@ void setup() {
 	setupOta(hostname);										// Uses wwwServer 
 #endif //_OTA
 
+	initDevs();												// index the nodes of configNode.h
 	readSeen(_SEENFILE, listSeen);							// read the seenFile records
+#if _TRAFFIC>=1
+	trafficInit();											// Synthetic devices, see _traffic.ino
+#endif //_TRAFFIC
 
 #if _SERVER==1	
 	// Setup the webserver
@@ -740,6 +811,19 @@ void loop ()
 	// in userspace in loop().
 	//
 	stateMachine();											// do the state machine
+
+#	if _TRAFFIC>=1
+	trafficGen();											// Synthetic uplink frames for testing
+#	endif //_TRAFFIC
+
+	// The stateMachine() only queues received messages and restarts the
+	// receiver. Build and send the PUSH_DATA messages of the queue now.
+	//
+	forwardQueue();
+
+	// Start transmission of a queued downlink message when it is due.
+	//
+	txDispatch();
 	
 	// After a quiet period, make sure we reinit the modem and state machine.
 	// The interval is in seconds (about 15 seconds) as this re-init
@@ -747,8 +831,10 @@ void loop ()
 	// So it will kick in if there are not many messages for the gateway.
 	// Note: Be careful that it does not happen too often in normal operation.
 	//
-	if ( ((nowSeconds - statr[0].time) > _MSG_INTERVAL) &&
-		(msgTime <= statr[0].time) ) 
+	struct stat_t *sr = statBegin();						// Last message, if any
+	uint32_t msgLast = (sr != NULL) ? sr->time : 0;
+	if ( ((nowSeconds - msgLast) > _MSG_INTERVAL) &&
+		(msgTime <= msgLast) ) 
 	{
 #		if _MONITOR>=1
 		if ((debug>=2) && (pdebug & P_MAIN)) {
@@ -913,11 +999,17 @@ void loop ()
 		}
 #	endif //_NTP_INTR
 
-#	if _MAXSEEN>=1
-		if ((nowSeconds - fileTime) >= _FILE_INTERVAL) {
-			printSeen(_SEENFILE, listSeen);
-			fileTime = nowSeconds;
+	// The seen list, and the configuration when cfgDirty was set by code that
+	// must not wait for SPIFFS (txCalib() on TXDONE). Not while a downlink is armed.
+	if (((nowSeconds - fileTime) >= _FILE_INTERVAL) && (!txArmed)) {
+#		if _MAXSEEN>=1
+		printSeen(_SEENFILE, listSeen);
+#		endif //_MAXSEEN
+		if (cfgDirty) {
+			cfgDirty = false;
+			writeGwayCfg(_CONFIGFILE, &gwayConfig );
 		}
-#	endif //_MAXSEEN
+		fileTime = nowSeconds;
+	}
 
 }//loop
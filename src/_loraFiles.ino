@@ -77,7 +77,11 @@ void initConfig(struct espGwayConfig *c)
 	(*c).expert = _EXPERT;				// Expert interface is default OFF
 	(*c).monitor = true;				// Monitoring is ON
 	(*c).trusted = 1;
+	(*c).statView = _STATISTICS;		// Show all statistics that are kept
 	(*c).txDelay = 0;					// First Value without saving is 0;
+	(*c).txLat = 0;						// No TX start measurements yet
+	(*c).txDev = 0;
+	(*c).txCnt = 0;
 	(*c).dusbStat = true;
 	(*c).d_fcnt = 0;					// Set downstream DCNT to 0 at reboot
 	
@@ -91,25 +95,12 @@ void initConfig(struct espGwayConfig *c)
 	(*c).logFileNo = 0;					// Increase file ID
 
 	// Declarations that are dependent on the init settings
-	// The structure definitions below make it possible to dynamically size and resize the
-	// information in the GUI
-	free(statr); 
-	delay(5);
-
-	statr = (struct stat_t *) malloc((*c).maxStat * sizeof(struct stat_t));
-	for (int i=0; i<(*c).maxStat; i++) {
-		statr[i].time=0;						// Time since 1970 in seconds
-		statr[i].upDown=0;						// Init for Down traffic
-		statr[i].node=0;						// 4-byte DEVaddr (the only one known to gateway)
-		statr[i].ch=0;							// Channel index to freqs array
-		statr[i].sf=0;							// Init Spreading Factor
-	}
+	// The message history statr[] has a fixed size of STAT_MAX records,
+	// maxStat only determines how many of them are shown in the GUI
+	memset(statr, 0, sizeof(statr));
+	statHead = 0;
 
-	free(listSeen); delay(50);
-	listSeen = (struct nodeSeen *) malloc((*c).maxSeen * sizeof(struct nodeSeen));
-	for (int i=0; i<(*c).maxSeen; i +=1 ) {
-		listSeen[i].idSeen=0;
-	}
+	initSeen(listSeen);
 
 } // initConfig()
 
@@ -170,6 +161,8 @@ int readConfig(const char *fn, struct espGwayConfig *c)
 		return(-1);
 	}
 
+	initConfig(c);												// Even if we do not read a value, give a default
+
 	while (f.available()) {
 		
 #		if _MONITOR>=1
@@ -193,8 +186,6 @@ int readConfig(const char *fn, struct espGwayConfig *c)
 			tries = 0;
 			initSeen(listSeen);
 		}
-		initConfig(c);											// Even if we do not read a value, give a default
-		
 		String id =f.readStringUntil('=');						// Read keyword until '=', C++ thing
 		String val=f.readStringUntil('\n');						// Read value until End of Line (EOL)
 
@@ -294,10 +285,26 @@ int readConfig(const char *fn, struct espGwayConfig *c)
 			id_print(id, val);
 			(*c).showdata = (uint8_t) val.toInt();
 		}
+		else if (id == "STATVIEW") {							// Statistics shown on the web page
+			id_print(id, val);
+			(*c).statView = (uint8_t) val.toInt();
+		}
 		else if (id == "TRUSTED") {								// TRUSTED setting
 			id_print(id, val);
 			(*c).trusted= (int8_t) val.toInt();
 		}
+		else if (id == "TXCNT") {								// TXCNT, number of TX start measurements
+			id_print(id, val);
+			(*c).txCnt = (uint16_t) val.toInt();
+		}
+		else if (id == "TXDEV") {								// TXDEV, deviation of TX start latency
+			id_print(id, val);
+			(*c).txDev = (uint32_t) val.toInt();
+		}
+		else if (id == "TXLAT") {								// TXLAT, TX start latency
+			id_print(id, val);
+			(*c).txLat = (int32_t) val.toInt();
+		}
 		else if (id == "VIEWS") {								// VIEWS setting
 			id_print(id, val);
 			(*c).views = (uint16_t) val.toInt();
@@ -397,8 +404,12 @@ int writeConfig(const char *fn, struct espGwayConfig *c)
 	f.print("FILENO");	f.print('='); f.print((*c).logFileNo);	f.print('\n');
 	f.print("FORMAT");	f.print('='); f.print((*c).formatCntr); f.print('\n');
 	f.print("DELAY");	f.print('='); f.print((*c).txDelay); 	f.print('\n');
+	f.print("TXLAT");	f.print('='); f.print((*c).txLat); 	f.print('\n');
+	f.print("TXDEV");	f.print('='); f.print((*c).txDev); 	f.print('\n');
+	f.print("TXCNT");	f.print('='); f.print((*c).txCnt); 	f.print('\n');
 	f.print("SHOWDATA");f.print('='); f.print((*c).showdata); 	f.print('\n');
 	f.print("TRUSTED");	f.print('='); f.print((*c).trusted); 	f.print('\n');
+	f.print("STATVIEW");f.print('='); f.print((*c).statView); 	f.print('\n');
 	f.print("EXPERT");	f.print('='); f.print((*c).expert); 	f.print('\n');
 	f.print("SEEN");	f.print('='); f.print((*c).seen);		f.print('\n');
 	f.print("MONITOR");	f.print('='); f.print((*c).monitor); 	f.print('\n');
@@ -418,12 +429,11 @@ int writeConfig(const char *fn, struct espGwayConfig *c)
 // restarts
 //
 // Parameters:
-//		line; char array with characters to write to log
-//		cnt;
+//		LoraUp; the message, written as rxpk by writeRxpk()
 // Returns:
 //		<none>
 // ----------------------------------------------------------------------------
-int addLog(const unsigned char * line, int cnt) 
+int addLog(struct LoraUp *LoraUp) 
 {
 
 #if _STAT_LOG==1
@@ -480,23 +490,18 @@ int addLog(const unsigned char * line, int cnt)
 #	endif
 
 
-	int i=0;
 #	if _MONITOR>=1
 	if ((debug>=2) && (pdebug & P_RX)) {
-		char s[256];
-		i += 12;								// First 12 chars are non printable
-		sprintf(s, "addLog:: fileno=%d, rec=%d : %s",gwayConfig.logFileNo,gwayConfig.logFileRec,&line[i]);
-		mPrint(s);
+		mPrint("addLog:: fileno="+String(gwayConfig.logFileNo)+", rec="+String(gwayConfig.logFileRec)+", SF="+String(LoraUp->sf)+", size="+String(LoraUp->size));
 	}
 #	endif //_MONITOR
 
-	for (i=0; i< 12; i++) {						// The first 12 bytes contain non printable characters
-	//	f.print(line[i],HEX);
+	for (int i=0; i< 12; i++) {					// In place of the 12 non printable header bytes
 		f.print('*');
 	}
 	f.print(now());
 	f.print(':');
-	f.write(&(line[i]), cnt-12);				// write/append the line to the file
+	writeRxpk(f, LoraUp, 1, false);				// write/append the rxpk to the file
 	f.print('\n');
 	
 	f.close();									// Close the file after appending to it
@@ -513,7 +518,144 @@ int addLog(const unsigned char * line, int cnt)
 // ============================================================================
 // Below are the xxxSeen() functions. These functions keep track of the kast
 // time a device was seen bij the gateway.
-// These functions are not round-robin and they do not need to be.
+// Nodes are found through the hash index seenHash[] and kept in least recently
+// seen order, so that the oldest node is replaced when listSeen[] is full.
+
+// ----------------------------------------------------------------------------
+// seenIndex
+// Return the position in seenHash[] where the search for a node starts.
+// ----------------------------------------------------------------------------
+uint16_t seenIndex(uint32_t id, uint8_t upDown)
+{
+	uint32_t h = (id ^ ((uint32_t)upDown << 31)) * 2654435761UL;		// Knuth multiplicative hash
+	return( (uint16_t)(h >> (32 - SEEN_BITS)) );
+}
+
+
+// ----------------------------------------------------------------------------
+// seenUnlink
+// Remove node i from the most recently seen list.
+// ----------------------------------------------------------------------------
+void seenUnlink(uint16_t i)
+{
+	struct nodeSeen *n = &listSeen[i];
+	if (n->prev != SEEN_NONE) listSeen[n->prev].next = n->next; else seenHead = n->next;
+	if (n->next != SEEN_NONE) listSeen[n->next].prev = n->prev; else seenTail = n->prev;
+}
+
+
+// ----------------------------------------------------------------------------
+// seenFirst
+// Make node i the first, most recently seen, node of the list.
+// ----------------------------------------------------------------------------
+void seenFirst(uint16_t i)
+{
+	listSeen[i].prev = SEEN_NONE;
+	listSeen[i].next = seenHead;
+	if (seenHead != SEEN_NONE) listSeen[seenHead].prev = i; else seenTail = i;
+	seenHead = i;
+}
+
+
+// ----------------------------------------------------------------------------
+// seenUnhash
+// Remove node i from seenHash[]. The following entries of the probe
+// sequence are moved back into the hole, so no tombstones are needed.
+// ----------------------------------------------------------------------------
+void seenUnhash(uint16_t i)
+{
+	uint16_t h = seenIndex(listSeen[i].idSeen, listSeen[i].upDown);
+	while (seenHash[h] != i+1) h = (h+1) & (SEEN_HASH-1);
+
+	uint16_t j = h;
+	for (;;) {
+		j = (j+1) & (SEEN_HASH-1);
+		if (seenHash[j] == 0) break;
+		struct nodeSeen *n = &listSeen[seenHash[j]-1];
+		uint16_t k = seenIndex(n->idSeen, n->upDown);
+
+		// Move entry j to the hole when its start k is not in (h, j]
+		if ((j > h) ? ((k <= h) || (k > j)) : ((k <= h) && (k > j))) {
+			seenHash[h] = seenHash[j];
+			h = j;
+		}
+	}
+	seenHash[h] = 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// seenFind
+// Find the node with address id and direction upDown and make it the most
+// recently seen node. When not found, a new record is made in a free place
+// or in place of the least recently seen node.
+// Parameters:
+//	id:			Node address
+//	upDown:		0==up, 1==down
+// Return:
+//	Pointer to the record, cntSeen==0 for a new record
+// ----------------------------------------------------------------------------
+struct nodeSeen * seenFind(uint32_t id, uint8_t upDown)
+{
+	uint16_t h = seenIndex(id, upDown);
+	uint16_t i;
+
+	while (seenHash[h] != 0) {
+		i = seenHash[h] - 1;
+		if ((listSeen[i].idSeen == id) && (listSeen[i].upDown == upDown)) {
+			if (i != seenHead) {
+				seenUnlink(i);
+				seenFirst(i);
+			}
+			return(&listSeen[i]);
+		}
+		h = (h+1) & (SEEN_HASH-1);
+	}
+
+	if (iSeen < SEEN_MAX) {
+		i = iSeen++;										// Use a free record
+	}
+	else {
+		i = seenTail;										// Replace least recently seen
+#		if _MONITOR>=1
+		if ((debug>=2) && (pdebug & P_MAIN)) {
+			mPrint("seenFind:: replace node="+String(listSeen[i].idSeen,HEX)+" by node="+String(id,HEX));
+		}
+#		endif //_MONITOR
+		seenUnhash(i);
+		seenUnlink(i);
+		h = seenIndex(id, upDown);							// seenUnhash() may have moved entries
+		while (seenHash[h] != 0) h = (h+1) & (SEEN_HASH-1);
+	}
+
+	memset(&listSeen[i], 0, sizeof(struct nodeSeen));
+	listSeen[i].idSeen = id;
+	listSeen[i].upDown = upDown;
+	seenHash[h] = i+1;
+	seenFirst(i);
+	return(&listSeen[i]);
+} // seenFind()
+
+
+// ----------------------------------------------------------------------------
+// seenLookup
+// Find the node with address id and direction upDown without adding a record
+// or changing the seen order, for counters of nodes that are already known.
+// Return:
+//	Pointer to the record, NULL when the node is not in listSeen[]
+// ----------------------------------------------------------------------------
+struct nodeSeen * seenLookup(uint32_t id, uint8_t upDown)
+{
+	uint16_t h = seenIndex(id, upDown);
+
+	while (seenHash[h] != 0) {
+		struct nodeSeen *n = &listSeen[seenHash[h] - 1];
+		if ((n->idSeen == id) && (n->upDown == upDown)) return(n);
+		h = (h+1) & (SEEN_HASH-1);
+	}
+	return(NULL);
+} // seenLookup()
+
 
 // ----------------------------------------------------------------------------
 // initSeen
@@ -526,14 +668,10 @@ int addLog(const unsigned char * line, int cnt)
 int initSeen(struct nodeSeen *listSeen) 
 {
 #if _MAXSEEN>=1
-	for (int i=0; i< gwayConfig.maxSeen; i++) {
-		listSeen[i].idSeen=0;
-		listSeen[i].upDown=0;
-		listSeen[i].sfSeen=0;
-		listSeen[i].cntSeen=0;
-		listSeen[i].chnSeen=0;
-		listSeen[i].timSeen=(time_t) 0;					// 1 jan 1970 0:00:00 hrs
-	}
+	memset(listSeen, 0, SEEN_MAX * sizeof(struct nodeSeen));
+	memset(seenHash, 0, sizeof(seenHash));
+	seenHead = SEEN_NONE;
+	seenTail = SEEN_NONE;
 	iSeen= 0;											// Init index to 0
 #endif //_MAXSEEN
 	return(1);
@@ -545,6 +683,8 @@ int initSeen(struct nodeSeen *listSeen)
 // readSeen
 // This function read the information stored by printSeen from the file.
 // The file is read as String() values and converted to int after.
+// printSeen() writes the least recently seen node first, so after reading
+// the order of the list is the same as before.
 // Parameters:
 //	fn:			Filename
 //	listSeen:	Array of all last seen nodes on the LoRa network
@@ -555,13 +695,12 @@ int readSeen(const char *fn, struct nodeSeen *listSeen)
 {
 #if _MAXSEEN>=1
 	int i;
-	iSeen= 0;												// Init the index at 0
+	initSeen(listSeen);										// Init the index at 0
 	
 	if (!SPIFFS.exists(fn)) {								// Does listSeen file exist
 #		if _MONITOR>=1
 			mPrint("WARNING:: readSeen, history file not exists "+String(fn) );
 #		endif //_MONITOR
-		initSeen(listSeen);		// XXX make all initial declarations here if config vars need to have a value
 		return(-1);
 	}
 	
@@ -575,7 +714,7 @@ int readSeen(const char *fn, struct nodeSeen *listSeen)
 
 	delay(1000);
 	
-	for (i=0; i<gwayConfig.maxSeen; i++) {
+	for (i=0; i<SEEN_MAX; i++) {
 		delay(200);
 		String val="";
 		
@@ -585,21 +724,26 @@ int readSeen(const char *fn, struct nodeSeen *listSeen)
 #			endif //_MONITOR
 			break;
 		}
-		val=f.readStringUntil('\t'); listSeen[i].timSeen = (time_t) val.toInt();
-		val=f.readStringUntil('\t'); listSeen[i].upDown = (uint8_t) val.toInt();
-		val=f.readStringUntil('\t'); listSeen[i].idSeen = (int64_t) val.toInt();
-		val=f.readStringUntil('\t'); listSeen[i].cntSeen = (uint32_t) val.toInt();
-		val=f.readStringUntil('\t'); listSeen[i].chnSeen = (uint8_t) val.toInt();
-		val=f.readStringUntil('\n'); listSeen[i].sfSeen = (uint8_t) val.toInt();
+		val=f.readStringUntil('\t'); time_t timSeen = (time_t) val.toInt();
+		val=f.readStringUntil('\t'); uint8_t upDown = (uint8_t) val.toInt();
+		val=f.readStringUntil('\t'); uint32_t idSeen = (int64_t) val.toInt();
+		val=f.readStringUntil('\t'); uint32_t cntSeen = (uint32_t) val.toInt();
+		val=f.readStringUntil('\t'); uint8_t chnSeen = (uint8_t) val.toInt();
+		val=f.readStringUntil('\n'); uint8_t sfSeen = (uint8_t) val.toInt();
 
-		if ((int32_t)listSeen[i].idSeen != 0) {
-			iSeen++;									// Increase index, new record read
+		if ((int32_t)idSeen != 0) {
+			struct nodeSeen *n = seenFind(idSeen, upDown);	// New record read
+			n->timSeen = timSeen;
+			n->cntSeen = cntSeen;
+			n->chnSeen = chnSeen;
+			n->sfSeen = sfSeen;
+			if ((sfSeen>=6) && (sfSeen<=12)) n->sfMask = (nSF6 << (sfSeen-6));
 		}
 
 #		if _MONITOR>=1
 
 		if ((debug>=2) && (pdebug & P_MAIN)) {
-				mPrint(" readSeen:: idSeen ="+String(listSeen[i].idSeen,HEX)+", i="+String(i));
+				mPrint(" readSeen:: idSeen ="+String(idSeen,HEX)+", i="+String(i));
 		}
 #		endif								
 	}
@@ -617,6 +761,7 @@ int readSeen(const char *fn, struct nodeSeen *listSeen)
 // ----------------------------------------------------------------------------
 // printSeen
 // Once every few messages, update the SPIFFS file and write the array.
+// The least recently seen node is written first.
 // Parameters:
 // - fn contains the filename to write
 // - listSeen contains the _MAXSEEN array of list structures 
@@ -626,7 +771,6 @@ int readSeen(const char *fn, struct nodeSeen *listSeen)
 int printSeen(const char *fn, struct nodeSeen *listSeen)
 {
 #if _MAXSEEN>=1
-	int i;
 	if (!SPIFFS.exists(fn)) {
 #		if _MONITOR>=1
 			mPrint("WARNING:: printSeen, file not exists="+String(fn));
@@ -643,8 +787,8 @@ int printSeen(const char *fn, struct nodeSeen *listSeen)
 	}
 	delay(500);
 
-	for (i=0; i<iSeen; i++) {							// For all records indexed
-		if ((int32_t)listSeen[i].idSeen == 0) break;
+	for (uint16_t i=seenTail; i!=SEEN_NONE; i=listSeen[i].prev) {	// For all records indexed
+		if ((int32_t)listSeen[i].idSeen == 0) continue;
 		
 		f.print((time_t)listSeen[i].timSeen);	f.print('\t');
 		f.print((uint8_t)listSeen[i].upDown);	f.print('\t');
@@ -674,8 +818,8 @@ int printSeen(const char *fn, struct nodeSeen *listSeen)
 // addSeen
 //	With every message received:
 // - Look whether message is already in the array, if so update existing message. 
-// - If not, create new record.
-// - With this record, update the SF settings
+// - If not, create new record, if needed in place of the least recently seen.
+// - With this record, update the SF settings and the RSSI and SNR statistics
 //
 // Parameters:
 //	listSeen: The array of records of nodes we have seen
@@ -687,56 +831,34 @@ int addSeen(struct nodeSeen *listSeen, struct stat_t stat)
 {
 
 #if _MAXSEEN>=1
-	int i;
-	
-	for (i=0; i<iSeen; i++) {						// For all known records
-
-		// If the record node is equal, we found the record already.
-		// So increment cntSeen
-		if ((listSeen[i].idSeen==stat.node)	&&
-			(listSeen[i].upDown==stat.upDown))
-		{
-			//listSeen[i].upDown	= stat.upDown;		// Not necessary, is the same
-			//listSeen[i].idSeen	= stat.node;		// Not necessary, is the same
-			listSeen[i].timSeen		= (time_t)stat.time;
-			listSeen[i].chnSeen		= stat.ch;
-			listSeen[i].sfSeen		= stat.sf;			// The SF argument
-			listSeen[i].cntSeen++;					// Not included on function para
-//			printSeen(_SEENFILE, listSeen);
-			
-#			if _MONITOR>=2
-			if ((debug>=3) && (pdebug & P_MAIN)) {
-				mPrint("addSeen:: adding i="+String(i)+", node="+String(stat.node,HEX));
-			}
-#			endif
-
-			return 1;
-		}
-	}
-
-	// else: We did not find the current record so make a new listSeen entry
-	if ((i>=iSeen) && (i<gwayConfig.maxSeen)) {
-		listSeen[i].upDown	= stat.upDown;
-		listSeen[i].idSeen	= stat.node;
-		listSeen[i].chnSeen	= stat.ch;
-		listSeen[i].sfSeen	= stat.sf;				// The SF argument
-		listSeen[i].timSeen	= (time_t)stat.time;	// Timestamp correctly
-		listSeen[i].cntSeen	= 1;					// We see this for the first time	
-		iSeen++;
+	struct nodeSeen *n = seenFind(stat.node, stat.upDown);
+
+	n->timSeen		= (time_t)stat.time;
+	n->chnSeen		= stat.ch;
+	n->sfSeen		= stat.sf;						// The SF argument
+	if ((stat.sf>=6) && (stat.sf<=12)) n->sfMask |= (nSF6 << (stat.sf-6));
+	n->cntSeen++;
+
+	if (stat.upDown == 0) {							// RSSI and SNR only for uplink
+		if ((n->cntStat == 0) || (stat.prssi < n->rssiMin)) n->rssiMin = stat.prssi;
+		if ((n->cntStat == 0) || (stat.prssi > n->rssiMax)) n->rssiMax = stat.prssi;
+		n->rssiTtl += stat.prssi;
+		n->snrTtl += stat.snr;
+		n->cntStat++;
 	}
 
 #	if _MONITOR>=1
 	if ((debug>=2) && (pdebug & P_MAIN)) {
 		String response= "  addSeen:: i=";
-		response += i;
+		response += String(n - listSeen);
 		response += ", tim=";
 		stringTime(stat.time, response);
 		response += ", iSeen=";
 		response += String(iSeen);
 		response += ", node=";
 		response += String(stat.node,HEX);
-		response += ", listSeen[0]=";
-		printHex(listSeen[0].idSeen,':',response);
+		response += ", cnt=";
+		response += String(n->cntSeen);
 
 		mPrint(response);
 	}
@@ -94,6 +94,52 @@
 #endif //_MUTEX==1
 
 
+// ----------------------------------------------------------------------------------------
+// Is register addr kept in the shadow copy?
+// Only configuration registers that are written by the gateway and never changed
+// by the chip are cached. FIFO, OPMODE (the chip changes mode by itself after
+// TX or RX_SINGLE), the FIFO pointer and all status registers are always read
+// and written over SPI.
+// Parameters:
+//	addr: SPI address of the register
+// Returns:
+//	true when cached, false otherwise
+// ----------------------------------------------------------------------------------------
+bool regCached(uint8_t addr)
+{
+	if (addr >= REG_SHADOW) return(false);
+	switch (addr) {
+		case REG_FRF_MSB: case REG_FRF_MID: case REG_FRF_LSB:			// 0x06-0x08
+		case REG_PAC: case REG_PARAMP: case REG_OCP: case REG_LNA:		// 0x09-0x0C
+		case REG_FIFO_TX_BASE_AD: case REG_FIFO_RX_BASE_AD:				// 0x0E, 0x0F
+		case REG_IRQ_FLAGS_MASK:										// 0x11
+		case REG_MODEM_CONFIG1: case REG_MODEM_CONFIG2:					// 0x1D, 0x1E
+		case REG_SYMB_TIMEOUT_LSB:										// 0x1F
+		case REG_PREAMBLE_MSB: case REG_PREAMBLE_LSB:					// 0x20, 0x21
+		case REG_PAYLOAD_LENGTH: case REG_MAX_PAYLOAD_LENGTH:			// 0x22, 0x23
+		case REG_HOP_PERIOD:											// 0x24
+		case REG_MODEM_CONFIG3: case REG_PPM_CORRECTION:				// 0x26, 0x27
+		case REG_DETECT_OPTIMIZE: case REG_INVERTIQ:					// 0x31, 0x33
+		case REG_DET_TRESH: case REG_SYNC_WORD: case REG_INVERTIQ2:		// 0x37, 0x39, 0x3B
+		case REG_DIO_MAPPING_1: case REG_DIO_MAPPING_2:					// 0x40, 0x41
+		case REG_PADAC_SX1276: case REG_PADAC_SX1272:					// 0x4D, 0x5A
+			return(true);
+		default:
+			return(false);
+	}
+}
+
+
+// ----------------------------------------------------------------------------------------
+// Invalidate the whole shadow copy, so every register is read from the chip
+// and written to the chip the next time. Call after a reset of the chip.
+// ----------------------------------------------------------------------------------------
+void regInvalidate()
+{
+	memset(regValid, 0, sizeof(regValid));
+}
+
+
 // ----------------------------------------------------------------------------------------
 // Read one byte value, par addr is address
 // Returns the value of register(addr)
@@ -101,6 +147,9 @@
 // The SS (Chip select) pin is used to make sure the RFM95 is selected
 // The variable is for obvious reasons valid for read and write traffic at the
 // same time. Since both read and write mean that we write to the SPI interface.
+// Configuration registers with a valid shadow value are not read over SPI.
+// Interrupts are masked during the transfer, so the timer interrupt of txGo()
+// cannot select the radio in the middle of it.
 // Parameters:
 //	Address: SPI address to read from. Type uint8_t
 // Return:
@@ -108,12 +157,24 @@
 // ----------------------------------------------------------------------------------------
 uint8_t readRegister(uint8_t addr)
 {
-			
+	bool cached = regCached(addr);
+	if (cached && (regValid[addr>>3] & (1<<(addr&0x07)))) {
+		spiStat.skips++;
+		return(regShadow[addr]);
+	}
+
+	noInterrupts();
     digitalWrite(pins.ss, LOW);					// Select Receiver
 	SPI.transfer(addr & 0x7F);					// First address bit means read, write address
 	uint8_t res = (uint8_t) SPI.transfer(0x00); // Read address
     digitalWrite(pins.ss, HIGH);				// Unselect Receiver
+	interrupts();
+	spiStat.reads++;
 
+	if (cached) {
+		regShadow[addr] = res;
+		regValid[addr>>3] |= (1<<(addr&0x07));
+	}
     return((uint8_t) res);
 }
 
@@ -121,6 +182,9 @@ uint8_t readRegister(uint8_t addr)
 // ----------------------------------------------------------------------------------------
 // Write value to a register with address addr. 
 // Function writes one byte at a time.
+// The shadow copy is write-through: writing the value a cached register
+// already holds is skipped. OPMODE is always written, but its last value
+// is remembered so opmode() does not need to read it back.
 // Parameters:
 //	addr: SPI address to write to
 //	value: The value to write to address
@@ -129,6 +193,19 @@ uint8_t readRegister(uint8_t addr)
 // ----------------------------------------------------------------------------------------
 void writeRegister(uint8_t addr, uint8_t value)
 {
+	if (regCached(addr)) {
+		if ((regValid[addr>>3] & (1<<(addr&0x07))) && (regShadow[addr] == value)) {
+			spiStat.skips++;
+			return;
+		}
+		regShadow[addr] = value;
+		regValid[addr>>3] |= (1<<(addr&0x07));
+	}
+	else if (addr == REG_OPMODE) {
+		regShadow[addr] = value;
+		regValid[addr>>3] |= (1<<(addr&0x07));
+	}
+
 	noInterrupts();									// MMM 210116
 	digitalWrite(pins.ss, LOW);						// Select Receiver
 
@@ -137,13 +214,165 @@ void writeRegister(uint8_t addr, uint8_t value)
 
     digitalWrite(pins.ss, HIGH);					// Unselect Receiver
 	interrupts();									// MMM 210116
+	spiStat.writes++;
 }
 
 
 // ----------------------------------------------------------------------------------------
-// Write a buffer to a register with address addr. 
-// Function writes one byte at a time.
+// Write value to a register from an interrupt handler (txGo).
+// SPI.transfer() is in flash on the ESP8266 and takes the bus mutex on the ESP32,
+// so this function is in IRAM and writes the SPI hardware directly: on the ESP8266
+// both bytes go out in one 16 bit transfer of SPI1, on the ESP32 through the
+// no-lock SPI functions of the core. All other register functions mask interrupts,
+// so this never runs in the middle of their transfer.
+// The shadow copy is not updated, the caller does that.
+// Parameters:
+//	addr: SPI address to write to
+//	value: The value to write to address
+// Returns:
+//	<void>
+// ----------------------------------------------------------------------------------------
+void ICACHE_RAM_ATTR writeRegisterIsr(uint8_t addr, uint8_t value)
+{
+	digitalWrite(pins.ss, LOW);						// Select Receiver
+
+#	if defined(ESP32_ARCH)
+	spiTransferByteNL(SPI.bus(), (uint8_t)(addr | 0x80));
+	spiTransferByteNL(SPI.bus(), value);
+#	else
+	while (SPI1CMD & SPIBUSY) {}
+	SPI1U1 = (SPI1U1 & ~((SPIMMOSI << SPILMOSI) | (SPIMMISO << SPILMISO)))
+		| ((16-1) << SPILMOSI) | ((16-1) << SPILMISO);
+	SPI1W0 = (uint32_t)(addr | 0x80) | ((uint32_t) value << 8);	// Low byte goes first
+	SPI1CMD |= SPIBUSY;
+	while (SPI1CMD & SPIBUSY) {}
+#	endif //ESP32_ARCH
+
+	digitalWrite(pins.ss, HIGH);					// Unselect Receiver
+	spiStat.writes++;
+}
+
+
+// ----------------------------------------------------------------------------------------
+// Write len consecutive registers starting at addr in one SPI transaction.
+// The radio increments the register address itself after every byte.
+// When the shadow already holds all values nothing is written.
+// Parameters:
+//	addr: First register to write to
+//	buf: The values, buf[0] is written to addr
+//	len: Number of registers
+// Returns:
+//	<void>
+// ----------------------------------------------------------------------------------------
+void writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+	bool same = true;
+	for (int i=0; i<len; i++) {
+		uint8_t a = addr+i;
+		if (!regCached(a) || ((regValid[a>>3] & (1<<(a&0x07))) == 0) || (regShadow[a] != buf[i])) {
+			same = false;
+			break;
+		}
+	}
+	if (same) {
+		spiStat.skips++;
+		return;
+	}
+	if (len == 1) {
+		writeRegister(addr, buf[0]);
+		return;
+	}
+
+	noInterrupts();
+	digitalWrite(pins.ss, LOW);						// Select Receiver
+	SPI.transfer((uint8_t)(addr | 0x80));			// 0x80 is write operation
+	for (int i=0; i<len; i++) {
+		SPI.transfer(buf[i]);
+	}
+    digitalWrite(pins.ss, HIGH);					// Unselect Receiver
+	interrupts();
+	spiStat.writes++;
+
+	for (int i=0; i<len; i++) {
+		uint8_t a = addr+i;
+		if (regCached(a)) {
+			regShadow[a] = buf[i];
+			regValid[a>>3] |= (1<<(a&0x07));
+		}
+	}
+}
+
+
+// ----------------------------------------------------------------------------------------
+// Apply a register program (see loraModem.h) to the radio.
+// Every run of consecutive register addresses is written with one writeBurst().
+// With _REG_PROG==0 the registers are written one by one with writeRegister().
+// Parameters:
+//	prog: Array of (register, value) pairs, sorted on register
+//	len: Number of pairs in prog, use PROG_LEN()
+// Returns:
+//	<void>
+// ----------------------------------------------------------------------------------------
+void applyProg(const struct regVal *prog, uint8_t len)
+{
+	uint8_t buf[8];
+	uint8_t i = 0;
+	while (i < len) {
+		uint8_t n = 0;
+		do {
+			buf[n] = prog[i+n].val;
+			n++;
+		} while ((i+n < len) && (n < sizeof(buf)) && (prog[i+n].reg == prog[i].reg + n));
+#		if _REG_PROG==1
+		writeBurst(prog[i].reg, buf, n);
+#		else
+		for (int j=0; j<n; j++) {
+			writeRegister(prog[i].reg+j, buf[j]);
+		}
+#		endif //_REG_PROG
+		i += n;
+	}
+}
+
+
+// ----------------------------------------------------------------------------------------
+// Read a buffer from a register with address addr, normally REG_FIFO.
+// Counterpart of writeBuffer(). All bytes are read with one chip select
+// instead of one readRegister() (so two SPI transfers) for every byte.
+// Interrupts are masked during the transfer, like in readRegister().
+// Parameters:
+//	addr: SPI address to read from
+//	buf: The buffer to fill
+//	len: Number of bytes to read
+// Returns:
+//	<void>
+// ----------------------------------------------------------------------------------------
+void readBuffer(uint8_t addr, uint8_t *buf, uint8_t len)
+{
+	noInterrupts();
+	digitalWrite(pins.ss, LOW);					// Select Receiver
+	SPI.transfer(addr & 0x7F);					// First address bit means read
+
+#	if _BUF_READ==1
+		memset(buf, 0x00, len);					// The radio ignores what we send
+		SPI.transfer((uint8_t *) buf, len);		// Received bytes overwrite buf
+#	else
+		for (int i=0; i< len; i++) {
+			buf[i] = (uint8_t) SPI.transfer(0x00);
+		}
+#	endif //_BUF_READ
+
+	digitalWrite(pins.ss, HIGH);				// Unselect Receiver
+	interrupts();
+	spiStat.reads++;
+} // readBuffer()
+
+
+// ----------------------------------------------------------------------------------------
+// Write a buffer to a register with address addr, normally REG_FIFO.
+// All bytes are written with one chip select.
 // Parameters:
+//	addr: SPI address to write to
 //	buf: The values to write to address
 //	len: Length of the buffer in bytes
 // Returns:
@@ -155,15 +384,10 @@ void writeBuffer(uint8_t addr, uint8_t *buf, uint8_t len)
 	noInterrupts();								// MMM 201120
 	digitalWrite(pins.ss, LOW);					// put SPI slave on
 
-	if (len >= 24) {
-		len=24;
-		mPrint("WARNING writeBuffer:: len > 24");
-	}
-
 	SPI.transfer((int8_t)(addr | 0x80) );		// Only when sending, addr | 0x80
 
 #	if _BUF_WRITE==1
-		SPI.transfer((uint8_t *) buf, len);
+		SPI.transfer((uint8_t *) buf, len);		// Received bytes overwrite buf
 #	else
 		for (int i=0; i< len; i++) {
 			SPI.transfer(buf[i]);
@@ -172,22 +396,64 @@ void writeBuffer(uint8_t addr, uint8_t *buf, uint8_t len)
 
     digitalWrite(pins.ss, HIGH);				// Unselect SPI slave
 	interrupts();	
+	spiStat.writes++;
 	
 #	if _MONITOR>=1
 	if ((debug>=1) && (pdebug & P_TX)) {
-		mPrint("v writeBuffer:: payLength=0x"+String(len,HEX)+", len FIFO=0x"+String((int8_t)(readRegister(REG_FIFO_ADDR_PTR)-readRegister(REG_FIFO_TX_BASE_AD)),HEX) );
-	}
-	if ((debug>=1) && (pdebug & P_MAIN)) {
-		String response = "v writeBuffer:: after  : buf=";
-		for (int j=0; j<len; j++) {
-			response += String(buf[j],HEX)+" ";
-		}
-		mPrint(response);
+		mPrint("v writeBuffer:: payLength=0x"+String(len,HEX)+", len FIFO=0x"+String((uint8_t)(readRegister(REG_FIFO_ADDR_PTR)-readRegister(REG_FIFO_TX_BASE_AD)),HEX) );
 	}
 #	endif
 } // writeBuffer()
 
 
+// ----------------------------------------------------------------------------------------
+// Decode a base64 string and write the bytes to REG_FIFO, 3 bytes for every
+// 4 characters, all with one chip select. So a downlink payload of up to 255
+// bytes needs no buffer of its own between the PULL_RESP and the radio.
+// Parameters:
+//	b64: The base64 characters, not 0 terminated
+//	len: Number of characters in b64
+// Returns:
+//	Number of bytes written to the FIFO
+// ----------------------------------------------------------------------------------------
+uint16_t writeFifo64(const char *b64, uint16_t len)
+{
+	uint8_t a3[3];
+	uint16_t cnt = 0;
+
+	noInterrupts();
+	digitalWrite(pins.ss, LOW);					// put SPI slave on
+
+	SPI.transfer((uint8_t)(REG_FIFO | 0x80));	// Only when sending, addr | 0x80
+
+	for (uint16_t i=0; i<len; i+=4) {
+		int n = base64_dec_quad(a3, b64+i, len-i);
+		if (n == 0) break;
+#		if _BUF_WRITE==1
+			SPI.transfer(a3, n);
+#		else
+			for (int j=0; j<n; j++) {
+				SPI.transfer(a3[j]);
+			}
+#		endif //_BUF_WRITE
+		cnt += n;
+		if (n < 3) break;						// Padding, end of the payload
+	}
+
+    digitalWrite(pins.ss, HIGH);				// Unselect SPI slave
+	interrupts();
+	spiStat.writes++;
+
+#	if _MONITOR>=1
+	if ((debug>=1) && (pdebug & P_TX)) {
+		mPrint("v writeFifo64:: payLength=0x"+String(cnt,HEX)+", len FIFO=0x"+String((uint8_t)(readRegister(REG_FIFO_ADDR_PTR)-readRegister(REG_FIFO_TX_BASE_AD)),HEX) );
+	}
+#	endif //_MONITOR
+
+	return(cnt);
+} // writeFifo64()
+
+
 // ----------------------------------------------------------------------------------------
 //  setRate is setting rate and spreading factor and CRC etc. for transmission
 //  for example
@@ -205,8 +471,6 @@ void writeBuffer(uint8_t addr, uint8_t *buf, uint8_t len)
 
 void setRate(uint8_t sf, uint8_t crc) 
 {
-	uint8_t mc1=0, mc2=0, mc3=0;
-
 	if (sf<SF7) {
 		sf=7;
 	}
@@ -214,29 +478,15 @@ void setRate(uint8_t sf, uint8_t crc)
 		sf=12;
 	}
 
-	// Set rate based on Spreading Factor etc
+	// The register values are taken from the rate programs in loraModem.h
 	// For sx1276 chips is the CRC is either ON for receive or OFF for transmit
-    if (sx1276) {
-		mc1= 0x72;							// SX1276_MC1_BW_125==0x70 | SX1276_MC1_CR_4_5==0x02 (4/5)
-		mc2= (sf<<4) | crc;					// crc is 0x00 or 0x04==SX1276_MC2_RX_PAYLOAD_CRCON
-		mc3= 0x00;							// 0x00; no AGC. SX1276_MC3_AGCAUTO
-        if (sf == SF11 || sf == SF12) { 
-			mc3|= 0x01; 					// 0x01 (AN1200.24) or 0x08 (specs)
-		}
-    }
-	else {
-		mc1= 0x0A;							// SX1272_MC1_BW_250 0x80 | SX1272_MC1_CR_4_5 0x02 (MMM define BW)
-		mc2= ((sf<<4) | crc) % 0xFF;
-		// SX1276_MC1_BW_250 0x80 | SX1276_MC1_CR_4_5 0x02 | SX1276_MC1_IMPLICIT_HEADER_MODE_ON 0x01
-        if (sf == SF11 || sf == SF12) { 
-			mc1= 0x0B; 
-		}
-#		if _MONITOR>=1
-		if ((debug>=1) &&(pdebug & P_MAIN)) {
-			mPrint("WARNING, sx1272 selected");
-		}
-#		endif
-    }
+	const struct ratePrg *r = &ratePrgs[sx1276 ? 1 : 0][sf-SF7][crc ? 1 : 0];
+
+#	if _MONITOR>=1
+	if ((!sx1276) && (debug>=1) && (pdebug & P_MAIN)) {
+		mPrint("WARNING, sx1272 selected");
+	}
+#	endif
 
 	// Implicit Header (IH), for CLASS B beacons (&& SF6)
 	//if (getIh(LMIC.rps)) {
@@ -244,25 +494,39 @@ void setRate(uint8_t sf, uint8_t crc)
     //    writeRegister(REG_PAYLOAD_LENGTH, getIh(LMIC.rps)); // required length
     //}
 	
-	writeRegister(REG_MODEM_CONFIG1, (uint8_t) mc1);
-	writeRegister(REG_MODEM_CONFIG2, (uint8_t) mc2);
-	writeRegister(REG_MODEM_CONFIG3, (uint8_t) mc3);
-	
-	// Symbol timeout settings
-    if (sf == SF10 || sf == SF11 || sf == SF12) {
-        writeRegister(REG_SYMB_TIMEOUT_LSB, (uint8_t) 0x05);
-    } 
-	else {
-        writeRegister(REG_SYMB_TIMEOUT_LSB, (uint8_t) 0x08);
-    }
+#	if _REG_PROG==1
+	writeBurst(REG_MODEM_CONFIG1, r->mc, 3);		// MC1, MC2 and Symbol timeout
+#	else
+	for (int i=0; i<3; i++) {
+		writeRegister(REG_MODEM_CONFIG1+i, r->mc[i]);
+	}
+#	endif //_REG_PROG
+	writeRegister(REG_MODEM_CONFIG3, r->mc3);
+	writeRegister(REG_PREAMBLE_LSB, LORA_PREAMBLE);	// txLoraModem() may have set another
+	return;
+}
+
+
+// ----------------------------------------------------------------------------------------
+// Set the frequency registers for our gateway
+// Write the three FRF bytes, normally taken from the upFrf or dwnFrf field
+// of freqs[], with one burst SPI transaction (the radio increments the
+// register address itself). When the shadow already holds the same bytes
+// nothing is written at all.
+// Parameters: 
+//	frf; Pointer to the MSB, MID and LSB bytes of REG_FRF
+// ----------------------------------------------------------------------------------------
+void setFrf(const uint8_t *frf)
+{
+	writeBurst(REG_FRF_MSB, frf, 3);				// 0x06 MSB, 0x07 MID, 0x08 LSB
 	return;
 }
 
 
 // ----------------------------------------------------------------------------------------
 // Set the frequency for our gateway
-// The function has no parameter other than the freq setting used in init.
-// Since we are using a 1ch gateway this value is set fixed.
+// Runtime version of setFrf() for frequencies that are not in freqs[], such
+// as the frequencies the server chooses when _STRICT_1CH==2.
 // Parameters: 
 //	freq; frequuency in Hz 
 // ----------------------------------------------------------------------------------------
@@ -272,11 +536,14 @@ void  setFreq(uint32_t freq)
     // set frequency
 	
 	//uint32_t temp_bytes = (((uint64_t)(freq << 8)) / 15265) & 0xFFFFFFFF;
-    uint32_t temp_bytes = (((uint64_t)freq << 19) / 32000000) & 0x00FFFFFF;	
-
-    writeRegister(REG_FRF_MSB, ((uint8_t)(temp_bytes>>16)) & 0xFF );
-    writeRegister(REG_FRF_MID, ((uint8_t)(temp_bytes>> 8)) & 0xFF );
-    writeRegister(REG_FRF_LSB, ((uint8_t)(temp_bytes>> 0)) & 0xFF );
+    uint32_t temp_bytes = FRF(freq);
+	uint8_t frf[3] = {
+		(uint8_t)(temp_bytes>>16),
+		(uint8_t)(temp_bytes>> 8),
+		(uint8_t)(temp_bytes>> 0)
+	};
+
+	setFrf(frf);
 	return;
 }
 
@@ -334,8 +601,12 @@ void opmode(uint8_t mode)
 		writeRegister(REG_OPMODE, 0xFF & (uint8_t) mode );
 	}
 	else {
-		// If in OPMODE_LORA, leave it is (0x80)
-		writeRegister(REG_OPMODE, 0xFF & (uint8_t)((readRegister(REG_OPMODE) & 0x80) | mode));
+		// If in OPMODE_LORA, leave it is (0x80). Take the bit from the shadow
+		// if we wrote OPMODE before, so we do not need to read it back.
+		uint8_t lora = (regValid[REG_OPMODE>>3] & (1<<(REG_OPMODE&0x07)))
+			? regShadow[REG_OPMODE]
+			: readRegister(REG_OPMODE);
+		writeRegister(REG_OPMODE, 0xFF & (uint8_t)((lora & 0x80) | mode));
 	}
 }
 
@@ -346,46 +617,37 @@ void opmode(uint8_t mode)
 // ----------------------------------------------------------------------------------------
 void hop() 
 {
+	uint32_t spiOps = spiStat.reads + spiStat.writes;
+	uint32_t spiSkips = spiStat.skips;
 
 	// 1. Set radio to standby
 	opmode(OPMODE_STANDBY);
 		
 	// 3. Set frequency based on value in freq		
 	gwayConfig.ch = (gwayConfig.ch + 1) % NUM_HOPS ;			// Increment the freq round robin
-	setFreq(freqs[gwayConfig.ch].upFreq);
+	setFrf(freqs[gwayConfig.ch].upFrf);
 	
 	// 4. Set spreading Factor
 	sf = SF7;													// Starting the new frequency 
 	setRate(sf, 0x04);											// set the sf to SF7, and CRC to 0x04
 		
-	// Low Noise Amplifier used in receiver
-	writeRegister(REG_LNA, (uint8_t) LNA_MAX_GAIN);  			// 0x0C, 0x23
-	
-	// 7. set sync word
-	writeRegister(REG_SYNC_WORD, (uint8_t) 0x34);				// set 0x39 to 0x34 LORA_MAC_PREAMBLE
-	
-	// prevent node to node communication
-	writeRegister(REG_INVERTIQ,0x27);							// set reg 0x33 to 0x27; to reset from TX
-	
-	// Max Payload length is dependent on 256 byte buffer. At startup TX starts at
-	// 0x80 and RX at 0x00. RX therefore maximized at 128 Bytes
-	writeRegister(REG_MAX_PAYLOAD_LENGTH,MAX_PAYLOAD_LENGTH);	// set 0x23 to 0x80==128 bytes
-	writeRegister(REG_PAYLOAD_LENGTH,PAYLOAD_LENGTH);			// 0x22, 0x40==64Byte long
+	// 5, 8. LNA, sync word, INVERTIQ (reset from TX), payload lengths, hop period
+	// and enable all interrupts. See progHop in loraModem.h
+	applyProg(progHop, PROG_LEN(progHop));
+
+	// 7. PA ramp-up time 50 uSec, keep the upper nibble
+	writeRegister(REG_PARAMP, (readRegister(REG_PARAMP) & 0xF0) | 0x08);
 	
 	writeRegister(REG_FIFO_ADDR_PTR,(uint8_t)readRegister(REG_FIFO_RX_BASE_AD));	// set reg 0x0D to reg 0x0F(==0x00)
-	writeRegister(REG_HOP_PERIOD,0x00);							// reg 0x24, set to 0x00
-
-	// 5. Config PA Ramp up time								// set reg 0x0A  
-	writeRegister(REG_PARAMP, (readRegister(REG_PARAMP) & 0xF0) | 0x08); // set PA ramp-up time 50 uSec
 	
 	// Set 0x4D REG_PADAC for SX1276 ; XXX register is 0x5a for sx1272
 	//writeRegister(REG_PADAC_SX1276,  0x84); 					// set 0x4D (PADAC) to 0x84
-	
-	// 8. Reset interrupt Mask, enable all interrupts
-	writeRegister(REG_IRQ_FLAGS_MASK, 0x00);
 		
 	// 9. clear all radio IRQ flags
     writeRegister(REG_IRQ_FLAGS, 0xFF);
+
+	spiStat.hop = spiStat.reads + spiStat.writes - spiOps;
+	spiStat.hopSkip = spiStat.skips - spiSkips;
 	
 	// Be aware that micros() has increased significantly from calling 
 	// the hop function until printed below
@@ -393,6 +655,7 @@ void hop()
 #	if _MONITOR>=1
 	if ((debug>=2) && (pdebug & P_RADIO)){
 			String response = "hop:: hopTime:: " + String(micros() - hopTime);
+			response += ", spi=" + String(spiStat.hop) + ", saved=" + String(spiStat.hopSkip);
 			mStat(0, response);
 			mPrint(response);
 	}
@@ -483,11 +746,7 @@ uint8_t receivePkt(uint8_t *payload)
 	// This means "Set FifoAddrPtr to FifoRxBaseAddr"
 	else {
         statc.msg_ok++;													// Receive OK statistics counter
-		switch(statr[0].ch) {
-			case 0: statc.msg_ok_0++; break;
-			case 1: statc.msg_ok_1++; break;
-			case 2: statc.msg_ok_2++; break;
-		}
+		statc.msg_ok_ch[gwayConfig.ch]++;
 
 		if (readRegister(REG_FIFO_RX_CURRENT_ADDR) != readRegister(REG_FIFO_RX_BASE_AD)) {
 #			if _MONITOR>=1
@@ -516,10 +775,20 @@ uint8_t receivePkt(uint8_t *payload)
 			receivedCount=PAYLOAD_LENGTH;
 		}
 
-        for(int i=0; i < receivedCount; i++)
-        {
-            payload[i] = readRegister(REG_FIFO);						// 0x00, FIFO will auto shift register
-        }
+		uint32_t fifoTime = micros();
+		readBuffer(REG_FIFO, payload, receivedCount);					// 0x00, FIFO will auto shift register
+		fifoTime = micros() - fifoTime;
+
+		rxPipe.fifo = fifoTime;											// Time to read the FIFO
+		rxPipe.fifoTtl += fifoTime;
+		rxPipe.fifoBytes += receivedCount;
+
+#		ifdef _PROFILER
+		if ((debug>=2) && (pdebug & P_RX)) {
+			mPrint("^ receivePkt:: FIFO read len=" + String(receivedCount) + ", uSec=" + String(fifoTime) + 
+				", uSec/byte=" + String((float) rxPipe.fifoTtl / rxPipe.fifoBytes, 2));
+		}
+#		endif //_PROFILER
 		
 #		if _MONITOR>=1
 		if ((debug>=1) && (pdebug & P_RX)) {
@@ -588,7 +857,7 @@ uint8_t receivePkt(uint8_t *payload)
 					receivedCount-9-4,
 					(uint16_t)LoraUp.fcnt,
 					DevAddr,
-					decodes[index].appKey,
+					&devKeys[index],
 					0
 				);
 
@@ -649,9 +918,11 @@ void initDown(struct LoraDown *LoraDown)
 
 // ------------------------------ DOWN ----------------------------------------------------
 //
-// The DOWN function fills the payLoad buffer with the data for payLength
+// The DOWN function writes the payload of LoraDown to the FIFO of the radio.
 // This DOWN function sends a payload to the LoRa node over the air
 // Radio must go back in standby mode as soon as the transmission is finished
+// A PULL_RESP payload (LoraDown->b64 set) is decoded straight into the FIFO by
+// writeFifo64(), other payloads (repeater) are written from LoraDown->payLoad.
 // 
 // NOTE:: writeRegister functions should not be used outside interrupts
 // The data fields are the following (Para 4.0 LoraWAN 1.1 Specification):
@@ -661,18 +932,9 @@ void initDown(struct LoraDown *LoraDown)
 //	Byte 6-7:	FCnt (FrameCounter) LSB First
 //	Byte 8:		0x00 (no options)
 // ----------------------------------------------------------------------------------------
-bool sendPkt(uint8_t *payLoad, uint8_t payLength)
+bool sendPkt(struct LoraDown *LoraDown)
 {
-#	if _MONITOR>=1
-	if (payLength>=128) {												// Buffer is too large
-		if ((debug>=1) && (pdebug & P_TX)) {
-			mPrint("v sendPkt:: ERROR len="+String(payLength));
-		}
-		return false;
-	}
-#	endif //_MONITOR
-
-	payLoad[payLength] = 0x00;											// terminate buffer
+	uint8_t payLength = LoraDown->size;
 	
 	writeRegister(REG_FIFO_ADDR_PTR, (uint8_t) readRegister(REG_FIFO_TX_BASE_AD));	// 0x0D, 0x0E
 	writeRegister(REG_PAYLOAD_LENGTH, (uint8_t) payLength);				// 0x22	
@@ -684,25 +946,30 @@ bool sendPkt(uint8_t *payLoad, uint8_t payLength)
 	// REG_FIFO_TX_BASE_AD = 0x0E
 	// REG_FIFO_ADDR_PTR = 0x0D
 	// REG_PAYLOAD_LENGT = 0x22
+	// All radio SPI traffic goes through readRegister(), writeRegister(), readBuffer(),
+	// writeBuffer(), writeFifo64(), writeBurst() and writeRegisterIsr(), so no bare
+	// SPI.transfer() here.
 	
-#	if _BUF_WRITE>=1
-
-		writeBuffer(REG_FIFO, (uint8_t *) payLoad, (uint8_t) payLength);
-		
-#	else
-		SPI.transfer((int8_t)(REG_FIFO | 0x80) );		// Only when sending, addr | 0x80
-		for (int i=0; i<(uint8_t) payLength; i++) {
-			writeRegister(REG_FIFO, (uint8_t) payLoad[i]);
+	if (LoraDown->b64 != NULL) {
+		if (writeFifo64(LoraDown->b64, LoraDown->b64Len) != payLength) {
+#			if _MONITOR>=1
+			if ((debug>=1) && (pdebug & P_TX)) {
+				mPrint("v sendPkt:: ERROR base64 length, size="+String(payLength));
+			}
+#			endif //_MONITOR
+			return false;
 		}
-
-#	endif //_BUF_WRITE
+	}
+	else {
+		writeBuffer(REG_FIFO, LoraDown->payLoad, payLength);
+	}
 
 #	if _MONITOR>=1
-		if ((debug>=2) && (pdebug & P_TX)) {
+		if ((debug>=2) && (pdebug & P_TX) && (LoraDown->b64 == NULL)) {
 			Serial.print("v sendPkt:: <");
 			for (int i=0; i<(uint8_t) payLength; i++) {
 				Serial.print(" ");
-				Serial.print((uint8_t) payLoad[i],HEX);
+				Serial.print((uint8_t) LoraDown->payLoad[i],HEX);
 			}
 			Serial.println(">");
 		}
@@ -717,15 +984,10 @@ bool sendPkt(uint8_t *payLoad, uint8_t payLength)
 // This function implements the wait time needed for downstream transmissions.
 // Note: Timing of downstream and JoinAccept messages is VERY critical.
 //
-// As the ESP8266 watchdog will not like us to wait more than a few hundred
-// milliseconds (or it will kick in) we have to implement a simple way to wait
-// time in case we have to wait seconds before sending messages (e.g. for OTAA 5 or 6 seconds)
-// Without it, the system is known to crash in half of the cases it has to wait for 
-// JOIN-ACCEPT messages to send.
-//
-// This function uses a combination of delay() statements and delayMicroseconds().
-// As we use delay() only when there is still enough time to wait and we use micros()
-// to make sure that delay() did not take too much time this works.
+// loraWait() does not wait for the transmit time itself. It is called by txDispatch()
+// in every loop() and only when less than TX_LEAD microseconds remain the message
+// is due, so that txDispatch() can stage it. So web, UDP and receiving continue while
+// a downlink message (e.g. a JOIN_ACCEPT 5 or 6 seconds later) is waiting in txQueue.
 // 
 // Parameter: uint32-t tmst in json message gives the micros() value when transmission should start. (!)
 // so it contains the local Gateway time as a reference when to start Downlink.
@@ -733,10 +995,12 @@ bool sendPkt(uint8_t *payLoad, uint8_t payLength)
 //		gwayConfig.txDelay is the delay as specified in the GUI
 //
 //	Parameters:
+//		LoraDown:	The message to transmit
 //
 //	Returns:
-//		1 if successful (There is sometings to wait for)
-//		0 if not successful (So if RX1 is in effect, we go to RX2)
+//		1 if the message is due, stage it now
+//		0 if the message is not due yet, try again next loop()
+//		-1 if the transmit time has passed (so if RX1 is in effect, we go to RX2)
 // ----------------------------------------------------------------------------------------
 
 int loraWait(struct LoraDown *LoraDown)
@@ -748,47 +1012,235 @@ int loraWait(struct LoraDown *LoraDown)
 		return(1);
 	}
 	LoraDown->usec    = micros();
-	int32_t delayTmst = (int32_t)(LoraDown->tmst - LoraDown->usec) + gwayConfig.txDelay - WAIT_CORRECTION;	// in Microseconds
+	int32_t delayTmst = (int32_t)(LoraDown->tmst - LoraDown->usec) + gwayConfig.txDelay;	// in Microseconds
 	// delayTmst based on txDelay and spreading factor
 	
-	if ((delayTmst > 8000000) || (delayTmst < -1000)) {		// Delay is  > 8 secs or less than 0
+	if (delayTmst < -1000) {							// Too late
 #		if _MONITOR>=1
-		if (delayTmst > 8000000) {
-			String response= "v loraWait:: ERROR: ";
-			printDwn(LoraDown, response);
-			mPrint(response);
-		}
-		else {
-			String response= "v loraWait:: return 0: ";
+		if ((debug>=1) && (pdebug & P_TX)) {
+			String response= "v loraWait:: return -1: ";
 			printDwn(LoraDown, response);
 			mPrint(response);
 		}
 #		endif //_MONITOR
 		gwayConfig.waitErr++;
 		
-		return(0);
+		return(-1);
 	}
 
-	// For larger delay times we use delay() since that is for > 15ms
-	// This is the most efficient way.
-	while (delayTmst > 15000) {
-		delay(15);										// ms delay including yield, slightly shorter
-		delayTmst -= 15000;
+	// More than TX_LEAD to go, so return and let loop() do its work
+	if (delayTmst > TX_LEAD) {
+		return(0);
 	}
-	
-	// The remaining wait time is less than 15000 uSecs
-	// but more than 1000 mSecs (see above)
-	// therefore we use delayMicroseconds() to wait
-	delayMicroseconds(delayTmst);
 
 	gwayConfig.waitOk++;
 	return (1);
 }
 
 
+// ------------------------------------------ DOWN ----------------------------------------
+// txArm()
+// Start the downlink staged by txLoraModem() at micros() time due. The fields of
+// the message txCalib() needs are kept in txDwn next to txDue. With _TX_TIMER==1
+// a single shot hardware timer calls txGo(), and loop() continues. Otherwise, or
+// when due is (almost) there, we wait with delayMicroseconds() and call txGo().
+//
+//	Parameters:
+//		due:		micros() time to start, tmst + txDelay or now for imme
+//		LoraDown:	The message staged by txLoraModem()
+// ----------------------------------------------------------------------------------------
+void txArm(uint32_t due, struct LoraDown *LoraDown)
+{
+	txDwn.tmst = LoraDown->tmst;
+	txDwn.bw = LoraDown->bw;
+	txDwn.sf = LoraDown->sf;
+	txDwn.size = LoraDown->size;
+	txDwn.crc = LoraDown->crc;
+	txDwn.cr = LoraDown->cr;
+	txDwn.prea = LoraDown->prea;
+	txDwn.imme = LoraDown->imme;
+	txDue = due;
+	txArmed = true;
+	int32_t w = (int32_t)(due - micros());
+
+#	if _TX_TIMER==1
+	if (w > 20) {
+#		if defined(ESP32_ARCH)
+		static hw_timer_t *txTimer = NULL;
+		if (txTimer == NULL) {
+			txTimer = timerBegin(1, 80, true);						// 1 MHz, 1 tick per uSec
+			timerAttachInterrupt(txTimer, &txGo, true);
+		}
+		timerWrite(txTimer, 0);
+		timerAlarmWrite(txTimer, w, false);						// Single shot
+		timerAlarmEnable(txTimer);
+#		else
+		timer1_attachInterrupt(txGo);
+		timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);			// 80 MHz/16, 5 ticks per uSec
+		timer1_write((uint32_t) w * 5);
+#		endif //ESP32_ARCH
+		return;
+	}
+#	endif //_TX_TIMER
+
+	if (w > 0) delayMicroseconds(w);
+	txGo();
+}
+
+
+// ------------------------------------------ DOWN ----------------------------------------
+// txGo()
+// Start the transmission staged in FSTX by txLoraModem() with one write of
+// REG_OPMODE by writeRegisterIsr(). Called by the timer interrupt of txArm() or
+// by txArm() itself.
+// The start time against txDue is kept in txJit for the web page.
+// ----------------------------------------------------------------------------------------
+void ICACHE_RAM_ATTR txGo()
+{
+	if (!txArmed) return;
+	txArmed = false;
+
+	writeRegisterIsr(REG_OPMODE, (uint8_t)(OPMODE_LORA | OPMODE_TX));	// set reg 0x01 to 0x83
+	txJit.start = micros();
+
+	regShadow[REG_OPMODE] = OPMODE_LORA | OPMODE_TX;
+	regValid[REG_OPMODE>>3] |= (1<<(REG_OPMODE&0x07));
+
+	int32_t d = (int32_t)(txJit.start - txDue);
+	if ((txJit.cnt == 0) || (d < txJit.min)) txJit.min = d;
+	if ((txJit.cnt == 0) || (d > txJit.max)) txJit.max = d;
+	txJit.last = d;
+	txJit.sum += d;
+	txJit.cnt++;
+}
+
+
+// ------------------------------------------ DOWN ----------------------------------------
+// txCalib()
+// Called by the stateMachine() on TXDONE. The transmission started the airtime of the
+// downlink before doneTime, so start minus txDue (tmst + txDelay, as armed by txArm())
+// is the latency of the gateway and the radio. gwayConfig.txLat keeps the mean latency
+// and txDev its mean deviation, both with weight 1/8. The start error against tmst is
+// counted in txErrHist[] for the web page.
+// The airtime, tmst and imme are taken from txDwn as saved by txArm(), LoraDown may
+// hold a PULL_RESP that came in during the transmission.
+// With _TX_CAL==1 txDelay becomes -txLat, so that the next downlink starts at tmst.
+// When txDelay moved more than TX_CAL_SAVE uSec, cfgDirty is set and loop() writes
+// the configuration, not this TXDONE handling.
+//
+//	Parameters:
+//		doneTime:	micros() of the TXDONE interrupt
+// ----------------------------------------------------------------------------------------
+#define TX_CAL_SAVE	200
+
+void txCalib(uint32_t doneTime)
+{
+	static uint8_t outRow = 0;							// Measurements not used in a row
+	uint32_t start = doneTime - airTime(txDwn.sf, txDwn.bw, txDwn.size, txDwn.crc, txDwn.cr, txDwn.prea);
+	int32_t lat = (int32_t)(start - txDue);
+
+	if (txDwn.imme != 1) {
+		txErrLast = (int32_t)(start - txDwn.tmst);
+		uint8_t i = 0;
+		while ((i < TX_HIST-1) && (txErrLast >= txErrLimit[i])) i++;
+		txErrHist[i]++;
+	}
+
+	// A late TXDONE must not move the estimate. When the latency really changed,
+	// all measurements are off, so after 4 in a row we start again.
+	if ((lat > TX_CAL_MAX) || (lat < -TX_CAL_MAX) || ((gwayConfig.txCnt >= 8) &&
+			((uint32_t) abs(lat - gwayConfig.txLat) > 4*gwayConfig.txDev + 1000))) {
+		txCalOut++;
+		if (++outRow >= 4) gwayConfig.txCnt = 0;
+		return;
+	}
+	outRow = 0;
+
+	if (gwayConfig.txCnt == 0) {
+		gwayConfig.txLat = lat;
+		gwayConfig.txDev = 0;
+	}
+	else {
+		int32_t d = lat - gwayConfig.txLat;
+		gwayConfig.txLat += d / 8;
+		gwayConfig.txDev = (gwayConfig.txDev * 7 + abs(d)) / 8;
+	}
+	if (gwayConfig.txCnt < 0xFFFF) gwayConfig.txCnt++;
+
+#	if _MONITOR>=1
+	if ((debug>=1) && (pdebug & P_TX)) {
+		mPrint("v txCalib:: lat=" + String(lat) + ", err=" + String(txErrLast) + ", txLat=" + String(gwayConfig.txLat) + ", txDev=" + String(gwayConfig.txDev));
+	}
+#	endif //_MONITOR
+
+#	if _TX_CAL==1
+	static int32_t saved = gwayConfig.txDelay;			// txDelay in the config file
+	gwayConfig.txDelay = -gwayConfig.txLat;
+	if (abs(gwayConfig.txDelay - saved) > TX_CAL_SAVE) {
+		saved = gwayConfig.txDelay;
+		cfgDirty = true;
+	}
+#	endif //_TX_CAL
+}
+
+
+// ------------------------------------------ DOWN ----------------------------------------
+// airTime()
+// Compute the time on air of a LoRa message in microseconds with loraAirTime()
+// of loraModem.h. We assume explicit header.
+//
+//	Parameters:
+//		sf:		Spreading factor 7-12
+//		bw:		Bandwidth in kHz (125, 250 or 500)
+//		size:	Payload length in bytes
+//		crc:	Not 0 if CRC is on, 0 otherwise
+//		cr:		Coding rate 1 (4/5) to 4 (4/8), 0 is 4/5
+//		pre:	Preamble symbols, 0 is LORA_PREAMBLE
+//	Returns:
+//		Time on air in microseconds
+// ----------------------------------------------------------------------------------------
+uint32_t airTime(uint8_t sf, uint16_t bw, uint8_t size, uint8_t crc, uint8_t cr, uint8_t pre)
+{
+	if (bw == 0) bw = 125;
+	if (cr == 0) cr = 1;
+	if (pre == 0) pre = LORA_PREAMBLE;
+	return( loraAirTime(sf, bw, size, cr, pre, 0, (crc ? 1 : 0)) );
+}
+
+
+// ----------------------------------------------------------------------------------------
+// chanTime()
+// Scale a BW125 time of loraTimes[] to the bandwidth of the current
+// receive channel freqs[gwayConfig.ch].
+//	Parameters:
+//		t:		Time in microseconds for BW125
+//	Returns:
+//		Time in microseconds for the channel bandwidth
+// ----------------------------------------------------------------------------------------
+uint32_t chanTime(uint32_t t)
+{
+	uint16_t bw = freqs[gwayConfig.ch].upBW;
+	if (bw == 0) return(t);
+	return( (t * 125) / bw );
+}
+
+
+// ----------------------------------------------------------------------------------------
+// sfTime()
+// Return the loraTimes[] entry of spreading factor sf.
+// ----------------------------------------------------------------------------------------
+const struct loraTime * sfTime(uint8_t sf)
+{
+	if (sf < SF7) sf = SF7;
+	else if (sf > SF12) sf = SF12;
+	return( &loraTimes[sf - SF7] );
+}
+
+
 // -------------------------------------- DOWN --------------------------------------------
 // txLoraModem
-// Init the transmitter and transmit the buffer
+// Init the transmitter and stage the buffer: the radio is programmed, the FIFO
+// loaded and the PLL locked in FSTX. txArm() starts the transmission at tmst.
 // After successful transmission (dio0==1) TxDone re-init the receiver
 //
 //	crc is set to 0x00 for TX
@@ -807,9 +1259,9 @@ int loraWait(struct LoraDown *LoraDown)
 // 11. write REG LoRa Fifo Base Address
 // 12. write REG LoRa Fifo Addr Ptr
 // 13. write REG LoRa Payload Length
-// 14. Write buffer (byte by byte)
-// 15. Wait until the right time to transmit has arrived
-// 16. opmode TX, start actual transmission
+// 14. Write buffer (one SPI transfer)
+// 15. opmode FSTX, lock the PLL on the TX frequency
+// 16. opmode TX at the right time, by txGo()
 //
 // Transmission to the device is not done often, but is time critical. 
 // The following registers are set (AN1200.24 para 2.1):
@@ -821,16 +1273,27 @@ int loraWait(struct LoraDown *LoraDown)
 //	REG_MODEM_CONFIG3	= 0x00 (or 0x01 depending on spreading factor >= 11)
 //	REG_SYNC_WORD		= 0x34
 // 
+// Return:
+//	true when the FIFO is loaded and the radio is in FSTX, ready for txArm()
+//	false when sendPkt() failed, the radio is left in standby and the caller
+//	has to restart the receiver
 // ----------------------------------------------------------------------------------------
 
-void txLoraModem(struct LoraDown *LoraDown)
+bool txLoraModem(struct LoraDown *LoraDown)
 {
+	uint32_t startTime = micros();
 	_state = S_TX;
 		
-	// 1. Select LoRa modem from sleep mode
-	opmode(OPMODE_SLEEP);												// set 0x01
-	delayMicroseconds(100);
-	opmode(OPMODE_LORA | 0x03);;										// set 0x01 to 0x80
+	// 1. Select LoRa modem, this is only possible from sleep mode. Normally the
+	// radio is in LoRa mode already and we go to standby right away.
+	uint8_t mode = (regValid[REG_OPMODE>>3] & (1<<(REG_OPMODE&0x07)))
+		? regShadow[REG_OPMODE]
+		: readRegister(REG_OPMODE);
+	if ((mode & OPMODE_LORA) == 0) {
+		opmode(OPMODE_SLEEP);											// set 0x01
+		delayMicroseconds(100);
+		opmode(OPMODE_LORA);											// set 0x01 to 0x80
+	}
 	
 	// Assert the value of the current mode
 	ASSERT((readRegister(REG_OPMODE) & OPMODE_LORA) != 0);
@@ -845,43 +1308,40 @@ void txLoraModem(struct LoraDown *LoraDown)
 	//writeRegister(REG_HOP_PERIOD, (uint8_t) 0x00);					// set 0x24 to 0x00 only for receivers
 	
 	// 4. Init Frequency, config channel
-	setFreq(LoraDown->freq);
+	if (LoraDown->freq == freqs[gwayConfig.ch].dwnFreq) {
+		setFrf(freqs[gwayConfig.ch].dwnFrf);
+	}
+	else {
+		setFreq(LoraDown->freq);										// Server chosen, _STRICT_1CH==2
+	}
 
-	//writeRegister(REG_PREAMBLE_LSB, (uint8_t) LoraDown->prea & 0xFF);	// Leave to default
+	// Coding rate of codr in MC1, bits 3-1 (sx1276) or 5-3 (sx1272), and the preamble
+	// of prea. For 4/5 and 8 symbols, the values of setRate() and the receiver, the
+	// writes are skipped by the shadow registers.
+	uint8_t cr = (LoraDown->cr ? LoraDown->cr : 1);
+	uint8_t mc1 = readRegister(REG_MODEM_CONFIG1);
+	if (sx1276)	writeRegister(REG_MODEM_CONFIG1, (mc1 & 0xF1) | (cr << 1));
+	else		writeRegister(REG_MODEM_CONFIG1, (mc1 & 0xC7) | (cr << 3));
+	writeRegister(REG_PREAMBLE_LSB, (LoraDown->prea ? LoraDown->prea : LORA_PREAMBLE));
 	
-	writeRegister(REG_SYNC_WORD, (uint8_t) 0x34);						// set 0x39 to 0x34==LORA_MAC_PREAMBLE
-	writeRegister(REG_PARAMP,(readRegister(REG_PARAMP) & 0xF0) | 0x08); // set 0x08  ramp-up time 50 uSec
 	//writeRegister(REG_PADAC_SX1276,  0x84); 							// set 0x4D (PADAC) to 0x84
 	//writeRegister(REG_DET_TRESH, 0x0A);								// 210117 Detection Treshhold
-	writeRegister(REG_LNA, (uint8_t) LNA_MAX_GAIN);  					// set reg 0x0C to 0x23
 	
 	// 6. Set power level, REG_PAC
 	setPow(LoraDown->powe);
 	
-	// 7. prevent node to node communication
+	// 5, 8, 9. Sync word, LNA, inverted IQ for downstream, DIO0=TxDone,
+	// mask all IRQs but TxDone and MAX_PAYLOAD_LENGTH. See progTx
 	//writeRegister(REG_INVERTIQ, readRegister(REG_INVERTIQ) | (uint8_t)(LoraDown->iiq));	
-																		// set 0x33, (0x27 up or |0x40 down)
-	writeRegister(REG_INVERTIQ, readRegister(REG_INVERTIQ) | 0x40); 	// set 0x33 to (0x27 (reserved) | 0x40) for downstream
-	writeRegister(REG_INVERTIQ2, 0x19);
-	
-	// 8. set the IRQ mapping DIO0=TxDone, DIO1=NOP, DIO2=NOP (for 1ch gateway)
-    writeRegister(REG_DIO_MAPPING_1, (uint8_t)(
-		MAP_DIO0_LORA_TXDONE | 
-		MAP_DIO1_LORA_NOP | 
-		MAP_DIO2_LORA_NOP |
-		MAP_DIO3_LORA_NOP));											// was MAP_DIO3_LORA_CRC
-
-	// 9. mask all IRQs but TxDone
-    writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) ~IRQ_LORA_TXDONE_MASK);
+	applyProg(progTx, PROG_LEN(progTx));
+
+	// 7. PA ramp-up time 50 uSec, keep the upper nibble
+	writeRegister(REG_PARAMP, (readRegister(REG_PARAMP) & 0xF0) | 0x08);
 	
 	// 10. clear all radio IRQ flags
     writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);
 	//writeRegister(REG_IRQ_FLAGS, (uint8_t) IRQ_LORA_TXDONE_MASK);		// set reg 0x12 to 0x08, clear TXDONE
 
-	// FSTX setting
-	//opmode(OPMODE_FSTX);												// set reg 0x01 to 0x02 (actual value becomes 0x82)
-	//delay(1);															// MMM
-
 	//Set the base addres of the transmit buffer in FIFO
 	writeRegister(REG_FIFO_ADDR_PTR, (uint8_t) readRegister(REG_FIFO_TX_BASE_AD));	
 																		// set 0x0D to 0x0F (contains 0x80);	
@@ -889,9 +1349,6 @@ void txLoraModem(struct LoraDown *LoraDown)
 	//For TX we have to set the PAYLOAD_LENGTH
 	writeRegister(REG_PAYLOAD_LENGTH, (uint8_t) LoraDown->size);		// set reg 0x22 to  0x40==64Byte long
 
-	//For TX we have to set the MAX_PAYLOAD_LENGTH
-	writeRegister(REG_MAX_PAYLOAD_LENGTH, (uint8_t) MAX_PAYLOAD_LENGTH);// set reg 0x22, max 0x40==64Byte long
-
 #	if _MONITOR >= 1
 			if ((debug>=2) && (pdebug & P_TX)) {
 				String response ="v txLoraModem:: Before sendPkt: Addr=";
@@ -907,7 +1364,15 @@ void txLoraModem(struct LoraDown *LoraDown)
 #	endif //_MONITOR
 
 	// 11, 12, 13, 14. write the buffer to the FiFo
-	sendPkt(LoraDown->payLoad, LoraDown->size);
+	if (!sendPkt(LoraDown)) {
+		return(false);													// Do not transmit a bad FIFO
+	}
+
+	// 15. Frequency synthesis for TX, so that txGo() only has to write OPMODE_TX
+	opmode(OPMODE_FSTX);												// set reg 0x01 to 0x02 (actual value becomes 0x82)
+
+	modeTime.tx = micros() - startTime;
+	if (modeTime.tx > modeTime.txMax) modeTime.txMax = modeTime.tx;
 
 #	if _MONITOR >= 1
 			if ((debug>=2) && (pdebug & P_TX)) {
@@ -924,18 +1389,11 @@ void txLoraModem(struct LoraDown *LoraDown)
 			}
 #	endif //_MONITOR
 
-	for (int i=0; i< _REG_AMOUNT; i++) {
-		registers[i].regvalue= readRegister(registers[i].regid);
-	}
-
-	// 16. Initiate actual transmission of FiFo, after opmode TX it switches to standby mode
-	delayMicroseconds(WAIT_CORRECTION);								// q0 milliseconds
-	opmode(OPMODE_TX);												// set reg 0x01 to 0x03 (actual value becomes 0x83)
-	
-	// After message transmitted the sender switches to STANDBY state, and issues TXDONE
-
-	yield();														// MMM 210720
+	// 16. txArm() starts the transmission of the FiFo with txGo(), after opmode TX
+	// the radio switches to STANDBY state, and issues TXDONE
+	// The registers for the GUI are read by buttonRegs() when asked for.
 
+	return(true);
 }// txLoraModem
 
 
@@ -959,6 +1417,8 @@ void txLoraModem(struct LoraDown *LoraDown)
 
 void rxLoraModem()
 {
+	uint32_t startTime = micros();
+
 	// 1. Put system in LoRa mode
 	//opmode(OPMODE_LORA);										// Is already so
 	
@@ -966,17 +1426,14 @@ void rxLoraModem()
 	opmode(OPMODE_STANDBY);										// CAD set 0x01 to 0x00
 	
 	// 3. Set frequency based on value in freq
-	setFreq(freqs[gwayConfig.ch].upFreq);						// set to the right frequency
+	setFrf(freqs[gwayConfig.ch].upFrf);						// set to the right frequency
 
 	// 4. Set spreading Factor and CRC
     setRate(sf, 0x04);
 	
-	// prevent node to node communication
-#	if _GWAYSCAN!=1
-	writeRegister(REG_INVERTIQ, (uint8_t) 0x27);				// 0x33, 0x27; to reset from TX
-#	else
-	writeRegister(REG_INVERTIQ, (uint8_t) 0x40);				// 0x33, 0x40; when receiving other gateway messages
-#	endif
+	// LNA, INVERTIQ (0x27 to reset from TX, 0x40 with _GWAYSCAN), DIO0=RxDone and accept
+	// no interrupts except RXDONE, RXTOUT en RXCRC. See progRx in loraModem.h
+	applyProg(progRx, PROG_LEN(progRx));
 
 	// Max Payload length is dependent on 256 byte buffer. 
 	// At startup TX starts at 0x80 and RX at 0x00. RX therefore maximized at 128 Bytes
@@ -988,16 +1445,6 @@ void rxLoraModem()
 	
 	//Set the start address for the FiFO (Which should be 0)
 	writeRegister(REG_FIFO_ADDR_PTR, (uint8_t) readRegister(REG_FIFO_RX_BASE_AD));	// set 0x0D to 0x0F (contains 0x00);
-	
-	// Low Noise Amplifier used in receiver
-	writeRegister(REG_LNA, (uint8_t) LNA_MAX_GAIN);  			// 0x0C, 0x23
-	
-	// 5. Accept no interrupts except RXDONE, RXTOUT en RXCRC
-	writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) ~(
-		IRQ_LORA_RXDONE_MASK |
-		IRQ_LORA_RXTOUT_MASK |
-		IRQ_LORA_HEADER_MASK |
-		IRQ_LORA_CRCERR_MASK));
 
 	// set frequency hopping
 	if (gwayConfig.hop) {
@@ -1007,12 +1454,6 @@ void rxLoraModem()
 	else {
 		writeRegister(REG_HOP_PERIOD,0xFF);						// 0x24, was 0xFF
 	}
-	// Set RXDONE interrupt to dio0
-	writeRegister(REG_DIO_MAPPING_1, (uint8_t)(
-			MAP_DIO0_LORA_RXDONE | 
-			MAP_DIO1_LORA_RXTOUT |
-			MAP_DIO2_LORA_NOP |			
-			MAP_DIO3_LORA_CRC));
 
 	// 7+8.  Set the opmode to either single or continuous receive. The first is used when
 	// every message can come on a different SF, the second when we have fixed SF
@@ -1035,6 +1476,9 @@ void rxLoraModem()
 	
 	// 9. clear all radio IRQ flags
     writeRegister(REG_IRQ_FLAGS, 0xFF);
+
+	modeTime.rx = micros() - startTime;
+	if (modeTime.rx > modeTime.rxMax) modeTime.rxMax = modeTime.rx;
 	
 	return;
 }// rxLoraModem
@@ -1052,6 +1496,10 @@ void rxLoraModem()
 // ----------------------------------------------------------------------------------------
 void cadScanner()
 {
+	uint32_t startTime = micros();
+	uint32_t spiOps = spiStat.reads + spiStat.writes;
+	uint32_t spiSkips = spiStat.skips;
+
 	// 1. Put system in LoRa mode (which destroys all other modes)
 	//opmode(OPMODE_LORA);
 	
@@ -1059,7 +1507,7 @@ void cadScanner()
 	opmode(OPMODE_STANDBY);										// Was old value
 	
 	// 3. Set frequency based on value in gwayConfig.ch			// might be needed when receiving down 
-	setFreq(freqs[gwayConfig.ch].upFreq);						// set to the right frequency
+	setFrf(freqs[gwayConfig.ch].upFrf);						// set to the right frequency
 
 	// For every time we start the scanner, we set the SF to the begin value
 	//sf = SF7;													// XXX 180501 Not by default
@@ -1067,28 +1515,20 @@ void cadScanner()
 	// 4. Set spreading Factor and CRC
 	setRate(sf, 0x04);
 	
-	// listen to LORA_MAC_PREAMBLE
-	writeRegister(REG_SYNC_WORD, (uint8_t) 0x34);				// set reg 0x39 to 0x34
-	
-	// Set the interrupts we want to listen to
-	writeRegister(REG_DIO_MAPPING_1, (uint8_t)(
-		MAP_DIO0_LORA_CADDONE | 
-		MAP_DIO1_LORA_CADDETECT | 
-		MAP_DIO2_LORA_NOP | 
-		MAP_DIO3_LORA_CRC ));
-	
-	// Set the mask for interrupts (we do not want to listen to) except for
-	writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) ~(
-		IRQ_LORA_CDDONE_MASK | 
-		IRQ_LORA_CDDETD_MASK | 
-		IRQ_LORA_CRCERR_MASK | 
-		IRQ_LORA_HEADER_MASK));
+	// Listen to LORA_MAC_PREAMBLE, set the interrupts we want to listen to
+	// and mask all others. See progCad in loraModem.h
+	applyProg(progCad, PROG_LEN(progCad));
 	
 	// Set the opMode to CAD
 	opmode(OPMODE_CAD);
 
 	// Clear all relevant interrupts
 	//writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF );						// May work better, clear ALL interrupts
+
+	spiStat.cad = spiStat.reads + spiStat.writes - spiOps;
+	spiStat.cadSkip = spiStat.skips - spiSkips;
+	modeTime.cad = micros() - startTime;
+	if (modeTime.cad > modeTime.cadMax) modeTime.cadMax = modeTime.cad;
 	
 	// If we are here. we either might have set the SF or we have a timeout in which
 	// case the receive is started just as normal.
@@ -1127,6 +1567,7 @@ void initLoraModem()
     digitalWrite(pins.rst, LOW);
 	delayMicroseconds(10000);
 #endif
+	regInvalidate();											// Chip registers are back to default
 	// 1. Set radio to sleep
 	opmode(OPMODE_SLEEP);										// set reg 0x01 to 0x00
 
@@ -1134,7 +1575,7 @@ void initLoraModem()
 	opmode(OPMODE_LORA);										// set reg 0x01 to 0x80
 
 	// 3. Set frequency based on value in gwayConfig.ch
-	setFreq(freqs[gwayConfig.ch].upFreq);						// set to 868.1MHz or the last saved frequency
+	setFrf(freqs[gwayConfig.ch].upFrf);						// set to 868.1MHz or the last saved frequency
 
 	// 4. Set spreading Factor
     setRate(sf, 0x04);											//
@@ -1253,6 +1694,32 @@ void startReceiver()
 }
 
 
+// ----------------------------------------------------------------------------------------
+// pushEvent is called by the interrupt handlers only.
+// Store the dio and the time of the interrupt in the event queue so that the 
+// stateMachine() knows when exactly the interrupt happened. If the queue is full 
+// the event is counted as lost, but _event is set anyway.
+//
+// Parameters:
+//	dio:	The dio line number (0-2) of the interrupt
+// ----------------------------------------------------------------------------------------
+void ICACHE_RAM_ATTR pushEvent(uint8_t dio)
+{
+	uint32_t t = micros();
+	uint8_t next = (evtHead + 1) & (EVT_QUEUE - 1);
+
+	if (next != evtTail) {
+		evtQueue[evtHead].dio = dio;
+		evtQueue[evtHead].tmst = t;
+		evtHead = next;									// Publish only when record complete
+	}
+	else {
+		evtDrops++;
+	}
+	_event=1;
+}
+
+
 // ----------------------------------------------------------------------------------------
 // Interrupt_0 Handler.
 // Both interrupts DIO0 and DIO1 are mapped on GPIO15. Se we have to look at 
@@ -1263,7 +1730,7 @@ void startReceiver()
 // ----------------------------------------------------------------------------------------
 void ICACHE_RAM_ATTR Interrupt_0()
 {
-	_event=1;
+	pushEvent(0);
 }
 
 
@@ -1280,7 +1747,7 @@ void ICACHE_RAM_ATTR Interrupt_0()
 // ----------------------------------------------------------------------------------------
 void ICACHE_RAM_ATTR Interrupt_1()
 {
-	_event=1;
+	pushEvent(1);
 }
 
 // ----------------------------------------------------------------------------------------
@@ -1288,7 +1755,7 @@ void ICACHE_RAM_ATTR Interrupt_1()
 // ----------------------------------------------------------------------------------------
 void ICACHE_RAM_ATTR Interrupt_2() 
 {
-	_event=1;
+	pushEvent(2);
 }
 
 
@@ -56,12 +56,15 @@ int repeatLora(struct LoraUp * LUP) {
 	LDWN->sf		= LUP->sf;
 	LDWN->powe		= 14;								// Default for normal frequencies
 	LDWN->crc		= 0;
+	LDWN->cr		= 1;								// 4/5
+	LDWN->prea		= 0;								// LORA_PREAMBLE
 	LDWN->iiq		= 0x27;								// 0x40 when ipol true or 0x27 when false
 	LDWN->imme		= false;
 
 	//strncpy((char *)((* LDWN).payLoad), (char *)((* LUP).payLoad), (int)((* LUP).size));
 	
 	LDWN->payLoad	= LUP->payLoad;
+	LDWN->b64		= NULL;								// Binary payload, not from a PULL_RESP
 
 	yield();										// During development, clean kernel.
 
@@ -80,7 +83,12 @@ int repeatLora(struct LoraUp * LUP) {
 
 	writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) 0x00);			// MMM 200407 Reset
 	writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);				// reset interrupt flags
-	txLoraModem(LDWN);
+	if (!txLoraModem(LDWN)) {
+		txStat.fail++;											// FIFO not loaded, do not transmit
+		startReceiver();
+		return(-1);
+	}
+	txArm(micros(), LDWN);										// Start right away
 
 	txDones=0;
 	_event=1;
@@ -24,6 +24,8 @@
 #include "LoRaCode.h"
 
 unsigned char DevAddr[4]  = _DEVADDR ;				// see configGway.h
+AES_Key nodeAppKs;									// Key schedules of _APPSKEY and _NWKSKEY,
+struct micKey nodeNwkKs;							// made by initDevs()
 
 
 // Only used by GPS sensor code
@@ -219,16 +221,17 @@ int LoRaSensors(uint8_t *buf) {
 	return(tchars);	// return the number of bytes added to payload
 }	
 
+#endif //_GATEWAYNODE==1
 
 
-
+#if (_GATEWAYNODE==1) || (_LOCALSERVER>=1)
 // ----------------------------------------------------------------------------
 // XOR()
 // perform x-or function for buffer and key
 // Since we do this ONLY for keys and X, Y we know that we need to XOR 16 bytes.
 //
 // ----------------------------------------------------------------------------
-void mXor(uint8_t *buf, uint8_t *key) 
+void mXor(uint8_t *buf, const uint8_t *key) 
 {
 	for (uint8_t i = 0; i < 16; ++i) buf[i] ^= key[i];
 }
@@ -256,14 +259,16 @@ void shift_left(uint8_t * buf, uint8_t len)
 // ----------------------------------------------------------------------------
 // generate_subkey
 // RFC 4493, para 2.3
+// Parameters:
+//	- key: Key schedule of the key, made by AES_Set_Key()
 // -----------------------------------------------------------------------------
-void generate_subkey(uint8_t *key, uint8_t *k1, uint8_t *k2) 
+void generate_subkey(const AES_Key *key, uint8_t *k1, uint8_t *k2) 
 {
 
 	memset(k1, 0, 16);								// Fill subkey1 with 0x00
 	
 	// Step 1: Assume k1 is an all zero block
-	AES_Encrypt(k1,key);
+	AES_Encrypt_Key(k1,key);
 	
 	// Step 2: Analyse outcome of Encrypt operation (in k1), generate k1
 	if (k1[0] & 0x80) {
@@ -290,6 +295,112 @@ void generate_subkey(uint8_t *key, uint8_t *k1, uint8_t *k2)
 }
 
 
+// ----------------------------------------------------------------------------
+// micKeySet
+// Make the key schedule and the CMAC subkeys of a NwkSKey. This is done once
+// per key (initDevs()), so computing a MIC costs no extra AES block.
+// Parameters:
+//	- mk:	micKey to fill
+//	- key:	16 byte NwkSKey
+// -----------------------------------------------------------------------------
+void micKeySet(struct micKey *mk, const uint8_t *key)
+{
+	AES_Set_Key(&mk->ks, key);
+	generate_subkey(&mk->ks, mk->k1, mk->k2);
+}
+
+
+// ----------------------------------------------------------------------------
+// aesCmac()
+// AES-CMAC (RFC 4493) of the message ( X | data ). X is the first, complete,
+// block and the data is read where it is, block by block. The CMAC replaces X.
+// Parameters:
+//	- X:		First 16 bytes of the message, and the CMAC on return
+//	- data:		Rest of the message
+//	- len:		Length of data
+//	- mk:		Key schedule and subkeys, made by micKeySet()
+// ----------------------------------------------------------------------------
+void aesCmac(uint8_t *X, const uint8_t *data, uint8_t len, const struct micKey *mk)
+{
+	// Every block but the last: X = AES(X ^ block). The last block is
+	// padded and XOR-ed with k2, or XOR-ed with k1 when complete.
+	//
+	const uint8_t *p = data;
+	uint8_t rest = len;
+
+	if (rest == 0) {
+		mXor(X, mk->k1);					// X is the complete last block
+	}
+	while (rest > 0) {
+		AES_Encrypt_Key(X, &mk->ks);
+		if (rest > 16) {
+			mXor(X, p);
+			p += 16;
+			rest -= 16;
+			continue;
+		}
+		for (uint8_t i=0; i<rest; i++) X[i] ^= p[i];
+		if (rest < 16) {
+			X[rest] ^= 0x80;
+			mXor(X, mk->k2);
+		}
+		else {
+			mXor(X, mk->k1);
+		}
+		rest = 0;
+	}
+	AES_Encrypt_Key(X, &mk->ks);
+}
+
+
+// ----------------------------------------------------------------------------
+// micCompute()
+// Compute the 4-byte MIC of a frame (par 4.4 of spec, RFC4493).
+// B0 is made in the CMAC state and the data is read where it is, block by
+// block, so no copy of B0 | data is made.
+// Parameters:
+//	- data:			( MHDR | FHDR | FPort | FRMPayload ), DevAddr is read from data[1-4]
+//	- len:			Length of data, without MIC
+//	- FrameCount:	16-bit framecounter
+//	- mk:			NwkSKey schedule and subkeys, made by micKeySet()
+//	- dir:			0=up, 1=down
+//	- mic:			The 4 MIC bytes are written here
+//
+// B0 = ( 0x49 | 4 x 0x00 | Dir | 4 x DevAddr | 4 x FCnt |  0x00 | len )
+// MIC is cmac [0:3] of ( aes128_cmac(NwkSKey, B0 | Data )
+// ----------------------------------------------------------------------------
+void micCompute(const uint8_t *data, uint8_t len, uint16_t FrameCount, const struct micKey *mk, uint8_t dir, uint8_t *mic)
+{
+	uint8_t X[16];
+
+	// ------------------------------------
+	// Block B0 is the first block, X = B0
+	X[0]= 0x49;								// 1 byte MIC code
+	X[1]= 0x00;								// 4 byte 0x00
+	X[2]= 0x00;
+	X[3]= 0x00;
+	X[4]= 0x00;
+	X[5]= dir;								// 1 byte Direction
+	X[6]= data[1];							// 4 byte DevAddr, LSB first as in the frame
+	X[7]= data[2];
+	X[8]= data[3];
+	X[9]= data[4];
+	X[10]= (FrameCount & 0x00FF);			// 4 byte FCNT
+	X[11]= ((FrameCount >> 8) & 0x00FF);
+	X[12]= 0x00; 							// Frame counter upper Bytes
+	X[13]= 0x00;							// These are not used so are 0
+	X[14]= 0x00;							// 1 byte 0x00
+	X[15]= len;								// 1 byte len
+
+	aesCmac(X, data, len, mk);				// cmac( B0 | data )
+
+	mic[0]=X[0];
+	mic[1]=X[1];
+	mic[2]=X[2];
+	mic[3]=X[3];
+}
+
+
 // ----------------------------------------------------------------------------
 // MICPACKET()
 // Provide a valid MIC 4-byte code (par 2.4 of spec, RFC4493)
@@ -306,122 +417,15 @@ void generate_subkey(uint8_t *key, uint8_t *k1, uint8_t *k2)
 //	- data:			uint8_t array of bytes = ( MHDR | FHDR | FPort | FRMPayload )
 //	- len:			8=bit length of data, normally less than 64 bytes
 //	- FrameCount:	16-bit framecounter
+//	- NwkSKey:		NwkSKey schedule and subkeys, made by micKeySet()
 //	- dir:			0=up, 1=down
 //
-// B0 = ( 0x49 | 4 x 0x00 | Dir | 4 x DevAddr | 4 x FCnt |  0x00 | len )
-// MIC is cmac [0:3] of ( aes128_cmac(NwkSKey, B0 | Data )
-//
+// Only 4 bytes are returned (32 bits), which is less than the RFC recommends.
+// We return by appending 4 bytes to data, so there must be space in data array.
 // ----------------------------------------------------------------------------
-uint8_t micPacket(uint8_t *data, uint8_t len, uint16_t FrameCount, uint8_t * NwkSKey, uint8_t dir)
+uint8_t micPacket(uint8_t *data, uint8_t len, uint16_t FrameCount, const struct micKey *NwkSKey, uint8_t dir)
 {
-
-
-	//uint8_t NwkSKey[16] = _NWKSKEY;
-	uint8_t Block_B[16];
-	uint8_t X[16];
-	uint8_t Y[16];
-	
-	// ------------------------------------
-	// build the B block used by the MIC process
-	Block_B[0]= 0x49;						// 1 byte MIC code
-			
-	Block_B[1]= 0x00;						// 4 byte 0x00
-	Block_B[2]= 0x00;
-	Block_B[3]= 0x00;
-	Block_B[4]= 0x00;
-	
-	Block_B[5]= dir;						// 1 byte Direction
-	
-	Block_B[6]= DevAddr[3];					// 4 byte DevAddr
-	Block_B[7]= DevAddr[2];
-	Block_B[8]= DevAddr[1];
-	Block_B[9]= DevAddr[0];
-	
-	Block_B[10]= (FrameCount & 0x00FF);		// 4 byte FCNT
-	Block_B[11]= ((FrameCount >> 8) & 0x00FF);
-	Block_B[12]= 0x00; 						// Frame counter upper Bytes
-	Block_B[13]= 0x00;						// These are not used so are 0
-	
-	Block_B[14]= 0x00;						// 1 byte 0x00
-	
-	Block_B[15]= len;						// 1 byte len
-	
-	// ------------------------------------
-	// Step 1: Generate the subkeys
-	//
-	uint8_t k1[16];
-	uint8_t k2[16];
-	generate_subkey(NwkSKey, k1, k2);
-	
-	// ------------------------------------
-	// Copy the data to a new buffer which is prepended with Block B0
-	//
-	uint8_t micBuf[len+16];					// B0 | data
-	for (uint8_t i=0; i<16; i++) micBuf[i]=Block_B[i];
-	for (uint8_t i=0; i<len; i++) micBuf[i+16]=data[i];
-	
-	// ------------------------------------
-	// Step 2: Calculate the number of blocks for CMAC
-	//
-	uint8_t numBlocks = len/16 + 1;			// Compensate for B0 block
-	if ((len % 16)!=0) numBlocks++;			// If we have only a part block, take it all
-	
-	// ------------------------------------
-	// Step 3: Calculate padding is necessary
-	//
-	uint8_t restBits = len%16;				// if numBlocks is not a multiple of 16 bytes
-	
-	
-	// ------------------------------------
-	// Step 5: Make a buffer of zeros
-	//
-	memset(X, 0, 16);
-	
-	// ------------------------------------
-	// Step 6: Do the actual encoding according to RFC
-	//
-	for(uint8_t i= 0x0; i < (numBlocks - 1); i++) {
-		for (uint8_t j=0; j<16; j++) Y[j] = micBuf[(i*16)+j];
-		mXor(Y, X);
-		AES_Encrypt(Y, NwkSKey);
-		for (uint8_t j=0; j<16; j++) X[j] = Y[j];
-	}
-	
-
-	// ------------------------------------
-	// Step 4: If there is a rest Block, padd it
-	// Last block. We move step 4 to the end as we need Y
-	// to compute the last block
-	// 
-	if (restBits) {
-		for (uint8_t i=0; i<16; i++) {
-			if (i< restBits) Y[i] = micBuf[((numBlocks-1)*16)+i];
-			if (i==restBits) Y[i] = 0x80;
-			if (i> restBits) Y[i] = 0x00;
-		}
-		mXor(Y, k2);
-	}
-	else {
-		for (uint8_t i=0; i<16; i++) {
-			Y[i] = micBuf[((numBlocks-1)*16)+i];
-		}
-		mXor(Y, k1);
-	}
-	mXor(Y, X);
-	AES_Encrypt(Y,NwkSKey);
-	
-	// ------------------------------------
-	// Step 7: done, return the MIC size. 
-	// Only 4 bytes are returned (32 bits), which is less than the RFC recommends.
-	// We return by appending 4 bytes to data, so there must be space in data array.
-	//
-	data[len+0]=Y[0];
-	data[len+1]=Y[1];
-	data[len+2]=Y[2];
-	data[len+3]=Y[3];
-	
-	yield();										// MMM to avoid crashes
-	
+	micCompute(data, len, FrameCount, NwkSKey, dir, data+len);
 	return 4;
 }
 
@@ -429,51 +433,57 @@ uint8_t micPacket(uint8_t *data, uint8_t len, uint16_t FrameCount, uint8_t * Nwk
 #if _CHECK_MIC==1
 // ----------------------------------------------------------------------------
 // CHECKMIC
-// Function to check the MIC computed for existing messages and for new messages
+// Check the MIC of a received frame. The key is the NwkSKey of the gateway
+// node or, with _LOCALSERVER, of the decodes[] entry of the DevAddr. As the
+// subkeys are cached this costs one AES block per 16 bytes of frame.
 // Parameters:
 //	- buf: LoRa buffer to check in bytes, last 4 bytes contain the MIC
 //	- len: Length of buffer in bytes
-//	- key: Key to use for MIC. Normally this is the NwkSKey
-//
+// Returns:
+//	1 when the MIC is right, 0 when wrong, -1 when the NwkSKey is not known
 // ----------------------------------------------------------------------------
-void checkMic(uint8_t *buf, uint8_t len, uint8_t *key)
+int checkMic(uint8_t *buf, uint8_t len)
 {
-	uint8_t cBuf[len+1];
-	uint8_t NwkSKey[16] = _NWKSKEY;
+	if (len < 12) return(0);							// MHDR, FHDR and MIC at least
 
-#	if _MONITOR>=1
-	if ((debug>=2) && (pdebug & P_RX)) {
-		String response = "";
-		for (int i=0; i<len; i++) { 
-			printHexDigit(buf[i], response); 
-			response += ' '; 
-		}
-		mPrint("old="+response);
-	}	
-#	endif //_MONITOR
+	const struct micKey *mk = NULL;
+	uint32_t id = ((uint32_t)buf[4]<<24) | (buf[3]<<16) | (buf[2]<<8) | buf[1];
 
-	for (int i=0; i<len-4; i++) {
-		cBuf[i] = buf[i];
+#	if _GATEWAYNODE==1
+	if (id == (uint32_t)((DevAddr[0]<<24) | (DevAddr[1]<<16) | (DevAddr[2]<<8) | DevAddr[3])) {
+		mk = &nodeNwkKs;
 	}
-	len -=4;
-	
-	//uint16_t FrameCount = ( cBuf[7] * 256 ) + cBuf[6];
-	uint16_t FrameCount = cBuf[6] | cBuf[7] << 8;					// To allow 32-bit counters
-	len += micPacket(cBuf, len, FrameCount, NwkSKey, 0);
-	
-	if ((debug>=2) && (pdebug & P_RX)) {
-		String response = "";
+#	endif //_GATEWAYNODE
+#	if _LOCALSERVER>=1
+	if (mk == NULL) {
+		struct devReg *d = findDev(id);
+		if ((d != NULL) && (d->decode >= 0)) mk = &devMics[d->decode];
+	}
+#	endif //_LOCALSERVER
+	if (mk == NULL) return(-1);
 
-		for (int i=0; i<len; i++) { 
-			printHexDigit(cBuf[i],response); 
-			response += " "; 
-		}
-		mPrint("new="+response);
+	uint8_t mic[4];
+	uint16_t FrameCount = buf[6] | buf[7] << 8;
+	micCompute(buf, len-4, FrameCount, mk, 0, mic);
+
+	if (memcmp(mic, buf+len-4, 4) == 0) return(1);
+
+#	if _MONITOR>=1
+	if ((debug>=1) && (pdebug & P_RX)) {
+		String response = "checkMic:: MIC error, addr=";
+		printHex(id, ':', response);
+		response += ", fcnt=" + String(FrameCount);
+		mPrint(response);
 	}
-	// Mic is only checked, but len is not corrected
+#	endif //_MONITOR
+	return(0);
 }
 #endif //_CHECK_MIC
 
+#endif //_GATEWAYNODE || _LOCALSERVER
+
+
+#if _GATEWAYNODE==1
 // ----------------------------- UP -------------------------------------------
 // SENSORPACKET
 // The gateway may also have local sensors that need reporting.
@@ -497,16 +507,13 @@ void checkMic(uint8_t *buf, uint8_t len, uint8_t *key)
 // So message size should be lass than 128 bytes if Payload is limited to 64 bytes.
 //
 // return value:
-//	- On success returns the number of bytes to send
+//	- On success returns the size of the message
 //	- On error returns -1
 // ----------------------------------------------------------------------------
 int sensorPacket() {
 
-	uint8_t buff_up[512];								// Declare buffer here to avoid exceptions
 	uint8_t message[64]={ 0 };							// Payload, init to 0
 	//uint8_t mlength = 0;
-	uint8_t NwkSKey[16] = _NWKSKEY;
-	uint8_t AppSKey[16] = _APPSKEY;
 	uint8_t DevAddr[4]  = _DEVADDR;
 	
 	// Init the other LoraUp fields
@@ -517,6 +524,8 @@ int sensorPacket() {
 	LUP.prssi = -50;
 	LUP.rssicorr = 139;
 	LUP.snr = 0;
+	LUP.chan = gwayConfig.ch;							// Report on current channel
+	LUP.tmst = micros();								// Timestamp, as for RXDONE
 	
 	// In the next few bytes the fake LoRa message must be put
 	// PHYPayload = MHDR | MACPAYLOAD | MIC
@@ -573,7 +582,7 @@ int sensorPacket() {
 		PayLength,
 		(uint16_t)LoraUp.fcnt, 
 		DevAddr, 
-		AppSKey, 
+		&nodeAppKs, 
 		0
 	);
 
@@ -596,7 +605,7 @@ int sensorPacket() {
 	// Note: Until MIC is done correctly, TTN does not receive these messages
 	//		 The last 4 bytes are MIC bytes.
 	//
-	LUP.size += micPacket((uint8_t *)(LUP.payLoad), LUP.size, (uint16_t)LoraUp.fcnt, NwkSKey, 0);
+	LUP.size += micPacket((uint8_t *)(LUP.payLoad), LUP.size, (uint16_t)LoraUp.fcnt, &nodeNwkKs, 0);
 
 #if _DUSB>=1
 	if ((debug>=2) && (pdebug & P_RADIO)) {
@@ -614,16 +623,12 @@ int sensorPacket() {
 	// be expanded if the server expects JSON messages.
 	// Note2: We fake this sensor message when sending
 	//
-	uint16_t buff_index = buildPacket(buff_up, &LUP, true);
+	buildPacket(&LUP, true);
 	
 	LoraUp.fcnt++;
 	statc.msg_ttl++;					// XXX Should we count sensor messages as well?
 	statc.msg_sens++;
-	switch(gwayConfig.ch) {
-		case 0: statc.msg_sens_0++; break;
-		case 1: statc.msg_sens_1++; break;
-		case 2: statc.msg_sens_2++; break;
-	}
+	statc.msg_sens_ch[gwayConfig.ch]++;
 	
 	// In order to save the memory, we only write the framecounter
 	// to EEPROM every 10 values. It also means that we will invalidate
@@ -632,25 +637,9 @@ int sensorPacket() {
 	//
 	if ((LoraUp.fcnt % 10)==0) writeGwayCfg(_CONFIGFILE, &gwayConfig );
 	
-	if (buff_index > 512) {
-		if (debug>0) 
-			mPrint("sensorPacket:: ERROR buffer size too large");
-		return(-1);
-	}
-
-#if _GWAYSCAN==0
-#	ifdef _TTNSERVER	
-	if (!sendUdp(ttnServer, _TTNPORT, buff_up, buff_index)) {
-		return(-1);
-	}
-#	endif //_TTNSERVER
-
-#	ifdef _THINGSERVER
-	if (!sendUdp(thingServer, _THINGPORT, buff_up, buff_index)) {
+	if (pushData(&LUP, 1) < 0) {
 		return(-1);
 	}
-#	endif //_THINGSERVER
-#endif //_GWAYSCAN
 
 #if _DUSB>=1
 	// If all is right, we should after decoding (which is the same as encoding) get
@@ -661,7 +650,7 @@ int sensorPacket() {
 			PayLength, 
 			(uint16_t)LoraUp.fcnt-1, 
 			DevAddr, 
-			AppSKey, 
+			&nodeAppKs, 
 			0
 		);
 		
@@ -691,7 +680,7 @@ int sensorPacket() {
 		rxLoraModem();	
 	}
 		
-	return(buff_index);
+	return(LUP.size);
 }
 
 #endif //_GATEWAYNODE==1
@@ -704,7 +693,8 @@ int sensorPacket() {
 // The same applies to decoding packages in the payload for _LOCALSERVER.
 // The library files for AES are added to the library directory in AES.
 // For the moment we use the AES library made by ideetron as this library
-// is also used in the LMIC stack and is small in size.
+// is also used in the LMIC stack and is small in size. The key is passed
+// as key schedule (AES_Set_Key()) so it is not expanded for every block.
 //
 // The function below follows the LoRa spec exactly.
 //
@@ -727,10 +717,10 @@ int sensorPacket() {
 //	DataLength:	Length of the data field
 //	FrameCount:	xx
 //	DevAddr:	Device ID
-//	AppSKey:	Device specific
+//	AppSKey:	Key schedule of the device AppSKey, made by AES_Set_Key()
 //	Direction:	Uplink==0, e.g. receivePakt(), semsorPacket(),
 // ----------------------------------------------------------------------------
-uint8_t encodePacket(uint8_t *Data, uint8_t DataLength, uint16_t FrameCount, uint8_t *DevAddr, uint8_t *AppSKey, uint8_t Direction)
+uint8_t encodePacket(uint8_t *Data, uint8_t DataLength, uint16_t FrameCount, uint8_t *DevAddr, const AES_Key *AppSKey, uint8_t Direction)
 {
 	//unsigned char AppSKey[16] = _APPSKEY ;	// see configGway.h
 	uint8_t i, j;
@@ -766,7 +756,7 @@ uint8_t encodePacket(uint8_t *Data, uint8_t DataLength, uint16_t FrameCount, uin
 		Block_A[15] = i;
 
 		// Encrypt and calculate the S
-		AES_Encrypt(Block_A, AppSKey);
+		AES_Encrypt_Key(Block_A, AppSKey);
 		
 		// Last block? set bLen to rest
 		if ((i == numBlocks) && (restLength>0)) bLen = restLength;
@@ -69,13 +69,36 @@
 
 void stateMachine()
 {
+	uint8_t rssi;
+	uint8_t dios = 0;											// Bit set for every dio that interrupted
+	_event=0;													// Reset the interrupt detector	
+
+	// Take all interrupt events from the queue filled by the Interrupt_x()
+	// handlers. Remember the interrupt time per dio and measure how long
+	// it took before we handle the interrupt.
+	// This is done before the flags are read: a dio rises after its flag is set,
+	// so every event taken here has its flag in flags. An interrupt held back by
+	// readRegister() is otherwise taken without its flag and lost for the next call.
+	//
+	while (evtTail != evtHead) {
+		uint8_t dio = evtQueue[evtTail].dio;
+		uint32_t late = micros() - evtQueue[evtTail].tmst;
+		
+		dioTime[dio] = evtQueue[evtTail].tmst;
+		dios |= (0x01 << dio);
+		evtTail = (evtTail + 1) & (EVT_QUEUE - 1);
+
+		uint8_t i = 0;
+		while ((i < EVT_HIST-1) && (late >= evtLimit[i])) i++;
+		evtHist[i]++;
+		if (late > evtMax) evtMax = late;
+	}
+
 	// Determine what interrupt flags are set
 	//
 	uint8_t flags = readRegister(REG_IRQ_FLAGS);
 	uint8_t mask  = readRegister(REG_IRQ_FLAGS_MASK);
 	uint8_t intr  = flags & ( ~ mask );							// Only react on non masked interrupts
-	uint8_t rssi;
-	_event=0;													// Reset the interrupt detector	
 
 #	if _MONITOR>=1
 	if (intr != flags) {
@@ -94,8 +117,8 @@ void stateMachine()
 		mPrint("state:: hop==1");
 		
 		// eventWait is the time since we have had a CDDETD event (preamble detected).
-		// If we are not in scanning state, and there will be an interrupt coming,
-		// In state S_RX it could be RXDONE in which case allow kernel time
+		// In S_SCAN we wait no longer than a preamble on the current SF lasts, in
+		// S_CAD as long as the CAD of all remaining SF of the channel takes.
 		//
 		if ((_state == S_SCAN) || (_state == S_CAD)) {
 
@@ -106,21 +129,16 @@ void stateMachine()
 				case S_INIT:	eventWait = 0; 
 					break;
 				// Next two are most important
-				case S_SCAN:	eventWait = EVENT_WAIT * 1;
+				case S_SCAN:	eventWait = chanTime(sfTime(sf)->pre);
 								mPrint("SCAN");
 					break;
-				case S_CAD:		eventWait = EVENT_WAIT * 1;
+				case S_CAD:		eventWait = 0;
+								for (uint8_t i=sf; i<=freqs[gwayConfig.ch].upHi; i++) {
+									eventWait += chanTime(sfTime(i)->cad);
+								}
+								if (eventWait == 0) eventWait = chanTime(sfTime(sf)->cad);
 								mPrint("CAD");
 					break;
-				case S_RX:		eventWait = EVENT_WAIT * 8;
-								mPrint("RX");
-					break;
-				case S_TX:		eventWait = EVENT_WAIT * 1; 
-								mPrint("TX"); 
-					break;
-				case S_TXDONE:	eventWait = EVENT_WAIT * 4; 
-								mPrint("TXDONE"); 
-					break;
 				default:
 					eventWait=0;
 #					if _MONITOR>=1
@@ -132,26 +150,10 @@ void stateMachine()
 
 			// doneWait is the time that we received CDDONE interrupt
 			// So we init the wait time for RXDONE based on the current SF.
-			// As for highter CF it takes longer to receive symbols
-			// Assume symbols in SF8 take twice the time of SF7
+			// As for highter CF it takes longer to receive symbols.
+			// A CAD takes about two symbols of the SF and bandwidth of the channel.
 			//
-			uint32_t doneWait = DONE_WAIT;						// Initial value
-			switch (sf) {
-				case SF7: 	break;
-				case SF8: 	doneWait *= 2;	break;
-				case SF9: 	doneWait *= 4;	break;
-				case SF10:	doneWait *= 8;	break;
-				case SF11:	doneWait *= 16;	break;
-				case SF12:	doneWait *= 32;	break;
-				default:
-					doneWait *= 1;
-#					if _MONITOR>=1
-					if ((debug>=0) && (pdebug & P_PRE)) {
-						mPrint("StateMachine:: PRE: DEF set");
-					}
-#					endif //_MONITOR
-					break;
-			}
+			uint32_t doneWait = chanTime(sfTime(sf)->cad);
 
 			// If micros is starting over again after 51 minutes 
 			// it's value is smaller than an earlier value of eventTime/doneTime
@@ -213,10 +215,36 @@ void stateMachine()
 #			endif //_MONITOR
 		} // if SCAN or CAD
 
-		// else, S_RX of S_TX for example
-		else {
-			//
-		} // else S_RX or S_TX, TXDONE
+		// In S_RX the message of which CDDETD found the preamble has to be received
+		// within the airtime of a maximum length message (loraTimes[].air, preamble
+		// and payload) of the SF and channel bandwidth. If RXDONE or RXTOUT did not
+		// come by then, count a timeout and hop. S_TX and S_TXDONE are watched by
+		// the sendTime timeout of S_TXDONE below.
+		//
+		else if (_state == S_RX) {
+			if (detTime > micros())	detTime=micros();
+
+			if ((micros() - detTime) > chanTime(sfTime(sf)->air)) {
+				if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].tout++;	// Detected but not received
+				_event=0;
+				writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) 0x00);
+				writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);		// reset all interrupts
+
+				_state = S_SCAN;
+				hop();
+				cadScanner();
+#				if _MONITOR>=1
+				if ((debug >= 2) && (pdebug & P_RX)) {
+					String response = "RXWAIT:: ";
+					mStat(intr, response);
+					mPrint(response);
+				}
+#				endif //_MONITOR
+				eventTime=micros();
+				doneTime=micros();
+				return;
+			}
+		} // else S_RX
 
 		yield();										// if hopping is enabled
 
@@ -289,6 +317,7 @@ void stateMachine()
 
 			_event=0;												// Make 0, as soon as we have an interrupt
 			detTime=micros();										// mark time that preamble detected
+			if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].det++;		// Preamble detected on this SF
 
 #			if _MONITOR>=1
 			if ((debug>=1) && (pdebug & P_PRE)) {
@@ -313,6 +342,7 @@ void stateMachine()
 
 			opmode(OPMODE_CAD);
 			rssi = readRegister(REG_RSSI);							// Read the RSSI
+			if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].cad++;		// CAD done on this SF
 
 #			if _MONITOR>=1
 			if ((debug>=2) && (pdebug & P_SCAN)) {
@@ -454,6 +484,7 @@ void stateMachine()
 			_rssi = rssi;											// Read the RSSI in the state variable
 
 			detTime = micros();
+			if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].det++;		// Preamble detected on this SF
 #			if _MONITOR>=1
 			if ((debug>=1) && (pdebug & P_CAD)) {
 				String response = "CAD:: ";
@@ -469,6 +500,8 @@ void stateMachine()
 		// So we scan this SF and if not high enough ... next
 		//
 		else if (intr & IRQ_LORA_CDDONE_MASK) {
+			if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].cad++;		// CAD done on this SF, no preamble
+
 			// If this is not the max SF, increment the SF and try again
 			// Depending on the frequency scheme this is for example SF8, SF10 or SF12
 			// We expect on other SF get CDDETD
@@ -607,81 +640,96 @@ void stateMachine()
 #			endif //_CRCCHECK
 
 			// If we are here, no CRC error occurred, start timer
-#			if _DUSB>=1 || _MONITOR>=1
-				uint32_t rxDoneTime = micros();	
-#			endif	
-
-			// There should not be an error in the message
-			LoraUp.payLoad[0]= 0x00;								// Empty the message
-
-			// If receive S_RX error, 
-			// - print Error message
-			// - Set _state to SCAN
-			// - Set _event=1 so that we loop until we have an interrupt
-			// - Reset the interrupts
-			// - break
-			// NOTE: receivePacket also increases .ok0 - .ok2 counter
-
-			if((LoraUp.size = receivePkt(LoraUp.payLoad)) <= 0) {
+			// RXDONE is on dio0, so use the time of its interrupt if we have it.
+			uint32_t rxDoneTime = micros();
+			if (dios & 0x01) rxDoneTime = dioTime[0];
+
+			// The frame is stored in the uplink queue and forwarded later
+			// by loop(). If the queue is full we drop the new message but
+			// restart the receiver as usual.
+			struct LoraUp *up = &rxQueue[rxHead];
+			uint8_t next = (rxHead + 1) % _RXQUEUE;
+
+			if (next == rxTail) {
+				rxPipe.drops++;
 #				if _MONITOR>=1
 				if ((debug>=0) && (pdebug & P_RX)) {
-					String response = "sMachine:: ERROR S-RX: size=" + String(LoraUp.size);
-					mPrint(response);
+					mPrint("sMachine:: ERROR S-RX: queue full, drops=" + String(rxPipe.drops));
 				}
 #				endif //_MONITOR
-
-				_event=1;
-				writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) 0x00);	// Reset the interrupt mask
-				writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);
-
-				_state = S_SCAN;
-				break;
 			}
+			else {
 
-#			if _MONITOR>=1
-			if ((debug >=2) && (pdebug & P_RX)) {
-				String response  = "RXDONE:: dT=";
-				response += String(rxDoneTime - detTime);
-				mStat(intr, response);
-				mPrint(response);
-			}
-#			endif //_MONITOR
+				// There should not be an error in the message
+				up->payLoad[0]= 0x00;									// Empty the message
 
-			// Do all register processing in this section
-			uint8_t value = readRegister(REG_PKT_SNR_VALUE);		// 0x19; 
-			if ( value & 0x80 ) {									// The SNR sign bit is 1
-				
-				value = ( ( ~value + 1 ) & 0xFF ) >> 2;				// Invert and divide by 4
-				LoraUp.snr = -value;
-			}
-			else {
-				// Divide by 4
-				LoraUp.snr = ( value & 0xFF ) >> 2;
-			}
+				// If receive S_RX error, 
+				// - print Error message
+				// - Set _state to SCAN
+				// - Set _event=1 so that we loop until we have an interrupt
+				// - Reset the interrupts
+				// - break
+				// NOTE: receivePkt also increases .ok0 - .ok2 counter
 
-			// Packet RSSI
-			LoraUp.prssi = readRegister(REG_PKT_RSSI);				// read register 0x1A, packet rssi
+				if((up->size = receivePkt(up->payLoad)) <= 0) {
+#					if _MONITOR>=1
+					if ((debug>=0) && (pdebug & P_RX)) {
+						String response = "sMachine:: ERROR S-RX: size=" + String(up->size);
+						mPrint(response);
+					}
+#					endif //_MONITOR
 
-			// Correction of RSSI value based on chip used.	
-			if (sx1276) {											// If it is a sx1276 or TFM95 radio
-				LoraUp.rssicorr = 157;
-			} else {												// Probably SX1272 or RFM92
-				LoraUp.rssicorr = 139;
-			}
+					_event=1;
+					writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) 0x00);	// Reset the interrupt mask
+					writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);
 
-			LoraUp.sf = readRegister(REG_MODEM_CONFIG2) >> 4;
+					_state = S_SCAN;
+					break;
+				}
 
-			// If read was successful, read the package from the LoRa bus
-			//
-			if (receivePacket() <= 0) {								// read is not successful
 #				if _MONITOR>=1
-				if ((debug>=0) && (pdebug & P_RX)) {
-					mPrint("sMach:: ERROR receivePacket");
+				if ((debug >=2) && (pdebug & P_RX)) {
+					String response  = "RXDONE:: dT=";
+					response += String(rxDoneTime - detTime);
+					mStat(intr, response);
+					mPrint(response);
 				}
 #				endif //_MONITOR
-			}
+
+				// Do all register processing in this section
+				uint8_t value = readRegister(REG_PKT_SNR_VALUE);		// 0x19; 
+				if ( value & 0x80 ) {									// The SNR sign bit is 1
+					
+					value = ( ( ~value + 1 ) & 0xFF ) >> 2;				// Invert and divide by 4
+					up->snr = -value;
+				}
+				else {
+					// Divide by 4
+					up->snr = ( value & 0xFF ) >> 2;
+				}
+
+				// Packet RSSI
+				up->prssi = readRegister(REG_PKT_RSSI);					// read register 0x1A, packet rssi
+
+				// Correction of RSSI value based on chip used.	
+				if (sx1276) {											// If it is a sx1276 or TFM95 radio
+					up->rssicorr = 157;
+				} else {												// Probably SX1272 or RFM92
+					up->rssicorr = 139;
+				}
+
+				up->sf = readRegister(REG_MODEM_CONFIG2) >> 4;
+				if ((up->sf>=SF7) && (up->sf<=SF12)) sfDet[up->sf-SF7].rx++;
+				up->chan = gwayConfig.ch;								// Channel may hop before loop() forwards
+				up->freq = freqs[gwayConfig.ch].upFreq;
+				up->tmst = rxDoneTime;									// RXDONE interrupt time, reported as tmst in rxpk
+
+				rxHead = next;											// Frame is complete, loop() may forward it
+				rxPipe.cnt++;
+			} // queue not full
 			
 			// Set the modem to receiving BEFORE going back to user space.
+			// The message is forwarded from the queue by loop().
 			// 
 			if ((gwayConfig.cad) || (gwayConfig.hop)) {
 				_state = S_SCAN;
@@ -697,6 +745,10 @@ void stateMachine()
 			writeRegister(REG_IRQ_FLAGS, (uint8_t) 0xFF);			// Reset the interrupt mask
 			eventTime=micros();										// There was an event for receive
 			_event=0;
+
+			rxPipe.dead = eventTime - rxDoneTime;					// Receiver was deaf this long
+			rxPipe.deadTtl += rxPipe.dead;
+			if (rxPipe.dead > rxPipe.deadMax) rxPipe.deadMax = rxPipe.dead;
 		}// RXDONE
 
 		// RXOUT: 
@@ -717,6 +769,8 @@ void stateMachine()
 			// If RXTOUT we put the modem in cad state and reset to SF7
 			// If a timeout occurs here we reset the cadscanner
 			//
+			if ((sf>=SF7) && (sf<=SF12)) sfDet[sf-SF7].tout++;		// Detected but not received
+
 			if ((gwayConfig.cad) || (gwayConfig.hop)) {
 				// Set the state to CAD scanning
 #				if _MONITOR>=1
@@ -890,9 +944,9 @@ void stateMachine()
 			
 			// UP: Now respond with an TX_ACK
 			// Byte 3 == 0x05; see para 5.2.6 of spec
-			buff[0]= buff_down[0];							// As read from the Network Server
-			buff[1]= buff_down[1];							// Token 1, copied from downstream
-			buff[2]= buff_down[2];							// Token 2
+			buff[0]= txAck[0];								// As read from the Network Server
+			buff[1]= txAck[1];								// Token 1, copied from PULL_RESP
+			buff[2]= txAck[2];								// Token 2
 			buff[3]= TX_ACK;								// ident == 0x05;
 			// MMMM Missing Gateway MAC Address 8 bytes
 			// MMMM
@@ -933,6 +987,11 @@ void stateMachine()
 			writeRegister(REG_IRQ_FLAGS_MASK, (uint8_t) 0xFF);
 			writeRegister(REG_IRQ_FLAGS, (uint8_t) 0x00);
 
+#			if _REPEATER==0
+			// The TX started the airtime before the TXDONE interrupt, calibrate txDelay
+			txCalib((dios & 0x01) ? dioTime[0] : micros());
+#			endif //_REPEATER
+
 			yield();
 		}
 
@@ -0,0 +1,255 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// Author: Maarten Westenberg (mw12554@hotmail.com)
+//
+// This file contains a synthetic traffic generator for capacity testing.
+// It simulates _TRAFFIC end devices that each send a frame every _TRAFFIC_PERIOD
+// seconds, and decides which frames the single channel gateway would have
+// received: same channel, an SF the gateway listens to, no collision with
+// another frame on the same channel and SF and the radio not busy with
+// another frame.
+// Those frames are put in the uplink queue where the stateMachine() would
+// have put them after receivePkt(), and forwarded by forwardQueue() as usual.
+// Unless _TRAFFIC_FWD is 1 pushData() makes the rxpk but does not send it to
+// the servers. With trafRadio set the frames go on the air of a radio (the
+// simulator of the native test_traffic) instead.
+//
+// ============================================================================
+
+#if _TRAFFIC>=1
+
+#if (_TRAFFIC_SIZE < 13) || (_TRAFFIC_SIZE > 128)
+#	error "_TRAFFIC_SIZE must be 13 (LoRaWAN header and MIC) to 128 bytes"
+#endif
+#if (_TRAFFIC > 65535)
+#	error "_TRAFFIC must be 65535 devices or less (16 bit device number in DevAddr)"
+#endif
+
+
+// ----------------------------------------------------------------------------
+// trafSf()
+// Return the SF of device dev, distributed according to _TRAFFIC_SFMIX.
+// ----------------------------------------------------------------------------
+uint8_t trafSf(uint16_t dev)
+{
+	const uint8_t mix[6] = _TRAFFIC_SFMIX;
+	uint8_t total = 0;
+	for (int i=0; i<6; i++) total += mix[i];
+	if (total == 0) return(SF7);
+
+	uint8_t k = dev % total;
+	for (int i=0; i<6; i++) {
+		if (k < mix[i]) return(SF7 + i);
+		k -= mix[i];
+	}
+	return(SF7);
+}
+
+
+// ----------------------------------------------------------------------------
+// trafPeriod()
+// Return the time until the next frame of a device in uSec, _TRAFFIC_PERIOD
+// seconds +/- 10% so that the devices do not stay synchronised.
+// ----------------------------------------------------------------------------
+uint32_t trafPeriod()
+{
+	uint32_t period = (uint32_t)_TRAFFIC_PERIOD * 1000000;
+	return( period - period/10 + random(period/5) );
+}
+
+
+// ----------------------------------------------------------------------------
+// trafFrame()
+// Make the _TRAFFIC_SIZE bytes frame of device dev: unconfirmed data up with
+// DevAddr 0x26FF<dev>, FCnt fcnt, FPort 1 and a zero payload and MIC.
+// ----------------------------------------------------------------------------
+void trafFrame(uint16_t dev, uint16_t fcnt, uint8_t *frame)
+{
+	memset(frame, 0, _TRAFFIC_SIZE);
+	frame[0] = 0x40;									// MHDR
+	frame[1] = dev & 0xFF;								// DevAddr, LSB first
+	frame[2] = (dev >> 8) & 0xFF;
+	frame[3] = 0xFF;
+	frame[4] = 0x26;
+	frame[5] = 0x00;									// FCtrl
+	frame[6] = fcnt & 0xFF;								// FCnt
+	frame[7] = (fcnt >> 8) & 0xFF;
+	frame[8] = 0x01;									// FPort
+}
+
+
+#if _TRAFFIC_FWD==0
+// ----------------------------------------------------------------------------
+// TrafSink
+// Print that drops what is written. pushData() writes the rxpk of the frames
+// to it, so the forward time still includes making the rxpk.
+// ----------------------------------------------------------------------------
+class TrafSink : public Print {
+public:
+	size_t write(uint8_t c) { return(1); }
+	size_t write(const uint8_t *buf, size_t len) { return(len); }
+} trafSink;
+#endif //_TRAFFIC_FWD
+
+
+// ----------------------------------------------------------------------------
+// trafficDone()
+// The frame on the air on channel chan and SF index s has ended. Decide
+// whether the gateway received it and if so put it in the uplink queue.
+// Parameters:
+//	chan: Channel of the device, 0 to _TRAFFIC_HOPS-1
+//	s: SF index, 0 for SF7 to 5 for SF12
+// ----------------------------------------------------------------------------
+void trafficDone(uint8_t chan, uint8_t s)
+{
+	struct trafAir *a = &trafAir[chan][s];
+	uint8_t sfDev = SF7 + s;
+	a->busy = false;
+
+	if (a->col) {
+		trafStat[s].col++;
+		return;
+	}
+
+	// Is the gateway listening on the channel and SF of the device?
+	bool heard = gwayConfig.hop ? (chan == gwayConfig.ch) : (chan == 0);
+	if (gwayConfig.cad) {
+		heard = heard && (sfDev >= freqs[gwayConfig.ch].upLo) && (sfDev <= freqs[gwayConfig.ch].upHi);
+	}
+	else {
+		heard = heard && (sfDev == (uint8_t) sf);
+	}
+
+	// The radio can only receive one frame at a time
+	if (heard && ((int32_t)(a->start - trafBusy) < 0)) {
+		heard = false;
+	}
+	if (!heard) {
+		trafStat[s].miss++;
+		return;
+	}
+	trafBusy = a->end;
+	trafStat[s].det++;
+
+	uint8_t next = (rxHead + 1) % _RXQUEUE;
+	if (next == rxTail) {
+		trafStat[s].full++;
+		rxPipe.drops++;
+		return;
+	}
+
+	struct LoraUp *up = &rxQueue[rxHead];
+	trafFrame(a->dev, a->fcnt, up->payLoad);
+
+	up->size = _TRAFFIC_SIZE;
+	up->snr = 7;
+	up->prssi = 60;
+	up->rssicorr = 157;									// sx1276, -97 dBm
+	up->sf = sfDev;
+	up->chan = gwayConfig.ch;
+	up->freq = freqs[gwayConfig.ch].upFreq;
+	up->tmst = a->end;									// RXDONE time
+
+	rxHead = next;
+	rxPipe.cnt++;
+	trafStat[s].rx++;
+}
+
+
+// ----------------------------------------------------------------------------
+// trafficInit()
+// Called by setup(). Give every device a random time for its first frame,
+// so that they do not all start at once, and FCnt 0.
+// ----------------------------------------------------------------------------
+void trafficInit()
+{
+	uint32_t now = micros();
+	for (int i=0; i<_TRAFFIC; i++) {
+		trafNext[i] = now + random((uint32_t)_TRAFFIC_PERIOD * 1000000);
+		trafFcnt[i] = 0;
+	}
+	memset(trafAir, 0, sizeof(trafAir));
+	trafBusy = now;
+}
+
+
+// ----------------------------------------------------------------------------
+// trafficGen()
+// Called in every loop(). Start the frames of the devices that are due and
+// finish the frames that have been on the air long enough.
+// ----------------------------------------------------------------------------
+void trafficGen()
+{
+	uint32_t now = micros();
+
+	for (int i=0; i<_TRAFFIC; i++) {
+		if ((int32_t)(now - trafNext[i]) < 0) continue;
+		trafNext[i] = now + trafPeriod();
+
+		uint8_t sfDev = trafSf(i);
+		uint8_t s = sfDev - SF7;
+		uint16_t fcnt = trafFcnt[i]++;
+		trafStat[s].gen++;
+
+		if (trafRadio != NULL) {
+			uint8_t frame[_TRAFFIC_SIZE];
+			trafFrame(i, fcnt, frame);
+			trafRadio(i % _TRAFFIC_HOPS, sfDev, frame, _TRAFFIC_SIZE);
+			continue;
+		}
+
+		uint32_t air = airTime(sfDev, 125, _TRAFFIC_SIZE, 1, 1, LORA_PREAMBLE);
+		struct trafAir *a = &trafAir[i % _TRAFFIC_HOPS][s];
+		if (a->busy) {
+			// Same channel and SF on the air, both frames are lost
+			a->col = true;
+			trafStat[s].col++;
+			if ((int32_t)(now + air - a->end) > 0) a->end = now + air;
+			continue;
+		}
+		a->dev = i;
+		a->fcnt = fcnt;
+		a->busy = true;
+		a->col = false;
+		a->start = now;
+		a->end = now + air;
+	}
+
+	for (uint8_t c=0; c<_TRAFFIC_HOPS; c++) {
+		for (uint8_t s=0; s<6; s++) {
+			if ((trafAir[c][s].busy) && ((int32_t)(now - trafAir[c][s].end) >= 0)) {
+				trafficDone(c, s);
+			}
+		}
+	}
+}
+
+
+// ----------------------------------------------------------------------------
+// fwdPercentile()
+// Return the upper limit of the fwdHist[] bucket that contains percentile
+// p of the forward times, or rxPipe.servMax for the last bucket.
+// ----------------------------------------------------------------------------
+uint32_t fwdPercentile(uint8_t p)
+{
+	uint32_t total = 0;
+	for (int i=0; i<EVT_HIST; i++) total += fwdHist[i];
+	if (total == 0) return(0);
+
+	uint32_t sum = 0;
+	for (int i=0; i<EVT_HIST-1; i++) {
+		sum += fwdHist[i];
+		if (sum * 100 >= total * p) return(fwdLimit[i]);
+	}
+	return(rxPipe.servMax);
+}
+
+#endif //_TRAFFIC
@@ -18,6 +18,248 @@
 // ========================================================================================
 
 
+// ------------------------------- DOWN ----------------------------------------
+// JSON tokenizer for the txpk object of PULL_RESP
+// The message is read once from begin to end, members may come in any order
+// and unknown members are skipped. Strings are terminated in place in the
+// PULL_RESP buffer and not copied, so no JSON document is needed.
+// All functions return the position after what was read, or NULL when the
+// input is not valid or ends too early.
+// ----------------------------------------------------------------------------
+static char * jsonWs(char *p, char *e)
+{
+	while ((p < e) && ((*p==' ') || (*p=='\t') || (*p=='\r') || (*p=='\n'))) p++;
+	return(p);
+}
+
+// String at p. *s is set to the string (terminated in place), *l to its length.
+// Escapes are skipped but not decoded, txpk strings do not contain them.
+static char * jsonStr(char *p, char *e, char **s, uint16_t *l)
+{
+	if ((p >= e) || (*p != '"')) return(NULL);
+	char *b = ++p;
+	while ((p < e) && (*p != '"')) {
+		if (*p == '\\') p++;
+		p++;
+	}
+	if (p >= e) return(NULL);
+	*p = 0;
+	if (s != NULL) *s = b;
+	if (l != NULL) *l = p - b;
+	return(p+1);
+}
+
+// Unsigned number at p, with dec digits of the fraction kept.
+// With dec==6 "868.1" is 868100000. Signs and exponents are not accepted.
+static char * jsonUint(char *p, char *e, uint32_t *v, uint8_t dec)
+{
+	char *b = p;
+	uint32_t n = 0;
+	uint8_t d = 0;
+	bool frac = false;
+
+	for (; p < e; p++) {
+		if ((*p >= '0') && (*p <= '9')) {
+			if (frac && (d >= dec)) continue;					// Truncate the rest
+			if ((n > 429496729UL) || ((n == 429496729UL) && (*p > '5'))) return(NULL);
+			n = n*10 + (*p - '0');
+			if (frac) d++;
+		}
+		else if ((*p == '.') && !frac) frac = true;
+		else break;
+	}
+	if (p == b) return(NULL);
+	for (; d < dec; d++) {
+		if (n > 429496729UL) return(NULL);
+		n = n*10;
+	}
+	*v = n;
+	return(p);
+}
+
+static char * jsonBool(char *p, char *e, uint8_t *v)
+{
+	if (((e - p) >= 4) && (strncmp(p, "true", 4) == 0)) { *v = 1; return(p+4); }
+	if (((e - p) >= 5) && (strncmp(p, "false", 5) == 0)) { *v = 0; return(p+5); }
+	return(NULL);
+}
+
+// Skip any value, objects and arrays up to 8 levels deep
+static char * jsonSkip(char *p, char *e)
+{
+	if (p >= e) return(NULL);
+	if (*p == '"') return(jsonStr(p, e, NULL, NULL));
+	if ((*p == '{') || (*p == '[')) {
+		uint8_t depth = 0;
+		while (p < e) {
+			if (*p == '"') {
+				if ((p = jsonStr(p, e, NULL, NULL)) == NULL) return(NULL);
+				continue;
+			}
+			if ((*p == '{') || (*p == '[')) {
+				if (++depth > 8) return(NULL);
+			}
+			else if ((*p == '}') || (*p == ']')) {
+				if (--depth == 0) return(p+1);
+			}
+			p++;
+		}
+		return(NULL);
+	}
+	char *b = p;												// number, true, false, null
+	while ((p < e) && (*p != ',') && (*p != '}') && (*p != ']') && (*p != ' ')) p++;
+	return(p > b ? p : NULL);
+}
+
+// Go to the next member of an object, *pp is after the '{' (first) or after
+// the value of the previous member.
+// Returns 1 with *key set and *pp at its value, 0 at the end of the object
+// with *pp after the '}', or -1 when not valid.
+static int jsonNext(char **pp, char *e, char **key, bool first)
+{
+	char *p = jsonWs(*pp, e);
+	if (p >= e) return(-1);
+	if (*p == '}') {
+		*pp = p+1;
+		return(0);
+	}
+	if (!first) {
+		if (*p != ',') return(-1);
+		p = jsonWs(p+1, e);
+	}
+	if ((p = jsonStr(p, e, key, NULL)) == NULL) return(-1);
+	p = jsonWs(p, e);
+	if ((p >= e) || (*p != ':')) return(-1);
+	*pp = jsonWs(p+1, e);
+	return((*pp < e) ? 1 : -1);
+}
+
+
+// ------------------------------- DOWN ----------------------------------------
+// txpkParse()
+// Decode {"txpk":{...}} of a PULL_RESP message in one pass, directly in
+// LoraDown and tx. Fields not in the message are 0 or NULL.
+//
+// Parameters:
+//	js:			The JSON text, it is changed (strings are terminated in place)
+//	len:		Length of js, js does not need to be terminated
+//	LoraDown:	tmst, ipol, imme, powe, prea, ncrc, rfch, modu, codr, cr, datr, sf and bw
+//	tx:			The other fields sendPacket() needs
+// Return:
+//	0 when success, -1 when the message is not valid or has no txpk data
+// ----------------------------------------------------------------------------
+int txpkParse(char *js, uint16_t len, struct LoraDown *LoraDown, struct txpk *tx)
+{
+	char *e = js + len;
+	char *p = jsonWs(js, e);
+	char *key;
+	bool found = false;
+	int r;
+
+	memset(tx, 0, sizeof(struct txpk));
+	LoraDown->tmst = 0;
+	LoraDown->ipol = false;
+	LoraDown->imme = 0;
+	LoraDown->powe = 0;
+	LoraDown->prea = 0;
+	LoraDown->ncrc = 0;
+	LoraDown->rfch = 0;
+	LoraDown->modu = NULL;
+	LoraDown->codr = NULL;
+	LoraDown->datr = NULL;
+
+	if ((p >= e) || (*p != '{')) return(-1);
+	p++;
+
+	for (bool first = true; (r = jsonNext(&p, e, &key, first)) > 0; first = false) {
+		if (found || (strcmp(key, "txpk") != 0) || (*p != '{')) {
+			if ((p = jsonSkip(p, e)) == NULL) return(-1);
+			continue;
+		}
+		p++;
+		for (bool f = true; (r = jsonNext(&p, e, &key, f)) > 0; f = false) {
+			uint32_t v = 0;
+			uint8_t b = 0;
+			if (strcmp(key, "tmst") == 0) {
+				p = jsonUint(p, e, &v, 0);
+				LoraDown->tmst = v;
+			}
+			else if (strcmp(key, "data") == 0) {
+				p = jsonStr(p, e, &tx->data, &tx->dataLen);
+			}
+			else if (strcmp(key, "size") == 0) {
+				p = jsonUint(p, e, &v, 0);
+				tx->size = (v > 0xFFFF ? 0xFFFF : v);
+			}
+			else if (strcmp(key, "freq") == 0) {
+				p = jsonUint(p, e, &tx->freq, 6);				// MHz to Hz
+			}
+			else if (strcmp(key, "datr") == 0) {
+				p = jsonStr(p, e, &LoraDown->datr, NULL);
+			}
+			else if (strcmp(key, "codr") == 0) {
+				p = jsonStr(p, e, &LoraDown->codr, NULL);
+			}
+			else if (strcmp(key, "modu") == 0) {
+				p = jsonStr(p, e, &LoraDown->modu, NULL);
+			}
+			else if (strcmp(key, "time") == 0) {
+				p = jsonStr(p, e, &tx->time, NULL);
+			}
+			else if (strcmp(key, "powe") == 0) {
+				p = jsonUint(p, e, &v, 0);
+				LoraDown->powe = (v > 0xFF ? 0xFF : v);
+			}
+			else if (strcmp(key, "prea") == 0) {
+				p = jsonUint(p, e, &v, 0);
+				LoraDown->prea = (v > 0xFF ? 0xFF : v);
+			}
+			else if (strcmp(key, "rfch") == 0) {
+				p = jsonUint(p, e, &v, 0);
+				LoraDown->rfch = (v > 0xFF ? 0xFF : v);
+			}
+			else if (strcmp(key, "ipol") == 0) {
+				p = jsonBool(p, e, &b);
+				LoraDown->ipol = b;
+			}
+			else if (strcmp(key, "imme") == 0) {
+				p = jsonBool(p, e, &b);
+				LoraDown->imme = b;
+			}
+			else if (strcmp(key, "ncrc") == 0) {
+				p = jsonBool(p, e, &b);
+				LoraDown->ncrc = b;
+			}
+			else {
+				p = jsonSkip(p, e);
+			}
+			if (p == NULL) return(-1);
+		}
+		if (r < 0) return(-1);
+		found = true;
+	}
+	if ((r < 0) || !found || (tx->data == NULL)) return(-1);
+
+	// datr is "SF7BW125" to "SF12BW500" for LoRa, only 125, 250 and 500 kHz
+	if ((LoraDown->datr == NULL) || (strncmp(LoraDown->datr, "SF", 2) != 0)) return(-1);
+	LoraDown->sf = atoi(LoraDown->datr+2);
+	const char *bw = strstr(LoraDown->datr, "BW");
+	if ((bw == NULL) || (LoraDown->sf < 6) || (LoraDown->sf > 12)) return(-1);
+	LoraDown->bw = atoi(bw+2);
+	if ((LoraDown->bw != 125) && (LoraDown->bw != 250) && (LoraDown->bw != 500)) return(-1);
+
+	// codr is "4/5" to "4/8", 4/5 when not given
+	LoraDown->cr = 1;
+	if (LoraDown->codr != NULL) {
+		const char *c = LoraDown->codr;
+		if ((c[0] != '4') || (c[1] != '/') || (c[2] < '5') || (c[2] > '8') || (c[3] != 0)) return(-1);
+		LoraDown->cr = c[2] - '4';
+	}
+
+	return(0);
+}
+
+
 // ------------------------------- DOWN ----------------------------------------
 // SENDPACKET()
 // Prepare DOWN a LoRa packet in down buffer. This function does all the 
@@ -32,7 +274,7 @@
 //
 // Parameters:
 //	char * buf			Total buffer including first 4 bytes that need skip
-//	uint8_t len;		Length of the buf unsigned 0-255 bytes, including first four bytes
+//	uint16_t len;		Length of the buf, including first four bytes
 //
 //	buf[0]	Version number (== _PROTOCOL)
 //	buf[1]	Token LSB: If Protocol version==1, make 0. If version==2 arbitrary?
@@ -42,7 +284,7 @@
 // Return:
 //	Int = 1 when success
 // ----------------------------------------------------------------------------
-int sendPacket(uint8_t *buf, uint8_t len) 
+int sendPacket(uint8_t *buf, uint16_t len) 
 {
 	// Received from server with Meta Data (for example):
 	//
@@ -88,10 +330,10 @@ int sendPacket(uint8_t *buf, uint8_t len)
 	}
 #	endif //_MONITOR
 
-	// Use JSON to decode the string after the first 4 bytes.
-	// The data for the node is in the "data" field. This function destroys original buffer
-	auto error = deserializeJson(jsonBuffer, bufPtr);		
-	if (error) {
+	// Decode the txpk JSON after the first 4 bytes with txpkParse().
+	// The data for the node is in the "data" field. This function changes the original buffer
+	struct txpk tx;
+	if ((len < 4) || (txpkParse(bufPtr, len-4, &LoraDown, &tx) < 0)) {
 #		if _MONITOR>=1
 		if ((debug>=0) && (pdebug & P_TX)) {
 			mPrint("v sendPacket:: ERROR: Json Decode: " + String(bufPtr) );
@@ -105,37 +347,28 @@ int sendPacket(uint8_t *buf, uint8_t len)
 	// {"txpk":{"codr":"4/5","data":"YCkEAgIABQABGmIwYX/kSn4Y","freq":868.1,"ipol":true,"modu":"LORA","powe":14,"rfch":0,"size":18,"tmst":1890991792,"datr":"SF7BW125"}}
 	// Used in the protocol of Gateway:
 
-	JsonObject root		= jsonBuffer.as<JsonObject>();	// 191111 Avoid Crashes
-
-	LoraDown.tmst		= (uint32_t) root["txpk"]["tmst"].as<unsigned long>();
-	const char * data	= root["txpk"]["data"];			// Downstream Payload
-	uint8_t psize		= root["txpk"]["size"];			// Payload size
-
-	const char * datr	= root["txpk"]["datr"];			// eg "SF7BW125"
-	const char * codr	= root["txpk"]["codr"];			// "4/5"
-	const char * modu	= root["txpk"]["modu"];
-	const char * time	= root["txpk"]["time"];			// Time is a string in UTC
+	char * data			= tx.data;						// Downstream Payload
+	uint16_t psize		= tx.size;						// Payload size
+	const char * time	= tx.time;						// Time is a string in UTC
 	
-	LoraDown.modu		= (char *) modu;				// =="LORA"
-	LoraDown.codr		= (char *) codr;				// e.g. "4/5"
-	
-	LoraDown.ipol		= root["txpk"]["ipol"];			// =0x01 for downlink
-
-	LoraDown.imme 		= root["txpk"]["imme"];			// Immediate Transmit (tmst don't care)
-	LoraDown.powe		= root["txpk"]["powe"];			// power, e.g. 14 or 27
-	LoraDown.prea		= root["txpk"]["prea"];
-	LoraDown.ncrc		= root["txpk"]["ncrc"];			// Cancel CRC for outgoing packets
-	LoraDown.rfch		= root["txpk"]["rfch"];			// ==0X00 first antenna
 	LoraDown.iiq 		= (LoraDown.ipol==true ? 0x40: 0x27);	// 210116 changed
 	LoraDown.crc		= 0x00;							// switch CRC off for TX
 
-	LoraDown.sf 		= atoi(datr+2);					// Convert "SF9BW125" or what is received from gateway to number
-	int j; for (j=3; *(datr+j)!='W'; j++); 
-	LoraDown.bw 		= atoi(datr+j+1);
-	
-	LoraDown.size		= base64_dec_len((char *) data, strlen(data));	// Length of the Payload data	
-	base64_decode((char *) payLoad, (char *) data, strlen(data));		// Fill payload w decoded message
-	LoraDown.payLoad	= payLoad;
+	// The payload stays base64 until sendPkt() decodes it into the radio FIFO,
+	// it must fit in one LoRa frame. Only the header is decoded in payLoad[]
+	int dlen = base64_dec_len(data, tx.dataLen);
+	if ((tx.dataLen > TX_B64_LEN) || (dlen <= 0) || (dlen > TX_MAX_SIZE)) {
+#		if _MONITOR>=1
+		if ((debug>=0) && (pdebug & P_TX)) {
+			mPrint("v sendPacket:: ERROR: payload size=" + String(dlen));
+		}
+#		endif //_MONITOR
+		return(-1);
+	}
+	LoraDown.size		= dlen;							// Length of the Payload data	
+	LoraDown.b64		= data;
+	LoraDown.b64Len		= tx.dataLen;
+	txHeader(&LoraDown);								// Decode the first bytes in payLoad
 
 	// Do some checks on the data received above
 
@@ -160,7 +393,7 @@ int sendPacket(uint8_t *buf, uint8_t len)
 		String response = "v (" ;
 		response += String(LoraDown.size);
 		response += "): " ;
-		for (j=0; j<LoraDown.size; j++) {
+		for (int j=0; (j<LoraDown.size) && (j<TX_HDR); j++) {
 			printHexDigit(LoraDown.payLoad[j], response);
 			response += " ";
 		}
@@ -251,7 +484,7 @@ int sendPacket(uint8_t *buf, uint8_t len)
 	if (data != NULL) {									// There is data!
 #		if _MONITOR>=1
 		if ((debug>=2) && (pdebug & P_TX)) { 
-			mPrint("v sendPacket:: LoraDown.size="+String(LoraDown.size)+", psize="+String(psize)+", strlen(data)="+String(strlen(data))+", data=" + String(data)); 
+			mPrint("v sendPacket:: LoraDown.size="+String(LoraDown.size)+", psize="+String(psize)+", strlen(data)="+String(tx.dataLen)+", data=" + String(data)); 
 		}
 #		endif //_MONITOR
 	}
@@ -275,10 +508,8 @@ int sendPacket(uint8_t *buf, uint8_t len)
 	// than for gateways.
 	// In this case we will probably answer in RX with RF==12 and use special answer frequency
 	//
-	LoraDown.powe	= root["txpk"]["powe"];				// The server determines the power
-	const float ff	= root["txpk"]["freq"];				// eg 868.1 (RX1) or 869.525 (RX2)
-	//mPrint("v sendPacket:: _STRICT_1CH==0, json freq="+String(ff));
-	// convert double frequency (MHz) into uint32_t frequency in Hz.
+	// The server determines the power, LoraDown.powe. The requested frequency
+	// tx.freq (868.1 (RX1) or 869.525 (RX2)) is not used.
 	LoraDown.freq	= (uint32_t) freqs[gwayConfig.ch].dwnFreq;
 	//mPrint("v sendPacket:: _STRICT_1CH==0, down freq="+String(LoraDown.freq));
 
@@ -311,7 +542,7 @@ int sendPacket(uint8_t *buf, uint8_t len)
 	// And Server is also capable of transmitting on more channels.
 	// So, not change to SF (arranged by server) or frequency, as long as it is RX1 or RX2.
 
-	uint32_t fff	= (uint32_t)(root["txpk"]["freq"].as<double>() * 1000000);
+	uint32_t fff	= tx.freq;							// Requested frequency in Hz
 	
 	if (abs(freqs[gwayConfig.ch].dwnFreq - fff) < 100000) {
 		LoraDown.freq = (uint32_t) (freqs[gwayConfig.ch].dwnFreq) & 0xFFFFFFFF ;
@@ -349,170 +580,446 @@ int sendPacket(uint8_t *buf, uint8_t len)
 
 	// Update downstream statistics
 	statc.msg_down++;
-	switch(statr[0].ch) {
-		case 0: statc.msg_down_0++; break;
-		case 1: statc.msg_down_1++; break;
-		case 2: statc.msg_down_2++; break;
-	}
+	statc.msg_down_ch[gwayConfig.ch]++;
 
 	// All data is in Payload and parameters and need to be transmitted.
-	// The function is called in user-space
-	_state = S_TX;										// _state set to transmit
+	// The function is called in user-space, txAdmit() will queue the message
+	// and txDispatch() sets _state to S_TX when transmitting.
 
 	return 1;
 	
 } //sendPacket DOWN
 
 
+// ------------------------------- DOWN ----------------------------------------
+// txHeader()
+// Decode the first TX_HDR bytes of the base64 payload of LoraDown in payLoad[].
+// That is enough for the MHDR, FHDR, FPort and the FRMPayload kept in statr,
+// the whole payload is decoded by sendPkt() straight into the radio FIFO.
+//
+// Parameters:
+//	LoraDown:	The message with b64 set, its payLoad is set to payLoad[]
+// ----------------------------------------------------------------------------
+void txHeader(struct LoraDown *LoraDown)
+{
+	uint16_t len = LoraDown->b64Len;
+	if (len > (TX_HDR/3)*4) len = (TX_HDR/3)*4;
+
+	memset(payLoad, 0, sizeof(payLoad));
+	base64_decode((char *) payLoad, (char *) LoraDown->b64, len);
+	LoraDown->payLoad = payLoad;
+}
+
+
+// ------------------------------- DOWN ----------------------------------------
+// txAdmit()
+// Put the message decoded by sendPacket() in the txQueue. The queue is sorted
+// on transmit time so txQueue[0] is always the first message to transmit.
+// A message is refused when its time has passed, when it is more than
+// TX_MAXWAIT in the future, when it overlaps with a message already queued,
+// or when the queue is full.
+//
+// Parameters:
+//	LoraDown:	The decoded message, its base64 payload is copied
+//	buf:		The PULL_RESP buffer, first 3 bytes are used for TX_ACK
+//
+// Return:
+//	The position in txQueue when success, -1 when message refused
+// ----------------------------------------------------------------------------
+int txAdmit(struct LoraDown *LoraDown, uint8_t *buf)
+{
+	uint32_t nowTime = micros();
+	int32_t wait = (int32_t)(LoraDown->tmst - nowTime);
+	uint32_t air = airTime(LoraDown->sf, LoraDown->bw, LoraDown->size, LoraDown->crc, LoraDown->cr, LoraDown->prea);
+	String err = "";
+	
+	if (LoraDown->imme == 1) {
+		wait = 0;
+	}
+	else if (wait > TX_MAXWAIT) {
+		txStat.early++;
+		err = "too early";
+	}
+	else if ((wait + gwayConfig.txDelay) < -1000) {
+		txStat.late++;
+		gwayConfig.waitErr++;
+		err = "too late";
+	}
+	
+	if ((err == "") && (txCnt >= _TXQUEUE)) {
+		txStat.full++;
+		err = "queue full";
+	}
+
+	// Find the place in the queue, and check that we do not overlap
+	// with the message before or after us
+	int i = 0;
+	if (err == "") {
+		while ((i < txCnt) && ((int32_t)(txQueue[i].dwn.tmst - nowTime) <= wait)) i++;
+		
+		if (i > 0) {
+			struct LoraDown *p = &txQueue[i-1].dwn;
+			if ((int32_t)(p->tmst - nowTime) + (int32_t)airTime(p->sf, p->bw, p->size, p->crc, p->cr, p->prea) > wait) {
+				err = "collision";
+			}
+		}
+		if ((i < txCnt) && (wait + (int32_t)air > (int32_t)(txQueue[i].dwn.tmst - nowTime))) {
+			err = "collision";
+		}
+		if (err != "") txStat.collide++;
+	}
+
+	if (err != "") {
+#		if _MONITOR>=1
+		if ((debug>=0) && (pdebug & P_TX)) {
+			String response = "v txAdmit:: ERROR " + err + ": ";
+			printDwn(LoraDown, response);
+			mPrint(response);
+		}
+#		endif //_MONITOR
+		return(-1);
+	}
+
+	// Make room at position i and copy the message
+	for (int j=txCnt; j>i; j--) txQueue[j] = txQueue[j-1];
+	
+	txQueue[i].dwn = *LoraDown;
+	txQueue[i].dwn.payLoad = NULL;
+	txQueue[i].dwn.b64 = NULL;
+	if (LoraDown->imme == 1) txQueue[i].dwn.tmst = nowTime;		// For sorting only
+	memcpy(txQueue[i].b64, LoraDown->b64, LoraDown->b64Len);
+	memcpy(txQueue[i].ack, buf, 3);
+	txCnt++;
+	txStat.admit++;
+
+#	if _MONITOR>=1
+	if ((debug>=2) && (pdebug & P_TX)) {
+		mPrint("v txAdmit:: pos=" + String(i) + ", cnt=" + String(txCnt) + ", wait=" + String(wait) + ", air=" + String(air));
+	}
+#	endif //_MONITOR
+
+	return(i);
+} // txAdmit
+
+
+// ------------------------------- DOWN ----------------------------------------
+// txDispatch()
+// Called by loop(). If the first message in txQueue is due (less than TX_LEAD
+// before tmst), stage it with txLoraModem(), let txArm() start it at tmst and
+// report the message in statr. As long as it is not due we return immediately 
+// so that receiving, web and UDP processing go on while waiting.
+// Messages that have passed their time are removed from txQueue. A message
+// that txLoraModem() cannot load in the FIFO is removed and counted in
+// txStat.fail, it is not armed and the receiver is restarted.
+//
+// Return:
+//	1 when a transmission was started, 0 otherwise
+// ----------------------------------------------------------------------------
+int txDispatch()
+{
+	// Wait for the previous transmission to finish
+	if ((txCnt == 0) || (_state == S_TX) || (_state == S_TXDONE)) {
+		return(0);
+	}
+
+	int res = loraWait(&txQueue[0].dwn);
+	if (res == 0) {
+		return(0);												// Not due yet
+	}
+
+	// Make the message the current LoraDown. Its payload is decoded from
+	// txQueue[0].b64 into the FIFO, so the entry is removed after txLoraModem()
+	LoraDown = txQueue[0].dwn;
+	LoraDown.b64 = txQueue[0].b64;
+	memcpy(txAck, txQueue[0].ack, 3);
+
+	if (res > 0) {
+		txHeader(&LoraDown);
+
+		// Stage the transmission of the buffer and start it at tmst
+		// (We normally react on ALL interrupts if we are in TX state)
+		sendTime = micros();									// record when we started sending the message
+		if (txLoraModem(&LoraDown)) {							// Transfer. Calls sendPkt() in turn
+			txArm(LoraDown.imme == 1 ? micros() : LoraDown.tmst + gwayConfig.txDelay, &LoraDown);
+		}
+		else {
+			res = -2;											// FIFO not loaded, do not transmit
+		}
+	}
+	LoraDown.b64 = NULL;
+
+	txCnt--;
+	for (int j=0; j<txCnt; j++) txQueue[j] = txQueue[j+1];
+
+	if (res == -2) {
+		txStat.fail++;											// Dropped, sendPkt() failed
+		startReceiver();
+		return(0);
+	}
+	if (res < 0) {
+		txStat.late++;											// Dropped, too late
+		return(0);
+	}
+
+	// Make room for the new entry in the message history
+	struct stat_t *sr = statNew();
+	sr->time	= now();
+	sr->ch		= gwayConfig.ch;
+	sr->sf		= LoraDown.sf;
+	sr->upDown	= 1;							// Down
+	sr->node	= ( 
+			LoraDown.payLoad[1]<<24 | 
+			LoraDown.payLoad[2]<<16 | 
+			LoraDown.payLoad[3]<<8  | 
+			LoraDown.payLoad[4] 
+	);
+	
+	// If transmission is finished, print statistics
+#	if _MONITOR>=1
+
+		// Decode Physical Payload: para 4.3.1 of Lora 1.1 Spec
+		// MHDR
+		//	1 byte			Payload[0]
+		// FHDR
+		// 	4 byte Dev Addr Payload[1-4]
+		// 	1 byte FCtrl  	Payload[5]
+		// 	2 bytes FCnt	Payload[6-7]				
+		// 		= Optional 0 to 15 bytes Options
+		// FPort
+		//	1 bytes, 0x00	Payload[8]
+		// ------------
+		// +=9 BYTES HEADER
+		//
+		// FRMPayload
+		//	N bytes			(base64 Payload)
+		//
+		// 4 bytes MIC trailer
+		
+#	  if _LOCALSERVER>=2				
+		uint8_t DevAddr[4];
+		int index;
+
+		// If not found, the address is NOT wellknown
+		if ((index = inDecodes((char *)(LoraDown.payLoad+1))) >= 0 ) {
+			// fcnt has to be defined earlier
+			LoraDown.fcnt= LoraDown.payLoad[7]<<8 | LoraDown.payLoad[6]; // MMM first removed now put back
+
+			// Only if _LOCALSERVER >= 2 for downstream. The FRMPayload is kept
+			// encrypted, statData() decrypts it when it is shown.
+			if (LoraDown.size > 9+4) {
+				sr->datal = LoraDown.size -9 -4;
+				if (sr->datal > sizeof(sr->data)) sr->datal = sizeof(sr->data);
+				memcpy(sr->data, LoraDown.payLoad+9, sr->datal);
+			}
+			sr->fcnt	= LoraDown.fcnt;
+			sr->decode	= index;
+
+			if ((LoraDown.size-9-4<=0) || (LoraDown.size-9-4>=30)) {
+
+#				if _MONITOR>=1
+				if (debug>=1) {
+					mPrint("PULL_RESP:: WARNING size="+String(LoraDown.size-9-4));
+				}
+#				endif						
+			}
+			else {
+				//mPrint("PULL_RESP:: OK");
+			}
+
+			DevAddr[0]= LoraDown.payLoad[4];
+			DevAddr[1]= LoraDown.payLoad[3];
+			DevAddr[2]= LoraDown.payLoad[2];
+			DevAddr[3]= LoraDown.payLoad[1];
+		}
+		else {
+#			if _MONITOR >= 1
+			if ((debug>=1) && (pdebug & P_MAIN)) {
+				String response ="v PULL_RESP:: index inDecodes not found, Addr=";
+				response+=
+					String(LoraDown.payLoad[4],HEX) + " " +
+					String(LoraDown.payLoad[3],HEX) + " " +
+					String(LoraDown.payLoad[2],HEX) + " " +
+					String(LoraDown.payLoad[1],HEX);
+				mPrint(response);
+			}
+#			endif //_MONITOR
+		}
+#	  elif _LOCALSERVER==1
+		// If we should not print data for downlink
+		sr->datal = 0;
+#	  else
+		// mPrint("PULL_RESP:: _LOCALSERVER <= 1");
+#	  endif //_LOCALSERVER
+
+	// If _MONITOR set print the statistics
+	if ((debug>=1) && (pdebug & P_TX)) {
+
+		String response = "v txLoraModem hi:: ";
+		printDwn(&LoraDown, response);
+		
+		response += " datal=" + String(sr->datal);
+		response += " data= [ ";
+		for (int i=0; i< sr->datal; i++) {
+			response += String(sr->data[i], HEX) + " ";
+		}
+		response += "]";
+		mPrint(response);
+	
+		yield();
+		
+		response = "v txLoraModem lo:: ";								// Get from byte data if possible
+
+#		if _LOCALSERVER>=2
+
+			if (sr->datal>24) {									// Size is too large
+				mPrint("readUDP:: ERROR: statr.datal larger than 24");
+				response+= ", sr->datal=" + String(sr->datal);
+				sr->datal=24;
+			}
+			
+			response+= "data=[ " ; 
+			
+			if ((sr->datal < 0) || (sr->datal > 24)) {
+				mPrint("ERROR datal<0");
+				sr->datal=0;
+			}
+			else for (int i=0; i<sr->datal; i++) {
+				response += String(statData(sr)[i],HEX) + " ";
+			}
+			
+			response += "], addr=";
+			printHex((IPAddress)DevAddr, ':', response);
+			
+			response += ", d_fcnt=" + String(LoraDown.fcnt);
+#		endif //_LOCALSERVER
+
+		response += ", size=" + String(LoraDown.size);
+		
+		response += ", old=[ ";
+		for(int i=0; (i<LoraDown.size) && (i<TX_HDR); i++) {
+			printHexDigit(LoraDown.payLoad[i],response);
+			response += " ";
+		}
+		response += "]";
+		
+		mPrint(response);
+	}
+
+#	endif //_MONITOR
+
+	addSeen(listSeen, *sr);
+	
+#	if RSSI>=1
+		sr->rssi	= _rssi - rssicorr;
+#	endif // RSSI
+
+	//LoraDown.fcnt++;								// 210219 Increase outgoining frameCount
+	
+	// After filling the buffer we only react on TXDONE interrupt
+	// So, more or less start at the "case TXDONE:"  
+	txDones=0;
+	_state=S_TXDONE;
+	_event=1;
+
+	return(1);
+} // txDispatch
+
+
+
 
 
 // --------------------------------- UP ---------------------------------------
 // buildPacket()
 // Based on the information read from the LoRa transceiver (or fake message)
-// build a gateway message to send upstream (to the user somewhere on the web).
-//
-// buildPacket() will send PUSH_DATA to the server.
+// do the bookkeeping of an upstream message: statistics, monitor, Oled
+// and the listSeen. The rxpk JSON itself is not built here anymore but is
+// streamed by writeRxpk() straight into the UDP packet (or logfile), so no
+// intermediate buffer on the stack is needed.
 //
 // parameters:
-// 	tmst:		Timestamp to include in the upstream message
-// 	buff_up:	The buffer that is generated for upstream for the server
 //	LoraUp:		ptr to Structure describing the message received from device
 // 	internal:	Boolean value to indicate whether the local sensor is processed
 //
 // returns:
-//	buff_index:
+//	Size of the message, -1 when the MIC is wrong (_CHECK_MIC)
 // ----------------------------------------------------------------------------
-int buildPacket(uint8_t *buff_up, struct LoraUp *LoraUp, bool internal) 
+int buildPacket(struct LoraUp *LoraUp, bool internal) 
 {
 	int32_t SNR;
     int16_t rssicorr;
 	int16_t prssi;										// packet rssi
 	
-	char cfreq[12] = {0};								// Character array to hold freq in MHz
-	uint16_t buff_index=0;
-	char b64[256];
-	
 	uint8_t *message = LoraUp->payLoad;
-	char messageLength = LoraUp->size;
+	uint8_t messageLength = LoraUp->size;
 		
 #	if _CHECK_MIC==1
-		unsigned char NwkSKey[16] = _NWKSKEY;
-		checkMic(message, messageLength, NwkSKey);
+	if ((!internal) && (checkMic(message, messageLength) == 0)) {
+		rxPipe.micErrs++;								// Not forwarded
+		return(-1);
+	}
 #	endif //_CHECK_MIC
 
 	// Read SNR and RSSI from the register. Note: Not for internal sensors!
 	// For internal sensor we fake these values as we cannot read a register
 	if (internal) {
-		SNR = 12;
-		prssi = 50;
-		rssicorr = 157;
+		LoraUp->snr = 12;
+		LoraUp->prssi = 50;
+		LoraUp->rssicorr = 157;
 	}
-	else {
-		SNR = LoraUp->snr;
-		prssi = LoraUp->prssi;								// read register 0x1A, packet rssi
-		rssicorr = LoraUp->rssicorr;
+	SNR = LoraUp->snr;
+	prssi = LoraUp->prssi;								// read register 0x1A, packet rssi
+	rssicorr = LoraUp->rssicorr;
+
+	if ((LoraUp->sf<6) || (LoraUp->sf>12)) { 			// Lora datarate & bandwidth SF6-SF12
+		LoraUp->sf=7;
 	}
+	LoraUp->tmst = LoraUp->tmst + _RXDELAY1; 			// micros() of RXDONE, correct timing with defined number,
+														// https://github.com/TheThingsNetwork/lorawan-stack/issues/277
 
 #if _STATISTICS >= 1
-	// push down all members of statr and make a new statr[0] member.
-	// Receive statistics, move old statistics down 1 position
-	// and fill the new top line with the latest received sensor values.
+	// Make a new newest member of the statr ring buffer, statRec(0), and
+	// fill it with the latest received sensor values.
 	// This works fine for the sensor, EXCEPT when we decode data for _LOCALSERVER
 	//
-	for (int m=( gwayConfig.maxStat -1); m>0; m--) statr[m]= statr[m-1];
+	struct stat_t *sr = statNew();
 	
-	// From now on we can fill statr[0] with sensor data
+	// From now on we can fill sr with sensor data
 #	if _LOCALSERVER>=1
-	statr[0].datal=0;
+	sr->datal=0;
 	int index;
 	if ((index = inDecodes((char *)(LoraUp->payLoad+1))) >=0 ) {
 
 		//LoraUp->fcnt=LoraUp->payLoad[7]*256 + LoraUp->payLoad[6];
 		LoraUp->fcnt=LoraUp->payLoad[7]<<8 | LoraUp->payLoad[6];
 		
-		for (int k=0; (k<LoraUp->size) && (k<23); k++) {
-			statr[0].data[k] = LoraUp->payLoad[k+9];
-		};
-		
-		// XXX Check that k<23 when leaving the for loop
-		// XXX or we can not display in statr
-		
-		uint8_t DevAddr[4]; 
-		DevAddr[0]= LoraUp->payLoad[4];
-		DevAddr[1]= LoraUp->payLoad[3];
-		DevAddr[2]= LoraUp->payLoad[2];
-		DevAddr[3]= LoraUp->payLoad[1];
-
-		statr[0].datal = encodePacket(							// actualy, decodePacket
-								(uint8_t *)(statr[0].data), 
-								LoraUp->size -9 -4, 
-								(uint16_t)LoraUp->fcnt, 
-								DevAddr, 
-								decodes[index].appKey, 
-								0);
+		// Keep the (first 24 bytes of the) FRMPayload encrypted, statData()
+		// decrypts it only when it is shown.
+		if (LoraUp->size > 9+4) {
+			sr->datal = LoraUp->size -9 -4;
+			if (sr->datal > sizeof(sr->data)) sr->datal = sizeof(sr->data);
+			memcpy(sr->data, LoraUp->payLoad+9, sr->datal);
+		}
+		sr->fcnt	= LoraUp->fcnt;
+		sr->decode	= index;
 	}
 #	endif //_LOCALSERVER
 
-	statr[0].time	= now();							// Not a real timestamp. but the current time
-	statr[0].ch		= gwayConfig.ch;					// Lora Channel
-	statr[0].prssi	= prssi - rssicorr;
-	statr[0].sf		= LoraUp->sf;						// spreading factor
-	statr[0].upDown = 0;								// Uplink
-	statr[0].node	= ( message[1]<<24 | message[2]<<16 | message[3]<<8 | message[4] );	
+	sr->time	= now();							// Not a real timestamp. but the current time
+	sr->ch		= LoraUp->chan;						// Lora Channel, at time of receive
+	sr->prssi	= prssi - rssicorr;
+	sr->snr		= SNR;
+	sr->sf		= LoraUp->sf;						// spreading factor
+	sr->upDown = 0;								// Uplink
+	sr->node	= ( message[1]<<24 | message[2]<<16 | message[3]<<8 | message[4] );	
 #	if RSSI==1
-	statr[0].rssi	= _rssi - rssicorr;
+	sr->rssi	= _rssi - rssicorr;
 #	endif // RSSI
 
-#	if _STATISTICS >= 2
 	// Fill in the statistics that we will also need for the GUI.
-	// So 
-	switch (statr[0].sf) {
-		case SF7:  statc.sf7++;  break;
-		case SF8:  statc.sf8++;  break;
-		case SF9:  statc.sf9++;  break;
-		case SF10: statc.sf10++; break;
-		case SF11: statc.sf11++; break;
-		case SF12: statc.sf12++; break;
-	}
-#	endif //_STATISTICS >= 2
-
-#	if _STATISTICS >= 3
-	if (statr[0].ch == 0) {
-		statc.msg_ttl_0++;								// Increase #message received channel 0
-		switch (statr[0].sf) {
-			case SF7:  statc.sf7_0++;  break;
-			case SF8:  statc.sf8_0++;  break;
-			case SF9:  statc.sf9_0++;  break;
-			case SF10: statc.sf10_0++; break;
-			case SF11: statc.sf11_0++; break;
-			case SF12: statc.sf12_0++; break;
-		}
+	if (sr->ch < STAT_CH) {
+		statc.msg_ttl_ch[sr->ch]++;						// Increase #message received on channel
+		if ((sr->sf >= SF7) && (sr->sf <= SF12)) statc.sf[sr->ch][sr->sf - SF7]++;
 	}
-	else 
-	if (statr[0].ch == 1) {
-		statc.msg_ttl_1++;
-		switch (statr[0].sf) {
-			case SF7:  statc.sf7_1++;  break;
-			case SF8:  statc.sf8_1++;  break;
-			case SF9:  statc.sf9_1++;  break;
-			case SF10: statc.sf10_1++; break;
-			case SF11: statc.sf11_1++; break;
-			case SF12: statc.sf12_1++; break;
-		}
-	}
-	else 
-	if (statr[0].ch == 2) {
-		statc.msg_ttl_2++;
-		switch (statr[0].sf) {
-			case SF7:  statc.sf7_2++;  break;
-			case SF8:  statc.sf8_2++;  break;
-			case SF9:  statc.sf9_2++;  break;
-			case SF10: statc.sf10_2++; break;
-			case SF11: statc.sf11_2++; break;
-			case SF12: statc.sf12_2++; break;
-		}
-	}
-#	endif //_STATISTICS>=3
 
 #endif //_STATISTICS>=1
 
@@ -567,224 +1074,357 @@ int buildPacket(uint8_t *buff_up, struct LoraUp *LoraUp, bool internal)
 
 #	endif //_OLED>=1
 
+	// When we have the node address and the SF, fill the listSeen array
+	// with the required data. _MAXSEEN must be >0 for this to happen.
+	// statBegin() is the record of the node last seen.
+#	if  _MAXSEEN>=1
+		struct stat_t *last = statBegin();
+		if (last != NULL) addSeen(listSeen, *last);
+#	endif //_MAXSEEN
 
-	// XXX Base64 library is no-pad. So we may have to add padding characters until
-	// 	message Length is multiple of 4!
-	// Encode message with messageLength into b64
-	int encodedLen = base64_enc_len(messageLength);		// max 341
-
-#	if _MONITOR>=1
-	if ((debug>=1) && (encodedLen>255) && (pdebug & P_RADIO)) {
-		mPrint("R buildPacket:: b64 err, len=" + String(encodedLen));
-		return(-1);
-	}
-#	endif //_MONITOR
+#	if _STAT_LOG==1	
+		// Do statistics logging. In first version we might only
+		// write part of the record to files, later more
+		addLog(LoraUp);
+#	endif //_STAT_LOG
 
-	base64_encode(b64, (char *) message, messageLength);// max 341
-	// start composing datagram with the header
-	
-	uint8_t token_h = (uint8_t)rand(); 					// random token
-	uint8_t token_l = (uint8_t)rand(); 					// random token
-	
-	// pre-fill the data buffer with fixed fields
-	// There are several types of messages that can be sent Up, but here PUSH_DATA is used:
-	//	PUSH_DATA,		0x00, Up,	Send data from gateway to server done in this function, random token
-	//	PUSH_ACK,		0x01, Down,	Ack to Gateway, use token of PUSH_DATA
-	//	PULL_DATA,		0x02, Up,	Send to server using a random token
-	//	PULL_ACK,		0x04, Down, Ack to Gateway use token of PULL_DATA
-	//	PULL_RESP,		0x03, Down, handled by sendPacket(), use token of last PULL_ACK
-	//	TX_ACK,			0x05, Up,	handled by sendPacket() in response when protocol>=2
-
-	// PUSH DATA, see para. 5.2.1 of Semtech Gateway to Server Interface document
-	// 	Mind that we only PUSH here
-	buff_up[0] = protocol;								// 0x01 or 0x02
-	buff_up[1] = (uint8_t)token_h;						// Arbitrary token
-	buff_up[2] = (uint8_t)token_l;
-	buff_up[3] = PUSH_DATA;								// 0x00
-	
-	// READ MAC ADDRESS OF ESP8266, and insert 0xFF 0xFF in the middle
-	buff_up[4]  = MAC_array[0];
-	buff_up[5]  = MAC_array[1];
-	buff_up[6]  = MAC_array[2];
-	buff_up[7]  = 0xFF;
-	buff_up[8]  = 0xFF;
-	buff_up[9]  = MAC_array[3];
-	buff_up[10] = MAC_array[4];
-	buff_up[11] = MAC_array[5];
-
-	buff_index	= 12; 									// 12-byte binary (!) header
-	
-	// start of JSON structure that will make payload
-	//memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":{", 9); buff_index += 9;	// Does not work with TTN
-	memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[{", 10); buff_index += 10;
+	//rstTime = now();								// 200930 MMM
+	return(LoraUp->size);
 	
-// More versions are defined for the moment, in order to keep timing as low as [possible. 
-// The serializeJson() version hopefully is quicker
+}// buildPacket()
 
-#ifdef _JSONENCODE
-//------------------
-	StaticJsonDocument<400> doc;
-	
-	//doc["time"] = ""+now();
 
-	doc["chan"] = "" + gwayConfig.ch;				// This could be any defined channel
-	doc["rfch"] = "0";								// First Antenna
-	doc["freq"] = "" + (freqs[gwayConfig.ch].upFreq / 1000000);
-	doc["stat"] = "1";								// Always OK for CRC
-	doc["modu"] = "LORA";
-	doc["datr"] = "SF" + String(LoraUp->sf) + "BW" + String(freqs[gwayConfig.ch].upBW);
-	doc["rssi"] = "" +(prssi-rssicorr);
-	doc["lsnr"] = "" +(long)SNR;
-	doc["codr"] = "4/5";							// MMM needs to be dynamic
-	//doc["ipol"] = "false";						// For UP not needed
+// --------------------------------- UP ---------------------------------------
+// writeRxpk()
+// Stream the PUSH_DATA message for the cnt messages in LoraUp[] to out, which
+// is the UDP packet of the server or the logfile. Every message is one object
+// of the rxpk array. Fixed parts are written as literals,
+// the frequency as a string made once per channel and the payload is base64
+// encoded in chunks of 24 bytes, so no JSON buffer is needed.
+//
+// There are several types of messages that can be sent Up, but here PUSH_DATA is used:
+//	PUSH_DATA,		0x00, Up,	Send data from gateway to server done in this function, random token
+//	PUSH_ACK,		0x01, Down,	Ack to Gateway, use token of PUSH_DATA
+//	PULL_DATA,		0x02, Up,	Send to server using a random token
+//	PULL_ACK,		0x04, Down, Ack to Gateway use token of PULL_DATA
+//	PULL_RESP,		0x03, Down, handled by sendPacket(), use token of last PULL_ACK
+//	TX_ACK,			0x05, Up,	handled by sendPacket() in response when protocol>=2
+//
+// parameters:
+//	out:		The Print object (Udp or File) to write to
+//	LoraUp:		ptr to the message(s), after buildPacket()
+//	cnt:		Number of messages in LoraUp[]
+//	header:		Write the 12-byte binary header too (not for the logfile)
+//
+// returns:
+//	Number of bytes written
+// ----------------------------------------------------------------------------
+#define OUT_LIT(s)	out.write((const uint8_t *)(s), sizeof(s)-1)
 
-	// Use gBase64 library to fill in the data string
-	encodedLen = base64_enc_len(messageLength);			// max 341	
-	doc["size"] = "" + encodedLen;
+int writeRxpk(Print &out, struct LoraUp *LoraUp, uint8_t cnt, bool header)
+{
+	static char rxpkFreq[sizeof(freqs)/sizeof(freqs[0])][12];	// "868.100000"
+	static bool init = false;
+	int len = 0;
+
+	if (!init) {
+		for (int i=0; i< (int)(sizeof(freqs)/sizeof(freqs[0])); i++) {
+			snprintf(rxpkFreq[i], sizeof(rxpkFreq[i]), "%lu.%06lu", 
+				(unsigned long)(freqs[i].upFreq / 1000000), 
+				(unsigned long)(freqs[i].upFreq % 1000000));
+		}
+		init = true;
+	}
 
-	int len= base64_encode(doc["data"], (char *)message, messageLength);
+	if (header) {
+		// PUSH DATA, see para. 5.2.1 of Semtech Gateway to Server Interface document
+		// READ MAC ADDRESS OF ESP8266, and insert 0xFF 0xFF in the middle
+		uint8_t hdr[12] = { 
+			(uint8_t)protocol, (uint8_t)rand(), (uint8_t)rand(), PUSH_DATA,
+			MAC_array[0], MAC_array[1], MAC_array[2], 0xFF, 0xFF,
+			MAC_array[3], MAC_array[4], MAC_array[5] 
+		};
+		len += out.write(hdr, 12);						// 12-byte binary (!) header
 
-	LoraUp->tmst = doc["tmst"] = "" + (uint32_t) micros() + _RXDELAY1;		// Tmst correction when necessary						
+#		if _MONITOR>=1
+		if ((debug>=1) && (pdebug & P_RX)) {
+			mPrint("^ PUSH_DATA:: token="+String(hdr[1]<<8 | hdr[2])+", cnt="+String(cnt)+", SF="+String(LoraUp->sf)+", size="+String(LoraUp->size)+", tmst="+String(LoraUp->tmst));
+		}
+#		endif //_MONITOR
+	}
 
-	// Write string inclusing first 12 chars to the buffer
-	const char	* p =  (const char *) & (buff_up [buff_index]);				// Start in buff where to put the serializedJson
-	int written = serializeJson(doc, (const char *)p, buff_index+20 );		// size is buff_index + encoded data + some closing chars
+	len += OUT_LIT("{\"rxpk\":[");
+	for (uint8_t m=0; m<cnt; m++, LoraUp++) {
+		if (m>0) len += OUT_LIT(",");
+
+		// MMM Make codr more dynamic, just like datr
+		len += OUT_LIT("{\"chan\":0,\"rfch\":0,\"freq\":");
+		len += out.print(rxpkFreq[LoraUp->chan]);
+		len += OUT_LIT(",\"stat\":1,\"modu\":\"LORA\",\"datr\":\"SF");
+		len += out.print(LoraUp->sf);
+		len += OUT_LIT("BW");
+		len += out.print(freqs[LoraUp->chan].upBW);
+		len += OUT_LIT("\",\"codr\":\"4/5\",\"lsnr\":");
+		len += out.print((long)LoraUp->snr);
+		len += OUT_LIT(",\"rssi\":");
+		len += out.print(LoraUp->prssi - LoraUp->rssicorr);
+		len += OUT_LIT(",\"size\":");
+		len += out.print(LoraUp->size);
+		len += OUT_LIT(",\"data\":\"");
+
+		// Use gBase64 library to fill in the data string, 24 bytes (32 chars) 
+		// at a time so that only the last chunk can contain padding.
+		char b64[33];
+		for (int i=0; i < LoraUp->size; i += 24) {
+			int n = LoraUp->size - i;
+			if (n > 24) n = 24;
+			int l = base64_encode(b64, (char *)(LoraUp->payLoad + i), n);
+			len += out.write((const uint8_t *)b64, l);
+		}
 
+		len += OUT_LIT("\",\"tmst\":");
+		len += out.print((unsigned long)LoraUp->tmst);
+		len += OUT_LIT("}");
+	}
+	len += OUT_LIT("]}");								// According to specs, this] can remove
 
-#else 
-// _JSONENCODE undefined, this is default
-// ---------------------------------------
-	ftoa((double)freqs[gwayConfig.ch].upFreq / 1000000, cfreq, 6);		// XXX This can be done better
-	if ((LoraUp->sf<6) || (LoraUp->sf>12)) { 							// Lora datarate & bandwidth SF6-SF12, 16-19 useful chars */
-		LoraUp->sf=7;
-	}			
+	return(len);
+}// writeRxpk()
 
-//	buff_index += snprintf((char *)(buff_up + buff_index), 
-//		RX_BUFF_SIZE-buff_index, 
-//		"%04d-%02d-%02d %02d:%02d:%02d CET", 
-//		year(),month(),day(),hour(),minute(),second());
 
-	buff_index += snprintf((char *)(buff_up + buff_index), 
-		RX_BUFF_SIZE-buff_index, 
-		"\"chan\":%1u,\"rfch\":%1u,\"freq\":%s,\"stat\":1,\"modu\":\"LORA\"" , 
-		0, 0, cfreq);
+// --------------------------------- UP ---------------------------------------
+// pushData()
+// Send the cnt messages in LoraUp[] in one PUSH_DATA datagram to the 
+// server(s), and count them for the mean batch size.
+//
+// returns:
+//	1 on success, -1 or -2 when sending to the first or second server failed
+// ----------------------------------------------------------------------------
+int pushData(struct LoraUp *LoraUp, uint8_t cnt)
+{
+	rxPipe.pushMsgs += cnt;
+	rxPipe.pushDgrams++;
+
+#if (_TRAFFIC>=1) && (_TRAFFIC_FWD==0)
+	// Synthetic traffic, make the rxpk but do not send it to the servers
+	writeRxpk(trafSink, LoraUp, cnt, true);
+	return(1);
+#endif //_TRAFFIC
+
+#if _GWAYSCAN==0
+#	ifdef _TTNSERVER	
+	// This is one of the potential problem areas.
+	// If possible, USB traffic should be left out of interrupt routines
+	// rxpk PUSH_DATA received from node is rxpk (*2, par. 3.2)
+	if (!sendRxpk(ttnServer, _TTNPORT, LoraUp, cnt)) {
+		return(-1);
+	}
+#	endif //_TTNSERVER
 
-	// MMM Make codr more dynamic, just like datr
-	buff_index += snprintf((char *)(buff_up + buff_index), RX_BUFF_SIZE-buff_index
-		, ",\"datr\":\"SF%uBW%u\",\"codr\":\"4/5\",\"lsnr\":%li,\"rssi\":%d,\"size\":%u,\"data\":\""
-		, LoraUp->sf, freqs[gwayConfig.ch].upBW, (long)SNR, prssi-rssicorr, messageLength);
+	yield();									// make sure the kernekl sends message to server asap
+	Udp.flush();								// 200419 empty the buffer
 
-	// Use gBase64 library to fill in the data string
-	encodedLen = base64_enc_len(messageLength);				// max 341
-	buff_index += base64_encode((char *)(buff_up + buff_index), (char *) message, messageLength);
+#	ifdef _THINGSERVER
+	// Use our own defined server or a second well known server
+	if (!sendRxpk(thingServer, _THINGPORT, LoraUp, cnt)) {
+		return(-2);
+	}
+#	endif //_THINGSERVER
+#endif //_GWAYSCAN
 
-	
-	LoraUp->tmst = (uint32_t) micros()+ _RXDELAY1; 			// Correct timing with defined number,
-															// https://github.com/TheThingsNetwork/lorawan-stack/issues/277
+	return(1);
+}// pushData()
 
-	// Get rid of this code when ready	
 
-	buff_index += snprintf((char *)(buff_up + buff_index), 
-		RX_BUFF_SIZE-buff_index, "\",\"tmst\":%u", 
-		LoraUp->tmst);	
+#if _RXBATCH>=1
+// --------------------------------- UP ---------------------------------------
+// batchFlush()
+// Send the messages waiting in rxBatch[] in one PUSH_DATA datagram.
+//
+// returns:
+//	0 when there was nothing to send, otherwise see pushData()
+// ----------------------------------------------------------------------------
+int batchFlush()
+{
+	if (rxBatchCnt == 0) return(0);
 
-#endif //_JSONENCODE undefined or ==0
-// ---------------------
+	int ret = pushData(rxBatch, rxBatchCnt);
+	rxBatchCnt = 0;
+	return(ret);
+}// batchFlush()
 
-	// End of packet serialization
 
-	buff_up[buff_index]   = '}';
-	buff_up[buff_index+1] = ']';						// According to specs, this] can remove
-	buff_up[buff_index+2] = '}'; 
-	buff_index += 3;
-	
-	buff_up[buff_index] = 0; 							// add string terminator, for safety
+// --------------------------------- UP ---------------------------------------
+// batchAdd()
+// Add a copy of the message to rxBatch[]. When it would not fit in the
+// datagram anymore the waiting messages are sent first. forwardQueue() sends
+// the batch when the first message waited _RXBATCH milliseconds.
+//
+// returns:
+//	1 on success, otherwise the result of batchFlush()
+// ----------------------------------------------------------------------------
+int batchAdd(struct LoraUp *LoraUp)
+{
+	int ret = 1;
+	uint16_t len = RXPK_MAX(LoraUp->size);
 
-	// When we have the node address and the SF, fill the listSeen array
-	// with the required data. _MAXSEEN must be >0 for this to happen.
-	// statr[0] contains the statistics of the node last seen.
-#	if  _MAXSEEN>=1
-		addSeen(listSeen, statr[0]);
-#	endif //_MAXSEEN
+	if ((rxBatchCnt >= RXBATCH_SLOTS) || 
+		((rxBatchCnt > 0) && (rxBatchLen + 1 + len > _RXBATCH_MTU))) {
+		ret = batchFlush();
+	}
 
-#	if _STAT_LOG==1	
-		// Do statistics logging. In first version we might only
-		// write part of the record to files, later more
-		addLog( (unsigned char *)(buff_up), buff_index );
-#	endif //_STAT_LOG
+	if (rxBatchCnt == 0) {
+		rxBatchStart = millis();
+		rxBatchLen = RXPK_HDR;
+	}
+	else {
+		rxBatchLen++;							// Comma between the rxpk
+	}
+	memcpy(&rxBatch[rxBatchCnt], LoraUp, sizeof(struct LoraUp));
+	rxBatchLen += len;
+	rxBatchCnt++;
 
-#	if _MONITOR>=1
-	if ((debug>=1) && (pdebug & P_RX)) {			// debug: display JSON payload
-		mPrint("^ PUSH_DATA:: token="+String(token_h<<8 | token_l)+", data="+String((char *)(buff_up + 12))+", Buff_up Length="+String(buff_index));		
+	return(ret);
+}// batchAdd()
+#endif //_RXBATCH
+
+
+
+#if _DEDUP>=1
+// ----------------------------------------------------------------------------
+// dupCheck()
+// Check whether a data uplink was received before: same DevAddr, FCnt and
+// MIC as one of the last _DEDUP uplinks, less than _DEDUP_TIME ms ago.
+// A copy of a confirmed data up frame (mtype 4) is only counted: the node
+// retransmits it because it did not receive the ACK, so the server must
+// see it again. A new frame is added to dupCache[] in place of the oldest one.
+// Parameters:
+//	LoraUp:		ptr to the message received from device
+// Returns:
+//	true when the frame is a duplicate and should not be forwarded
+// ----------------------------------------------------------------------------
+bool dupCheck(struct LoraUp *LoraUp)
+{
+	uint8_t *m = LoraUp->payLoad;
+	uint8_t mtype = m[0] >> 5;
+	if ((LoraUp->size < 12) || ((mtype != 2) && (mtype != 4))) {		// Only data up frames
+		return(false);
 	}
-#	endif
 
-	//rstTime = now();								// 200930 MMM
-	return(buff_index);
-	
-}// buildPacket()
+	uint32_t node = ( m[1]<<24 | m[2]<<16 | m[3]<<8 | m[4] );
+	uint16_t fcnt = m[6] | (m[7] << 8);
+	uint8_t *p = m + LoraUp->size - 4;
+	uint32_t mic = ( p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3] );
+	uint32_t tim = millis();
+
+	for (int i=0; i<_DEDUP; i++) {
+		struct dupEntry *e = &dupCache[i];
+		if ((e->tim != 0) && ((tim - e->tim) < _DEDUP_TIME) &&
+			(e->node == node) && (e->fcnt == fcnt) && (e->mic == mic))
+		{
+			if (mtype == 4) {
+				rxPipe.dupsConf++;									// Flag only, forward
+				return(false);
+			}
+			rxPipe.dups++;
+#			if _MAXSEEN>=1
+			struct nodeSeen *n = seenLookup(node, 0);		// Only count known nodes
+			if (n != NULL) n->cntDup++;
+#			endif //_MAXSEEN
+#			if _MONITOR>=1
+			if ((debug>=2) && (pdebug & P_RX)) {
+				String response = "dupCheck:: drop addr=";
+				printHex(node, ':', response);
+				response += ", fcnt=" + String(fcnt);
+				mPrint(response);
+			}
+#			endif //_MONITOR
+			return(true);
+		}
+	}
 
+	struct dupEntry *e = &dupCache[dupNext];
+	e->node = node;
+	e->fcnt = fcnt;
+	e->mic = mic;
+	e->tim = (tim != 0 ? tim : 1);									// 0 is an empty entry
+	dupNext = (dupNext + 1) % _DEDUP;
+	return(false);
+}
+#endif //_DEDUP
 
 
 // --------------------------------- UP ---------------------------------------
 //
 // Receive a LoRa package over the air, LoRa and deliver to server(s)
 //
-// Receive a LoRa message and fill the buff_up char buffer.
+// Receive a LoRa message and stream it as rxpk to the server(s).
 // returns values:
-// - returns the length of string returned in buff_up
+// - returns the size of the message, also when it is dropped as duplicate
+//   or for a wrong MIC
 // - returns -1 or -2 when no message arrived, depending connection.
 //
-// This is the "highlevel" read function called by loop(). The receive function 
-// is started in the _stateMachine.ini file after CDONE event by interrupt 
-// functions.
-// However, the actual read from the buffer (filled by interrupt) is done 
-// by this function in the main loop() program.
+// This is the "highlevel" read function called by forwardQueue() from loop().
+// The receive function is started in the _stateMachine.ino file after CDONE 
+// event by interrupt functions. The stateMachine reads the FIFO of the radio 
+// into the rxQueue and restarts the receiver, so the actual building and
+// sending of the message to the server(s) is done here in user space.
+//
+// Parameters:
+//	LoraUp:		ptr to the (queued) message received from device
 // ----------------------------------------------------------------------------
-int receivePacket()
+int receivePacket(struct LoraUp *LoraUp)
 {
-	uint8_t buff_up[RX_BUFF_SIZE]; 						// buffer to compose the upstream packet to backend server
-
 	// Regular message received, see SX1276 spec table 18
-	// Next statement could also be a "while" to combine several messages received
-	// in one UDP message as the Semtech Gateway spec does allow this.
-	// XXX Bit ... Not yet supported
+	// Several messages received can be combined in one UDP message as the 
+	// Semtech Gateway spec does allow this, see batchAdd() and _RXBATCH.
 
 
 		// Handle the physical data read from LoraUp
-		if (LoraUp.size > 0) {
+		if (LoraUp->size > 0) {
 
 #			ifdef _PROFILER
 				int32_t startTime = micros();
 #			endif //_PROFILER
 
+			// A copy of a frame that was forwarded a moment ago is not
+			// built or sent again
+#			if _DEDUP>=1
+			if (dupCheck(LoraUp)) {
+				int size = LoraUp->size;
+				LoraUp->size = 0;
+				return(size);
+			}
+#			endif //_DEDUP
+
 			// externally received packet, so last parameter is false (==LoRa external)
-			// Make a buffer to transmit later
-            int build_index = buildPacket(buff_up, &LoraUp, false);
+            int build_index = buildPacket(LoraUp, false);
+			if (build_index < 0) {
+				int size = LoraUp->size;						// Wrong MIC, drop the frame
+				LoraUp->size = 0;
+				return(size);
+			}
 
 			// REPEATER is a special function where we retransmit package received 
 			// message on incoming channel and transmits to outgoing channel.
 			// Note:: For the moment incoming channel is not allowed to be same as outgoing channel.
 			//
 #			if _REPEATER==1
-			if (!repeatLora(&LoraUp)) {
+			if (!repeatLora(LoraUp)) {
 				return(-3);												// Return when message repeated
 			}
 #			endif //_REPEATER
 
-#	if _GWAYSCAN==0
-#			ifdef _TTNSERVER	
-			// This is one of the potential problem areas.
-			// If possible, USB traffic should be left out of interrupt routines
-			// rxpk PUSH_DATA received from node is rxpk (*2, par. 3.2)
-
-			if (!sendUdp(ttnServer, _TTNPORT, buff_up, build_index)) {
-				return(-1); 							// received a message
+			// Send the message now, or combine it with other messages in
+			// one PUSH_DATA when _RXBATCH is defined
+#			if _RXBATCH>=1
+			int ret = batchAdd(LoraUp);
+#			else
+			int ret = pushData(LoraUp, 1);
+#			endif //_RXBATCH
+			if (ret < 0) {
+				return(ret);
 			}
-#			endif //_TTNSERVER
-
-			yield();									// make sure the kernekl sends message to server asap
-			Udp.flush();								// 200419 empty the buffer
 
 #			ifdef _PROFILER
 			if ((debug>=1) && (pdebug & P_RX)) {
@@ -796,19 +1436,10 @@ int receivePacket()
 			}
 #			endif //_PROFILER
 
-#			ifdef _THINGSERVER
-			// Use our own defined server or a second well known server
-			if (!sendUdp(thingServer, _THINGPORT, buff_up, build_index)) {
-				return(-2); 							// received a message
-			}
-#			endif //_THINGSERVER
-
-#	endif //_GWAYSCAN
-
 #	if _LOCALSERVER>=1
 			// Or special case, we do not use a local server to receive
 			// and decode the server. We use buildPacket() to call decode
-			// and use statr[0] information to store decoded message
+			// and use statRec(0) information to store decoded message
 
 			//DecodePayload: para 4.3.1 of Lora 1.1 Spec
 			// MHDR
@@ -829,21 +1460,21 @@ int receivePacket()
 			// 4 bytes MIC trailer
 
 			int index=0;
-			if ((index = inDecodes((char *)(LoraUp.payLoad+1))) >=0 ) {
+			if ((index = inDecodes((char *)(LoraUp->payLoad+1))) >=0 ) {
 
 				uint8_t DevAddr[4]; 
-				DevAddr[0]= LoraUp.payLoad[4];
-				DevAddr[1]= LoraUp.payLoad[3];
-				DevAddr[2]= LoraUp.payLoad[2];
-				DevAddr[3]= LoraUp.payLoad[1];
-				//uint16_t LoraUp.fcnt=LoraUp.payLoad[7]*256 + LoraUp.payLoad[6];
+				DevAddr[0]= LoraUp->payLoad[4];
+				DevAddr[1]= LoraUp->payLoad[3];
+				DevAddr[2]= LoraUp->payLoad[2];
+				DevAddr[3]= LoraUp->payLoad[1];
+				//uint16_t LoraUp->fcnt=LoraUp->payLoad[7]*256 + LoraUp->payLoad[6];
 
 #				if _DUSB>=1
 				if ((debug>=2) && (pdebug & P_RX)) {
 					Serial.print(F("UP receivePacket:: Ind="));
 					Serial.print(index);
 					Serial.print(F(", Len="));
-					Serial.print(LoraUp.size);
+					Serial.print(LoraUp->size);
 					Serial.print(F(", A="));
 					for (int i=0; i<4; i++) {
 						if (DevAddr[i]<0x0F) Serial.print('0');
@@ -852,9 +1483,10 @@ int receivePacket()
 					}
 				
 					Serial.print(F(", Msg="));
-					for (int i=0; (i<statr[0].datal) && (i<23); i++) {
-						if (statr[0].data[i]<0x0F) Serial.print('0');
-						Serial.print(statr[0].data[i],HEX);
+					uint8_t *data = statData(statRec(0));
+					for (int i=0; (i<statRec(0)->datal) && (i<23); i++) {
+						if (data[i]<0x0F) Serial.print('0');
+						Serial.print(data[i],HEX);
 						Serial.print(' ');
 					}
 				}
@@ -869,8 +1501,8 @@ int receivePacket()
 #	endif //_LOCALSERVER
 
 			// Reset the message area
-			LoraUp.size = 0;
-			LoraUp.payLoad[0] = 0x00;
+			LoraUp->size = 0;
+			LoraUp->payLoad[0] = 0x00;
 
 			return(build_index);
         }
@@ -878,3 +1510,62 @@ int receivePacket()
 	return(0);											// failure no message read
 
 }//receivePacket
+
+
+
+// --------------------------------- UP ---------------------------------------
+// forwardQueue()
+// Forward all messages that the stateMachine() has put in the rxQueue.
+// This is called by loop() after every stateMachine() call. As the radio is
+// already receiving again, the time we spend here does not make the gateway
+// deaf for other messages, but we record it in rxPipe.serv to compare.
+//
+// Returns:
+//	The number of messages forwarded
+// ----------------------------------------------------------------------------
+int forwardQueue()
+{
+	int cnt = 0;
+
+	while (rxTail != rxHead) {
+		uint32_t startTime = micros();
+#		if _TRAFFIC>=1
+		uint8_t upSf = rxQueue[rxTail].sf;
+#		endif //_TRAFFIC
+
+		if (receivePacket(&rxQueue[rxTail]) <= 0) {				// read is not successful
+#			if _MONITOR>=1
+			if ((debug>=0) && (pdebug & P_RX)) {
+				mPrint("forwardQueue:: ERROR receivePacket");
+			}
+#			endif //_MONITOR
+		}
+		rxTail = (rxTail + 1) % _RXQUEUE;						// Free the slot
+
+		rxPipe.serv = micros() - startTime;
+		rxPipe.servTtl += rxPipe.serv;
+		if (rxPipe.serv > rxPipe.servMax) rxPipe.servMax = rxPipe.serv;
+		uint32_t stack = freeStack();
+		if ((rxPipe.stack == 0) || (stack < rxPipe.stack)) rxPipe.stack = stack;
+
+#		if _TRAFFIC>=1
+		if ((upSf>=SF7) && (upSf<=SF12)) trafStat[upSf-SF7].fwd++;
+		int h = 0;
+		while ((h < EVT_HIST-1) && (rxPipe.serv > fwdLimit[h])) h++;
+		fwdHist[h]++;
+#		endif //_TRAFFIC
+
+		cnt++;
+		yield();
+	}
+
+#	if _RXBATCH>=1
+	// Send the batch when its first message has waited long enough
+	if ((rxBatchCnt > 0) && ((millis() - rxBatchStart) >= _RXBATCH)) {
+		batchFlush();
+	}
+#	endif //_RXBATCH
+
+	return(cnt);
+}//forwardQueue
+
@@ -29,6 +29,7 @@
 // The following functions ae defined in this module:
 // int readUdp(int Packetsize)
 // int sendUdp(IPAddress server, int port, uint8_t *msg, uint16_t length)
+// int sendRxpk(IPAddress server, int port, struct LoraUp *LoraUp, uint8_t cnt)
 // bool connectUdp();
 // void pullData();
 // void sendStat();
@@ -107,7 +108,7 @@ int readUdp(int packetSize)
 		return(-1);
 	}
 	
-	if (packetSize > TX_BUFF_SIZE) {
+	if (packetSize >= TX_BUFF_SIZE) {						// sendPacket() terminates the string
 #		if _MONITOR>=1
 			mPrint("v readUdp:: ERROR package of size: " + String(packetSize));
 #		endif //_MONITOR
@@ -151,7 +152,6 @@ int readUdp(int packetSize)
 		// First 4 bytes are very important, rest is data
 		// Especially the 2 token bytes should be watched.
 		protocol= buff_down[0];
-		uint16_t token= buff_down[2]<<8 | buff_down[1];			// LSB first [1], MSB [2] comes after
 		uint8_t  ident= buff_down[3];
 		// uint8_t *data = (uint8_t *) ((uint8_t *)buff_down + 4);
 		
@@ -283,8 +283,7 @@ int readUdp(int packetSize)
 		case PULL_RESP:										// 0x03 DOWN
 
 			if (protocol==0x01) {							// If protocol version is 0x01
-				token = 0;									// Use token 0 in that case
-				buff_down[2]=0;
+				buff_down[2]=0;								// Use token 0 in that case
 				buff_down[1]=0;
 			}
 			
@@ -293,7 +292,7 @@ int readUdp(int packetSize)
 			if ((debug>=1) && (pdebug & P_TX)) {
 				char res[128];			
 				sprintf(res, "v PULL_RESP:: token=%u, size=%u, IP=%d.%d.%d.%d, port=%d, prot=%u, secs=%lu",
-					token,
+					(buff_down[2]<<8 | buff_down[1]),		// LSB first [1], MSB [2] comes after
 					(uint16_t) LoraDown.fcnt,
 					//packetSize,
 					remoteIpNo[0], remoteIpNo[1], remoteIpNo[2], remoteIpNo[3],
@@ -305,10 +304,6 @@ int readUdp(int packetSize)
 			}
 #			endif //_PROFILER
 
-			// Send to the LoRa Node first (timing) and then do reporting to _MONITOR
-			//_state=S_TX;
-			sendTime = micros();							// record when we started sending the message
-
 			// Prepare to send the buffer package DOWN to the sensor
 			// We just read the packet from the Network Server and it is formatted
 			// as described in the specs. This function fills LoraDown struct.
@@ -322,182 +317,13 @@ int readUdp(int packetSize)
 				return(-1);
 			}
 
-
-			// We need a timeout for this case. During transmission we should not accept
-			// another package receiving/sending
-			if (loraWait(&LoraDown) == 0) {
-				_state=S_CAD;										
-				_event=1;
-				break;
-			}
-			
-			// Initiate the transmission of the buffer
-			// (We normally react on ALL interrupts if we are in TX state)
-			txLoraModem(&LoraDown);							// Transfer. Calls sendPkt() in turn
-
-			// Copy the lastSeen data down, making room on first entry
-			for (int m=(gwayConfig.maxStat -1); m>0; m--) statr[m]= statr[m-1];
-			
-			// If transmission is finished, print statistics
-#			if _MONITOR>=1
-
-				// Decode Physical Payload: para 4.3.1 of Lora 1.1 Spec
-				// MHDR
-				//	1 byte			Payload[0]
-				// FHDR
-				// 	4 byte Dev Addr Payload[1-4]
-				// 	1 byte FCtrl  	Payload[5]
-				// 	2 bytes FCnt	Payload[6-7]				
-				// 		= Optional 0 to 15 bytes Options
-				// FPort
-				//	1 bytes, 0x00	Payload[8]
-				// ------------
-				// +=9 BYTES HEADER
-				//
-				// FRMPayload
-				//	N bytes			(base64 Payload)
-				//
-				// 4 bytes MIC trailer
-				
-#			  if _LOCALSERVER>=2				
-				uint8_t DevAddr[4];
-				int index;
-
-				// If not found, the address is NOT wellknown
-				if ((index = inDecodes((char *)(LoraDown.payLoad+1))) >= 0 ) {
-					// fcnt has to be defined earlier
-					LoraDown.fcnt= LoraDown.payLoad[7]<<8 | LoraDown.payLoad[6]; // MMM first removed now put back
-
-					// Only if _LOCALSERVER >= 2 for downstream
-					strncpy ((char *)statr[0].data, (char *)LoraDown.payLoad+9,  LoraDown.size-9-4);
-
-					if ((LoraDown.size-9-4<=0) || (LoraDown.size-9-4>=30)) {
-
-#						if _MONITOR>=1
-						if (debug>=1) {
-							mPrint("PULL_RESP:: WARNING size="+String(LoraDown.size-9-4));
-						}
-#						endif						
-					}
-					else {
-						//mPrint("PULL_RESP:: OK");
-					}
-
-					DevAddr[0]= LoraDown.payLoad[4];
-					DevAddr[1]= LoraDown.payLoad[3];
-					DevAddr[2]= LoraDown.payLoad[2];
-					DevAddr[3]= LoraDown.payLoad[1];
-
-					statr[0].datal = encodePacket(
-										(uint8_t *)(statr[0].data), 
-										LoraDown.size -9 -4, 
-										(uint16_t)LoraDown.fcnt, 
-										DevAddr, 
-										decodes[index].appKey, 
-										1											// Down
-					);
-				}
-				else {
-#					if _MONITOR >= 1
-					if ((debug>=1) && (pdebug & P_MAIN)) {
-						String response ="v PULL_RESP:: index inDecodes not found, Addr=";
-						response+=
-							String(LoraDown.payLoad[4],HEX) + " " +
-							String(LoraDown.payLoad[3],HEX) + " " +
-							String(LoraDown.payLoad[2],HEX) + " " +
-							String(LoraDown.payLoad[1],HEX);
-						mPrint(response);
-					}
-#					endif //_MONITOR
-				}
-#			  elif _LOCALSERVER==1
-				// If we should not print data for downlink
-				statr[0].datal = 0;
-#			  else
-				// mPrint("PULL_RESP:: _LOCALSERVER <= 1");
-#			  endif //_LOCALSERVER
-
-			// If _MONITOR set print the statistics
-			if ((debug>=1) && (pdebug & P_TX)) {
-
-				String response = "v txLoraModem hi:: ";
-				printDwn(&LoraDown, response);
-				
-				response += " datal=" + String(statr[0].datal);
-				response += " data= [ ";
-				for (int i=0; i< statr[0].datal; i++) {
-					response += String(statr[0].data[i], HEX) + " ";
-				}
-				response += "]";
-				mPrint(response);
-			
-				yield();
-				
-				response = "v txLoraModem lo:: ";								// Get from byte data if possible
-
-#				if _LOCALSERVER>=2
-
-					if (statr[0].datal>24) {									// Size is too large
-						mPrint("readUDP:: ERROR: statr.datal larger than 24");
-						response+= ", statr[0].datal=" + String(statr[0].datal);
-						statr[0].datal=24;
-					}
-					
-					response+= "data=[ " ; 
-					
-					if ((statr[0].datal < 0) || (statr[0].datal > 24)) {
-						mPrint("ERROR datal<0");
-						statr[0].datal=0;
-					}
-					else for (int i=0; i<statr[0].datal; i++) {
-						response += String(statr[0].data[i],HEX) + " ";
-					}
-					
-					response += "], addr=";
-					printHex((IPAddress)DevAddr, ':', response);
-					
-					response += ", d_fcnt=" + String(LoraDown.fcnt);
-#				endif //_LOCALSERVER
-
-				response += ", size=" + String(LoraDown.size);
-				
-				response += ", old=[ ";
-				for(int i=0; i<LoraDown.size; i++) {
-					printHexDigit(LoraDown.payLoad[i],response);
-					response += " ";
-				}
-				response += "]";
-				
-				mPrint(response);
+			// Put the message in the downlink queue. txDispatch() will transmit
+			// it from loop() when it is due, so we do not wait here.
+			if (txAdmit(&LoraDown, buff_down) < 0) {
+				Udp.flush();
+				return(-1);
 			}
 
-#			endif //_MONITOR
-
-			statr[0].time	= now();
-			statr[0].ch		= gwayConfig.ch;
-			statr[0].sf		= LoraDown.sf;
-			statr[0].upDown	= 1;							// Down
-			statr[0].node	= ( 
-					LoraDown.payLoad[1]<<24 | 
-					LoraDown.payLoad[2]<<16 | 
-					LoraDown.payLoad[3]<<8  | 
-					LoraDown.payLoad[4] 
-			);
-
-			addSeen(listSeen, statr[0]);
-			
-#			if RSSI>=1
-				statr[0].rssi	= _rssi - rssicorr;
-#			endif // RSSI
-
-			//LoraDown.fcnt++;								// 210219 Increase outgoining frameCount
-			
-			// After filling the buffer we only react on TXDONE interrupt
-			// So, more or less start at the "case TXDONE:"  
-			txDones=0;
-			_state=S_TXDONE;
-			_event=1;										// Or remove the break below
-
 			yield();										// MMM 200925
 
 		break; //PULL_RESP
@@ -639,6 +465,57 @@ int sendUdp(IPAddress server, int port, uint8_t *msg, uint16_t length)
 }//sendUDP
 
 
+// ----------------------------------- UP -------------------------------------
+// sendRxpk()
+//
+// Send UP a PUSH_DATA message with the rxpk of the cnt messages in LoraUp[].
+// The message is streamed by writeRxpk() directly into the UDP packet, so 
+// there is no buffer to compose it first.
+// Parameters:
+//	IPAddress
+//	port
+//	LoraUp *	(after buildPacket())
+//	cnt			Number of messages
+// return values:
+//	0: Error
+//	1: Success
+// ----------------------------------------------------------------------------
+int sendRxpk(IPAddress server, int port, struct LoraUp *LoraUp, uint8_t cnt) 
+{
+	// Check whether we are conected to Wifi and the internet
+	if (WlanConnect(3) < 0) {
+#		if _MONITOR>=1
+		if (pdebug & P_MAIN) {
+			mPrint("sendRxpk: ERROR not connected to WiFi");
+		}
+#		endif //_MONITOR
+		Udp.flush();
+		return(0);
+	}
+
+	if (!Udp.beginPacket(server, (int) port)) {
+#		if _MONITOR>=1
+		if ( debug>=0 ) {
+			mPrint("M sendRxpk:: ERROR Udp.beginPacket");
+		}
+#		endif //_MONITOR
+		return(0);
+	}
+
+	writeRxpk(Udp, LoraUp, cnt, true);
+
+	if (!Udp.endPacket()) {
+#	if _MONITOR>=1
+		if (debug>=0) {
+			mPrint("sendRxpk:: ERROR Udp.endPacket");
+		}
+#	endif //_MONITOR
+		return(0);
+	}
+	return(1);
+}//sendRxpk
+
+
 
 
 // --------------------------------- UP ---------------------------------------
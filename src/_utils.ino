@@ -540,6 +540,111 @@ void setupTime()
 
 
 	
+// ----------------------------------------------------------------------------
+// devIndex(id)
+// Return the position in devHash[] where the search for DevAddr id starts.
+// ----------------------------------------------------------------------------
+uint16_t devIndex(uint32_t id)
+{
+	uint32_t h = id * 2654435761UL;						// Knuth multiplicative hash
+	return( (uint16_t)(h >> (32 - DEV_BITS)) );
+}
+
+
+// ----------------------------------------------------------------------------
+// findDev(id)
+// Find the registry entry of DevAddr id.
+// Returns:
+//		Pointer to the entry in devs[], or NULL if the device is not known
+// ----------------------------------------------------------------------------
+struct devReg * findDev(uint32_t id)
+{
+	uint16_t h = devIndex(id);
+	while (devHash[h] != 0) {
+		struct devReg *d = &devs[devHash[h]-1];
+		if (d->id == id) return(d);
+		h = (h+1) & (DEV_HASH-1);
+	}
+	return(NULL);
+}
+
+
+// ----------------------------------------------------------------------------
+// addDev(id)
+// Return the registry entry of DevAddr id, make a new one when not found.
+// ----------------------------------------------------------------------------
+struct devReg * addDev(uint32_t id)
+{
+	struct devReg *d = findDev(id);
+	if (d != NULL) return(d);
+
+	uint16_t h = devIndex(id);
+	while (devHash[h] != 0) h = (h+1) & (DEV_HASH-1);
+
+	d = &devs[devCnt];
+	d->id = id;
+	d->nm = NULL;
+	d->nwkKey = NULL;
+	d->appKey = NULL;
+	d->node = -1;
+	d->decode = -1;
+	devHash[h] = ++devCnt;
+	return(d);
+}
+
+
+// ----------------------------------------------------------------------------
+// initDevs()
+// Make the device registry from nodes[] and decodes[] of configNode.h.
+// This is done once in setup(), after that SerialName() and inDecodes()
+// do not depend on the number of devices configured. The AES key schedules
+// of decodes[] and of the gateway node are made here as well.
+// ----------------------------------------------------------------------------
+void initDevs()
+{
+	memset(devHash, 0, sizeof(devHash));
+	devCnt = 0;
+
+#	if _TRUSTED_NODES>=1
+	for (unsigned int i=0; i< DEV_NODES; i++) {
+		struct devReg *d = addDev(nodes[i].id);
+		if (d->node < 0) {								// First name wins, as before
+			d->node = i;
+			d->nm = nodes[i].nm;
+		}
+	}
+#	endif //_TRUSTED_NODES
+
+#	if _LOCALSERVER>=1
+	for (unsigned int i=0; i< DEV_DECODES; i++) {
+		struct devReg *d = addDev(decodes[i].id);
+		if (d->decode < 0) {
+			d->decode = i;
+			d->nwkKey = decodes[i].nwkKey;
+			d->appKey = decodes[i].appKey;
+		}
+		AES_Set_Key(&devKeys[i], decodes[i].appKey);
+#		if _CHECK_MIC==1
+		micKeySet(&devMics[i], decodes[i].nwkKey);
+#		endif //_CHECK_MIC
+	}
+#	endif //_LOCALSERVER
+
+#	if _GATEWAYNODE==1
+	const uint8_t appKey[16] = _APPSKEY;				// Session keys of the gateway node
+	const uint8_t nwkKey[16] = _NWKSKEY;
+	AES_Set_Key(&nodeAppKs, appKey);
+	micKeySet(&nodeNwkKs, nwkKey);
+#	endif //_GATEWAYNODE
+
+#	if _MONITOR>=1
+	if ((debug>=1) && (pdebug & P_MAIN)) {
+		mPrint("initDevs:: devices="+String(devCnt)+", index size="+String(DEV_HASH));
+	}
+#	endif //_MONITOR
+}
+
+
 // ----------------------------------------------------------------------------
 // SerialName(id, response)
 // Check whether for address a (4 bytes in uint32_t) there is a 
@@ -554,18 +659,16 @@ int SerialName(uint32_t a, String & response)
 	uint8_t * in = (uint8_t *)(& a);
 	uint32_t id = ((in[0]<<24) | (in[1]<<16) | (in[2]<<8) | in[3]);
 
-	for (unsigned int i=0; i< (sizeof(nodes)/sizeof(nodex)); i++) {
-
-		if (id == nodes[i].id) {
-#			if _MONITOR>=1
-			if ((debug>=3) && (pdebug & P_MAIN )) {
-				mPrint("SerialName:: i="+String(i)+", Name="+String(nodes[i].nm)+". for node=0x"+String(nodes[i].id,HEX));
-			}
-#			endif //_MONITOR
-
-			response += nodes[i].nm;
-			return(i);
+	struct devReg *d = findDev(id);
+	if ((d != NULL) && (d->node >= 0)) {
+#		if _MONITOR>=1
+		if ((debug>=3) && (pdebug & P_MAIN )) {
+			mPrint("SerialName:: i="+String(d->node)+", Name="+String(d->nm)+". for node=0x"+String(d->id,HEX));
 		}
+#		endif //_MONITOR
+
+		response += d->nm;
+		return(d->node);
 	}
 #endif //_TRUSTED_NODES
 
@@ -584,12 +687,12 @@ int SerialName(uint32_t a, String & response)
 // ----------------------------------------------------------------------------
 int inDecodes(char * id) {
 
-	uint32_t ident = ((id[3]<<24) | (id[2]<<16) | (id[1]<<8) | id[0]);
+	uint8_t * in = (uint8_t *) id;
+	uint32_t ident = ((in[3]<<24) | (in[2]<<16) | (in[1]<<8) | in[0]);
 
-	for (unsigned int i=0; i< (sizeof(decodes)/sizeof(codex)); i++) {
-		if (ident == decodes[i].id) {
-			return(i);
-		}
+	struct devReg *d = findDev(ident);
+	if ((d != NULL) && (d->decode >= 0)) {
+		return(d->decode);
 	}
 	return(-1);
 }
@@ -599,6 +702,97 @@ int inDecodes(char * id) {
 
 
 
+// ----------------------------------------------------------------------------
+// statNew()
+// Add a record to the statr[] message history. The oldest record of the ring
+// buffer is cleared and becomes the newest, so nothing has to be moved.
+// Returns:
+//	Pointer to the new record, same as statRec(0)
+// ----------------------------------------------------------------------------
+struct stat_t * statNew()
+{
+	statHead = (statHead + STAT_MAX - 1) % STAT_MAX;
+	memset(&statr[statHead], 0, sizeof(struct stat_t));
+	return(&statr[statHead]);
+}
+
+
+// ----------------------------------------------------------------------------
+// statRec()
+// Return the i-th newest record of the statr[] message history, 0 is the
+// last message. i must be smaller than STAT_MAX.
+// ----------------------------------------------------------------------------
+struct stat_t * statRec(uint8_t i)
+{
+	return(&statr[(statHead + i) % STAT_MAX]);
+}
+
+
+// ----------------------------------------------------------------------------
+// statBegin(), statNext()
+// Walk the statr[] message history from the newest record to the oldest,
+// over the records in use (sf != 0) and at most max records:
+//	for (struct stat_t *sr = statBegin(); sr != NULL; sr = statNext(sr, max))
+// Returns:
+//	Pointer to the record, NULL when there are no more
+// ----------------------------------------------------------------------------
+struct stat_t * statBegin()
+{
+	struct stat_t *sr = statRec(0);
+	return( (sr->sf == 0) ? NULL : sr );
+}
+
+struct stat_t * statNext(struct stat_t *sr, uint8_t max)
+{
+	uint8_t i = ((sr - statr) + STAT_MAX - statHead) % STAT_MAX + 1;	// Age of the next record
+	if ((i >= max) || (i >= STAT_MAX)) return(NULL);
+	sr = statRec(i);
+	return( (sr->sf == 0) ? NULL : sr );
+}
+
+
+#if _LOCALSERVER>=1
+// ----------------------------------------------------------------------------
+// statData()
+// Return the decrypted payload of history record sr. The FRMPayload is kept
+// encrypted when received and decrypted the first time it is asked for, by
+// messageHistory() or a debug print, so not for every message received.
+// The result is kept in the record.
+// Returns:
+//	sr->data, with sr->datal bytes of plain payload
+// ----------------------------------------------------------------------------
+uint8_t * statData(struct stat_t *sr)
+{
+	if ((sr->plain == 0) && (sr->datal > 0)) {
+		uint8_t DevAddr[4];
+		DevAddr[0]= sr->node & 0xFF;						// node is MSB first
+		DevAddr[1]= (sr->node >> 8) & 0xFF;
+		DevAddr[2]= (sr->node >> 16) & 0xFF;
+		DevAddr[3]= (sr->node >> 24) & 0xFF;
+
+		encodePacket(sr->data, sr->datal, sr->fcnt, DevAddr, &devKeys[sr->decode], sr->upDown);
+	}
+	sr->plain = 1;
+	return(sr->data);
+}
+#endif //_LOCALSERVER
+
+
+// ----------------------------------------------------------------------------
+// freeStack()
+// Return the free stack of the loop() task in bytes. On ESP32 this is the
+// high water mark of the task, on ESP8266 the current free continuation stack.
+// ----------------------------------------------------------------------------
+uint32_t freeStack()
+{
+#	if defined(ESP32_ARCH)
+	return(uxTaskGetStackHighWaterMark(NULL));
+#	else
+	return(ESP.getFreeContStack());
+#	endif //ESP32_ARCH
+}
+
+
 // ============================= GENERAL SKETCH ===============================
 
 // ----------------------------------------------------------------------------
@@ -248,8 +248,6 @@ void buttonRegs()
 	response += "    txt += \"or Cancel to return to the home page.\\n\\n\"; ";
 	response += "    alert(txt); ";
 			// If OK read the registers for reading
-			// For writing, these values are automatically overwritten each time 
-			// a message is transmitted down
 			for (int i=0; i< _REG_AMOUNT; i++) {registers[i].regvalue= readRegister(registers[i].regid); }
 	response += " txt += \"</div>\"; ";
 	response += "  }";								// catch err
@@ -365,7 +363,7 @@ static void setVariables(const char *cmd, const char *arg)
 	if (strcmp(cmd, "HOP")==0) {									// Set -hop on=1 or off=0
 		gwayConfig.hop=(bool)atoi(arg);
 		if (! gwayConfig.hop) { 
-			setFreq(freqs[gwayConfig.ch].upFreq);			
+			setFrf(freqs[gwayConfig.ch].upFrf);			
 			rxLoraModem();
 			sf = SF7;
 			cadScanner();
@@ -393,6 +391,20 @@ static void setVariables(const char *cmd, const char *arg)
 		writeGwayCfg(_CONFIGFILE, &gwayConfig );					// Save configuration to file
 	}
 	
+#if _STATISTICS >= 2
+	// STATVIEW, the statistics shown in Package Statistics, 1 to _STATISTICS
+	//
+	if (strcmp(cmd, "STATVIEW")==0) {
+		if (atoi(arg) == 1) {
+			gwayConfig.statView = (gwayConfig.statView >= _STATISTICS) ? 1 : gwayConfig.statView+1;
+		}
+		else if (atoi(arg) == -1) {
+			gwayConfig.statView = (gwayConfig.statView <= 1) ? _STATISTICS : gwayConfig.statView-1;
+		}
+		writeGwayCfg(_CONFIGFILE, &gwayConfig );					// Save configuration to file
+	}
+#endif //_STATISTICS
+
 	// SF; Handle Spreading Factor Settings
 	//
 	if (strcmp(cmd, "SF")==0) {
@@ -419,7 +431,7 @@ static void setVariables(const char *cmd, const char *arg)
 			Serial.println("down");
 			if (gwayConfig.ch==0) gwayConfig.ch=(nf-1); else gwayConfig.ch--;
 		}
-		setFreq(freqs[gwayConfig.ch].upFreq);
+		setFrf(freqs[gwayConfig.ch].upFrf);
 		rxLoraModem();												// Reset the radio with the new frequency
 		writeGwayCfg(_CONFIGFILE, &gwayConfig );						// Save configuration to file
 	}
@@ -739,6 +751,16 @@ static void gatewaySettings()
 
 #endif //_LOCALSERVER
 
+#if _STATISTICS >= 2
+	// Statistics view: 1 totals, 2 per SF, 3 per SF and channel
+	response +="<tr><td class=\"cell\">Statistics View</td><td class=\"cell\" colspan=\"2\">";
+	response +=gwayConfig.statView;
+	response +="</td>";
+	response +="<td class=\"cell\"><a href=\"STATVIEW=-1\"><button>-</button></a></td>";
+	response +="<td class=\"cell\"><a href=\"STATVIEW=1\"><button>+</button></a></td>";
+	response +="</tr>";
+#endif //_STATISTICS
+
 	/// WWW Refresh
 #if _REFRESH==1
 	bg = " background-color: ";
@@ -804,26 +826,54 @@ static void gatewaySettings()
 }
 
 
+// --------------------------------------------------------------------------------
+// statRow()
+// Add one row of the Package Statistics table: the counters of the channels
+// in chans[], the total and the last column (rate or percentage).
+// --------------------------------------------------------------------------------
+static void statRow(String & response, const String & label, const uint32_t *cnt, 
+				uint32_t ttl, const String & last, const uint8_t *chans, uint8_t nc)
+{
+	response +="<tr><td class=\"cell\">" + label + "</td>";
+	for (uint8_t i=0; i<nc; i++) {
+		response +="<td class=\"cell\">" + String(cnt[chans[i]]) + "</td>";
+	}
+	response +="<td class=\"cell\">" + String(ttl) + "</td>";
+	response +="<td class=\"cell\">" + last + "</td></tr>";
+}
+
+
 // --------------------------------------------------------------------------------
 // H2 Package Statistics
 //
 // This section display a matrix on the screen where everay channel and spreading
-// factor is displayed.
+// factor is displayed. _STATISTICS is the most that is kept, gwayConfig.statView
+// what is shown: 2 adds a row per SF, 3 a column for every channel of the
+// frequency plan that has messages, and for the current channel.
 // --------------------------------------------------------------------------------
 static void statisticsData()
 {
 	String response="";
+	uint8_t chans[STAT_CH];								// Channels shown
+	uint8_t nc = 0;
+
+#	if _STATISTICS == 3
+	for (uint8_t c=0; (c<STAT_CH) && (gwayConfig.statView>=3); c++) {
+		if ((c == gwayConfig.ch) || (statc.msg_ttl_ch[c] > 0) || (statc.msg_down_ch[c] > 0)) {
+			chans[nc++] = c;
+		}
+	}
+#	endif //_STATISTICS==3
+
 	//
 	// Header Row
 	//
 	response +="<h2>Package Statistics</h2>";
 	response +="<table class=\"config_table\">";
 	response +="<tr><th class=\"thead\">Counter</th>";
-#	if _STATISTICS == 3
-		response +="<th class=\"thead\">C 0</th>";
-		response +="<th class=\"thead\">C 1</th>";
-		response +="<th class=\"thead\">C 2</th>";
-#	endif //_STATISTICS==3
+	for (uint8_t i=0; i<nc; i++) {
+		response +="<th class=\"thead\">C " + String(chans[i]) + "</th>";
+	}
 	response +="<th class=\"thead\">Pkgs</th>";
 	response +="<th class=\"thead\">Pkgs/hr</th>";
 	response +="</tr>";
@@ -831,122 +881,29 @@ static void statisticsData()
 	//
 	// Table rows
 	//
-	response +="<tr><td class=\"cell\">Packages Downlink</td>";
-#	if _STATISTICS == 3
-		response +="<td class=\"cell\">" + String(statc.msg_down_0) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_down_1) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_down_2) + "</td>"; 
-#	endif
-	response += "<td class=\"cell\">" + String(statc.msg_down) + "</td>";
-	response +="<td class=\"cell\"></td></tr>";
-		
-	response +="<tr><td class=\"cell\">Packages Uplink Total</td>";
-#	if	 _STATISTICS == 3
-		response +="<td class=\"cell\">" + String(statc.msg_ttl_0) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_ttl_1) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_ttl_2) + "</td>";
-#	endif //_STATISTICS==3
-	response +="<td class=\"cell\">" + String(statc.msg_ttl) + "</td>";
-	response +="<td class=\"cell\">" + String((statc.msg_ttl*3600)/(now() - startTime)) + "</td></tr>";
-
+	statRow(response, "Packages Downlink", statc.msg_down_ch, statc.msg_down, "", chans, nc);
+	statRow(response, "Packages Uplink Total", statc.msg_ttl_ch, statc.msg_ttl, 
+		String((statc.msg_ttl*3600)/(now() - startTime)), chans, nc);
 #	if _GATEWAYNODE==1
-		response +="<tr><td class=\"cell\">Packages Internal Sensor</td>";
-#		if	 _STATISTICS == 3
-			response +="<td class=\"cell\">" + String(statc.msg_sens_0) + "</td>";
-			response +="<td class=\"cell\">" + String(statc.msg_sens_1) + "</td>";
-			response +="<td class=\"cell\">" + String(statc.msg_sens_2) + "</td>";
-#		endif //_STATISTICS==3
-		response +="<td class=\"cell\">" + String(statc.msg_sens) + "</td>";
-		response +="<td class=\"cell\">" + String((statc.msg_sens*3600)/(now() - startTime)) + "</td></tr>";
+	statRow(response, "Packages Internal Sensor", statc.msg_sens_ch, statc.msg_sens, 
+		String((statc.msg_sens*3600)/(now() - startTime)), chans, nc);
 #	endif //_GATEWAYNODE
-
-	response +="<tr><td class=\"cell\">Packages Uplink OK </td>";
-#if	 _STATISTICS == 3
-		response +="<td class=\"cell\">" + String(statc.msg_ok_0) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_ok_1) + "</td>";
-		response +="<td class=\"cell\">" + String(statc.msg_ok_2) + "</td>";
-#	endif //_STATISTICS==3
-	response +="<td class=\"cell\">" + String(statc.msg_ok) + "</td>";
-	response +="<td class=\"cell\">" + String((statc.msg_ok*3600)/(now() - startTime)) + "</td></tr>";
-		
+	statRow(response, "Packages Uplink OK ", statc.msg_ok_ch, statc.msg_ok, 
+		String((statc.msg_ok*3600)/(now() - startTime)), chans, nc);
 
 	// Provide a table with all the SF data including percentage of messsages
-	#if _STATISTICS == 2
-	response +="<tr><td class=\"cell\">SF7 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf7; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf7/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-	response +="<tr><td class=\"cell\">SF8 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf8;
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf8/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-	response +="<tr><td class=\"cell\">SF9 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf9;
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf9/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-	response +="<tr><td class=\"cell\">SF10 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf10; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf10/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-	response +="<tr><td class=\"cell\">SF11 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf11; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf11/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-	response +="<tr><td class=\"cell\">SF12 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf12; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf12/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-#	endif //_STATISTICS==2
-
-#	if _STATISTICS == 3
-	response +="<tr><td class=\"cell\">SF7 rcvd</td>";
-		response +="<td class=\"cell\">"; response +=statc.sf7_0; 
-		response +="<td class=\"cell\">"; response +=statc.sf7_1; 
-		response +="<td class=\"cell\">"; response +=statc.sf7_2; 
-		response +="<td class=\"cell\">"; response +=statc.sf7; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf7/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-		
-	response +="<tr><td class=\"cell\">SF8 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf8_0;
-		response +="<td class=\"cell\">"; response +=statc.sf8_1;
-		response +="<td class=\"cell\">"; response +=statc.sf8_2;
-		response +="<td class=\"cell\">"; response +=statc.sf8;
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf8/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-		
-	response +="<tr><td class=\"cell\">SF9 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf9_0;
-		response +="<td class=\"cell\">"; response +=statc.sf9_1;
-		response +="<td class=\"cell\">"; response +=statc.sf9_2;
-		response +="<td class=\"cell\">"; response +=statc.sf9;
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf9/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-		
-	response +="<tr><td class=\"cell\">SF10 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf10_0; 
-		response +="<td class=\"cell\">"; response +=statc.sf10_1; 
-		response +="<td class=\"cell\">"; response +=statc.sf10_2; 
-		response +="<td class=\"cell\">"; response +=statc.sf10; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf10/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-		
-	response +="<tr><td class=\"cell\">SF11 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf11_0;
-		response +="<td class=\"cell\">"; response +=statc.sf11_1; 
-		response +="<td class=\"cell\">"; response +=statc.sf11_2; 
-		response +="<td class=\"cell\">"; response +=statc.sf11; 
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf11/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-		
-	response +="<tr><td class=\"cell\">SF12 rcvd</td>"; 
-		response +="<td class=\"cell\">"; response +=statc.sf12_0;
-		response +="<td class=\"cell\">"; response +=statc.sf12_1;
-		response +="<td class=\"cell\">"; response +=statc.sf12_1;
-		response +="<td class=\"cell\">"; response +=statc.sf12;		
-		response +="<td class=\"cell\">"; response += String(statc.msg_ttl>0 ? 100*statc.sf12/statc.msg_ttl : 0)+" %"; 
-		response +="</td></tr>";
-#	endif //_STATISTICS==3
+#	if _STATISTICS >= 2
+	for (uint8_t f=0; (f<STAT_SF) && (gwayConfig.statView>=2); f++) {
+		uint32_t cnt[STAT_CH];
+		uint32_t ttl = 0;
+		for (uint8_t c=0; c<STAT_CH; c++) {
+			cnt[c] = statc.sf[c][f];
+			ttl += cnt[c];
+		}
+		statRow(response, "SF" + String(SF7 + f) + " rcvd", cnt, ttl, 
+			String(statc.msg_ttl>0 ? 100*ttl/statc.msg_ttl : 0)+" %", chans, nc);
+	}
+#	endif //_STATISTICS>=2
 
 	response +="</table>";
 	server.sendContent(response);
@@ -1012,17 +969,16 @@ static void messageHistory()
 	server.sendContent(response);
 
 	// PRINT NODE CONTENT
-	for (int i=0; i< gwayConfig.maxStat; i++) {								// For every Node in the list
-		if (statr[i].sf == 0) break;
+	for (struct stat_t *sr = statBegin(); sr != NULL; sr = statNext(sr, gwayConfig.maxStat)) {
 		
 		response = "" + String();
 		
 		response += "<tr><td class=\"cell\">";								// Tmst
-		stringTime(statr[i].time, response);								// XXX Change tmst not to be millis() dependent
+		stringTime(sr->time, response);								// XXX Change tmst not to be millis() dependent
 		response += "</td>";
 
 		response += String() + "<td class=\"cell\">"; 						// Up or Downlink
-		response += String(statr[i].upDown ? "v" : "^");
+		response += String(sr->upDown ? "v" : "^");
 		response += "</td>";
 
 		response += String() + "<td class=\"cell\">"; 						// Node
@@ -1030,15 +986,15 @@ static void messageHistory()
 #ifdef  _TRUSTED_NODES														// DO nothing with TRUSTED NODES
 		switch (gwayConfig.trusted) {
 			case 0: 
-				printHex(statr[i].node,' ',response); 
+				printHex(sr->node,' ',response); 
 				break;
 			case 1: 
-				if (SerialName(statr[i].node, response) < 0) {				// If name not known, print only HXX
-					printHex(statr[i].node,' ',response);
+				if (SerialName(sr->node, response) < 0) {				// If name not known, print only HXX
+					printHex(sr->node,' ',response);
 				};
 				break;
 			case 2: 
-				if (SerialName(statr[i].node, response) < 0) {				// If name not known, print only HXX
+				if (SerialName(sr->node, response) < 0) {				// If name not known, print only HXX
 					continue;												// And do not lookup or print name
 				};
 				break;
@@ -1051,7 +1007,7 @@ static void messageHistory()
 		}
 		
 #else //_TRUSTED_NODES
-		printHex(statr[i].node,' ',response);
+		printHex(sr->node,' ',response);
 #endif //_TRUSTED_NODES
 
 		response += "</td>";
@@ -1059,24 +1015,24 @@ static void messageHistory()
 #if _LOCALSERVER>=1
 	if (gwayConfig.showdata) {
 		response += String() + "<td class=\"cell\">";						// Data
-		if (statr[i].datal>24) statr[i].datal=24;							
-		for (int j=0; j<statr[i].datal; j++) {
-			if (statr[i].data[j] <0x10) response+= "0";
-			response += String(statr[i].data[j],HEX) + " ";
+		uint8_t *data = statData(sr);							// Decrypted once, when shown
+		for (int j=0; j<sr->datal; j++) {
+			if (data[j] <0x10) response+= "0";
+			response += String(data[j],HEX) + " ";
 		}
 		response += "</td>";
 	}
 #endif //_LOCALSERVER
 
 
-		response += String() + "<td class=\"cell\">" + statr[i].ch + "</td>";
-		response += String() + "<td class=\"cell\">" + freqs[statr[i].ch].upFreq + "</td>";
-		response += String() + "<td class=\"cell\">" + statr[i].sf + "</td>";
+		response += String() + "<td class=\"cell\">" + sr->ch + "</td>";
+		response += String() + "<td class=\"cell\">" + freqs[sr->ch].upFreq + "</td>";
+		response += String() + "<td class=\"cell\">" + sr->sf + "</td>";
 
-		response += String() + "<td class=\"cell\">" + statr[i].prssi + "</td>";
+		response += String() + "<td class=\"cell\">" + sr->prssi + "</td>";
 #if RSSI==1
 		if (debug >= 2) {
-			response += String() + "<td class=\"cell\">" + statr[i].rssi + "</td>";
+			response += String() + "<td class=\"cell\">" + sr->rssi + "</td>";
 		}
 #endif
 		response += "</tr>";
@@ -1115,15 +1071,20 @@ static void nodeHistory()
 		response += "<th class=\"thead\">Pkgs</th>";
 		response += "<th class=\"thead\" style=\"width: 20px;\">C</th>";
 		response += "<th class=\"thead\" style=\"width: 40px;\">SF</th>";
+		response += "<th class=\"thead\">SFs seen</th>";
+		response += "<th class=\"thead\">RSSI avg (min/max)</th>";
+		response += "<th class=\"thead\" style=\"width: 40px;\">SNR</th>";
+		response += "<th class=\"thead\" style=\"width: 40px;\">Dups</th>";
 
 		response += "</tr>";
 		server.sendContent(response);
 		
-		// Now start the contents
-		
-		for (int i=0; i<gwayConfig.maxSeen; i++) {
+		// Now start the contents, most recently seen node first
+		int r = 0;
+		for (uint16_t i=seenHead; (i!=SEEN_NONE) && (r<gwayConfig.maxSeen); i=listSeen[i].next, r++) {
+			struct nodeSeen *n = &listSeen[i];
 		
-			if (listSeen[i].idSeen == 0)
+			if (n->idSeen == 0)
 			{
 #				if _MONITOR>=1
 				if ((debug>=2) && (pdebug & P_MAIN)) {
@@ -1135,11 +1096,11 @@ static void nodeHistory()
 			response = "";
 		
 			response += String("<tr><td class=\"cell\">");						// Tmst
-			stringTime((listSeen[i].timSeen), response);
+			stringTime((n->timSeen), response);
 			response += "</td>";
 			
 			response += String("<td class=\"cell\">");							// upDown
-			switch (listSeen[i].upDown) 
+			switch (n->upDown) 
 			{
 				case 0: response += String("^"); break;
 				case 1: response += String("v"); break;
@@ -1151,17 +1112,17 @@ static void nodeHistory()
 #			ifdef  _TRUSTED_NODES												// Do nothing with TRUSTED NODES
 				switch (gwayConfig.trusted) {
 					case 0: 	
-						printHex(listSeen[i].idSeen,' ',response);
+						printHex(n->idSeen,' ',response);
 							// Only print the HEX address, no names
 						break;
 					case 1: 
-						if (SerialName(listSeen[i].idSeen, response) < 0) {
+						if (SerialName(n->idSeen, response) < 0) {
 							// if no name found print HEX, else print name
-							printHex(listSeen[i].idSeen,' ',response);
+							printHex(n->idSeen,' ',response);
 						};
 						break;
 					case 2: 
-						if (SerialName(listSeen[i].idSeen, response) < 0) {
+						if (SerialName(n->idSeen, response) < 0) {
 							// If name not found print nothing, else print name
 							continue;
 							//break;
@@ -1176,14 +1137,31 @@ static void nodeHistory()
 					break;
 				}	
 #			else
-				printHex(listSeen[i].idSeen,' ',response);
+				printHex(n->idSeen,' ',response);
 #			endif //_TRUSTED_NODES
 			
 			response += "</td>";
 			
-			response += String() + "<td class=\"cell\">" + listSeen[i].cntSeen + "</td>";			// Counter		
-			response += String() + "<td class=\"cell\">" + listSeen[i].chnSeen + "</td>";								// Channel
-			response += String() + "<td class=\"cell\">" + listSeen[i].sfSeen + "</td>";			// SF
+			response += String() + "<td class=\"cell\">" + n->cntSeen + "</td>";			// Counter		
+			response += String() + "<td class=\"cell\">" + n->chnSeen + "</td>";								// Channel
+			response += String() + "<td class=\"cell\">" + n->sfSeen + "</td>";			// SF
+
+			response += String("<td class=\"cell\">");							// All SF seen
+			for (int b=0; b<7; b++) {
+				if (n->sfMask & (nSF6 << b)) response += String(b+6) + " ";
+			}
+			response += "</td>";
+
+			response += String("<td class=\"cell\">");							// RSSI and SNR
+			if (n->cntStat > 0) {
+				response += String(n->rssiTtl / (int32_t)n->cntStat) + " (" + String(n->rssiMin) + "/" + String(n->rssiMax) + ")";
+				response += String("</td><td class=\"cell\">") + String(n->snrTtl / (int32_t)n->cntStat);
+			}
+			else {
+				response += "</td><td class=\"cell\">";
+			}
+			response += String("</td><td class=\"cell\">") + n->cntDup;		// Duplicates
+			response += "</td></tr>";
 			
 			server.sendContent(response);
 			//yield();
@@ -1455,7 +1433,227 @@ static void interruptData()
 		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
 		response += String(gwayConfig.waitOk);
 		response +="</td></tr>";
-		
+
+		response +="<tr><td class=\"cell\">TX queue admitted/waiting</td>";
+		response +="<td class=\"cell\">"; 
+		response += String(txStat.admit);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(txCnt);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">TX refused early/late/collision/full/failed</td>";
+		response +="<td class=\"cell\" colspan=\"3\">"; 
+		response += String(txStat.early) + " / " + String(txStat.late) + " / ";
+		response += String(txStat.collide) + " / " + String(txStat.full) + " / ";
+		response += String(txStat.fail);
+		response +="</td></tr>";
+
+		// Radio dead-time of the uplink queue. Before the queue was used
+		// the receiver was deaf for both the RX and forward times.
+		response +="<tr><td class=\"cell\">RX dead-time last/max/avg (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.dead);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.deadMax);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.cnt>0 ? rxPipe.deadTtl/rxPipe.cnt : 0);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">RX forward last/max/avg (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.serv);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.servMax);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.cnt>0 ? rxPipe.servTtl/rxPipe.cnt : 0);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">RX forward min free stack (bytes)</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.stack);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">PUSH_DATA frames/datagrams/mean batch</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.pushMsgs);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.pushDgrams);
+		response +="</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.pushDgrams>0 ? (float)rxPipe.pushMsgs/rxPipe.pushDgrams : 0, 2);
+		response +="</td></tr>";
+
+#		if _DEDUP>=1
+		response +="<tr><td class=\"cell\">RX duplicates dropped</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.dups);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response +="confirmed, forwarded=" + String(rxPipe.dupsConf);
+		response +="</td></tr>";
+#		endif //_DEDUP
+
+#		if _CHECK_MIC==1
+		response +="<tr><td class=\"cell\">RX wrong MIC dropped</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.micErrs);
+		response +="</td></tr>";
+#		endif //_CHECK_MIC
+
+		// Histogram of the time between interrupt and stateMachine()
+		response +="<tr><td class=\"cell\">Interrupt latency max/lost</td>";
+		response +="<td class=\"cell\">";
+		response += String(evtMax);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(evtDrops);
+		response +="</td></tr>";
+
+		for (int i=0; i<EVT_HIST; i++) {
+			response +="<tr><td class=\"cell\">Interrupt latency ";
+			if (i < EVT_HIST-1) {
+				response += "&lt; " + String(evtLimit[i]);
+			}
+			else {
+				response += "&gt;= " + String(evtLimit[EVT_HIST-2]);
+			}
+			response +=" uSec</td>";
+			response +="<td class=\"cell\">";
+			response += String(evtHist[i]);
+			response +="</td></tr>";
+		}
+
+		response +="<tr><td class=\"cell\">RX FIFO read last/per byte (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.fifo);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(rxPipe.fifoBytes>0 ? (float)rxPipe.fifoTtl/rxPipe.fifoBytes : 0, 2);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">RX queued/dropped</td>";
+		response +="<td class=\"cell\">";
+		response += String(rxPipe.cnt);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(rxPipe.drops);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">SPI reads/writes/saved</td>";
+		response +="<td class=\"cell\">";
+		response += String(spiStat.reads) + "/" + String(spiStat.writes);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(spiStat.skips);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">SPI last hop/cadScanner (saved)</td>";
+		response +="<td class=\"cell\">";
+		response += String(spiStat.hop) + " (" + String(spiStat.hopSkip) + ")";
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(spiStat.cad) + " (" + String(spiStat.cadSkip) + ")";
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">Switch to CAD/RX mode last/max (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(modeTime.cad) + "/" + String(modeTime.cadMax);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(modeTime.rx) + "/" + String(modeTime.rxMax);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">Switch to TX mode last/max (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(modeTime.tx) + "/" + String(modeTime.txMax);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += "_REG_PROG=" + String(_REG_PROG);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">TX start against tmst last/mean (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(txJit.last) + "/" + String(txJit.cnt ? txJit.sum/txJit.cnt : 0);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += "min/max=" + String(txJit.min) + "/" + String(txJit.max) + ", cnt=" + String(txJit.cnt);
+		response += ", _TX_TIMER=" + String(_TX_TIMER);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">TX start latency/deviation (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(gwayConfig.txLat) + "/" + String(gwayConfig.txDev);
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += "txDelay=" + String(gwayConfig.txDelay) + ", cnt=" + String(gwayConfig.txCnt);
+		response += ", lost=" + String(txCalOut) + ", _TX_CAL=" + String(_TX_CAL);
+		response +="</td></tr>";
+
+		response +="<tr><td class=\"cell\">TX start against tmst last (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(txErrLast);
+		response +="</td></tr>";
+
+		for (int i=0; i<TX_HIST; i++) {
+			response +="<tr><td class=\"cell\">TX start against tmst ";
+			if (i < TX_HIST-1) {
+				response += "&lt; " + String(txErrLimit[i]);
+			}
+			else {
+				response += "&gt;= " + String(txErrLimit[TX_HIST-2]);
+			}
+			response +=" uSec</td>";
+			response +="<td class=\"cell\">";
+			response += String(txErrHist[i]);
+			response +="</td></tr>";
+		}
+
+		// Timing used by the stateMachine() and detection counters per SF
+		for (int i=0; i<6; i++) {
+			response +="<tr><td class=\"cell\">SF" + String(i+SF7);
+			response +=" symbol/CAD/preamble/air (uSec)</td>";
+			response +="<td class=\"cell\">";
+			response += String(chanTime(loraTimes[i].symb)) + "/" + String(chanTime(loraTimes[i].cad)) + "/";
+			response += String(chanTime(loraTimes[i].pre)) + "/" + String(chanTime(loraTimes[i].air));
+			response +="</td>";
+			response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+			response +="cad=" + String(sfDet[i].cad) + ", det=" + String(sfDet[i].det);
+			response +=", rx=" + String(sfDet[i].rx) + ", tout=" + String(sfDet[i].tout);
+			response +="</td></tr>";
+		}
+
+#		if _TRAFFIC>=1
+		// Synthetic traffic generator, see _traffic.ino
+		for (int i=0; i<6; i++) {
+			response +="<tr><td class=\"cell\">Traffic SF" + String(i+SF7);
+			response +=" gen/det/rx/fwd</td>";
+			response +="<td class=\"cell\">";
+			response += String(trafStat[i].gen) + "/" + String(trafStat[i].det) + "/";
+			response += String(trafStat[i].rx) + "/" + String(trafStat[i].fwd);
+			response +="</td>";
+			response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+			response +="lost col=" + String(trafStat[i].col) + ", miss=" + String(trafStat[i].miss);
+			response +=", full=" + String(trafStat[i].full);
+			response +="</td></tr>";
+		}
+
+		response +="<tr><td class=\"cell\">Forward time p50/p90/p99 (uSec)</td>";
+		response +="<td class=\"cell\">";
+		response += String(fwdPercentile(50)) + "/" + String(fwdPercentile(90)) + "/" + String(fwdPercentile(99));
+		response +="</td>";
+		response +="<td colspan=\"2\" style=\"border: 1px solid black;\">";
+		response += String(_TRAFFIC) + " devices, " + String(gwayConfig.cad ? "CAD" : "fixed SF");
+		response +="</td></tr>";
+#		endif //_TRAFFIC
+
 		response +="</tr>";
 		
 		response +="</table>";
@@ -1589,51 +1787,24 @@ void setupWWW()
 		mPrint("RESET");
 		startTime= now() - 1;					// Reset all timers too (-1 to avoid division by 0)
 		
-		statc.msg_ttl = 0;						// Reset ALL package statistics
-		statc.msg_ok = 0;
-		statc.msg_down = 0;
-		statc.msg_sens = 0;
-		
-#if _STATISTICS >= 3
-		statc.msg_ttl_0 = 0;
-		statc.msg_ttl_1 = 0;
-		statc.msg_ttl_2 = 0;
-		
-		statc.msg_ok_0 = 0;
-		statc.msg_ok_1 = 0;
-		statc.msg_ok_2 = 0;
-		
-		statc.msg_down_0 = 0;
-		statc.msg_down_1 = 0;
-		statc.msg_down_2 = 0;
-
-		statc.msg_sens_0 = 0;
-		statc.msg_sens_1 = 0;
-		statc.msg_sens_2 = 0;
-#endif
+		memset(&statc, 0, sizeof(statc));		// Reset ALL package statistics
+
+		memset(&rxPipe, 0, sizeof(rxPipe));		// Reset the uplink queue timing too
+		memset(evtHist, 0, sizeof(evtHist));	// And the interrupt latency histogram
+		evtMax = 0;
+		memset(&spiStat, 0, sizeof(spiStat));	// And the SPI transaction counters
+		memset(&modeTime, 0, sizeof(modeTime));	// And the mode switch times
+		memset(&txJit, 0, sizeof(txJit));		// And the TX start times
+		memset(txErrHist, 0, sizeof(txErrHist));	// And the TX start errors, txLat stays
+		txCalOut = 0;
+		memset(sfDet, 0, sizeof(sfDet));		// And the detection counters per SF
+#if _TRAFFIC>=1
+		memset(trafStat, 0, sizeof(trafStat));	// And the traffic generator
+		memset(fwdHist, 0, sizeof(fwdHist));
+#endif //_TRAFFIC
 
 #	if _STATISTICS >= 1
-		for (int i=0; i< gwayConfig.maxStat; i++) { statr[i].sf = 0; }
-#		if _STATISTICS >= 2
-			statc.sf7 = 0;
-			statc.sf8 = 0;
-			statc.sf9 = 0;
-			statc.sf10= 0;
-			statc.sf11= 0;
-			statc.sf12= 0;
-		
-			statc.resets= 0;
-			
-#			if _STATISTICS >= 3
-				statc.sf7_0 = 0; statc.sf7_1 = 0; statc.sf7_2 = 0;
-				statc.sf8_0 = 0; statc.sf8_1 = 0; statc.sf8_2 = 0;
-				statc.sf9_0 = 0; statc.sf9_1 = 0; statc.sf9_2 = 0;
-				statc.sf10_0= 0; statc.sf10_1= 0; statc.sf10_2= 0;
-				statc.sf11_0= 0; statc.sf11_1= 0; statc.sf11_2= 0;
-				statc.sf12_0= 0; statc.sf12_1= 0; statc.sf12_2= 0;
-#			endif //_STATISTICS==3
-			
-#		endif //_STATISTICS==2
+		for (int i=0; i< STAT_MAX; i++) { statr[i].sf = 0; }
 #	endif //_STATISTICS==1
 
 		writeGwayCfg(_CONFIGFILE, &gwayConfig );			
@@ -1780,6 +1951,22 @@ void setupWWW()
 		server.send( 302, "text/plain", "");
 	});
 
+#if _STATISTICS >= 2
+	// Statistics view, the tables of Package Statistics
+	server.on("/STATVIEW=1", []() {
+		gwayConfig.statView = (gwayConfig.statView >= _STATISTICS) ? 1 : gwayConfig.statView+1;
+		writeGwayCfg(_CONFIGFILE, &gwayConfig );	// Save configuration to file
+		server.sendHeader("Location", String("/"), true);
+		server.send( 302, "text/plain", "");
+	});
+	server.on("/STATVIEW=-1", []() {
+		gwayConfig.statView = (gwayConfig.statView <= 1) ? _STATISTICS : gwayConfig.statView-1;
+		writeGwayCfg(_CONFIGFILE, &gwayConfig );	// Save configuration to file
+		server.sendHeader("Location", String("/"), true);
+		server.send( 302, "text/plain", "");
+	});
+#endif //_STATISTICS
+
 	// Spreading Factor setting
 	server.on("/SF=1", []() {
 		if (sf>=SF12) sf=SF7; else sf= (sf_t)((int)sf+1);
@@ -1898,7 +2085,7 @@ void setupWWW()
 	});
 	server.on("/HOP=0", []() {
 		gwayConfig.hop=false;
-		setFreq(freqs[gwayConfig.ch].upFreq);
+		setFrf(freqs[gwayConfig.ch].upFrf);
 		rxLoraModem();
 		server.sendHeader("Location", String("/"), true);
 		server.send( 302, "text/plain", "");
@@ -1957,57 +2144,30 @@ void setupWWW()
 	// ---------------------------- 
 	server.on("/MAXSTAT=-5", []() {
 		if (gwayConfig.maxStat>5) {
-			struct stat_t * oldStat = statr;
-			gwayConfig.maxStat-=5;
-			statr = (struct stat_t *) malloc(gwayConfig.maxStat * sizeof(struct stat_t));
-			for (int i=0; i<gwayConfig.maxStat; i+=1) {
-				statr[i]=oldStat[i];
-			}
-			free(oldStat);
+			gwayConfig.maxStat-=5;						// Only shows less, statr[] is fixed
 		}
 		server.sendHeader("Location", String("/"), true);
 		server.send( 302, "text/plain", "");
 	});
 	server.on("/MAXSTAT=5", []() {
-		struct stat_t * oldStat = statr;
-		gwayConfig.maxStat+=5;
-		statr = (struct stat_t *) malloc(gwayConfig.maxStat * sizeof(struct stat_t));
-		for (int i=0; i<gwayConfig.maxStat; i+=1) {
-			if (i<(gwayConfig.maxStat-5)) {
-				statr[i]=oldStat[i];
-			}
-			else {
-				statr[i].sf=0;
-			}
+		if (gwayConfig.maxStat+5 <= STAT_MAX) {
+			gwayConfig.maxStat+=5;						// Up to the _MAXSTAT records kept
 		}
-		free(oldStat);
 		server.sendHeader("Location", String("/"), true);
 		server.send( 302, "text/plain", "");
 	});
 
 	server.on("/MAXSEEN-5", []() {
 		if (gwayConfig.maxSeen>5) {
-			struct nodeSeen * oldSeen = listSeen;
-			gwayConfig.maxSeen-=5;
-			listSeen = (struct nodeSeen *) malloc(gwayConfig.maxSeen * sizeof(struct nodeSeen));
-			for (int i=0; i<gwayConfig.maxSeen; i+=1) {
-				listSeen[i]=oldSeen[i];
-			}
-			if (gwayConfig.maxSeen<iSeen) iSeen = gwayConfig.maxSeen;			
-			free(oldSeen);
+			gwayConfig.maxSeen-=5;						// Only shows less, listSeen[] is fixed
 		}
 		server.sendHeader("Location", String("/"), true);
 		server.send( 302, "text/plain", "");
 	});
 	server.on("/MAXSEEN+5", []() {
-		struct nodeSeen * oldSeen = listSeen;
-		gwayConfig.maxSeen+=5;
-		listSeen = (struct nodeSeen *) malloc(gwayConfig.maxSeen * sizeof(struct nodeSeen));
-		for (int i=0; i<gwayConfig.maxSeen; i+=1) {
-			if (i<(gwayConfig.maxSeen-5)) listSeen[i]=oldSeen[i];
-			else listSeen[i].idSeen=0;
+		if ((gwayConfig.maxSeen+5 <= SEEN_MAX) && (gwayConfig.maxSeen <= 250)) {
+			gwayConfig.maxSeen+=5;						// Up to the _MAXSEEN nodes kept
 		}
-		free(oldSeen);
 		server.sendHeader("Location", String("/"), true);
 		server.send( 302, "text/plain", "");
 	});
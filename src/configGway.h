@@ -140,7 +140,9 @@
 // Definitions for the admin webserver.
 // _SERVER determines whether or not the admin webpage is included in the sketch.
 // Normally, leave it in!
-#define _SERVER 1				// Define local WebServer only if this define is set
+#if !defined _SERVER
+#	define _SERVER 1			// Define local WebServer only if this define is set
+#endif
 #define _REFRESH 1				// Allow the webserver refresh or not?
 #define _SERVERPORT 80			// Local webserver port (normally 80)
 #define _MAXBUFSIZE 192			// Must be larger than 128, but small enough to work
@@ -319,13 +321,94 @@
 //	- Last seen 'seconds since 1/1/1970'
 //	- SF seen (8-bit integer with SF per bit)
 // The initial version _NUMMAX stores max this many nodes, please make
-// _MAXSEEN==0 when not used
+// _MAXSEEN==0 when not used. When more nodes are seen, the node that was
+// seen longest ago is replaced.
 #if !defined _MAXSEEN
 #	define _MAXSEEN 15
 #endif
 #define _SEENFILE "/gwaySeen.txt"
 
 
+// Number of received LoRa frames that can wait in the uplink queue.
+// The stateMachine() only copies the FIFO into the queue and restarts the
+// receiver, loop() builds and forwards the PUSH_DATA messages later.
+// One slot is always kept free, so 4 means 3 frames can be pending.
+#if !defined _RXQUEUE
+#	define _RXQUEUE 4
+#endif
+
+
+// Number of downlink messages (PULL_RESP) that can wait in the downlink
+// queue for their transmit time.
+#if !defined _TXQUEUE
+#	define _TXQUEUE 4
+#endif
+
+
+// Combine the rxpk of several received frames in one PUSH_DATA datagram.
+// _RXBATCH is the time in milliseconds that the first frame of a batch may
+// wait for others, 0 sends every frame in its own datagram as before.
+// _RXBATCH_MTU is the maximum size of the datagram in bytes. Mind that the
+// tmst of the frames is not changed, so keep _RXBATCH well below RX1 delay.
+#if !defined _RXBATCH
+#	define _RXBATCH 0
+#endif
+#if _RXBATCH>=1
+#	if !defined _RXBATCH_MTU
+#		define _RXBATCH_MTU 1400
+#	endif
+#endif //_RXBATCH
+
+
+// Synthetic traffic for capacity testing. When _TRAFFIC is the number of simulated
+// end devices (>0), trafficGen() in loop() generates their uplink frames and puts
+// the ones the gateway would have heard in the uplink queue, as if receivePkt()
+// read them. No uplink is sent to the servers then, pushData() only makes the rxpk.
+//	_TRAFFIC_FWD: 1 sends the uplinks to the servers anyway, use a local server
+//	_TRAFFIC_PERIOD: Seconds between two frames of one device (+/- 10%)
+//	_TRAFFIC_SIZE: Payload size in bytes, at least 13 (LoRaWAN header and MIC)
+//	_TRAFFIC_HOPS: Devices are spread over this number of channels
+//	_TRAFFIC_SFMIX: Weight of SF7 to SF12 when assigning SF to the devices
+// Frames on the same channel and SF that overlap in time collide and are both lost.
+#if !defined _TRAFFIC
+#	define _TRAFFIC 0
+#endif
+#if _TRAFFIC>=1
+#	if !defined _TRAFFIC_PERIOD
+#		define _TRAFFIC_PERIOD 60
+#	endif
+#	if !defined _TRAFFIC_SIZE
+#		define _TRAFFIC_SIZE 20
+#	endif
+#	if !defined _TRAFFIC_HOPS
+#		define _TRAFFIC_HOPS 1
+#	endif
+#	if !defined _TRAFFIC_SFMIX
+#		define _TRAFFIC_SFMIX { 4, 2, 1, 1, 1, 1 }
+#	endif
+#	if !defined _TRAFFIC_FWD
+#		define _TRAFFIC_FWD 0
+#	endif
+#endif //_TRAFFIC
+
+
+// Drop copies of an uplink frame before they are forwarded. A frame with the
+// same DevAddr, FCnt and MIC as one of the last _DEDUP data uplinks, received
+// less than _DEDUP_TIME milliseconds ago, is counted and not sent to the
+// servers (node retransmissions and frames looped back by a repeater).
+// Copies of confirmed data up frames are counted but always forwarded, as the
+// server must answer a retransmission with a new ACK.
+// 0 forwards every copy as before.
+#if !defined _DEDUP
+#	define _DEDUP 8
+#endif
+#if _DEDUP>=1
+#	if !defined _DEDUP_TIME
+#		define _DEDUP_TIME 5000
+#	endif
+#endif //_DEDUP
+
+
 // Define the maximum amount of items we monitor on the screen
 #if !defined _MAXMONITOR
 #	define _MAXMONITOR 20
@@ -351,6 +434,41 @@
 #define _BAUDRATE 115200						// Works for debug messages to serial momitor
 
 
+// Read the FIFO of the radio in one SPI transaction.
+// 1= Use the SPI.transfer(buf,len) block function (default)
+// 0= Transfer byte by byte, but still with one chip select
+#if !defined _BUF_READ
+#	define _BUF_READ 1
+#endif //_BUF_READ
+
+
+// Write the register programs of cadScanner(), rxLoraModem(), hop() and txLoraModem()
+// with applyProg() in as few SPI transactions as possible.
+// 1= Burst write runs of consecutive registers, skip runs the radio already holds (default)
+// 0= Write register by register as before, to compare the mode switch times
+#if !defined _REG_PROG
+#	define _REG_PROG 1
+#endif //_REG_PROG
+
+
+// Start downlinks with a hardware timer. txLoraModem() stages the radio in FSTX
+// with the FIFO loaded before the transmit time, so at tmst only REG_OPMODE is written.
+// 1= The timer interrupt (timer1 on ESP8266, timer 1 on ESP32) writes REG_OPMODE (default)
+// 0= loop() waits the last part with delayMicroseconds() and writes REG_OPMODE
+#if !defined _TX_TIMER
+#	define _TX_TIMER 1
+#endif //_TX_TIMER
+
+
+// Calibrate the TX delay. The TXDONE interrupt time minus the airtime of the downlink is
+// the real TX start, txCalib() keeps the mean latency against tmst + txDelay in the config.
+// 1= Set gwayConfig.txDelay so that downlinks start at tmst (default)
+// 0= Only measure, txDelay is set by hand on the web page
+#if !defined _TX_CAL
+#	define _TX_CAL 1
+#endif //_TX_CAL
+
+
 // Will we use Mutex or not?
 // +SPI is input for SPI, SPO is output for SPI
 #if !defined _MUTEX
@@ -26,7 +26,9 @@
 	// Make sure to only select one.
 #	define _LCODE 1
 //#	define _RAW 1
-#	define _CHECK_MIC 1
+#	if !defined _CHECK_MIC
+#		define _CHECK_MIC 1
+#	endif
 #	define _SENSOR_INTERVAL 300
 
 	// Sensor and app address information
@@ -48,9 +50,11 @@ struct nodex {
 };
 
 // Add all your named and trusted nodes to this list
+#if !defined _DEVICES_FILE
 nodex nodes[] = {
 	{ 0x00000000 , "lora-00 well known sensor" }				// F=0
 };
+#endif //_DEVICES_FILE
 
 #endif //_TRUSTED_NODES
 
@@ -75,15 +79,24 @@ struct codex  {
 
 // Definition of all nodes that we want to decode locally on the gateway.
 //
+#if !defined _DEVICES_FILE
 codex decodes[] = {
 	{	0x00000000 , "lora-00",	// F=0
 		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
 		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }
 	}			
 };
+#endif //_DEVICES_FILE
 #endif //_LOCALSERVER
 
 
+// Instead of the nodes[] and decodes[] above, the lists can be kept in a file
+// of their own (e.g. with many devices) by defining _DEVICES_FILE as its name.
+#if defined _DEVICES_FILE
+#	include _DEVICES_FILE
+#endif //_DEVICES_FILE
+
+
 // Wifi definitions
 // WPA is an array with SSID and password records. Set WPA size to number of entries in array
 // When using the WiFiManager, we will overwrite the first entry with the 
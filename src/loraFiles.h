@@ -58,6 +58,8 @@
 struct espGwayConfig {
 
 	int32_t txDelay;			// Init 0 at setup
+	int32_t txLat;				// Estimated TX start latency after tmst + txDelay, uSec
+	uint32_t txDev;				// Mean deviation of txLat, uSec
 	uint32_t ntpErrTime;		// Record the time of the last NTP error
 
 	uint16_t u_fcnt;			// =0 as init value	XXX It could be 32 bit in size
@@ -75,12 +77,14 @@ struct espGwayConfig {
 	uint16_t ntpErr;			// Number of UTP requests that failed
 	uint16_t waitErr;			// Number of times the loraWait() call failed
 	uint16_t waitOk;			// Number of times the loraWait() call success
+	uint16_t txCnt;				// Number of TXDONE measurements in txLat
 	
 	uint8_t ch;					// index to freqs array, freqs[gwayConfig.ch]=868100000 default
 	uint8_t sf;					// range from SF7 to SF12
 	uint8_t debug;				// range 0 to 4
 	uint8_t pdebug;				// pattern debug, 
 	uint8_t trusted;			// pattern debug,
+	uint8_t statView;			// Statistics shown on the web page, 1 to _STATISTICS
 	
 	uint8_t	maxSeen;			// Max Seen lines on GUI (not saved for reboots)
 	uint8_t maxMoni;			// Max Monitoring lines	(not saved)
@@ -121,6 +125,21 @@ struct espGwayConfig {
 #define nFSK	0x80
 
 // define the Seen functon as when we have seen seen nodes last time
+// listSeen[] has room for SEEN_MAX nodes. A node is found with the open
+// addressing hash index seenHash[] on (idSeen, upDown), and all nodes are in
+// a list from most recently (seenHead) to least recently seen (seenTail).
+// When listSeen[] is full the seenTail node is replaced by the new one.
+#define SEEN_MAX	(_MAXSEEN>=1 ? _MAXSEEN : 1)
+#define SEEN_NONE	0xFFFF
+
+// Number of bits b of a hash index for n entries, so that it has at
+// least 2*n positions and stays less than half full
+constexpr uint8_t hashBits(uint16_t n, uint8_t b) {
+	return( ((1UL << b) >= 2UL*n) ? b : hashBits(n, b+1) );
+}
+#define SEEN_BITS	hashBits(SEEN_MAX, 1)
+#define SEEN_HASH	(1 << SEEN_BITS)
+
 struct nodeSeen {
 	time_t timSeen;
 	uint8_t	upDown;
@@ -128,8 +147,69 @@ struct nodeSeen {
 	uint32_t cntSeen;
 	uint8_t chnSeen;
 	uint8_t sfSeen;				// Encode the SF seen.This might differ per message!
+	uint8_t sfMask;				// nSF bits of all SF seen
+	int8_t rssiMin;
+	int8_t rssiMax;
+	int32_t rssiTtl;			// Sum of the packet RSSI, for the average
+	int32_t snrTtl;				// Sum of the SNR
+	uint32_t cntStat;			// Uplinks in rssiTtl and snrTtl (not saved)
+	uint16_t cntDup;			// Duplicate uplinks dropped, _DEDUP (not saved)
+	uint16_t prev;				// More recently seen node or SEEN_NONE
+	uint16_t next;				// Less recently seen node or SEEN_NONE
+};
+struct nodeSeen listSeen[SEEN_MAX];
+uint16_t seenHash[SEEN_HASH];	// Index in listSeen[] + 1, 0 is empty
+uint16_t seenHead = SEEN_NONE;
+uint16_t seenTail = SEEN_NONE;
+
+
+// Registry of the devices in configNode.h. Every DevAddr of nodes[] (name,
+// _TRUSTED_NODES) and decodes[] (session keys, _LOCALSERVER) has one entry
+// in devs[], made by initDevs() at startup. findDev() finds it through the
+// open addressing hash index devHash[] with a constant number of probes.
+// The AppSKey of every decodes[] entry is expanded once into devKeys[], so
+// decoding a frame does not expand the key again for every AES block.
+#if _TRUSTED_NODES>=1
+#	define DEV_NODES	(sizeof(nodes)/sizeof(nodes[0]))
+#else
+#	define DEV_NODES	0
+#endif
+#if _LOCALSERVER>=1
+#	define DEV_DECODES	(sizeof(decodes)/sizeof(decodes[0]))
+#else
+#	define DEV_DECODES	0
+#endif
+#define DEV_MAX		((DEV_NODES + DEV_DECODES) > 0 ? (DEV_NODES + DEV_DECODES) : 1)
+#define DEV_BITS	hashBits(DEV_MAX, 1)
+#define DEV_HASH	(1 << DEV_BITS)
+
+struct devReg {
+	uint32_t id;				// DevAddr
+	const char *nm;				// Name from nodes[] or NULL
+	const uint8_t *nwkKey;		// NwkSKey from decodes[] or NULL
+	const uint8_t *appKey;		// AppSKey from decodes[] or NULL
+	int16_t node;				// Index in nodes[] or -1
+	int16_t decode;				// Index in decodes[] or -1
+};
+struct devReg devs[DEV_MAX];
+uint16_t devCnt = 0;			// Entries used in devs[]
+uint16_t devHash[DEV_HASH];		// Index in devs[] + 1, 0 is empty
+#if _LOCALSERVER>=1
+AES_Key devKeys[DEV_DECODES];	// AppSKey schedule of decodes[i], made once by initDevs()
+#endif //_LOCALSERVER
+
+#if (_GATEWAYNODE==1) || (_LOCALSERVER>=1)
+// NwkSKey schedule and CMAC subkeys (RFC 4493) for the MIC. The subkeys only
+// depend on the key, so they are made once by micKeySet() and not per frame.
+struct micKey {
+	AES_Key ks;					// Key schedule of the NwkSKey
+	uint8_t k1[16];				// Subkey for a complete last block
+	uint8_t k2[16];				// Subkey for a padded last block
 };
-struct nodeSeen * listSeen;
+#	if (_LOCALSERVER>=1) && (_CHECK_MIC==1)
+struct micKey devMics[DEV_DECODES];	// NwkSKey of decodes[i], for checkMic()
+#	endif
+#endif //_GATEWAYNODE || _LOCALSERVER
 
 
 // define the logging structure used for printout of error and warning messages
@@ -43,13 +43,18 @@
 #define RSSI_WAIT	6							// was 25
 
 // How long will it take when hopping before a CDONE or CDETD value
-// is present and can be measured.
+// is present and can be measured. In S_SCAN, S_CAD and S_RX the stateMachine()
+// uses the loraTimes[] of the SF and channel instead.
 //
 #define EVENT_WAIT	15000						// XXX 180520 was 25 milliseconds before CDDETD timeout
 #define DONE_WAIT	1950						// 2000 microseconds (1/500) sec between CDDONE events
 
-// Correct for the delay time and for activation TX time.
-#define WAIT_CORRECTION	20000					// In uSecs, delay the time less, and use te time for the delay of TX
+// Downlink messages are staged by txDispatch() when less than TX_LEAD uSecs
+// remain: txLoraModem() programs the radio, loads the FIFO and puts it in FSTX,
+// then txArm() starts it at the transmit time (see _TX_TIMER).
+// TX_MAXWAIT is the maximum time a message may wait in txQueue.
+#define TX_LEAD		15000						// In uSecs
+#define TX_MAXWAIT	8000000						// In uSecs, JOIN_ACCEPT2 is at 6 seconds
 
 // SPI setting. 8MHz seems to be the max
 #define SPISPEED 8000000						// Set to freq (40MHz) / 8
@@ -59,6 +64,13 @@
 // Each "real" gateway should support the first 3 frequencies according to LoRa spec.
 // NOTE: This means you have to specify at least 3 frequencies here for the single
 //	channel gateway to work according to spec. 
+//
+// The FRF register value of each frequency is computed by the compiler, so
+// setFrf() only has to burst-write the three MSB/MID/LSB bytes. Only
+// frequencies chosen by the server (_STRICT_1CH==2) are computed at runtime
+// by setFreq().
+#define FRF(f)	((uint32_t)((((uint64_t)(f)) << 19) / 32000000) & 0x00FFFFFF)
+
 struct vector {
 	// Upstream messages
 	uint32_t upFreq;							// 4 bytes unsigned int32 Frequency
@@ -70,6 +82,17 @@ struct vector {
 	uint16_t dwnBW;								// 2 bytes BW Specification
 	uint8_t  dwnLo;								// 1 bytes Spreading Factor
 	uint8_t  dwnHi;								// 1 bytes Spreading Factor
+	// FRF register bytes MSB, MID, LSB
+	uint8_t  upFrf[3];							// 3 bytes REG_FRF_MSB to REG_FRF_LSB
+	uint8_t  dwnFrf[3];							// 3 bytes REG_FRF_MSB to REG_FRF_LSB
+
+	constexpr vector(uint32_t uf, uint16_t ub, uint8_t ul, uint8_t uh,
+					 uint32_t df, uint16_t db, uint8_t dl, uint8_t dh) :
+		upFreq(uf), upBW(ub), upLo(ul), upHi(uh),
+		dwnFreq(df), dwnBW(db), dwnLo(dl), dwnHi(dh),
+		upFrf{ (uint8_t)(FRF(uf)>>16), (uint8_t)(FRF(uf)>>8), (uint8_t)FRF(uf) },
+		dwnFrf{ (uint8_t)(FRF(df)>>16), (uint8_t)(FRF(df)>>8), (uint8_t)FRF(df) }
+	{ }
 };
 
 // Define all the relevant LoRa Regions
@@ -183,6 +206,71 @@ vector freqs [] = {
 // Set the structure for spreading factor
 enum sf_t { SF6=6, SF7, SF8, SF9, SF10, SF11, SF12 };
 
+// ----------------------------------------
+// LoRa timing, see the Semtech SX1276 datasheet para 4.1.1.6 and 4.1.1.7.
+// All times are in microseconds. The functions are constexpr so that the
+// loraTimes[] table below is computed by the compiler.
+//	sf:		Spreading factor 7-12
+//	bw:		Bandwidth in kHz (125, 250 or 500)
+//	size:	Payload length in bytes
+//	cr:		Coding rate 1-4 for 4/5 to 4/8
+//	pre:	Number of preamble symbols
+//	ih:		1 for implicit header, 0 for explicit header
+//	crc:	1 if CRC is on, 0 otherwise
+// Low data rate optimize is used when a symbol takes longer than 16 mSec.
+#define LORA_PREAMBLE	8						// Preamble symbols of LoRaWAN
+
+constexpr uint32_t symbTime(uint8_t sf, uint16_t bw) {
+	return( (((uint32_t)1 << sf) * 1000) / bw );
+}
+constexpr uint8_t loraLdro(uint8_t sf, uint16_t bw) {
+	return( (symbTime(sf,bw) > 16000) ? 1 : 0 );
+}
+constexpr int32_t loraPayNum(uint8_t sf, uint8_t size, uint8_t ih, uint8_t crc) {
+	return( 8*size - 4*sf + 28 + 16*crc - 20*ih );
+}
+constexpr int32_t loraPayDen(uint8_t sf, uint16_t bw) {
+	return( 4*(sf - 2*loraLdro(sf,bw)) );
+}
+constexpr uint32_t loraPaySymb(uint8_t sf, uint16_t bw, uint8_t size, uint8_t cr, uint8_t ih, uint8_t crc) {
+	return( 8 + ((loraPayNum(sf,size,ih,crc) > 0)
+		? ((loraPayNum(sf,size,ih,crc) + loraPayDen(sf,bw) - 1) / loraPayDen(sf,bw)) * (cr + 4)
+		: 0) );
+}
+constexpr uint32_t loraPreTime(uint8_t sf, uint16_t bw, uint8_t pre) {
+	return( ((4*pre + 17) * symbTime(sf,bw)) / 4 );						// pre + 4.25 symbols
+}
+constexpr uint32_t loraAirTime(uint8_t sf, uint16_t bw, uint8_t size, uint8_t cr, uint8_t pre, uint8_t ih, uint8_t crc) {
+	return( loraPreTime(sf,bw,pre) + loraPaySymb(sf,bw,size,cr,ih,crc) * symbTime(sf,bw) );
+}
+
+// Timing per SF for BW125, used for the CAD, RX and hop timeouts of the
+// stateMachine(). For BW250 and BW500 channels the times are scaled by
+// chanTime(). A CAD takes about 2 symbols, the preamble 8+4.25 symbols and
+// air is the time of a 64 byte message, CR4/5 with CRC.
+struct loraTime {
+	uint32_t	symb;							// One symbol
+	uint32_t	cad;							// One CAD, time between CDDONE events
+	uint32_t	pre;							// Preamble, time left to detect a message
+	uint32_t	air;							// Airtime of a PAYLOAD_LENGTH message
+};
+
+#define LORA_TIME(s)	{ symbTime(s,125), 2*symbTime(s,125), loraPreTime(s,125,LORA_PREAMBLE), \
+						  loraAirTime(s,125,PAYLOAD_LENGTH,1,LORA_PREAMBLE,0,1) }
+
+const struct loraTime loraTimes[6] = {			// SF7 to SF12
+	LORA_TIME(SF7), LORA_TIME(SF8), LORA_TIME(SF9),
+	LORA_TIME(SF10), LORA_TIME(SF11), LORA_TIME(SF12)
+};
+
+// Detection counters per SF, to measure the effect of the timeouts
+struct sfDet {
+	uint32_t	cad;							// CDDONE, a CAD was done on this SF
+	uint32_t	det;							// CDDETD, a preamble was detected
+	uint32_t	rx;								// RXDONE, a message was received
+	uint32_t	tout;							// RXTOUT, a detected message was lost
+} sfDet[6];
+
 // The state of the receiver. See Semtech Datasheet (rev 4, March 2015) page 43
 // The _state is of the enum type (and should be cast when used as a number)
 enum state_t { S_INIT=0, S_SCAN, S_CAD, S_RX, S_TX, S_TXDONE};
@@ -190,6 +278,31 @@ enum state_t { S_INIT=0, S_SCAN, S_CAD, S_RX, S_TX, S_TXDONE};
 volatile state_t _state=S_INIT;
 volatile uint8_t _event=0;
 
+// Interrupt event queue.
+// The Interrupt_x() handlers push the dio number and the micros() of the
+// interrupt in evtQueue (only they write evtHead), stateMachine() takes them
+// out again (only it writes evtTail). So no locking is needed.
+// EVT_QUEUE must be a power of 2.
+#define EVT_QUEUE 8
+#define EVT_HIST 8								// Number of latency histogram buckets
+
+struct intEvent {
+	uint8_t		dio;							// 0, 1 or 2
+	uint32_t	tmst;							// micros() at interrupt time
+};
+volatile struct intEvent evtQueue[EVT_QUEUE];
+volatile uint8_t evtHead = 0;
+volatile uint8_t evtTail = 0;
+volatile uint16_t evtDrops = 0;					// Events lost as queue was full
+
+uint32_t dioTime[3] = { 0, 0, 0 };				// Last interrupt time for each dio
+
+// Histogram of the time between interrupt and stateMachine() handling it.
+// Bucket upper limits in microseconds, the last bucket is everything above.
+const uint32_t evtLimit[EVT_HIST-1] = { 50, 100, 200, 500, 1000, 2000, 5000 };
+uint32_t evtHist[EVT_HIST];
+uint32_t evtMax = 0;
+
 // rssi is measured at specific moments and reported on others
 // so we need to store the current value we like to work with
 uint8_t _rssi;	
@@ -304,7 +417,7 @@ struct pins {
 
 // stat_t contains the statistics that are kept for a message. 
 // Each time a message is received or sent the statistics are updated.
-// In case _STATISTICS==1 we define the last gwayConfig.maxStat message as statistics
+// In case _STATISTICS==1 we keep the last _MAXSTAT messages as statistics
 struct stat_t {
 	uint32_t time;							// Time since 1970 in seconds		
 	uint32_t node;							// 4-byte DEVaddr (the only one known to gateway)
@@ -314,10 +427,14 @@ struct stat_t {
 	int8_t	rssi;						// XXX Can be < -128
 #endif //RSSI
 	int8_t	prssi;						// XXX Can be < -128
+	int8_t	snr;							// Uplink only
 	uint8_t upDown;							// 0==up, 1==down
 #if _LOCALSERVER>=1
 	uint8_t data[24];						// For memory purposes, only 24 chars
-	uint8_t datal;							// Length of decoded message 1 char
+	uint8_t datal;							// Length of the message in data
+	uint8_t plain;							// data is decrypted, else FRMPayload as received
+	uint16_t fcnt;							// FCnt of the message, for decryption
+	int16_t decode;							// Index in decodes[] and devKeys[]
 #endif
 } stat_t;
 
@@ -328,6 +445,12 @@ struct stat_t {
 // So where statr contains the statistics gathered per packet the statc_c
 // contains general statistics of the node
 
+// The counters per channel are sized from the freqs[] table of the
+// frequency plan, the SF counters are for SF7 to SF12. They are always
+// kept, _STATISTICS only selects which tables are shown on the web page.
+#define STAT_CH		(sizeof(freqs)/sizeof(freqs[0]))
+#define STAT_SF		6
+
 struct stat_c {
 
 	uint32_t msg_ok;
@@ -335,47 +458,40 @@ struct stat_c {
 	uint32_t msg_down;
 	uint32_t msg_sens;
 
-	// Of statistics == 2 we add spreading factor data to the statistics
-#if _STATISTICS >= 2						// Only if we explicitly set it higher	
-	uint32_t sf7, sf8, sf9;					// Spreading factor 7, 8, 9 statistics/Count
-	uint32_t sf10, sf11, sf12;				// Spreading factor 10, 11, 12
-	
-	// If _STATISTICS is 3, we add statistics about the channel 
-	// When only one channel is used, we normally know the spread of these
-	// statistics, but when HOP mode is selected we migth want to add this info
-#if _STATISTICS >=3
-	uint32_t msg_ok_0,   msg_ok_1,   msg_ok_2;
-	uint32_t msg_ttl_0,  msg_ttl_1,  msg_ttl_2;
-	uint32_t msg_down_0, msg_down_1, msg_down_2;
-	uint32_t msg_sens_0, msg_sens_1, msg_sens_2;
-
-	uint32_t  sf7_0,  sf7_1,  sf7_2;
-	uint32_t  sf8_0,  sf8_1,  sf8_2;
-	uint32_t  sf9_0,  sf9_1,  sf9_2;
-	uint32_t sf10_0, sf10_1, sf10_2;
-	uint32_t sf11_0, sf11_1, sf11_2;
-	uint32_t sf12_0, sf12_1, sf12_2;
-#endif //3
+	uint32_t msg_ok_ch[STAT_CH];			// Same counters per channel
+	uint32_t msg_ttl_ch[STAT_CH];
+	uint32_t msg_down_ch[STAT_CH];
+	uint32_t msg_sens_ch[STAT_CH];
+
+	uint32_t sf[STAT_CH][STAT_SF];			// Uplink per channel and SF7 to SF12
 	
 	uint16_t boots;							// Number of boots
 	uint16_t resets;
-#endif // 2
 
 } stat_c;
 struct stat_c statc;
 
-// History of received uplink and downlink messages from nodes
-struct stat_t * statr;
-
+#	define STAT_MAX _MAXSTAT
 
 #else //_STATISTICS==0
-struct stat_t	statr[1];					// Always have at least one element to store in
+#	define STAT_MAX 1						// Always have at least one element to store in
 #endif
 
+// History of received uplink and downlink messages from nodes. This is a
+// ring buffer, statHead is the index of the newest record. statNew() adds
+// a record in place of the oldest, statRec(i) returns the i-th newest.
+// gwayConfig.maxStat only limits the number of records shown.
+struct stat_t statr[STAT_MAX];
+uint8_t statHead = 0;
+
 
-// Define the payload structure used to separate interrupt and SPI
-// processing from the loop() part
-uint8_t payLoad[128];						// Payload i
+// Downlink payloads stay base64 encoded until sendPkt() decodes them straight
+// into the radio FIFO. Only the first TX_HDR bytes (MHDR, FHDR, FPort and the
+// start of FRMPayload) are decoded in payLoad for the statistics and debug.
+#define TX_MAX_SIZE	255							// Largest LoRa payload
+#define TX_B64_LEN	(((TX_MAX_SIZE+2)/3)*4)		// Its base64 length, 340
+#define TX_HDR		33							// 44 base64 characters
+uint8_t payLoad[TX_HDR];
 
 
 
@@ -398,7 +514,7 @@ struct LoraDown {
 	uint8_t		size;
 	uint8_t		chan;						// = <NOT USED>
 	uint8_t		sf;							// through datr
-	uint8_t		bw;							// through datr
+	uint16_t	bw;							// through datr, 125 to 500
 	
 	bool		ipol;
 	uint8_t		powe;						// transmit power == 14, except when using special channel
@@ -406,7 +522,8 @@ struct LoraDown {
 	uint8_t		iiq;						// message inverted or not for node-node communiction
 	uint8_t		imme;						// Immediate transfer execution
 	uint8_t		ncrc;						// no CRC check
-	uint8_t		prea;						// preamble
+	uint8_t		prea;						// preamble symbols, 0 is LORA_PREAMBLE
+	uint8_t		cr;							// Coding rate of codr, 1 (4/5) to 4 (4/8)
 	uint8_t		rfch;						// Antenna "RF chain" used for TX (unsigned integer)
 
 	char *		modu;						//	"LORA" os "FSCK"
@@ -414,9 +531,46 @@ struct LoraDown {
 	char *		codr;
 
 	uint8_t	* 	payLoad;
+	const char * b64;						// base64 payload for sendPkt(), or NULL when payLoad holds it all
+	uint16_t	b64Len;						// Length of b64
 } LoraDown;
 
 
+// The txpk fields of a PULL_RESP that sendPacket() uses besides LoraDown,
+// filled by txpkParse(). The strings point into the PULL_RESP buffer.
+struct txpk {
+	char *		data;						// base64 payload
+	uint16_t	dataLen;					// Length of data
+	uint16_t	size;						// Payload size stated by the server
+	uint32_t	freq;						// Requested frequency in Hz
+	char *		time;						// UTC time string or NULL
+};
+
+
+// Downlink (JIT) queue.
+// sendPacket() decodes a PULL_RESP message in LoraDown, txAdmit() then copies
+// it into txQueue, sorted on the time it has to be transmitted (tmst).
+// txDispatch() is called by loop() and starts the transmission of txQueue[0]
+// when it is due, so we keep receiving while waiting for a downlink.
+struct txEntry {
+	struct LoraDown	dwn;						// Decoded txpk, dwn.payLoad and dwn.b64 not used
+	uint8_t		ack[3];							// buff_down[0-2] of PULL_RESP, for TX_ACK
+	char		b64[TX_B64_LEN];				// Copy of the base64 payload, dwn.b64Len long
+};
+struct txEntry txQueue[_TXQUEUE];
+uint8_t txCnt = 0;								// Number of entries in txQueue
+uint8_t txAck[3];								// buff_down[0-2] of the message transmitting
+
+struct txStat {
+	uint16_t	admit;							// Accepted in txQueue
+	uint16_t	early;							// Rejected, tmst too far in the future
+	uint16_t	late;							// Rejected or dropped, tmst has passed
+	uint16_t	collide;						// Rejected, overlaps with queued message
+	uint16_t	full;							// Rejected, txQueue full
+	uint16_t	fail;							// Dropped, txLoraModem() could not load the FIFO
+} txStat;
+
+
 
 // Up buffer (from Lora sensor to UDP)
 // This struct contains all data of the buffer received from devices to gateway
@@ -441,6 +595,108 @@ struct LoraUp {
 } LoraUp;
 
 
+// Uplink queue of received frames.
+// The S_RX state of stateMachine() fills rxQueue[rxHead] with the FIFO data and
+// the register values and restarts the receiver. loop() empties the queue from
+// rxTail with receivePacket() which builds and sends the PUSH_DATA message.
+// Both indexes are only changed in user space (not in interrupt).
+struct LoraUp rxQueue[_RXQUEUE];
+uint8_t rxHead = 0;								// Next free slot, written by stateMachine()
+uint8_t rxTail = 0;								// Oldest pending frame, written by loop()
+
+
+// Radio dead-time statistics of the uplink pipeline in microseconds.
+// dead is the time between RXDONE and the receiver running again, serv the
+// time loop() needs for forwarding the frame. Before the queue was introduced
+// the receiver was deaf for dead+serv microseconds for every message.
+struct rxPipe {
+	uint32_t	dead;							// Last RXDONE to re-arm time
+	uint32_t	deadMax;
+	uint32_t	deadTtl;						// Total, for the average
+	uint32_t	serv;							// Last buildPacket() and sendRxpk() time
+	uint32_t	servMax;
+	uint32_t	servTtl;
+	uint32_t	cnt;							// Number of frames queued
+	uint16_t	drops;							// Frames dropped as queue was full
+	uint32_t	fifo;							// Last FIFO read time by readBuffer()
+	uint32_t	fifoTtl;						// Total FIFO read time
+	uint32_t	fifoBytes;						// Total bytes read from FIFO
+	uint32_t	stack;							// Lowest free stack after forwarding, 0 is unknown
+	uint32_t	pushMsgs;						// Frames sent in PUSH_DATA by pushData()
+	uint32_t	pushDgrams;						// PUSH_DATA datagrams, for the mean batch size
+	uint32_t	dups;							// Duplicate uplinks not forwarded, see _DEDUP
+	uint32_t	dupsConf;						// Duplicate confirmed uplinks, forwarded
+	uint32_t	micErrs;						// Uplinks with a wrong MIC, not forwarded
+} rxPipe;
+
+
+#if _DEDUP>=1
+// The last _DEDUP data uplinks, for dupCheck(). Entries are replaced in the
+// order received, so dupNext is always the oldest.
+struct dupEntry {
+	uint32_t	node;							// DevAddr, as in statr[].node
+	uint32_t	mic;							// Last 4 bytes of the frame
+	uint16_t	fcnt;
+	uint32_t	tim;							// millis() when received
+};
+struct dupEntry dupCache[_DEDUP];
+uint8_t dupNext = 0;
+#endif //_DEDUP
+
+
+// Upper limit of the size of one rxpk object of writeRxpk() for a payload
+// of s bytes, and of the 12 byte header plus {"rxpk":[ and ]}.
+#define RXPK_MAX(s)	(160 + 4*(((s)+2)/3))
+#define RXPK_HDR	(12 + 9 + 2)
+
+#if _RXBATCH>=1
+// Frames waiting to be sent together in one PUSH_DATA, filled by batchAdd()
+// and sent by batchFlush(). The number of slots is what fits in the MTU
+// with an empty payload, larger frames are limited by batchLen.
+#define RXBATCH_SLOTS	((_RXBATCH_MTU - RXPK_HDR) / (RXPK_MAX(0) + 1))
+struct LoraUp rxBatch[RXBATCH_SLOTS];
+uint8_t rxBatchCnt = 0;							// Frames in rxBatch[]
+uint16_t rxBatchLen = 0;						// Upper limit of the datagram size
+uint32_t rxBatchStart = 0;						// millis() of the first frame
+#endif //_RXBATCH
+
+#if _TRAFFIC>=1
+// Synthetic traffic, see _traffic.ino. Per channel and SF we keep the frame
+// that is on the air at the moment (collision model), and per SF the counters.
+struct trafAir {
+	uint16_t	dev;							// Device sending
+	uint16_t	fcnt;							// FCnt of its frame
+	bool		busy;							// A frame is on the air
+	bool		col;							// Frame collided with another one
+	uint32_t	start;							// micros() of start of frame
+	uint32_t	end;							// micros() of end of frame
+} trafAir[_TRAFFIC_HOPS][6];
+
+struct trafStat {
+	uint32_t	gen;							// Frames sent by the devices
+	uint32_t	det;							// Frames the gateway could hear
+	uint32_t	rx;								// Frames put in the uplink queue
+	uint32_t	fwd;							// Frames forwarded by forwardQueue()
+	uint32_t	col;							// Lost, collision on the same SF
+	uint32_t	miss;							// Lost, wrong channel or SF, or radio busy
+	uint32_t	full;							// Lost, uplink queue full
+} trafStat[6];
+
+uint32_t trafNext[_TRAFFIC];					// micros() of next frame per device
+uint16_t trafFcnt[_TRAFFIC];					// FCnt of the next frame per device
+uint32_t trafBusy = 0;							// Radio is receiving until this micros()
+
+// When set, trafficGen() hands every frame to this function to put it on the
+// air (the sx1276 simulator of test_traffic) and the radio decides what is
+// received, instead of the collision model of trafficDone().
+void (*trafRadio)(uint8_t chan, uint8_t sfDev, uint8_t *frame, uint8_t len) = NULL;
+
+// Forward time histogram for the percentiles, in uSec
+const uint32_t fwdLimit[EVT_HIST-1] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000 };
+uint32_t fwdHist[EVT_HIST];
+#endif //_TRAFFIC
+
+
 
 
 // ============================================================================
@@ -521,6 +777,26 @@ struct LoraUp {
 #define REG_PADAC_SX1272			0x5A
 #define REG_PADAC_SX1276			0x4D
 
+// ----------------------------------------
+// Shadow copy of the configuration registers. Only registers that are
+// written by the gateway and never changed by the chip itself are kept
+// (see regCached() in _loraModem.ino). A write of an unchanged value is
+// skipped and a read is served from the shadow without SPI traffic.
+// The shadow is invalidated when the chip is reset in initLoraModem().
+#define REG_SHADOW					0x5B		// Registers 0x00 to 0x5A
+uint8_t regShadow[REG_SHADOW];
+uint8_t regValid[(REG_SHADOW+7)/8];				// One bit per shadow register
+
+struct spiStat {
+	uint32_t	reads;							// SPI register reads
+	uint32_t	writes;							// SPI register writes
+	uint32_t	skips;							// Reads and writes served by the shadow
+	uint16_t	hop;							// SPI transactions of the last hop()
+	uint16_t	hopSkip;						// Transactions saved in the last hop()
+	uint16_t	cad;							// SPI transactions of the last cadScanner()
+	uint16_t	cadSkip;						// Transactions saved in the last cadScanner()
+} spiStat;
+
 
 // ----------------------------------------
 // opModes
@@ -634,6 +910,144 @@ struct LoraUp {
 #define IRQ_LORA_CDDETD_MASK 		0x01	// Detect preamble channel
 
 
+// ----------------------------------------
+// Register programs
+// A register program is a list of (register, value) pairs, sorted on register
+// address, that brings the radio in a certain mode. They are applied by
+// applyProg() which writes each run of consecutive registers in one burst.
+// Values that depend on the message (frequency, power, payload length) are
+// still written by the caller.
+struct regVal {
+	uint8_t		reg;
+	uint8_t		val;
+};
+
+#if _GWAYSCAN!=1
+#	define INVERTIQ_RX				0x27	// Normal IQ, prevent node to node communication
+#else
+#	define INVERTIQ_RX				0x40	// Inverted IQ, receive other gateway messages
+#endif
+
+const struct regVal progCad[] = {
+	{ REG_IRQ_FLAGS_MASK,	(uint8_t) ~(IRQ_LORA_CDDONE_MASK | IRQ_LORA_CDDETD_MASK | IRQ_LORA_CRCERR_MASK | IRQ_LORA_HEADER_MASK) },
+	{ REG_SYNC_WORD,		0x34 },										// LORA_MAC_PREAMBLE
+	{ REG_DIO_MAPPING_1,	MAP_DIO0_LORA_CADDONE | MAP_DIO1_LORA_CADDETECT | MAP_DIO2_LORA_NOP | MAP_DIO3_LORA_CRC }
+};
+
+const struct regVal progRx[] = {
+	{ REG_LNA,				LNA_MAX_GAIN },
+	{ REG_IRQ_FLAGS_MASK,	(uint8_t) ~(IRQ_LORA_RXDONE_MASK | IRQ_LORA_RXTOUT_MASK | IRQ_LORA_HEADER_MASK | IRQ_LORA_CRCERR_MASK) },
+	{ REG_INVERTIQ,			INVERTIQ_RX },
+	{ REG_DIO_MAPPING_1,	MAP_DIO0_LORA_RXDONE | MAP_DIO1_LORA_RXTOUT | MAP_DIO2_LORA_NOP | MAP_DIO3_LORA_CRC }
+};
+
+// REG_PARAMP is not in progHop and progTx: only its lower nibble is set, as
+// bit 4 of the sx1272 (LowPnTxPllOff) must keep its value
+const struct regVal progHop[] = {
+	{ REG_LNA,				LNA_MAX_GAIN },
+	{ REG_IRQ_FLAGS_MASK,	0x00 },										// Enable all interrupts
+	{ REG_PAYLOAD_LENGTH,	PAYLOAD_LENGTH },							// 0x22, 0x23 and 0x24 in one burst
+	{ REG_MAX_PAYLOAD_LENGTH, MAX_PAYLOAD_LENGTH },
+	{ REG_HOP_PERIOD,		0x00 },
+	{ REG_INVERTIQ,			0x27 },										// Reset from TX
+	{ REG_SYNC_WORD,		0x34 }
+};
+
+const struct regVal progTx[] = {
+	{ REG_LNA,				LNA_MAX_GAIN },
+	{ REG_FIFO_TX_BASE_AD,	0x00 },										// Whole FIFO, 255 byte payloads
+	{ REG_IRQ_FLAGS_MASK,	(uint8_t) ~IRQ_LORA_TXDONE_MASK },
+	{ REG_MAX_PAYLOAD_LENGTH, MAX_PAYLOAD_LENGTH },
+	{ REG_INVERTIQ,			INVERTIQ_RX | 0x40 },						// Inverted IQ for downstream
+	{ REG_SYNC_WORD,		0x34 },
+	{ REG_INVERTIQ2,		0x19 },
+	{ REG_DIO_MAPPING_1,	MAP_DIO0_LORA_TXDONE | MAP_DIO1_LORA_NOP | MAP_DIO2_LORA_NOP | MAP_DIO3_LORA_NOP }
+};
+
+#define PROG_LEN(p) (sizeof(p)/sizeof(struct regVal))
+
+// Rate programs, one for every chip, SF7 to SF12 and CRC off (TX) or on (RX).
+// MC1, MC2 and SYMB_TIMEOUT_LSB (0x1D-0x1F) are written in one burst, MC3 (0x26)
+// separately. The values are computed by the compiler with the same rules
+// setRate() used: BW125 CR4/5 for the sx1276, BW250 for the sx1272, and
+// low data rate optimize for SF11 and SF12.
+struct ratePrg {
+	uint8_t		mc[3];							// REG_MODEM_CONFIG1, 2 and REG_SYMB_TIMEOUT_LSB
+	uint8_t		mc3;							// REG_MODEM_CONFIG3
+};
+
+constexpr uint8_t rateMc1(bool s76, uint8_t sf) {
+	return(s76 ? 0x72 : ((sf>=SF11) ? 0x0B : 0x0A));
+}
+constexpr uint8_t rateMc2(bool s76, uint8_t sf, uint8_t crc) {
+	return(s76 ? (uint8_t)((sf<<4) | crc) : (uint8_t)(((sf<<4) | crc) % 0xFF));
+}
+constexpr uint8_t rateSymb(uint8_t sf) {
+	return((sf>=SF10) ? 0x05 : 0x08);
+}
+constexpr uint8_t rateMc3(bool s76, uint8_t sf) {
+	return((s76 && (sf>=SF11)) ? 0x01 : 0x00);
+}
+
+#define RATE(c,s,r)		{ { rateMc1(c,s), rateMc2(c,s,r), rateSymb(s) }, rateMc3(c,s) }
+#define RATE_SF(c,s)	{ RATE(c,s,0x00), RATE(c,s,0x04) }
+#define RATE_CHIP(c)	{ RATE_SF(c,SF7), RATE_SF(c,SF8), RATE_SF(c,SF9), \
+						  RATE_SF(c,SF10), RATE_SF(c,SF11), RATE_SF(c,SF12) }
+
+const struct ratePrg ratePrgs[2][6][2] = {		// [sx1276][sf-SF7][crc!=0]
+	RATE_CHIP(false),
+	RATE_CHIP(true)
+};
+
+// Time needed to switch the radio into a mode, in uSec
+struct modeTime {
+	uint32_t	cad;							// Last cadScanner()
+	uint32_t	cadMax;
+	uint32_t	rx;								// Last rxLoraModem()
+	uint32_t	rxMax;
+	uint32_t	tx;								// Last txLoraModem() staging, FIFO included
+	uint32_t	txMax;
+} modeTime;
+
+// Start of the downlinks against the requested time tmst + txDelay, in uSec.
+// Positive is late. Measured by txGo() right after the REG_OPMODE write.
+struct txJitter {
+	uint32_t	start;							// micros() of the last TX start
+	int32_t		last;
+	int32_t		min;
+	int32_t		max;
+	int32_t		sum;							// For the mean, sum/cnt
+	uint16_t	cnt;
+} txJit;
+
+volatile bool txArmed = false;					// A staged downlink waits for txGo()
+uint32_t txDue;									// micros() the staged downlink must start
+
+// The fields of the staged downlink that txCalib() needs on TXDONE, copied by txArm().
+// The global LoraDown is overwritten by sendPacket() when a PULL_RESP comes in
+// during the transmission.
+struct txArmDown {
+	uint32_t	tmst;
+	uint16_t	bw;
+	uint8_t		sf;
+	uint8_t		size;
+	uint8_t		crc;
+	uint8_t		cr;
+	uint8_t		prea;
+	uint8_t		imme;
+} txDwn;
+
+// Histogram of the real TX start (TXDONE time minus airtime) against tmst, filled
+// by txCalib(). Bucket upper limits in microseconds, the last bucket is everything
+// above. Measurements more than TX_CAL_MAX off are counted in txCalOut only.
+#define TX_HIST 8
+#define TX_CAL_MAX 50000
+const int32_t txErrLimit[TX_HIST-1] = { -2000, -500, -100, 0, 100, 500, 2000 };
+uint32_t txErrHist[TX_HIST];
+int32_t txErrLast = 0;							// Last TX start error against tmst
+uint16_t txCalOut = 0;							// Measurements not used
+
+
 // ----------------------------------------
 // Definitions for UDP message arriving from server
 #define	_PROTOCOL					0x02	// This is the new version
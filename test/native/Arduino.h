@@ -0,0 +1,317 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// 	based on work done by Thomas Telkamp for Raspberry PI 1ch gateway and many others.
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of the Arduino core, just enough to compile the gateway sketch
+// on Linux for the tests in test/. Time is virtual: micros() only moves when
+// delay(), delayMicroseconds(), an SPI transfer or the test itself advances it
+// with simAdvance(). Radio and timer interrupts are delivered while the clock
+// moves, and are held back between noInterrupts() and interrupts() like on the ESP.
+// The shims define their objects (Serial, SPI, SPIFFS, the clock) in the headers, as
+// the sketch does, so a test includes them in one source file only.
+// ----------------------------------------------------------------------------------------
+#ifndef ARDUINO_SHIM_H
+#define ARDUINO_SHIM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+
+#define ARDUINO 10813
+
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+
+// ----------------------------------------------------------------------------------------
+// String, a std::string with the Arduino interface
+// ----------------------------------------------------------------------------------------
+class String {
+public:
+	String() {}
+	String(const char *s) : s_(s ? s : "") {}
+	String(const __FlashStringHelper *s) : s_(reinterpret_cast<const char *>(s)) {}
+	String(const std::string &s) : s_(s) {}
+	explicit String(char c) : s_(1, c) {}
+	explicit String(unsigned char v, unsigned char base=DEC) { num((unsigned long long) v, base); }
+	explicit String(int v, unsigned char base=DEC) { snum(v, base); }
+	explicit String(unsigned int v, unsigned char base=DEC) { num(v, base); }
+	explicit String(long v, unsigned char base=DEC) { snum(v, base); }
+	explicit String(unsigned long v, unsigned char base=DEC) { num(v, base); }
+	explicit String(long long v, unsigned char base=DEC) { snum(v, base); }
+	explicit String(unsigned long long v, unsigned char base=DEC) { num(v, base); }
+	explicit String(float v, unsigned char dec=2) { dbl(v, dec); }
+	explicit String(double v, unsigned char dec=2) { dbl(v, dec); }
+
+	unsigned int length() const { return s_.length(); }
+	const char *c_str() const { return s_.c_str(); }
+	bool reserve(unsigned int n) { s_.reserve(n); return true; }
+	char charAt(unsigned int i) const { return i < s_.length() ? s_[i] : 0; }
+	void setCharAt(unsigned int i, char c) { if (i < s_.length()) s_[i] = c; }
+	char operator[](unsigned int i) const { return charAt(i); }
+	char &operator[](unsigned int i) { return s_[i]; }
+	String substring(unsigned int from) const { return from < s_.length() ? String(s_.substr(from)) : String(); }
+	String substring(unsigned int from, unsigned int to) const {
+		if (from > to) std::swap(from, to);
+		if (from >= s_.length()) return String();
+		return String(s_.substr(from, to - from));
+	}
+	int indexOf(char c, unsigned int from=0) const { size_t i = s_.find(c, from); return i == std::string::npos ? -1 : (int) i; }
+	int indexOf(const String &s, unsigned int from=0) const { size_t i = s_.find(s.s_, from); return i == std::string::npos ? -1 : (int) i; }
+	int lastIndexOf(char c) const { size_t i = s_.rfind(c); return i == std::string::npos ? -1 : (int) i; }
+	long toInt() const { return atol(s_.c_str()); }
+	float toFloat() const { return (float) atof(s_.c_str()); }
+	bool startsWith(const String &p) const { return s_.compare(0, p.s_.length(), p.s_) == 0; }
+	bool endsWith(const String &p) const { return s_.length() >= p.s_.length() && s_.compare(s_.length() - p.s_.length(), p.s_.length(), p.s_) == 0; }
+	bool equals(const String &o) const { return s_ == o.s_; }
+	void trim() {
+		size_t b = s_.find_first_not_of(" \t\r\n");
+		size_t e = s_.find_last_not_of(" \t\r\n");
+		s_ = (b == std::string::npos) ? std::string() : s_.substr(b, e - b + 1);
+	}
+	void toUpperCase() { for (auto &c: s_) c = toupper(c); }
+	void toLowerCase() { for (auto &c: s_) c = tolower(c); }
+	void remove(unsigned int i) { if (i < s_.length()) s_.erase(i); }
+	void remove(unsigned int i, unsigned int n) { if (i < s_.length()) s_.erase(i, n); }
+	void replace(const String &a, const String &b) {
+		if (a.s_.empty()) return;
+		for (size_t i = s_.find(a.s_); i != std::string::npos; i = s_.find(a.s_, i + b.s_.length())) s_.replace(i, a.s_.length(), b.s_);
+	}
+	void toCharArray(char *buf, unsigned int n) const { getBytes((unsigned char *) buf, n); }
+	void getBytes(unsigned char *buf, unsigned int n) const {
+		if (n == 0) return;
+		size_t l = std::min((size_t) n - 1, s_.length());
+		memcpy(buf, s_.data(), l);
+		buf[l] = 0;
+	}
+
+	template<typename T> bool concat(const T &v) { *this += v; return true; }
+	String &operator+=(const String &o) { s_ += o.s_; return *this; }
+	String &operator+=(const char *o) { s_ += o; return *this; }
+	String &operator+=(const __FlashStringHelper *o) { s_ += reinterpret_cast<const char *>(o); return *this; }
+	String &operator+=(char c) { s_ += c; return *this; }
+	String &operator+=(unsigned char v) { return *this += String(v); }
+	String &operator+=(int v) { return *this += String(v); }
+	String &operator+=(unsigned int v) { return *this += String(v); }
+	String &operator+=(long v) { return *this += String(v); }
+	String &operator+=(unsigned long v) { return *this += String(v); }
+	String &operator+=(float v) { return *this += String(v); }
+	String &operator+=(double v) { return *this += String(v); }
+
+	bool operator==(const String &o) const { return s_ == o.s_; }
+	bool operator==(const char *o) const { return s_ == o; }
+	bool operator!=(const String &o) const { return s_ != o.s_; }
+	bool operator!=(const char *o) const { return s_ != o; }
+	bool operator<(const String &o) const { return s_ < o.s_; }
+
+	const std::string &str() const { return s_; }
+
+private:
+	std::string s_;
+
+	void num(unsigned long long v, unsigned char base) {
+		char buf[72];
+		int i = sizeof(buf) - 1;
+		buf[i] = 0;
+		if (base < 2) base = 10;
+		do { int d = v % base; buf[--i] = d < 10 ? '0' + d : 'a' + d - 10; v /= base; } while (v);
+		s_ = &buf[i];
+	}
+	void snum(long long v, unsigned char base) {
+		if ((base == DEC) && (v < 0)) { num((unsigned long long) -v, base); s_.insert(0, 1, '-'); }
+		else if (base == DEC) num((unsigned long long) v, base);
+		else if (v < 0) num((uint32_t) v, base);					// Like the ESP, 32 bits
+		else num((unsigned long long) v, base);
+	}
+	void dbl(double v, unsigned char dec) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%.*f", dec, v);
+		s_ = buf;
+	}
+};
+
+inline String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+inline String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, const __FlashStringHelper *b) { String r(a); r += b; return r; }
+inline String operator+(const __FlashStringHelper *a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, char c) { String r(a); r += c; return r; }
+inline String operator+(const String &a, int v) { String r(a); r += v; return r; }
+inline String operator+(const String &a, unsigned int v) { String r(a); r += v; return r; }
+inline String operator+(const String &a, long v) { String r(a); r += v; return r; }
+inline String operator+(const String &a, unsigned long v) { String r(a); r += v; return r; }
+inline String operator+(const String &a, double v) { String r(a); r += v; return r; }
+
+
+// ----------------------------------------------------------------------------------------
+// Print, Stream and Serial
+// ----------------------------------------------------------------------------------------
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buf, size_t len) {
+		size_t n = 0;
+		while (len--) n += write(*buf++);
+		return n;
+	}
+	size_t write(const char *s) { return write((const uint8_t *) s, strlen(s)); }
+	size_t write(const char *buf, size_t len) { return write((const uint8_t *) buf, len); }
+
+	size_t print(const char *s) { return write(s); }
+	size_t print(const String &s) { return write(s.c_str(), s.length()); }
+	size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+	size_t print(char c) { return write((uint8_t) c); }
+	size_t print(unsigned char v, int base=DEC) { return print(String(v, base)); }
+	size_t print(int v, int base=DEC) { return print(String(v, base)); }
+	size_t print(unsigned int v, int base=DEC) { return print(String(v, base)); }
+	size_t print(long v, int base=DEC) { return print(String(v, base)); }
+	size_t print(unsigned long v, int base=DEC) { return print(String(v, base)); }
+	size_t print(double v, int dec=2) { return print(String(v, dec)); }
+
+	template<typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+	template<typename T> size_t println(const T &v, int f) { size_t n = print(v, f); return n + println(); }
+	size_t println() { return write((const uint8_t *) "\r\n", 2); }
+
+	size_t printf(const char *fmt, ...) {
+		char buf[256];
+		va_list ap;
+		va_start(ap, fmt);
+		int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		return write(buf, std::min((size_t) n, sizeof(buf) - 1));
+	}
+};
+
+class Stream : public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+	String readStringUntil(char t) {
+		String r;
+		int c;
+		while ((available() > 0) && ((c = read()) >= 0) && (c != t)) r += (char) c;
+		return r;
+	}
+	String readString() {
+		String r;
+		int c;
+		while ((available() > 0) && ((c = read()) >= 0)) r += (char) c;
+		return r;
+	}
+};
+
+// Serial output is discarded unless echo is set, the tests look at the
+// gateway through the radio and UDP, not through its messages.
+class HardwareSerial : public Stream {
+public:
+	bool echo = false;
+	void begin(unsigned long) {}
+	void flush() { if (echo) fflush(stdout); }
+	size_t write(uint8_t c) override { if (echo) putchar(c); return 1; }
+	using Print::write;
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+	operator bool() const { return true; }
+};
+
+HardwareSerial Serial;
+
+
+// ----------------------------------------------------------------------------------------
+// Time, pins and interrupts, see simCore.h for the virtual clock
+// ----------------------------------------------------------------------------------------
+uint32_t micros();
+uint32_t millis();
+inline void delay(uint32_t ms);
+inline void delayMicroseconds(uint32_t us);
+inline void yield();
+
+inline void pinMode(uint8_t pin, uint8_t mode);
+inline void digitalWrite(uint8_t pin, uint8_t val);
+inline int digitalRead(uint8_t pin);
+inline int analogRead(uint8_t pin);
+inline void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+inline void detachInterrupt(uint8_t pin);
+#define digitalPinToInterrupt(p) (p)
+inline void noInterrupts();
+inline void interrupts();
+
+// ESP8266 timer1, the single shot timer used by txArm()
+#define TIM_DIV1	0
+#define TIM_DIV16	1
+#define TIM_DIV256	3
+#define TIM_EDGE	0
+#define TIM_LEVEL	1
+#define TIM_SINGLE	0
+#define TIM_LOOP	1
+inline void timer1_attachInterrupt(void (*isr)());
+inline void timer1_enable(uint8_t div, uint8_t edge, uint8_t reload);
+inline void timer1_write(uint32_t ticks);
+inline void timer1_disable();
+
+inline long random(long max);
+inline long random(long min, long max);
+inline void randomSeed(unsigned long seed);
+
+inline char *itoa(int v, char *buf, int base) {
+	String s(v, (unsigned char) base);
+	strcpy(buf, s.c_str());
+	return buf;
+}
+inline char *ltoa(long v, char *buf, int base) { return itoa((int) v, buf, base); }
+inline char *utoa(unsigned v, char *buf, int base) {
+	String s(v, (unsigned char) base);
+	strcpy(buf, s.c_str());
+	return buf;
+}
+inline char *dtostrf(double v, signed char width, unsigned char prec, char *buf) {
+	sprintf(buf, "%*.*f", width, prec, v);
+	return buf;
+}
+
+#include "IPAddress.h"
+#include "simCore.h"
+
+#endif //ARDUINO_SHIM_H
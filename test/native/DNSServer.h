@@ -0,0 +1,14 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of DNSServer, not used by the gateway.
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,51 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of the ESP8266 WiFi station, always connected.
+// ----------------------------------------------------------------------------------------
+#ifndef ESP8266WIFI_SHIM_H
+#define ESP8266WIFI_SHIM_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+typedef enum {
+	WL_NO_SHIELD = 255, WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_SCAN_COMPLETED = 2,
+	WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_CONNECTION_LOST = 5, WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } WiFiMode_t;
+
+class ESP8266WiFiClass {
+public:
+	wl_status_t status() { return WL_CONNECTED; }
+	bool isConnected() { return true; }
+	int begin(const char *, const char *) { return WL_CONNECTED; }
+	bool disconnect(bool = false) { return true; }
+	bool mode(WiFiMode_t) { return true; }
+	void persistent(bool) {}
+	bool setAutoConnect(bool) { return true; }
+	bool setAutoReconnect(bool) { return true; }
+	uint8_t *macAddress(uint8_t *mac) {
+		static const uint8_t m[6] = { 0x60, 0x01, 0x94, 0x1C, 0x2E, 0x3F };
+		memcpy(mac, m, 6);
+		return mac;
+	}
+	String SSID() { return String("native"); }
+	IPAddress localIP() { return IPAddress(192,168,1,38); }
+	IPAddress gatewayIP() { return IPAddress(192,168,1,1); }
+	IPAddress softAPIP() { return IPAddress(192,168,4,1); }
+	int hostByName(const char *, IPAddress &ip) { ip = IPAddress(127,0,0,1); return 1; }
+};
+
+ESP8266WiFiClass WiFi;
+
+#endif //ESP8266WIFI_SHIM_H
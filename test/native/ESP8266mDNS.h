@@ -0,0 +1,28 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of mDNS.
+// ----------------------------------------------------------------------------------------
+#ifndef ESP8266MDNS_SHIM_H
+#define ESP8266MDNS_SHIM_H
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+	bool begin(const char *) { return true; }
+	IPAddress queryHost(const char *, uint32_t = 2000) { return IPAddress(); }
+	IPAddress queryHost(const String &, uint32_t = 2000) { return IPAddress(); }
+};
+
+MDNSResponder MDNS;
+
+#endif //ESP8266MDNS_SHIM_H
@@ -0,0 +1,31 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of the ESP class.
+// ----------------------------------------------------------------------------------------
+#ifndef ESP_SHIM_H
+#define ESP_SHIM_H
+
+#include <Arduino.h>
+
+class EspClass {
+public:
+	uint32_t getChipId() { return 0x1C2E3F; }
+	uint64_t getEfuseMac() { return 0x3F2E1C940160ull; }
+	uint8_t getCpuFreqMHz() { return 80; }
+	uint32_t getFreeHeap() { return 40000; }
+	uint32_t getFreeContStack() { return 3000; }
+	void restart() { fprintf(stderr, "ESP.restart()\n"); abort(); }
+};
+
+EspClass ESP;
+
+#endif //ESP_SHIM_H
@@ -0,0 +1,84 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of SPIFFS, files are kept in memory. Write time of the flash
+// is not simulated.
+// ----------------------------------------------------------------------------------------
+#ifndef FS_SHIM_H
+#define FS_SHIM_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+
+class File : public Stream {
+public:
+	File() {}
+	File(std::shared_ptr<std::string> d, bool w) : data(d), writing(w) {}
+
+	operator bool() const { return (bool) data; }
+	size_t write(uint8_t c) override {
+		if (!data || !writing) return 0;
+		data->push_back((char) c);
+		return 1;
+	}
+	using Print::write;
+	int available() override { return data ? (int)(data->size() - pos) : 0; }
+	int read() override { return (data && (pos < data->size())) ? (uint8_t)(*data)[pos++] : -1; }
+	int peek() override { return (data && (pos < data->size())) ? (uint8_t)(*data)[pos] : -1; }
+	size_t read(uint8_t *buf, size_t len) {
+		size_t n = 0;
+		while ((n < len) && (available() > 0)) buf[n++] = (uint8_t) read();
+		return n;
+	}
+	bool seek(uint32_t p) { pos = p; return data && (p <= data->size()); }
+	size_t position() const { return pos; }
+	size_t size() const { return data ? data->size() : 0; }
+	void flush() {}
+	void close() { data.reset(); }
+
+private:
+	std::shared_ptr<std::string> data;
+	bool writing = false;
+	size_t pos = 0;
+};
+
+class FS {
+public:
+	bool begin() { return true; }
+	void end() {}
+	bool format() { files.clear(); return true; }
+	bool exists(const char *fn) { return files.count(fn) > 0; }
+	bool exists(const String &fn) { return exists(fn.c_str()); }
+	bool remove(const char *fn) { return files.erase(fn) > 0; }
+	bool remove(const String &fn) { return remove(fn.c_str()); }
+	bool rename(const char *a, const char *b) {
+		if (!exists(a)) return false;
+		files[b] = files[a];
+		files.erase(a);
+		return true;
+	}
+	File open(const char *fn, const char *mode) {
+		if (mode[0] == 'r') {
+			if (!exists(fn)) return File();
+			return File(files[fn], false);
+		}
+		if ((mode[0] == 'w') || !exists(fn)) files[fn] = std::make_shared<std::string>();
+		return File(files[fn], true);
+	}
+	File open(const String &fn, const char *mode) { return open(fn.c_str(), mode); }
+
+	std::map<std::string, std::shared_ptr<std::string>> files;
+};
+
+FS SPIFFS;
+
+#endif //FS_SHIM_H
@@ -0,0 +1,46 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of IPAddress, IPv4 only.
+// ----------------------------------------------------------------------------------------
+#ifndef IPADDRESS_SHIM_H
+#define IPADDRESS_SHIM_H
+
+class IPAddress {
+public:
+	IPAddress() { memset(a_, 0, 4); }
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { a_[0]=a; a_[1]=b; a_[2]=c; a_[3]=d; }
+	IPAddress(uint32_t v) { memcpy(a_, &v, 4); }
+	IPAddress(const uint8_t *p) { memcpy(a_, p, 4); }
+
+	operator uint32_t() const { uint32_t v; memcpy(&v, a_, 4); return v; }
+	uint8_t operator[](int i) const { return a_[i]; }
+	uint8_t &operator[](int i) { return a_[i]; }
+	bool operator==(const IPAddress &o) const { return memcmp(a_, o.a_, 4) == 0; }
+	bool operator!=(const IPAddress &o) const { return !(*this == o); }
+
+	bool fromString(const char *s) {
+		unsigned v[4];
+		if (sscanf(s, "%u.%u.%u.%u", &v[0], &v[1], &v[2], &v[3]) != 4) return false;
+		for (int i=0; i<4; i++) a_[i] = (uint8_t) v[i];
+		return true;
+	}
+	String toString() const {
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%u.%u.%u.%u", a_[0], a_[1], a_[2], a_[3]);
+		return String(buf);
+	}
+
+private:
+	uint8_t a_[4];
+};
+
+#endif //IPADDRESS_SHIM_H
@@ -0,0 +1,81 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of SPI. Every byte goes to the sx1276 simulator, which is
+// selected with digitalWrite() of its ssPin, and takes 1 uSec of virtual time.
+// The SPI1 hardware registers of the ESP8266 (esp8266_peri.h) that writeRegisterIsr()
+// uses are here too: setting SPIBUSY in SPI1CMD sends the first (MOSI bits of
+// SPI1U1 + 1) / 8 bytes of SPI1W0, low byte first, and SPIBUSY reads back as done.
+// ----------------------------------------------------------------------------------------
+#ifndef SPI_SHIM_H
+#define SPI_SHIM_H
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0x00
+
+class SPISettings {
+public:
+	SPISettings() {}
+	SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+public:
+	void begin() {}
+	void begin(int8_t, int8_t, int8_t, int8_t) {}
+	void end() {}
+	void beginTransaction(SPISettings) {}
+	void endTransaction() {}
+	void setFrequency(uint32_t) {}
+
+	uint8_t transfer(uint8_t b) {
+		uint8_t r = sx1276Sim.transfer(b);
+		simAdvance(1);
+		return r;
+	}
+	void transfer(void *buf, uint32_t len) {				// Full duplex, in place
+		uint8_t *p = (uint8_t *) buf;
+		for (uint32_t i = 0; i < len; i++) p[i] = sx1276Sim.transfer(p[i]);
+		simAdvance(len);
+	}
+};
+
+SPIClass SPI;
+
+#define SPIBUSY		(1u << 18)
+#define SPILMOSI	17
+#define SPIMMOSI	0x1FFu
+#define SPILMISO	8
+#define SPIMMISO	0x1FFu
+
+uint32_t SPI1U1 = ((8-1) << SPILMOSI) | ((8-1) << SPILMISO);
+uint32_t SPI1W0 = 0;
+
+class Spi1Cmd {
+public:
+	operator uint32_t() const { return 0; }					// Never busy
+	Spi1Cmd &operator|=(uint32_t v) {
+		if (v & SPIBUSY) {
+			uint32_t n = (((SPI1U1 >> SPILMOSI) & SPIMMOSI) + 1) / 8;
+			for (uint32_t i = 0; (i < n) && (i < 4); i++) {
+				sx1276Sim.transfer((uint8_t)(SPI1W0 >> (8*i)));
+			}
+			simAdvance(n);
+		}
+		return *this;
+	}
+};
+Spi1Cmd SPI1CMD;
+
+#endif //SPI_SHIM_H
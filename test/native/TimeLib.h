@@ -0,0 +1,51 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of the Time library, now() follows the virtual clock.
+// ----------------------------------------------------------------------------------------
+#ifndef TIMELIB_SHIM_H
+#define TIMELIB_SHIM_H
+
+#include <Arduino.h>
+
+typedef enum { timeNotSet, timeNeedsSync, timeSet } timeStatus_t;
+
+namespace simTime {
+	time_t base = 1609459200;								// 2021-01-01 00:00:00 at simNow() 0
+	bool set = true;
+
+	inline struct tm tmOf(time_t t) {
+		struct tm r;
+		gmtime_r(&t, &r);
+		return r;
+	}
+}
+
+inline time_t now() { return simTime::base + (time_t)(simNow() / 1000000); }
+inline void setTime(time_t t) { simTime::base = t - (time_t)(simNow() / 1000000); simTime::set = true; }
+inline timeStatus_t timeStatus() { return simTime::set ? timeSet : timeNotSet; }
+
+inline int second(time_t t) { return simTime::tmOf(t).tm_sec; }
+inline int minute(time_t t) { return simTime::tmOf(t).tm_min; }
+inline int hour(time_t t) { return simTime::tmOf(t).tm_hour; }
+inline int day(time_t t) { return simTime::tmOf(t).tm_mday; }
+inline int weekday(time_t t) { return simTime::tmOf(t).tm_wday + 1; }
+inline int month(time_t t) { return simTime::tmOf(t).tm_mon + 1; }
+inline int year(time_t t) { return simTime::tmOf(t).tm_year + 1900; }
+inline int second() { return second(now()); }
+inline int minute() { return minute(now()); }
+inline int hour() { return hour(now()); }
+inline int day() { return day(now()); }
+inline int weekday() { return weekday(now()); }
+inline int month() { return month(now()); }
+inline int year() { return year(now()); }
+
+#endif //TIMELIB_SHIM_H
@@ -0,0 +1,98 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of WiFiUDP. Datagrams sent by the gateway are kept in
+// simUdp::out with their virtual send time, datagrams for the gateway are put in
+// simUdp::in by the test and returned by parsePacket() one by one.
+// ----------------------------------------------------------------------------------------
+#ifndef WIFIUDP_SHIM_H
+#define WIFIUDP_SHIM_H
+
+#include <Arduino.h>
+#include <vector>
+#include <deque>
+
+struct simDatagram {
+	IPAddress				ip;
+	uint16_t				port;
+	std::vector<uint8_t>	data;
+	uint64_t				time;
+};
+
+namespace simUdp {
+	std::deque<simDatagram> in;
+	std::deque<simDatagram> out;
+
+	inline void reset() { in.clear(); out.clear(); }
+}
+
+class WiFiUDP : public Stream {
+public:
+	uint8_t begin(uint16_t port) { local = port; return 1; }
+	void stop() {}
+
+	int beginPacket(IPAddress ip, uint16_t port) {
+		tx = simDatagram { ip, port, {}, 0 };
+		building = true;
+		return 1;
+	}
+	int beginPacket(const char *, uint16_t port) { return beginPacket(IPAddress(127,0,0,1), port); }
+	int endPacket() {
+		if (!building) return 0;
+		building = false;
+		tx.time = simNow();
+		simUdp::out.push_back(tx);
+		return 1;
+	}
+	size_t write(uint8_t c) override {
+		if (!building) return 0;
+		tx.data.push_back(c);
+		return 1;
+	}
+	size_t write(const uint8_t *buf, size_t len) override {
+		if (!building) return 0;
+		tx.data.insert(tx.data.end(), buf, buf + len);
+		return len;
+	}
+	using Print::write;
+
+	int parsePacket() {
+		rx.data.clear();
+		pos = 0;
+		if (simUdp::in.empty()) return 0;
+		rx = simUdp::in.front();
+		simUdp::in.pop_front();
+		return (int) rx.data.size();
+	}
+	int available() override { return (int)(rx.data.size() - pos); }
+	int read() override { return (pos < rx.data.size()) ? rx.data[pos++] : -1; }
+	int peek() override { return (pos < rx.data.size()) ? rx.data[pos] : -1; }
+	int read(uint8_t *buf, size_t len) {
+		size_t n = std::min(len, rx.data.size() - pos);
+		memcpy(buf, rx.data.data() + pos, n);
+		pos += n;
+		return (int) n;
+	}
+	int read(char *buf, size_t len) { return read((uint8_t *) buf, len); }
+	void flush() { pos = rx.data.size(); }					// Drop the rest, like the ESP32
+
+	IPAddress remoteIP() { return rx.ip; }
+	uint16_t remotePort() { return rx.port; }
+
+private:
+	uint16_t	local = 0;
+	bool		building = false;
+	simDatagram	tx;
+	simDatagram	rx;
+	size_t		pos = 0;
+};
+
+#endif //WIFIUDP_SHIM_H
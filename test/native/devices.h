@@ -0,0 +1,25 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// nodes[] and decodes[] of _DEVICES entries for the registry tests, included by
+// configNode.h as _DEVICES_FILE. devsBench.h fills them before initDevs().
+// ----------------------------------------------------------------------------------------
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#if _TRUSTED_NODES>=1
+nodex nodes[_DEVICES];
+#endif
+#if _LOCALSERVER>=1
+codex decodes[_DEVICES];
+#endif
+
+#endif //DEVICES_H
@@ -0,0 +1,125 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test and benchmark of the device registry (initDevs(), findDev(), SerialName() and
+// inDecodes()) with _DEVICES devices in nodes[] and decodes[]. The number of devices is
+// a compile time constant of the registry, so every size has its own test directory
+// (test_devs_1, test_devs_50, test_devs_500) that defines _DEVICES and includes this file.
+// ----------------------------------------------------------------------------------------
+#ifndef DEVSBENCH_H
+#define DEVSBENCH_H
+
+#define _DEVICES_FILE "devices.h"
+
+#include <unity.h>
+#include <chrono>
+#include "sketch.h"
+
+// DevAddr of device i, in the 0x260B.... range of one network server
+static uint32_t devId(int i)
+{
+	return( 0x260B0000 + (uint32_t) i * 7919 );
+}
+
+// The old lookup of SerialName() and inDecodes(), a scan of nodes[]
+static int linearFind(uint32_t id)
+{
+	for (unsigned int i=0; i< (sizeof(nodes)/sizeof(nodex)); i++) {
+		if (id == nodes[i].id) return(i);
+	}
+	return(-1);
+}
+
+static double nsecSince(std::chrono::steady_clock::time_point t0, uint32_t n)
+{
+	return( std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n );
+}
+
+void setUp(void)
+{
+	for (int i=0; i<_DEVICES; i++) {
+		nodes[i].id = devId(i);
+		snprintf(nodes[i].nm, sizeof(nodes[i].nm), "node-%d", i);
+		decodes[i].id = devId(i);
+		snprintf((char *) decodes[i].nm, sizeof(decodes[i].nm), "node-%d", i);
+		for (int k=0; k<16; k++) {
+			decodes[i].nwkKey[k] = (uint8_t)(i + k);
+			decodes[i].appKey[k] = (uint8_t)(i * 3 + k);
+		}
+	}
+	simBoot();											// setup() calls initDevs()
+}
+
+void tearDown(void)
+{
+}
+
+// Every device is found with its index in nodes[] and decodes[], unknown ones are not
+void test_registry(void)
+{
+	TEST_ASSERT_EQUAL(_DEVICES, devCnt);
+	for (int i=0; i<_DEVICES; i++) {
+		uint32_t id = devId(i);
+		struct devReg *d = findDev(id);
+		TEST_ASSERT_NOT_NULL(d);
+		TEST_ASSERT_EQUAL(i, d->node);
+		TEST_ASSERT_EQUAL(i, d->decode);
+		TEST_ASSERT_TRUE(d->appKey == decodes[i].appKey);
+
+		String name = "";
+		TEST_ASSERT_EQUAL(i, SerialName(__builtin_bswap32(id), name));	// MSB first in memory
+		TEST_ASSERT_EQUAL_STRING(nodes[i].nm, name.c_str());
+		TEST_ASSERT_EQUAL(i, inDecodes((char *) &id));					// LSB first in memory
+	}
+	TEST_ASSERT_NULL(findDev(0x26FFFFFF));
+	uint32_t unknown = 0x01020304;
+	TEST_ASSERT_EQUAL(-1, inDecodes((char *) &unknown));
+}
+
+// Host time of initDevs(), and of a lookup with findDev() and with the old scan
+void test_bench(void)
+{
+	const uint32_t n = 1000000;
+	volatile uint32_t sink = 0;
+
+	uint32_t reps = 20000 / _DEVICES + 10;
+	auto t0 = std::chrono::steady_clock::now();
+	for (uint32_t r=0; r<reps; r++) initDevs();
+	double init = nsecSince(t0, reps) / 1000.0;
+
+	t0 = std::chrono::steady_clock::now();
+	for (uint32_t i=0; i<n; i++) sink += findDev(devId(i % _DEVICES))->node;
+	double hit = nsecSince(t0, n);
+
+	t0 = std::chrono::steady_clock::now();
+	for (uint32_t i=0; i<n; i++) sink += (findDev(0x27000000 + i) == NULL);
+	double miss = nsecSince(t0, n);
+
+	t0 = std::chrono::steady_clock::now();
+	for (uint32_t i=0; i<n; i++) sink += linearFind(devId(i % _DEVICES));
+	double scan = nsecSince(t0, n);
+
+	char res[200];
+	snprintf(res, sizeof(res), "%d devices (index %d): initDevs %.1f uSec, findDev hit %.1f nsec, miss %.1f nsec, old scan %.1f nsec",
+		_DEVICES, DEV_HASH, init, hit, miss, scan);
+	TEST_MESSAGE(res);
+	TEST_ASSERT_TRUE(sink != 0);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_registry);
+	RUN_TEST(test_bench);
+	return UNITY_END();
+}
+
+#endif //DEVSBENCH_H
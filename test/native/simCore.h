@@ -0,0 +1,164 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Virtual clock, pins, interrupts and timer1 of the native build.
+//
+// simNow() is the virtual time in microseconds. It moves with simAdvance(), which
+// delay(), delayMicroseconds() and every SPI byte (8 MHz, 1 uSec a byte) call. While
+// it moves the sx1276 simulator and timer1 get their events in time order, and the
+// interrupt of a gateway pin that rose or of timer1 is called. Between noInterrupts()
+// and interrupts() the interrupt is held back and called by interrupts().
+// Time spent in an interrupt handler (its SPI bytes) is added to the clock, but the
+// events in that time are handled after the handler returns.
+// ----------------------------------------------------------------------------------------
+#ifndef SIMCORE_H
+#define SIMCORE_H
+
+#include <random>
+#include "sx1276Sim.h"
+
+Sx1276Sim sx1276Sim;
+
+namespace simCore {
+	uint64_t now = 0;
+	bool irqOn = true;
+	bool inIsr = false;
+	bool moving = false;
+	void (*isr[33])() = {};							// 32 is timer1
+	uint64_t pending = 0;								// Interrupts held back
+	uint8_t pinOut[32];
+
+	void (*t1Isr)() = nullptr;
+	uint64_t t1Due = Sx1276Sim::NEVER;
+	uint8_t t1Div = 1;
+	bool t1On = false;
+
+	uint32_t irqCalls = 0;							// Interrupt handlers called
+	uint32_t irqLate = 0;							// of which held back by noInterrupts()
+
+	std::mt19937 rng(1);
+
+	inline void call(int n) {
+		if (isr[n] == nullptr) return;
+		if (!irqOn || inIsr) {
+			pending |= (1ull << n);
+			return;
+		}
+		inIsr = true;
+		irqCalls++;
+		isr[n]();
+		inIsr = false;
+	}
+
+	inline void flush() {
+		while (pending && irqOn && !inIsr) {
+			int n = __builtin_ctzll(pending);
+			pending &= ~(1ull << n);
+			irqLate++;
+			call(n);
+		}
+	}
+
+	inline void edges() {
+		uint32_t rose = sx1276Sim.dioEdges();
+		for (int pin = 0; pin < 32; pin++) {
+			if (rose & (1u << pin)) call(pin);
+		}
+	}
+
+	// Move the clock us forward and handle all radio and timer events on the way
+	inline void advance(uint64_t us) {
+		uint64_t target = now + us;
+		if (moving) {										// From an interrupt handler
+			now = target;
+			return;
+		}
+		moving = true;
+		for (;;) {
+			uint64_t t = std::min(sx1276Sim.nextEvent(), t1On ? t1Due : Sx1276Sim::NEVER);
+			if (t > target) break;
+			if (t > now) now = t;
+			if (t1On && (t1Due <= now)) {
+				t1On = false;
+				t1Due = Sx1276Sim::NEVER;
+				isr[32] = t1Isr;
+				call(32);
+			}
+			if (sx1276Sim.nextEvent() <= now) {
+				sx1276Sim.event(now);
+				edges();
+			}
+		}
+		if (target > now) now = target;
+		moving = false;
+	}
+
+	// Reset the clock and all pins, the sketch globals are not touched
+	inline void reset(uint64_t start = 1000000) {
+		now = start;
+		irqOn = true;
+		inIsr = moving = false;
+		memset(isr, 0, sizeof(isr));
+		pending = 0;
+		t1Isr = nullptr;
+		t1On = false;
+		t1Due = Sx1276Sim::NEVER;
+		irqCalls = irqLate = 0;
+		rng.seed(1);
+		sx1276Sim.reset();
+	}
+}
+
+inline uint64_t simNow() { return simCore::now; }
+inline void simAdvance(uint64_t us) { simCore::advance(us); }
+
+inline uint32_t micros() { return (uint32_t) simCore::now; }
+inline uint32_t millis() { return (uint32_t)(simCore::now / 1000); }
+inline void delay(uint32_t ms) { simCore::advance((uint64_t) ms * 1000); }
+inline void delayMicroseconds(uint32_t us) { simCore::advance(us); }
+inline void yield() {}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t val) {
+	if (pin < 32) simCore::pinOut[pin] = val;
+	if (pin == sx1276Sim.ssPin) {
+		sx1276Sim.select(val == LOW);
+		if (val == HIGH) simCore::edges();				// Flags or DIO mapping may have changed
+	}
+}
+inline int digitalRead(uint8_t pin) {
+	for (int d = 0; d < 4; d++) {
+		if ((sx1276Sim.dioPin[d] == pin) && sx1276Sim.dio(d)) return HIGH;
+	}
+	return (pin < 32) ? simCore::pinOut[pin] : LOW;
+}
+inline int analogRead(uint8_t) { return 512; }
+
+inline void attachInterrupt(uint8_t pin, void (*fn)(), int) { if (pin < 32) simCore::isr[pin] = fn; }
+inline void detachInterrupt(uint8_t pin) { if (pin < 32) simCore::isr[pin] = nullptr; }
+inline void noInterrupts() { simCore::irqOn = false; }
+inline void interrupts() { simCore::irqOn = true; simCore::flush(); }
+
+inline void timer1_attachInterrupt(void (*fn)()) { simCore::t1Isr = fn; }
+inline void timer1_enable(uint8_t div, uint8_t, uint8_t) {
+	simCore::t1Div = (div == TIM_DIV256) ? 256 : (div == TIM_DIV16) ? 16 : 1;
+}
+inline void timer1_write(uint32_t ticks) {						// 80 MHz clock
+	simCore::t1Due = simCore::now + ((uint64_t) ticks * simCore::t1Div) / 80;
+	simCore::t1On = true;
+}
+inline void timer1_disable() { simCore::t1On = false; }
+
+inline long random(long max) { return (max <= 0) ? 0 : (long)(simCore::rng() % max); }
+inline long random(long min, long max) { return (max <= min) ? min : min + random(max - min); }
+inline void randomSeed(unsigned long seed) { simCore::rng.seed(seed); }
+
+#endif //SIMCORE_H
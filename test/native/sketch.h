@@ -0,0 +1,93 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// The whole gateway sketch compiled for the native environment, in the order of the
+// Arduino IDE (ESP-sc-gway.ino first), against the shims of this directory and the
+// sx1276 simulator. Include it in one file of a test only.
+//
+// simBoot() resets the virtual clock and the simulator and runs the setup() of the
+// sketch, simRun() runs loop() for a while like the ESP does.
+// ----------------------------------------------------------------------------------------
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <Arduino.h>
+
+#include "ESP-sc-gway.ino"
+#include "_WiFi.ino"
+#include "_gatewayMgt.ino"
+#include "_loraFiles.ino"
+#include "_loraModem.ino"
+#include "_oLED.ino"
+#include "_otaServer.ino"
+#include "_repeater.ino"
+#include "_sensor.ino"
+#include "_stateMachine.ino"
+#include "_tcpTTN.ino"
+#include "_traffic.ino"
+#include "_txRx.ino"
+#include "_udpSemtech.ino"
+#include "_utils.ino"
+#include "_wwwServer.ino"
+
+// ----------------------------------------------------------------------------------------
+// Power on the simulated gateway: clock at start uSec, empty SPIFFS and UDP, radio in
+// its reset state, and setup(). The gateway listens with CAD (cad true) or on one
+// SF in RX continuous mode.
+// ----------------------------------------------------------------------------------------
+inline void simBoot(bool cad = false, uint64_t start = 1000000)
+{
+	simCore::reset(start);
+	simUdp::reset();
+	SPIFFS.format();
+	sx1276Sim.ssPin = pins.ss;
+	sx1276Sim.dioPin[0] = pins.dio0;
+	sx1276Sim.dioPin[1] = pins.dio1;
+	sx1276Sim.dioPin[2] = pins.dio2;
+	regInvalidate();
+
+	initConfig(&gwayConfig);
+	gwayConfig.hop = false;
+	writeGwayCfg(_CONFIGFILE, &gwayConfig);				// setup() reads it back
+	setup();
+
+	// The listen mode of the test, whatever the config file had
+	gwayConfig.cad = cad;
+	gwayConfig.hop = false;
+	if (cad) {
+		_state = S_SCAN;
+		sf = SF7;
+		cadScanner();
+	}
+	else {
+		_state = S_RX;
+		rxLoraModem();
+	}
+
+	ntptimer = now();									// No NTP server on the host
+	statTime = pullTime = rstTime = fileTime = now();
+	simUdp::out.clear();
+}
+
+// ----------------------------------------------------------------------------------------
+// Run loop() for us microseconds, with a loop() every step uSec. The loop itself
+// takes the virtual time of its SPI traffic and delays.
+// ----------------------------------------------------------------------------------------
+inline void simRun(uint64_t us, uint32_t step = 100)
+{
+	uint64_t end = simNow() + us;
+	while (simNow() < end) {
+		loop();
+		simAdvance(step);
+	}
+}
+
+#endif //SKETCH_H
@@ -0,0 +1,412 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Register level simulation of an sx1276 in LoRa mode, on the virtual clock of simCore.h.
+//
+// The simulator honours:
+//	- OPMODE: SLEEP, STDBY, FSTX, TX, FSRX, RXCONTINUOUS, RXSINGLE and CAD. TX and CAD
+//	  end by themselves after the time on air and the CAD time, RXSINGLE after
+//	  SYMB_TIMEOUT symbols or a packet, all three in STDBY like the chip.
+//	- IRQ flags and mask: flags are set only when not masked in REG_IRQ_FLAGS_MASK,
+//	  and cleared by writing a 1.
+//	- FIFO pointers: REG_FIFO reads and writes at REG_FIFO_ADDR_PTR, which moves on.
+//	  TX sends PAYLOAD_LENGTH bytes from REG_FIFO_TX_BASE_AD, a received packet is
+//	  written at REG_FIFO_RX_BASE_AD and REG_FIFO_RX_CURRENT_ADDR, RX_NB_BYTES,
+//	  PKT_SNR, PKT_RSSI and HOP_CHANNEL are set.
+//	- DIO mapping: DIO0-DIO3 follow the flag mapped in REG_DIO_MAPPING_1, and every
+//	  rising edge of a gateway pin (several DIO may share one) calls its interrupt.
+//	- Every other register is a plain read/write byte, burst access auto increments.
+//
+// A packet is only received when the radio is in RX on its frequency, spreading
+// factor, bandwidth, sync word and IQ polarity no later than 6 preamble symbols after
+// the start of the packet. CAD detects a packet on its frequency and spreading factor.
+// Transmitted packets are recorded in tx[] with their start time.
+// SPI misuse is counted: a chip select while the radio is already selected (an
+// interrupt handler that interrupted a transaction) in spiNested, and transfers
+// without chip select in spiOrphan.
+// ----------------------------------------------------------------------------------------
+#ifndef SX1276SIM_H
+#define SX1276SIM_H
+
+#include <vector>
+#include <deque>
+
+inline uint64_t simNow();
+
+class Sx1276Sim {
+public:
+	// A LoRa packet on the air, as sent by a node or by the gateway
+	struct Packet {
+		uint64_t	start;							// Virtual micros() of the first preamble symbol
+		uint32_t	frf;							// REG_FRF value, 61.035 Hz steps
+		uint8_t		sf;
+		uint16_t	bw;								// kHz
+		bool		crc;							// Payload CRC present
+		bool		iq;								// Inverted IQ (downlink)
+		uint8_t		sync;							// Sync word, 0x34 for LoRaWAN
+		int8_t		snr;							// dB
+		int16_t		rssi;							// dBm
+		bool		crcErr;							// Received with a payload CRC error
+		std::vector<uint8_t> data;
+		uint64_t	end;							// Computed from the time on air
+		bool		fromFstx;						// TX only: PLL was locked in FSTX before TX
+	};
+
+	uint8_t			reg[128];
+	uint8_t			fifo[256];
+	std::deque<Packet> air;							// Uplinks the test put on the air, sorted on start
+	std::vector<Packet> tx;							// Packets transmitted by the gateway
+	uint32_t		spiNested = 0;
+	uint32_t		spiOrphan = 0;
+	uint32_t		spiBytes = 0;
+	uint32_t		rxOk = 0;						// Packets received (RXDONE)
+	uint32_t		rxMissed = 0;					// Packets on our channel not received
+
+	uint8_t			ssPin = 0xFF;					// Chip select
+	uint8_t			dioPin[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+
+	Sx1276Sim() { reset(); }
+
+	// Power on reset values (datasheet table 41) in LoRa sleep
+	void reset() {
+		memset(reg, 0, sizeof(reg));
+		memset(fifo, 0, sizeof(fifo));
+		reg[0x01] = 0x80;
+		reg[0x06] = 0x6C; reg[0x07] = 0x80; reg[0x08] = 0x00;
+		reg[0x09] = 0x4F; reg[0x0A] = 0x09; reg[0x0B] = 0x2B; reg[0x0C] = 0x20;
+		reg[0x0E] = 0x80;
+		reg[0x1D] = 0x72; reg[0x1E] = 0x70; reg[0x1F] = 0x64;
+		reg[0x21] = 0x08; reg[0x22] = 0x01; reg[0x23] = 0xFF;
+		reg[0x26] = 0x04; reg[0x31] = 0xC3; reg[0x33] = 0x27; reg[0x37] = 0x0A;
+		reg[0x39] = 0x12; reg[0x3B] = 0x1D; reg[0x42] = 0x12; reg[0x4D] = 0x84;
+		selected = false;
+		rxLock = -1;
+		modeEnd = NEVER;
+		dioLevel = 0;
+		last = 0;
+		tx.clear();
+		air.clear();
+		spiNested = spiOrphan = spiBytes = rxOk = rxMissed = 0;
+	}
+
+	uint8_t mode() const { return reg[0x01] & 0x07; }
+	uint32_t frf() const { return ((uint32_t) reg[0x06] << 16) | ((uint32_t) reg[0x07] << 8) | reg[0x08]; }
+	uint8_t sf() const { return reg[0x1E] >> 4; }
+	uint16_t bw() const { return bwKhz(reg[0x1D] >> 4); }
+
+	// Time on air in uSec (sx1276 datasheet 4.1.1.7), explicit header, CR 4/(4+cr)
+	static uint64_t airTime(uint8_t sf, uint16_t bw, uint16_t size, bool crc, uint16_t pre=8, bool ldro=false,
+			uint8_t cr=1) {
+		double tsym = (double)(1 << sf) * 1000.0 / bw;
+		int de = ldro ? 1 : 0;
+		double n = ceil((8.0*size - 4*sf + 28 + 16*(crc ? 1 : 0)) / (4.0*(sf - 2*de))) * (4 + cr);
+		if (n < 0) n = 0;
+		return (uint64_t)((pre + 4.25 + 8 + n) * tsym);
+	}
+	static uint32_t symTime(uint8_t sf, uint16_t bw) { return (uint32_t)((1 << sf) * 1000 / bw); }
+	static uint32_t frfOf(uint32_t hz) { return (uint32_t)(((uint64_t) hz << 19) / 32000000); }
+
+	// Put an uplink on the air. The packet is received if the gateway listens
+	// on frf/sf/bw at its start.
+	void send(uint64_t start, uint32_t hz, uint8_t sf, const std::vector<uint8_t> &data,
+			int8_t snr=7, int16_t rssi=-60, uint16_t bw=125, bool crcErr=false) {
+		Packet p {};
+		p.start = start; p.frf = frfOf(hz); p.sf = sf; p.bw = bw;
+		p.crc = true; p.iq = false; p.sync = 0x34; p.snr = snr; p.rssi = rssi;
+		p.crcErr = crcErr; p.data = data;
+		p.end = start + airTime(sf, bw, data.size(), true, 8, ldroOf(sf, bw));
+		auto it = air.begin();
+		while ((it != air.end()) && (it->start <= start)) it++;
+		air.insert(it, p);
+	}
+
+	// ------------------------------------------------------------------------------------
+	// SPI side, called by the SPI and digitalWrite() shims
+	// ------------------------------------------------------------------------------------
+	void select(bool low) {
+		if (low) {
+			if (selected) spiNested++;
+			selected = true;
+			first = true;
+		}
+		else {
+			selected = false;
+		}
+	}
+
+	uint8_t transfer(uint8_t b) {
+		spiBytes++;
+		if (!selected) {
+			spiOrphan++;
+			return 0xFF;
+		}
+		if (first) {
+			first = false;
+			addr = b & 0x7F;
+			write = (b & 0x80) != 0;
+			return 0x00;
+		}
+		uint8_t a = addr;
+		if (addr != 0x00) addr = (addr + 1) & 0x7F;
+		if (write) {
+			writeReg(a, b);
+			return 0x00;
+		}
+		return readReg(a);
+	}
+
+	// ------------------------------------------------------------------------------------
+	// Time side, called by the virtual clock of simCore.h
+	// ------------------------------------------------------------------------------------
+	static const uint64_t NEVER = ~(uint64_t) 0;
+
+	uint64_t nextEvent() const {
+		uint64_t t = modeEnd;
+		if (rxLock >= 0) {
+			t = std::min(t, headerAt);
+			t = std::min(t, lockEnd);
+		}
+		else if (listening()) {
+			for (auto &p: air) {
+				if (p.start > last) {
+					t = std::min(t, p.start);
+					break;
+				}
+			}
+		}
+		// Packets that nobody receives leave the air at their end
+		if (!air.empty() && (rxLock != 0)) t = std::min(t, air.front().end);
+		return t;
+	}
+
+	void event(uint64_t now) {
+		last = now;
+		if (rxLock >= 0) {
+			if (now >= headerAt) {
+				headerAt = NEVER;
+				irq(0x10);											// Valid header
+			}
+			if (now >= lockEnd) rxDone(now);
+		}
+		if (now >= modeEnd) {
+			modeEnd = NEVER;
+			switch (mode()) {
+				case 3:												// TX
+					setMode(1, now);
+					irq(0x08);
+					break;
+				case 7:												// CAD
+					setMode(1, now);
+					for (auto &p: air) {
+						if ((p.start <= now) && (p.end > now) && match(p, false)) {
+							irq(0x01);								// CAD detected
+							break;
+						}
+					}
+					irq(0x04);
+					break;
+				case 6:												// RX single timeout
+					setMode(1, now);
+					irq(0x80);
+					break;
+			}
+		}
+		tryLock(now);
+		while (!air.empty() && (air.front().end <= now) && (rxLock != 0)) {
+			if (rxLock > 0) rxLock--;
+			if (match(air.front(), true)) rxMissed++;
+			air.pop_front();
+		}
+	}
+
+	// DIO lines after a change of flags, mapping or mask. Returns the gateway pins
+	// that rose, so the clock can call their interrupt.
+	uint32_t dioEdges() {
+		uint8_t map = reg[0x40];
+		uint8_t f = reg[0x12];
+		uint8_t lv = 0;
+		static const uint8_t dio0[4] = { 0x40, 0x08, 0x04, 0x00 };		// RxDone, TxDone, CadDone
+		static const uint8_t dio1[4] = { 0x80, 0x02, 0x01, 0x00 };		// RxTimeout, FhssChange, CadDetected
+		static const uint8_t dio2[4] = { 0x02, 0x02, 0x02, 0x00 };		// FhssChangeChannel
+		static const uint8_t dio3[4] = { 0x04, 0x10, 0x20, 0x00 };		// CadDone, ValidHeader, PayloadCrcError
+		if (f & dio0[(map >> 6) & 3]) lv |= 1;
+		if (f & dio1[(map >> 4) & 3]) lv |= 2;
+		if (f & dio2[(map >> 2) & 3]) lv |= 4;
+		if (f & dio3[map & 3]) lv |= 8;
+
+		uint32_t rose = 0;
+		for (int pin = 0; pin < 4; pin++) {
+			if (dioPin[pin] == 0xFF) continue;
+			bool before = false, after = false;
+			for (int d = 0; d < 4; d++) {
+				if (dioPin[d] != dioPin[pin]) continue;
+				before |= (dioLevel >> d) & 1;
+				after |= (lv >> d) & 1;
+			}
+			if (after && !before) rose |= (1u << dioPin[pin]);
+		}
+		dioLevel = lv;
+		return rose;
+	}
+
+	bool dio(uint8_t d) const { return (dioLevel >> d) & 1; }
+
+private:
+	bool		selected = false;
+	bool		first = false;
+	bool		write = false;
+	uint8_t		addr = 0;
+	uint64_t	modeEnd = NEVER;
+	uint64_t	modeStart = 0;
+	uint8_t		prevMode = 0;
+	int			rxLock = -1;						// Index in air[] of the packet we receive
+	uint64_t	headerAt = NEVER;
+	uint64_t	lockEnd = NEVER;
+	uint8_t		dioLevel = 0;
+	uint64_t	last = 0;							// Time of the last event()
+
+	static uint16_t bwKhz(uint8_t v) {
+		switch (v) {
+			case 7: return 125;
+			case 8: return 250;
+			case 9: return 500;
+			default: return 0;
+		}
+	}
+	static bool ldroOf(uint8_t sf, uint16_t bw) { return ((1 << sf) * 1000 / bw) > 16000; }
+
+	bool listening() const { return (mode() == 5) || (mode() == 6); }
+
+	bool match(const Packet &p, bool rx) const {
+		if ((p.frf != frf()) || (p.sf != sf()) || (p.bw != bw())) return false;
+		if (!rx) return true;
+		return (p.sync == reg[0x39]) && (p.iq == ((reg[0x33] & 0x40) != 0));
+	}
+
+	void tryLock(uint64_t now) {
+		if ((rxLock >= 0) || !listening()) return;
+		for (size_t i = 0; i < air.size(); i++) {
+			const Packet &p = air[i];
+			if (p.start > now) break;
+			if (now - p.start > 6 * symTime(p.sf, p.bw)) continue;
+			if (!match(p, true)) continue;
+			rxLock = (int) i;
+			headerAt = p.start + (uint64_t)((8 + 4.25 + 8) * symTime(p.sf, p.bw));
+			lockEnd = p.end;
+			if (mode() == 6) modeEnd = NEVER;					// No RX timeout once locked
+			return;
+		}
+	}
+
+	void rxDone(uint64_t now) {
+		Packet p = air[rxLock];
+		air.erase(air.begin() + rxLock);
+		rxLock = -1;
+		headerAt = lockEnd = NEVER;
+
+		uint8_t base = reg[0x0F];
+		for (size_t i = 0; i < p.data.size(); i++) fifo[(uint8_t)(base + i)] = p.data[i];
+		reg[0x10] = base;
+		reg[0x13] = (uint8_t) p.data.size();
+		reg[0x19] = (uint8_t)(int8_t)(p.snr * 4);
+		reg[0x1A] = (uint8_t)(p.rssi + 157);
+		reg[0x1C] = p.crc ? 0x40 : 0x00;
+		rxOk++;
+		if (mode() == 6) setMode(1, now);
+		if (p.crcErr) irq(0x20);
+		irq(0x40);
+	}
+
+	void irq(uint8_t flag) {
+		reg[0x12] |= (flag & ~reg[0x11]);
+	}
+
+	void setMode(uint8_t m, uint64_t now) {
+		prevMode = mode();
+		reg[0x01] = (reg[0x01] & 0xF8) | m;
+		modeStart = now;
+		modeEnd = NEVER;
+		if ((m != 5) && (m != 6)) {								// Leaving RX drops the packet
+			rxLock = -1;
+			headerAt = lockEnd = NEVER;
+		}
+	}
+
+	uint8_t readReg(uint8_t a) {
+		if (a == 0x00) return fifo[reg[0x0D]++];
+		if (a == 0x1B) return rssiNow();
+		return reg[a];
+	}
+
+	// Current RSSI of the channel: the strongest packet on our frequency (any SF)
+	// or the noise floor of -127 dBm
+	uint8_t rssiNow() const {
+		uint64_t now = simNow();
+		int16_t rssi = -127;
+		for (auto &p: air) {
+			if ((p.frf == frf()) && (p.start <= now) && (p.end > now) && (p.rssi > rssi)) rssi = p.rssi;
+		}
+		return (uint8_t)(rssi + 157);
+	}
+
+	void writeReg(uint8_t a, uint8_t v);
+};
+
+const uint64_t Sx1276Sim::NEVER;
+
+inline void Sx1276Sim::writeReg(uint8_t a, uint8_t v)
+{
+	uint64_t now = simNow();
+	switch (a) {
+		case 0x00:
+			fifo[reg[0x0D]++] = v;
+			return;
+		case 0x01: {
+			uint8_t m = v & 0x07;
+			if (mode() != 0) v = (v & 0x7F) | (reg[0x01] & 0x80);	// LoRa bit only in SLEEP
+			reg[0x01] = (v & 0xF8) | mode();
+			setMode(m, now);
+			if (m == 3) {											// TX
+				Packet p {};
+				p.start = now; p.frf = frf(); p.sf = sf(); p.bw = bw();
+				p.crc = (reg[0x1E] & 0x04) != 0;
+				p.iq = (reg[0x33] & 0x40) != 0;
+				p.sync = reg[0x39];
+				p.fromFstx = (prevMode == 2);
+				for (int i = 0; i < reg[0x22]; i++) p.data.push_back(fifo[(uint8_t)(reg[0x0E] + i)]);
+				p.end = now + airTime(p.sf, p.bw, reg[0x22], p.crc,
+					((uint16_t) reg[0x20] << 8) | reg[0x21], (reg[0x26] & 0x08) != 0, (reg[0x1D] >> 1) & 0x07);
+				modeEnd = p.end;
+				tx.push_back(p);
+			}
+			else if (m == 7) {										// CAD, about 2 symbols
+				modeEnd = now + 2 * symTime(sf(), bw());
+			}
+			else if (m == 6) {										// RX single, timeout
+				uint16_t n = ((reg[0x1E] & 0x03) << 8) | reg[0x1F];
+				modeEnd = now + (uint64_t) n * symTime(sf(), bw());
+			}
+			if ((m == 5) || (m == 6)) tryLock(now);
+			return;
+		}
+		case 0x12:
+			reg[0x12] &= ~v;
+			return;
+		case 0x10: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
+		case 0x18: case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x42:
+			return;													// Read only
+		default:
+			reg[a] = v;
+			return;
+	}
+}
+
+#endif //SX1276SIM_H
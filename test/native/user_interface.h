@@ -0,0 +1,27 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Host (native) shim of the ESP8266 SDK user_interface.h.
+// ----------------------------------------------------------------------------------------
+#ifndef USER_INTERFACE_SHIM_H
+#define USER_INTERFACE_SHIM_H
+
+struct station_config {
+	uint8_t ssid[32];
+	uint8_t password[64];
+};
+
+inline bool wifi_station_set_hostname(const char *) { return true; }
+inline const char *wifi_station_get_hostname() { return "esp8266-native"; }
+inline bool wifi_station_get_config(struct station_config *c) { memset(c, 0, sizeof(*c)); return true; }
+inline bool system_update_cpu_freq(uint8_t) { return true; }
+
+#endif //USER_INTERFACE_SHIM_H
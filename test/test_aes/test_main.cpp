@@ -0,0 +1,133 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test and benchmark of the AES-128 of lib/aes: the FIPS-197 vectors, 100000 random
+// blocks against the old byte oriented implementation (aesOld.h), and blocks per
+// second of both. Run with: pio test -e native -f test_aes
+// ----------------------------------------------------------------------------------------
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include "AES-128_V10.h"
+#include "aesOld.h"
+
+static std::mt19937 rng(1);
+
+static void randomBytes(unsigned char *buf, int len)
+{
+	for (int i=0; i<len; i++) buf[i] = (unsigned char) rng();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// FIPS-197 appendix B and appendix C.1
+void test_fips197(void)
+{
+	const unsigned char keyB[16] = { 0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c };
+	const unsigned char ptB[16]  = { 0x32,0x43,0xf6,0xa8,0x88,0x5a,0x30,0x8d,0x31,0x31,0x98,0xa2,0xe0,0x37,0x07,0x34 };
+	const unsigned char ctB[16]  = { 0x39,0x25,0x84,0x1d,0x02,0xdc,0x09,0xfb,0xdc,0x11,0x85,0x97,0x19,0x6a,0x0b,0x32 };
+	const unsigned char keyC[16] = { 0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f };
+	const unsigned char ptC[16]  = { 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xdd,0xee,0xff };
+	const unsigned char ctC[16]  = { 0x69,0xc4,0xe0,0xd8,0x6a,0x7b,0x04,0x30,0xd8,0xcd,0xb7,0x80,0x70,0xb4,0xc5,0x5a };
+
+	unsigned char key[16], data[16];
+	AES_Key ks;
+
+	memcpy(key, keyB, 16); memcpy(data, ptB, 16);
+	AES_Encrypt(data, key);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(ctB, data, 16);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(keyB, key, 16);					// Key is not changed
+
+	AES_Set_Key(&ks, keyB);
+	memcpy(data, ptB, 16);
+	AES_Encrypt_Key(data, &ks);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(ctB, data, 16);
+
+	memcpy(key, keyC, 16); memcpy(data, ptC, 16);
+	AES_Encrypt(data, key);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(ctC, data, 16);
+
+	AES_Set_Key(&ks, keyC);
+	memcpy(data, ptC, 16);
+	AES_Encrypt_Key(data, &ks);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(ctC, data, 16);
+}
+
+// 100000 random keys and blocks give the same result as the old implementation
+void test_random_vs_old(void)
+{
+	unsigned char key[16], data[16], ref[16];
+	AES_Key ks;
+
+	for (int n=0; n<100000; n++) {
+		randomBytes(key, 16);
+		randomBytes(data, 16);
+		memcpy(ref, data, 16);
+		aesOld::AES_Encrypt(ref, key);
+
+		if ((n & 1) == 0) {
+			AES_Encrypt(data, key);
+		}
+		else {
+			AES_Set_Key(&ks, key);
+			AES_Encrypt_Key(data, &ks);
+		}
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, data, 16);
+	}
+}
+
+// Blocks per second of the old implementation, of AES_Encrypt() that expands the
+// key for every block, and of AES_Encrypt_Key() with a key schedule made once.
+void test_bench(void)
+{
+	const int n = 200000;
+	unsigned char key[16], data[16];
+	AES_Key ks;
+	randomBytes(key, 16);
+	randomBytes(data, 16);
+	AES_Set_Key(&ks, key);
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i=0; i<n; i++) aesOld::AES_Encrypt(data, key);
+	double tOld = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	t0 = std::chrono::steady_clock::now();
+	for (int i=0; i<n; i++) AES_Encrypt(data, key);
+	double tNew = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	t0 = std::chrono::steady_clock::now();
+	for (int i=0; i<n; i++) AES_Encrypt_Key(data, &ks);
+	double tKey = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	char res[200];
+	snprintf(res, sizeof(res), "blocks/s: old %.0f, AES_Encrypt %.0f (x%.1f), AES_Encrypt_Key %.0f (x%.1f)",
+		n / tOld, n / tNew, tOld / tNew, n / tKey, tOld / tKey);
+	TEST_MESSAGE(res);
+
+	volatile unsigned char sink = data[0];							// Keep the loops
+	(void) sink;
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_fips197);
+	RUN_TEST(test_random_vs_old);
+	RUN_TEST(test_bench);
+	return UNITY_END();
+}
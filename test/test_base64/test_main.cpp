@@ -0,0 +1,172 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test and benchmark of lib/gBase64: random payloads of 0 to 300 bytes are encoded and
+// decoded (also 4 characters at a time with base64_dec_quad(), as writeFifo64() does)
+// and compared with the old implementation (gBase64Old.h), and the encode and decode
+// speed of both. Run with: pio test -e native -f test_base64
+// ----------------------------------------------------------------------------------------
+#include <unity.h>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include "gBase64.h"
+#include "gBase64Old.h"
+
+static std::mt19937 rng(1);
+
+static void randomBytes(unsigned char *buf, int len)
+{
+	for (int i=0; i<len; i++) buf[i] = (unsigned char) rng();
+}
+
+// Decode b64 like writeFifo64(), one group of 4 characters at a time in a3
+static int decQuads(unsigned char *out, const char *b64, int len)
+{
+	unsigned char a3[3];
+	int cnt = 0;
+	for (int i=0; i<len; i+=4) {
+		int n = base64_dec_quad(a3, b64+i, len-i);
+		if (n == 0) break;
+		memcpy(out+cnt, a3, n);
+		cnt += n;
+		if (n < 3) break;
+	}
+	return(cnt);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// RFC 4648 section 10
+void test_rfc4648(void)
+{
+	const char *plain[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+	const char *enc[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+	char out[16], dec[16];
+
+	for (int i=0; i<7; i++) {
+		int len = strlen(plain[i]);
+		TEST_ASSERT_EQUAL(strlen(enc[i]), base64_encode(out, (char *) plain[i], len));
+		TEST_ASSERT_EQUAL_STRING(enc[i], out);
+		TEST_ASSERT_EQUAL(strlen(enc[i]), base64_enc_len(len));
+		TEST_ASSERT_EQUAL(len, base64_dec_len((char *) enc[i], strlen(enc[i])));
+		TEST_ASSERT_EQUAL(len, base64_decode(dec, (char *) enc[i], strlen(enc[i])));
+		TEST_ASSERT_EQUAL_MEMORY(plain[i], dec, len);
+		TEST_ASSERT_EQUAL(len, decQuads((unsigned char *) dec, enc[i], strlen(enc[i])));
+		TEST_ASSERT_EQUAL_MEMORY(plain[i], dec, len);
+	}
+}
+
+// Random payloads give the same encoding as the old implementation, and decode back
+// to the payload with base64_decode() and base64_dec_quad(), with and without padding.
+void test_roundtrip(void)
+{
+	unsigned char data[300], dec[304];
+	char enc[410], ref[410];
+
+	for (int n=0; n<20000; n++) {
+		int len = rng() % 301;
+		randomBytes(data, len);
+
+		int elen = base64_encode(enc, (char *) data, len);
+		int rlen = b64Old::base64_encode(ref, (char *) data, len);
+		TEST_ASSERT_EQUAL(rlen, elen);
+		TEST_ASSERT_EQUAL_STRING(ref, enc);
+		TEST_ASSERT_EQUAL(b64Old::base64_enc_len(len), base64_enc_len(len));
+		if (elen > 0) {
+			TEST_ASSERT_EQUAL(b64Old::base64_dec_len(enc, elen), base64_dec_len(enc, elen));
+		}
+
+		// Decoding writes base64_dec_len() bytes and not one more
+		memset(dec, 0xA5, sizeof(dec));
+		TEST_ASSERT_EQUAL(len, base64_dec_len(enc, elen));
+		TEST_ASSERT_EQUAL(len, base64_decode((char *) dec, enc, elen));
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+		TEST_ASSERT_EQUAL_HEX8(0xA5, dec[len]);
+
+		memset(dec, 0xA5, sizeof(dec));
+		TEST_ASSERT_EQUAL(len, decQuads(dec, enc, elen));
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+		TEST_ASSERT_EQUAL_HEX8(0xA5, dec[len]);
+
+		// Without the '=' padding, as some servers send it
+		int ulen = elen;
+		while ((ulen > 0) && (enc[ulen-1] == '=')) ulen--;
+		TEST_ASSERT_EQUAL(len, base64_dec_len(enc, ulen));
+		TEST_ASSERT_EQUAL(len, base64_decode((char *) dec, enc, ulen));
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+		TEST_ASSERT_EQUAL(len, b64Old::base64_decode((char *) dec, enc, ulen));
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+		TEST_ASSERT_EQUAL(len, decQuads(dec, enc, ulen));
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+	}
+}
+
+// MByte/s of the old and new encode and decode, and of decoding with base64_dec_quad(),
+// for a 51 byte (SF12 maximum) and a 255 byte payload
+void test_bench(void)
+{
+	const int sizes[] = { 51, 255 };
+	unsigned char data[256], dec[260];
+	char enc[350];
+
+	for (int len: sizes) {
+		const int n = 4000000 / len;
+		randomBytes(data, len);
+		int elen = base64_encode(enc, (char *) data, len);
+		volatile int sink = 0;
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (int i=0; i<n; i++) sink += b64Old::base64_encode(enc, (char *) data, len);
+		double eOld = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		t0 = std::chrono::steady_clock::now();
+		for (int i=0; i<n; i++) sink += base64_encode(enc, (char *) data, len);
+		double eNew = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		t0 = std::chrono::steady_clock::now();
+		for (int i=0; i<n; i++) sink += b64Old::base64_decode((char *) dec, enc, elen);
+		double dOld = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		t0 = std::chrono::steady_clock::now();
+		for (int i=0; i<n; i++) sink += base64_decode((char *) dec, enc, elen);
+		double dNew = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		t0 = std::chrono::steady_clock::now();
+		for (int i=0; i<n; i++) sink += decQuads(dec, enc, elen);
+		double dQuad = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		TEST_ASSERT_EQUAL_MEMORY(data, dec, len);
+
+		double mb = (double) n * len / 1e6;
+		char res[200];
+		snprintf(res, sizeof(res), "%d bytes MB/s: encode old %.0f new %.0f (x%.1f), "
+			"decode old %.0f new %.0f (x%.1f) quad %.0f (x%.1f)", len,
+			mb / eOld, mb / eNew, eOld / eNew, mb / dOld, mb / dNew, dOld / dNew, mb / dQuad, dOld / dQuad);
+		TEST_MESSAGE(res);
+		(void) sink;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_rfc4648);
+	RUN_TEST(test_roundtrip);
+	RUN_TEST(test_bench);
+	return UNITY_END();
+}
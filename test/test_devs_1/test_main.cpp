@@ -0,0 +1,16 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Device registry test and benchmark with 1 device, see devsBench.h
+// Run with: pio test -e native -f test_devs_1
+// ----------------------------------------------------------------------------------------
+#define _DEVICES 1
+#include "devsBench.h"
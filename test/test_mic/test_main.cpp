@@ -0,0 +1,159 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test of the MIC of _sensor.ino: the AES-CMAC subkeys and MACs of RFC 4493, the MIC of
+// a known LoRaWAN frame, checkMic() and the drop of received frames with a wrong MIC.
+// The sketch is built with _LOCALSERVER and _CHECK_MIC, the frame key is in decodes[0].
+// Run with: pio test -e native -f test_mic
+// ----------------------------------------------------------------------------------------
+#define _CHECK_MIC 1
+#include <unity.h>
+#include <string>
+#include "sketch.h"
+
+// RFC 4493 para 4
+static const uint8_t rfcKey[16] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+static const uint8_t rfcMsg[64] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+	0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+	0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+	0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10 };
+
+// Unconfirmed data up of DevAddr 0x49BE7DF1, FCnt 2, FPort 1, FRMPayload "test"
+static const uint8_t frmKeyNwk[16] = {
+	0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6, 0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3 };
+static const uint8_t frmKeyApp[16] = {
+	0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7, 0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88 };
+static const std::vector<uint8_t> frame = {
+	0x40, 0xF1, 0x7D, 0xBE, 0x49, 0x00, 0x02, 0x00, 0x01, 0x95, 0x43, 0x78, 0x76,
+	0x2B, 0x11, 0xFF, 0x0D };
+
+// Number of PUSH_DATA datagrams the gateway sent
+static int pushCount()
+{
+	int n = 0;
+	for (auto &d: simUdp::out) {
+		if ((d.data.size() >= 4) && (d.data[3] == PUSH_DATA)) n++;
+	}
+	return n;
+}
+
+void setUp(void)
+{
+	decodes[0].id = 0x49BE7DF1;
+	memcpy(decodes[0].nwkKey, frmKeyNwk, 16);
+	memcpy(decodes[0].appKey, frmKeyApp, 16);
+	simBoot(false);										// setup() makes devMics[] by initDevs()
+}
+
+void tearDown(void)
+{
+}
+
+void test_rfc4493_subkeys(void)
+{
+	const uint8_t k1[16] = {
+		0xfb, 0xee, 0xd6, 0x18, 0x35, 0x71, 0x33, 0x66, 0x7c, 0x85, 0xe0, 0x8f, 0x72, 0x36, 0xa8, 0xde };
+	const uint8_t k2[16] = {
+		0xf7, 0xdd, 0xac, 0x30, 0x6a, 0xe2, 0x66, 0xcc, 0xf9, 0x0b, 0xc1, 0x1e, 0xe4, 0x6d, 0x51, 0x3b };
+	struct micKey mk;
+	micKeySet(&mk, rfcKey);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(k1, mk.k1, 16);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(k2, mk.k2, 16);
+}
+
+// Examples 2 to 4, the messages of 16, 40 and 64 bytes. aesCmac() takes the
+// first block apart, so the empty message of example 1 does not apply.
+void test_rfc4493_cmac(void)
+{
+	const uint8_t mac[3][16] = {
+		{ 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c },
+		{ 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 },
+		{ 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } };
+	const uint8_t len[3] = { 16, 40, 64 };
+	struct micKey mk;
+	micKeySet(&mk, rfcKey);
+
+	for (int i=0; i<3; i++) {
+		uint8_t X[16];
+		memcpy(X, rfcMsg, 16);
+		aesCmac(X, rfcMsg + 16, len[i] - 16, &mk);
+		TEST_ASSERT_EQUAL_HEX8_ARRAY(mac[i], X, 16);
+	}
+}
+
+// The MIC of the frame and its FRMPayload, decrypted with encodePacket()
+void test_frame_mic(void)
+{
+	struct micKey mk;
+	uint8_t mic[4];
+	micKeySet(&mk, frmKeyNwk);
+	micCompute(frame.data(), frame.size() - 4, 2, &mk, 0, mic);
+	TEST_ASSERT_EQUAL_HEX8_ARRAY(frame.data() + frame.size() - 4, mic, 4);
+
+	uint8_t data[4];
+	uint8_t DevAddr[4] = { 0x49, 0xBE, 0x7D, 0xF1 };
+	memcpy(data, frame.data() + 9, 4);
+	encodePacket(data, 4, 2, DevAddr, &devKeys[0], 0);
+	TEST_ASSERT_EQUAL_MEMORY("test", data, 4);
+}
+
+void test_check_mic(void)
+{
+	std::vector<uint8_t> f = frame;
+	TEST_ASSERT_EQUAL(1, checkMic(f.data(), f.size()));
+
+	f[10] ^= 0x01;											// FRMPayload changed
+	TEST_ASSERT_EQUAL(0, checkMic(f.data(), f.size()));
+
+	f = frame;
+	f[1] ^= 0x01;											// DevAddr without key
+	TEST_ASSERT_EQUAL(-1, checkMic(f.data(), f.size()));
+
+	// MHDR | FHDR | MIC is the shortest frame, one byte less is wrong
+	std::vector<uint8_t> s(frame.begin(), frame.begin() + 8);
+	uint8_t mic[4];
+	micCompute(s.data(), 8, 2, &devMics[0], 0, mic);
+	s.insert(s.end(), mic, mic + 4);
+	TEST_ASSERT_EQUAL(1, checkMic(s.data(), 12));
+	TEST_ASSERT_EQUAL(0, checkMic(s.data(), 11));
+}
+
+// A received frame with a wrong MIC is counted and not forwarded
+void test_uplink_wrong_mic(void)
+{
+	uint32_t errs = rxPipe.micErrs;
+	sx1276Sim.send(simNow() + 10000, freqs[gwayConfig.ch].upFreq, sf, frame);
+	simRun(500000);
+	TEST_ASSERT_EQUAL(1, pushCount());
+	TEST_ASSERT_EQUAL(errs, rxPipe.micErrs);
+
+	std::vector<uint8_t> f = frame;
+	f[6] = 0x03;											// FCnt 3 with the MIC of FCnt 2
+	simUdp::out.clear();
+	sx1276Sim.send(simNow() + 10000, freqs[gwayConfig.ch].upFreq, sf, f);
+	simRun(500000);
+	TEST_ASSERT_EQUAL(2, sx1276Sim.rxOk);
+	TEST_ASSERT_EQUAL(0, pushCount());
+	TEST_ASSERT_EQUAL(errs + 1, rxPipe.micErrs);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_rfc4493_subkeys);
+	RUN_TEST(test_rfc4493_cmac);
+	RUN_TEST(test_frame_mic);
+	RUN_TEST(test_check_mic);
+	RUN_TEST(test_uplink_wrong_mic);
+	return UNITY_END();
+}
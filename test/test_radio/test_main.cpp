@@ -0,0 +1,498 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Radio tests of the whole gateway against the sx1276 simulator: receive an uplink
+// and forward it with PUSH_DATA, transmit a PULL_RESP downlink at its tmst and
+// answer with TX_ACK. Run with: pio test -e native -f test_radio
+// ----------------------------------------------------------------------------------------
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include "sketch.h"
+
+// An unconfirmed data up frame of size bytes with DevAddr 0x04030201
+static std::vector<uint8_t> upFrame(uint8_t size, uint8_t seed)
+{
+	std::vector<uint8_t> f(size);
+	for (int i=0; i<size; i++) f[i] = (uint8_t)(seed + 7*i);
+	f[0] = 0x40;
+	f[1] = 0x01; f[2] = 0x02; f[3] = 0x03; f[4] = 0x04;
+	return f;
+}
+
+// The datagrams the gateway sent with message ident
+static std::vector<simDatagram> sentUdp(uint8_t ident)
+{
+	std::vector<simDatagram> res;
+	for (auto &d: simUdp::out) {
+		if ((d.data.size() >= 4) && (d.data[3] == ident)) res.push_back(d);
+	}
+	return res;
+}
+
+// The JSON text of a PUSH_DATA message (after the 12 byte header)
+static std::string pushJson(const simDatagram &d)
+{
+	return std::string(d.data.begin() + 12, d.data.end());
+}
+
+// The numeric value of "key": in js, or -1
+static long jsonNum(const std::string &js, const char *key)
+{
+	size_t p = js.find(std::string("\"") + key + "\":");
+	if (p == std::string::npos) return -1;
+	return strtol(js.c_str() + p + strlen(key) + 3, NULL, 10);
+}
+
+// Let the server send a PULL_RESP with payload data at tmst. The preamble is
+// only in the message when prea is not 0.
+static void pullResp64(uint32_t tmst, const char *b64, unsigned size, uint16_t token, const char *datr="SF7BW125",
+	const char *codr="4/5", unsigned prea=0)
+{
+	char js[400], pre[16] = "";
+	if (prea != 0) snprintf(pre, sizeof(pre), "\"prea\":%u,", prea);
+	snprintf(js, sizeof(js),
+		"{\"txpk\":{\"imme\":false,\"tmst\":%u,\"freq\":868.1,\"rfch\":0,\"powe\":14,%s"
+		"\"modu\":\"LORA\",\"datr\":\"%s\",\"codr\":\"%s\",\"ipol\":true,\"size\":%u,\"data\":\"%s\"}}",
+		tmst, pre, datr, codr, size, b64);
+
+	simDatagram d { IPAddress(127,0,0,1), _TTNPORT, {}, 0 };
+	d.data = { 0x02, (uint8_t)(token & 0xFF), (uint8_t)(token >> 8), PULL_RESP };
+	d.data.insert(d.data.end(), js, js + strlen(js));
+	simUdp::in.push_back(d);
+}
+
+static void pullResp(uint32_t tmst, const std::vector<uint8_t> &data, uint16_t token, const char *datr="SF7BW125",
+	const char *codr="4/5", unsigned prea=0)
+{
+	char b64[256];
+	int len = base64_encode(b64, (char *) data.data(), data.size());
+	b64[len] = 0;
+	pullResp64(tmst, b64, data.size(), token, datr, codr, prea);
+}
+
+void setUp(void)
+{
+	simBoot(false);
+}
+
+void tearDown(void)
+{
+}
+
+// After setup() the radio listens in RX continuous on the channel and SF of the config
+void test_boot_rx(void)
+{
+	TEST_ASSERT_EQUAL_HEX8(0x85, sx1276Sim.reg[0x01]);
+	TEST_ASSERT_EQUAL_UINT32(Sx1276Sim::frfOf(freqs[gwayConfig.ch].upFreq), sx1276Sim.frf());
+	TEST_ASSERT_EQUAL(sf, sx1276Sim.sf());
+	TEST_ASSERT_EQUAL(125, sx1276Sim.bw());
+	TEST_ASSERT_EQUAL_HEX8(0x34, sx1276Sim.reg[0x39]);
+}
+
+// An uplink is read from the FIFO and forwarded with the data, SF and tmst
+void test_uplink_push_data(void)
+{
+	std::vector<uint8_t> f = upFrame(17, 0x11);
+	uint64_t start = simNow() + 10000;
+	sx1276Sim.send(start, freqs[gwayConfig.ch].upFreq, sf, f, 7, -60);
+	simRun(500000);
+
+	TEST_ASSERT_EQUAL_UINT32(1, sx1276Sim.rxOk);
+	std::vector<simDatagram> push = sentUdp(PUSH_DATA);
+	TEST_ASSERT_EQUAL(1, push.size());
+
+	std::string js = pushJson(push[0]);
+	char b64[64];
+	int len = base64_encode(b64, (char *) f.data(), f.size());
+	b64[len] = 0;
+	TEST_ASSERT_TRUE(js.find(std::string("\"data\":\"") + b64 + "\"") != std::string::npos);
+	TEST_ASSERT_TRUE(js.find("\"datr\":\"SF7BW125\"") != std::string::npos);
+	TEST_ASSERT_EQUAL(17, jsonNum(js, "size"));
+	TEST_ASSERT_EQUAL(-60, jsonNum(js, "rssi"));
+
+	// tmst is the micros() of the RXDONE interrupt, after the end of the packet
+	uint64_t end = start + Sx1276Sim::airTime(sf, 125, f.size(), true);
+	long tmst = jsonNum(js, "tmst");
+	TEST_ASSERT_GREATER_OR_EQUAL((long) end, tmst);
+	TEST_ASSERT_LESS_THAN((long)(end + 2000), tmst);
+
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiOrphan);
+}
+
+// A packet with a payload CRC error is not forwarded
+void test_uplink_crc_error(void)
+{
+	sx1276Sim.send(simNow() + 10000, freqs[gwayConfig.ch].upFreq, sf, upFrame(20, 1), 7, -60, 125, true);
+	simRun(500000);
+	TEST_ASSERT_EQUAL(0, sentUdp(PUSH_DATA).size());
+}
+
+// A second copy of an unconfirmed frame is dropped, but every copy of a confirmed
+// frame is forwarded as the server must answer its retransmission
+void test_uplink_dedup(void)
+{
+	uint32_t dups = rxPipe.dups;							// Not reset by setup()
+	uint32_t dupsConf = rxPipe.dupsConf;
+	std::vector<uint8_t> f = upFrame(20, 0x31);
+	sx1276Sim.send(simNow() + 10000, freqs[gwayConfig.ch].upFreq, sf, f);
+	sx1276Sim.send(simNow() + 300000, freqs[gwayConfig.ch].upFreq, sf, f);
+	f[0] = 0x80;											// Confirmed data up
+	f[6]++;													// Next FCnt
+	sx1276Sim.send(simNow() + 600000, freqs[gwayConfig.ch].upFreq, sf, f);
+	sx1276Sim.send(simNow() + 900000, freqs[gwayConfig.ch].upFreq, sf, f);
+	simRun(1500000);
+
+	TEST_ASSERT_EQUAL_UINT32(4, sx1276Sim.rxOk);
+	TEST_ASSERT_EQUAL(3, sentUdp(PUSH_DATA).size());
+	TEST_ASSERT_EQUAL_UINT32(dups + 1, rxPipe.dups);
+	TEST_ASSERT_EQUAL_UINT32(dupsConf + 1, rxPipe.dupsConf);
+#	if _MAXSEEN>=1
+	struct nodeSeen *n = seenLookup(0x01020304, 0);
+	TEST_ASSERT_NOT_NULL(n);
+	TEST_ASSERT_GREATER_THAN(0, n->cntDup);
+#	endif
+}
+
+// A copy of a frame of a node that is not in listSeen[] is dropped without
+// making a record for it
+void test_dedup_unknown_node(void)
+{
+	struct LoraUp up;
+	std::vector<uint8_t> f = upFrame(20, 0x47);
+	f[1] = 0x0A; f[2] = 0x0B; f[3] = 0x0C; f[4] = 0x0D;
+	memcpy(up.payLoad, f.data(), f.size());
+	up.size = f.size();
+
+	uint16_t seen = iSeen;
+	TEST_ASSERT_NULL(seenLookup(0x0A0B0C0D, 0));
+	TEST_ASSERT_FALSE(dupCheck(&up));
+	TEST_ASSERT_TRUE(dupCheck(&up));
+	TEST_ASSERT_NULL(seenLookup(0x0A0B0C0D, 0));
+	TEST_ASSERT_EQUAL(seen, iSeen);
+}
+
+// A PULL_RESP is transmitted at its tmst from FSTX with inverted IQ, acknowledged
+// with TX_ACK, and the gateway is back in RX afterwards.
+void test_downlink_tx(void)
+{
+	std::vector<uint8_t> d = upFrame(23, 0x55);
+	d[0] = 0x60;											// Unconfirmed data down
+	uint32_t tmst = micros() + 1000000;
+	pullResp(tmst, d, 0xBEEF);
+	simRun(1500000);
+
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	Sx1276Sim::Packet &p = sx1276Sim.tx[0];
+	TEST_ASSERT_EQUAL_UINT32(Sx1276Sim::frfOf(freqs[gwayConfig.ch].dwnFreq), p.frf);
+	TEST_ASSERT_EQUAL(7, p.sf);
+	TEST_ASSERT_TRUE(p.iq);
+	TEST_ASSERT_TRUE(p.fromFstx);
+	TEST_ASSERT_EQUAL(d.size(), p.data.size());
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(d.data(), p.data.data(), d.size());
+	TEST_ASSERT_UINT32_WITHIN(20, tmst + gwayConfig.txDelay, (uint32_t) p.start);
+
+	std::vector<simDatagram> ack = sentUdp(TX_ACK);
+	TEST_ASSERT_EQUAL(1, ack.size());
+	TEST_ASSERT_EQUAL_HEX8(0xEF, ack[0].data[1]);
+	TEST_ASSERT_EQUAL_HEX8(0xBE, ack[0].data[2]);
+	TEST_ASSERT_GREATER_OR_EQUAL(p.end, ack[0].time);
+
+	TEST_ASSERT_EQUAL_HEX8(0x85, sx1276Sim.reg[0x01]);
+	TEST_ASSERT_EQUAL_UINT32(Sx1276Sim::frfOf(freqs[gwayConfig.ch].upFreq), sx1276Sim.frf());
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiOrphan);
+}
+
+// txLoraModem() sets the PA ramp-up time but keeps the upper nibble of REG_PARAMP
+// (LowPnTxPllOff on the sx1272)
+void test_tx_paramp(void)
+{
+	sx1276Sim.reg[0x0A] = 0x19;
+	regInvalidate();
+	pullResp(micros() + 500000, upFrame(12, 3), 1);
+	simRun(1000000);
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	TEST_ASSERT_EQUAL_HEX8(0x18, sx1276Sim.reg[0x0A]);
+}
+
+// The timer interrupt of txArm() fires while loop() reads registers. It is held back
+// until the read is done, never selects the radio in the middle of it, and still
+// starts the transmission within a few uSec.
+void test_tx_timer_spi(void)
+{
+	uint8_t pay[12] = { 0x60, 1, 2, 3, 4, 0, 1, 0, 1, 5, 6, 7 };
+	struct LoraDown d;
+	memset(&d, 0, sizeof(d));
+	d.sf = 7; d.bw = 125; d.size = sizeof(pay); d.powe = 14;
+	d.freq = freqs[gwayConfig.ch].dwnFreq;
+	d.iiq = 0x40;
+	d.payLoad = pay;
+
+	txLoraModem(&d);
+	uint32_t due = micros() + 200;
+	txArm(due, &d);
+	while ((int32_t)(micros() - due) < 50) {
+		readRegister(REG_IRQ_FLAGS);
+		uint8_t buf[8];
+		readBuffer(REG_FIFO, buf, sizeof(buf));
+	}
+
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	TEST_ASSERT_TRUE(sx1276Sim.tx[0].fromFstx);
+	TEST_ASSERT_UINT32_WITHIN(12, due, (uint32_t) sx1276Sim.tx[0].start);
+	TEST_ASSERT_EQUAL_HEX8(OPMODE_LORA | OPMODE_TX, regShadow[REG_OPMODE]);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiOrphan);
+	simRun(200000);
+}
+
+// A PULL_RESP that comes in while a downlink is on the air replaces LoraDown. The
+// TXDONE of the first downlink is still calibrated with its own airtime and tmst.
+void test_tx_calib_next(void)
+{
+	uint16_t calOut = txCalOut;
+	uint16_t cnt = gwayConfig.txCnt;
+	std::vector<uint8_t> d = upFrame(23, 0x55);
+	d[0] = 0x60;
+	uint32_t tmst = micros() + 300000;
+	pullResp(tmst, d, 1);
+	simRun(320000);
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	TEST_ASSERT_TRUE(micros() < sx1276Sim.tx[0].end);			// On the air
+
+	pullResp(micros() + 1000000, upFrame(51, 7), 2, "SF9BW125");
+	simRun(100000);
+	TEST_ASSERT_EQUAL(9, LoraDown.sf);
+	TEST_ASSERT_EQUAL(calOut, txCalOut);
+	TEST_ASSERT_EQUAL(cnt + 1, gwayConfig.txCnt);
+	TEST_ASSERT_INT32_WITHIN(20, (int32_t)(sx1276Sim.tx[0].start - tmst), txErrLast);
+	simRun(2000000);
+	TEST_ASSERT_EQUAL(2, sx1276Sim.tx.size());
+	TEST_ASSERT_EQUAL(calOut, txCalOut);
+}
+
+// The coding rate and preamble of the PULL_RESP are transmitted and used for the
+// airtime of txCalib(). The receiver is back at 4/5 and 8 symbols afterwards.
+void test_tx_codr_prea(void)
+{
+	std::vector<uint8_t> d = upFrame(23, 0x55);
+	d[0] = 0x60;
+	uint32_t tmst = micros() + 300000;
+	pullResp(tmst, d, 1, "SF9BW125", "4/7", 12);
+	simRun(600000);
+
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	Sx1276Sim::Packet &p = sx1276Sim.tx[0];
+	TEST_ASSERT_EQUAL(Sx1276Sim::airTime(9, 125, d.size(), false, 12, false, 3), p.end - p.start);
+	TEST_ASSERT_UINT32_WITHIN(2, airTime(9, 125, d.size(), 0, 3, 12), (uint32_t)(p.end - p.start));
+	TEST_ASSERT_INT32_WITHIN(20, (int32_t)(p.start - tmst), txErrLast);
+
+	TEST_ASSERT_EQUAL_HEX8(0x85, sx1276Sim.reg[0x01]);
+	TEST_ASSERT_EQUAL_HEX8(0x72, sx1276Sim.reg[0x1D]);
+	TEST_ASSERT_EQUAL_HEX8(0x08, sx1276Sim.reg[0x21]);
+}
+
+// txCalib() does not write the configuration on TXDONE, loop() writes it
+// at the next _FILE_INTERVAL
+void test_tx_cal_save(void)
+{
+	std::shared_ptr<std::string> cfg = SPIFFS.files[_CONFIGFILE];
+	uint32_t due = micros() + 1000;
+	memset(&txDwn, 0, sizeof(txDwn));
+	txDwn.tmst = due; txDwn.sf = 7; txDwn.bw = 125; txDwn.size = 12;
+	txDue = due;
+	gwayConfig.txCnt = 0;
+
+	txCalib(due + 3000 + airTime(7, 125, 12, 0, 1, 0));			// 3 msec latency
+	TEST_ASSERT_EQUAL(-3000, gwayConfig.txDelay);
+	TEST_ASSERT_TRUE(cfgDirty);
+	TEST_ASSERT_TRUE(cfg == SPIFFS.files[_CONFIGFILE]);			// Not written
+
+	simRun((uint64_t)(_FILE_INTERVAL + 1) * 1000000, 1000);
+	TEST_ASSERT_FALSE(cfgDirty);
+	TEST_ASSERT_TRUE(cfg != SPIFFS.files[_CONFIGFILE]);
+}
+
+// statBegin() and statNext() walk the history from the newest record, over the records
+// in use and at most max records, also when the ring buffer has wrapped
+void test_stat_each(void)
+{
+	memset(statr, 0, sizeof(statr));
+	TEST_ASSERT_NULL(statBegin());
+
+	for (int n=1; n<=STAT_MAX+3; n++) {
+		statNew()->sf = 7;
+		statRec(0)->node = n;
+
+		int cnt = 0;
+		for (struct stat_t *sr = statBegin(); sr != NULL; sr = statNext(sr, STAT_MAX)) {
+			TEST_ASSERT_EQUAL_UINT32(n - cnt, sr->node);
+			cnt++;
+		}
+		TEST_ASSERT_EQUAL((n < STAT_MAX) ? n : STAT_MAX, cnt);
+
+		cnt = 0;
+		for (struct stat_t *sr = statBegin(); sr != NULL; sr = statNext(sr, 3)) cnt++;
+		TEST_ASSERT_EQUAL((n < 3) ? n : 3, cnt);
+	}
+}
+
+// The statistics view set on the web page is kept in the config file
+void test_statview_saved(void)
+{
+	TEST_ASSERT_EQUAL(_STATISTICS, gwayConfig.statView);
+	gwayConfig.statView = 2;
+	writeGwayCfg(_CONFIGFILE, &gwayConfig);
+	gwayConfig.statView = 0;
+	readGwayCfg(_CONFIGFILE, &gwayConfig);
+	TEST_ASSERT_EQUAL(2, gwayConfig.statView);
+	gwayConfig.statView = _STATISTICS;
+}
+
+// A downlink whose tmst has passed is refused and not transmitted
+void test_downlink_late(void)
+{
+	pullResp(micros() - 100000, upFrame(12, 3), 1);
+	simRun(500000);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.tx.size());
+	TEST_ASSERT_EQUAL(0, sentUdp(TX_ACK).size());
+}
+
+// A payload that sendPkt() cannot load in the FIFO (padding in the middle of the
+// base64) is not armed: it is counted as failed, not transmitted, not acknowledged,
+// the receiver is restarted and the next downlink goes out as usual.
+void test_downlink_fail(void)
+{
+	uint16_t fail = txStat.fail;
+	pullResp64(micros() + 500000, "YAAAAA==AAAAAAAAAAAAAAAA", 18, 1);
+	simRun(1000000);
+	TEST_ASSERT_EQUAL(fail + 1, txStat.fail);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.tx.size());
+	TEST_ASSERT_EQUAL(0, sentUdp(TX_ACK).size());
+	TEST_ASSERT_EQUAL(S_RX, _state);
+	TEST_ASSERT_EQUAL_HEX8(0x85, sx1276Sim.reg[0x01]);
+	TEST_ASSERT_EQUAL_UINT32(Sx1276Sim::frfOf(freqs[gwayConfig.ch].upFreq), sx1276Sim.frf());
+
+	pullResp(micros() + 500000, upFrame(12, 3), 2);
+	simRun(1000000);
+	TEST_ASSERT_EQUAL(1, sx1276Sim.tx.size());
+	TEST_ASSERT_EQUAL(fail + 1, txStat.fail);
+}
+
+// With CAD the scanner finds the SF of the uplink
+void test_cad_uplink(void)
+{
+	simBoot(true);
+	TEST_ASSERT_EQUAL(7, sx1276Sim.mode());					// CAD
+
+	std::vector<uint8_t> f = upFrame(15, 0x21);
+	sx1276Sim.send(simNow() + 20000, freqs[gwayConfig.ch].upFreq, 9, f);
+	simRun(1000000);
+
+	TEST_ASSERT_EQUAL_UINT32(1, sx1276Sim.rxOk);
+	std::vector<simDatagram> push = sentUdp(PUSH_DATA);
+	TEST_ASSERT_EQUAL(1, push.size());
+	TEST_ASSERT_TRUE(pushJson(push[0]).find("\"datr\":\"SF9BW125\"") != std::string::npos);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+}
+
+// When hopping, a preamble detected without RXDONE or RXTOUT (e.g. a lost interrupt)
+// ends after the airtime of a maximum length message of the SF: count a timeout and hop
+void test_hop_rx_wait(void)
+{
+	simBoot(true);
+	gwayConfig.hop = true;
+	uint8_t ch = gwayConfig.ch;
+	uint32_t tout = sfDet[SF9-SF7].tout;
+
+	opmode(OPMODE_STANDBY);									// No interrupt will come
+	sf = SF9;
+	_state = S_RX;
+	detTime = micros();
+	uint32_t wait = chanTime(sfTime(SF9)->air);
+
+	simRun(wait - 2000);
+	TEST_ASSERT_EQUAL(S_RX, _state);
+	TEST_ASSERT_EQUAL(tout, sfDet[SF9-SF7].tout);
+
+	simRun(4000);
+	TEST_ASSERT_EQUAL(tout + 1, sfDet[SF9-SF7].tout);
+	TEST_ASSERT_NOT_EQUAL(S_RX, _state);
+	TEST_ASSERT_EQUAL((ch + 1) % NUM_HOPS, gwayConfig.ch);
+	gwayConfig.hop = false;
+}
+
+// Benchmark: 200 uplinks 250 msec apart. Reports how many were forwarded, the
+// latency from the RXDONE interrupt (tmst) to PUSH_DATA in virtual uSec and the
+// host time per virtual second. Packets are lost when loop() is blocked while
+// the next packet overwrites the FIFO (e.g. by the delay() in printSeen()).
+void test_bench_uplink(void)
+{
+	const int n = 200;
+	uint64_t t = simNow() + 10000;
+	for (int i=0; i<n; i++) {
+		sx1276Sim.send(t, freqs[gwayConfig.ch].upFreq, sf, upFrame(20 + (i % 30), (uint8_t) i));
+		t += 250000;
+	}
+
+	uint64_t v0 = simNow();
+	auto h0 = std::chrono::steady_clock::now();
+	simRun(t - v0 + 200000);
+	double host = std::chrono::duration<double>(std::chrono::steady_clock::now() - h0).count();
+
+	// PUSH_DATA may carry more than one rxpk (see _RXBATCH)
+	uint32_t cnt = 0;
+	uint64_t sum = 0, max = 0;
+	for (auto &d: sentUdp(PUSH_DATA)) {
+		std::string js = pushJson(d);
+		for (size_t p = js.find("\"tmst\":"); p != std::string::npos; p = js.find("\"tmst\":", p+1)) {
+			uint64_t lat = d.time - strtoul(js.c_str() + p + 7, NULL, 10);
+			sum += lat;
+			if (lat > max) max = lat;
+			cnt++;
+		}
+	}
+	TEST_ASSERT_EQUAL_UINT32(n, sx1276Sim.rxOk);
+	TEST_ASSERT_GREATER_OR_EQUAL(n - n/50, cnt);
+
+	char res[160];
+	snprintf(res, sizeof(res), "%u of %d uplinks forwarded: latency avg=%llu max=%llu uSec, host %.1f msec per virtual sec",
+		cnt, n, (unsigned long long)(sum / (cnt ? cnt : 1)), (unsigned long long) max,
+		host * 1000.0 / ((simNow() - v0) / 1e6));
+	TEST_MESSAGE(res);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_boot_rx);
+	RUN_TEST(test_uplink_push_data);
+	RUN_TEST(test_uplink_crc_error);
+	RUN_TEST(test_uplink_dedup);
+	RUN_TEST(test_dedup_unknown_node);
+	RUN_TEST(test_downlink_tx);
+	RUN_TEST(test_tx_paramp);
+	RUN_TEST(test_tx_timer_spi);
+	RUN_TEST(test_tx_calib_next);
+	RUN_TEST(test_tx_codr_prea);
+	RUN_TEST(test_tx_cal_save);
+	RUN_TEST(test_statview_saved);
+	RUN_TEST(test_stat_each);
+	RUN_TEST(test_downlink_late);
+	RUN_TEST(test_downlink_fail);
+	RUN_TEST(test_cad_uplink);
+	RUN_TEST(test_hop_rx_wait);
+	RUN_TEST(test_bench_uplink);
+	return UNITY_END();
+}
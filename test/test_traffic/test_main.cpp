@@ -0,0 +1,141 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test and benchmark of the synthetic traffic of _traffic.ino with 50 devices: the FCnt
+// of every device, no uplinks to the servers without _TRAFFIC_FWD, and the frames
+// forwarded when trafficGen() puts them in the uplink queue (collision model) compared
+// with the same devices on the air of the sx1276 simulator (trafRadio).
+// Run with: pio test -e native -f test_traffic
+// ----------------------------------------------------------------------------------------
+#define _TRAFFIC 50
+#define _TRAFFIC_PERIOD 10
+#include <unity.h>
+#include <map>
+#include "sketch.h"
+
+static std::vector<std::vector<uint8_t>> sent;			// Frames trafRadio() was given
+
+// trafRadio: put the frame of a device on the air of the simulator
+static void simAir(uint8_t chan, uint8_t sfDev, uint8_t *frame, uint8_t len)
+{
+	sent.push_back(std::vector<uint8_t>(frame, frame + len));
+	sx1276Sim.send(simNow(), freqs[chan].upFreq, sfDev, sent.back());
+}
+
+// Number of PUSH_DATA datagrams the gateway sent
+static int pushCount()
+{
+	int n = 0;
+	for (auto &d: simUdp::out) {
+		if ((d.data.size() >= 4) && (d.data[3] == PUSH_DATA)) n++;
+	}
+	return n;
+}
+
+static uint32_t sum(uint32_t trafStat::*c)
+{
+	uint32_t n = 0;
+	for (int i=0; i<6; i++) n += trafStat[i].*c;
+	return n;
+}
+
+// Boot with the same random numbers, so both runs have the same devices and times
+void setUp(void)
+{
+	randomSeed(1);
+	trafRadio = NULL;
+	sent.clear();
+	memset(trafStat, 0, sizeof(trafStat));
+	memset(fwdHist, 0, sizeof(fwdHist));
+	simBoot(false);
+}
+
+void tearDown(void)
+{
+	trafRadio = NULL;
+}
+
+// Every device counts its own FCnt from 0, the SF and DevAddr are those of the device
+void test_fcnt(void)
+{
+	trafRadio = simAir;
+	simRun(60000000);
+
+	std::map<uint16_t, uint16_t> fcnt;
+	for (auto &f: sent) {
+		TEST_ASSERT_EQUAL(_TRAFFIC_SIZE, f.size());
+		TEST_ASSERT_EQUAL_HEX8(0x40, f[0]);
+		TEST_ASSERT_EQUAL_HEX8(0xFF, f[3]);
+		TEST_ASSERT_EQUAL_HEX8(0x26, f[4]);
+		uint16_t dev = f[1] | (f[2] << 8);
+		TEST_ASSERT_LESS_THAN(_TRAFFIC, dev);
+		TEST_ASSERT_EQUAL(fcnt[dev], f[6] | (f[7] << 8));
+		fcnt[dev]++;
+	}
+	TEST_ASSERT_EQUAL(_TRAFFIC, fcnt.size());
+	for (auto &d: fcnt) {
+		TEST_ASSERT_EQUAL(d.second, trafFcnt[d.first]);
+		TEST_ASSERT_TRUE((d.second >= 5) && (d.second <= 7));	// 60 sec, period 9 to 11 sec
+	}
+	TEST_ASSERT_EQUAL(sent.size(), sum(&trafStat::gen));
+}
+
+// The model forwards frames, but nothing is sent to the servers
+void test_no_server(void)
+{
+	uint32_t msgs = rxPipe.pushMsgs;
+	simRun(60000000);
+	TEST_ASSERT_GREATER_THAN(0, sum(&trafStat::fwd));
+	TEST_ASSERT_EQUAL(sum(&trafStat::fwd), rxPipe.pushMsgs - msgs);
+	TEST_ASSERT_EQUAL(0, pushCount());
+}
+
+// The same devices through the collision model and through the simulator. The gateway
+// listens on SF7, so only SF7 frames are forwarded. The simulator receives the first
+// of two overlapping frames where the model loses both.
+void test_model_radio(void)
+{
+	const uint64_t t = 300000000;
+	char res[200];
+
+	simRun(t);
+	uint32_t gen = trafStat[0].gen;
+	uint32_t fwd = trafStat[0].fwd;
+	TEST_ASSERT_EQUAL(sum(&trafStat::fwd), fwd);
+	TEST_ASSERT_EQUAL(trafStat[0].rx, fwd);
+	TEST_ASSERT_EQUAL(gen, trafStat[0].rx + trafStat[0].col + trafStat[0].miss + trafStat[0].full
+		+ (trafAir[0][0].busy ? 1 : 0));
+	snprintf(res, sizeof(res), "model: SF7 %u frames, %u forwarded, %u collided, fwd p50 %u p95 %u uSec",
+		gen, fwd, trafStat[0].col, fwdPercentile(50), fwdPercentile(95));
+	TEST_MESSAGE(res);
+
+	setUp();
+	trafRadio = simAir;
+	simRun(t);
+	TEST_ASSERT_EQUAL(gen, trafStat[0].gen);					// Same devices and times
+	TEST_ASSERT_EQUAL(sum(&trafStat::fwd), trafStat[0].fwd);
+	TEST_ASSERT_EQUAL(sx1276Sim.rxOk, trafStat[0].fwd);
+	TEST_ASSERT_LESS_OR_EQUAL(gen, sx1276Sim.rxOk + sx1276Sim.rxMissed);
+	TEST_ASSERT_GREATER_OR_EQUAL(fwd, trafStat[0].fwd);
+	TEST_ASSERT_EQUAL(0, sx1276Sim.spiNested);
+	snprintf(res, sizeof(res), "radio: SF7 %u frames, %u forwarded, %u missed, fwd p50 %u p95 %u uSec",
+		trafStat[0].gen, trafStat[0].fwd, sx1276Sim.rxMissed, fwdPercentile(50), fwdPercentile(95));
+	TEST_MESSAGE(res);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_fcnt);
+	RUN_TEST(test_no_server);
+	RUN_TEST(test_model_radio);
+	return UNITY_END();
+}
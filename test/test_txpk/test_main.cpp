@@ -0,0 +1,211 @@
+// 1-channel LoRa Gateway for ESP8266 and ESP32
+// Copyright (c) 2016-2021 Maarten Westenberg version for ESP8266
+//
+// All rights reserved. This program and the accompanying materials
+// are made available under the terms of the MIT License
+// which accompanies this distribution, and is available at
+// https://opensource.org/licenses/mit-license.php
+//
+// NO WARRANTY OF ANY KIND IS PROVIDED
+//
+// ----------------------------------------------------------------------------------------
+// Test of txpkParse(), the PULL_RESP parser of _txRx.ino, and a benchmark of its parse
+// time against the ArduinoJson path sendPacket() used before (deserializeJson() in a
+// StaticJsonDocument<312> and root["txpk"][...] lookups).
+// Run with: pio test -e native -f test_txpk
+// ----------------------------------------------------------------------------------------
+#include <unity.h>
+#include <chrono>
+#include <string>
+#include <ArduinoJson.h>
+#include "sketch.h"
+
+static const char *msg =
+	"{\"txpk\":{\"codr\":\"4/5\",\"data\":\"YCkEAgIABQABGmIwYX/kSn4Y\",\"freq\":868.1,\"ipol\":true,"
+	"\"modu\":\"LORA\",\"powe\":14,\"rfch\":0,\"size\":18,\"tmst\":1890991792,\"datr\":\"SF7BW125\"}}";
+
+// Parse a copy of js, txpkParse() changes its input
+static int parse(const std::string &js, struct LoraDown *d, struct txpk *tx)
+{
+	static char buf[TX_BUFF_SIZE];
+	memcpy(buf, js.data(), js.size());
+	return( txpkParse(buf, js.size(), d, tx) );
+}
+
+// js with datr replaced by datr
+static std::string withDatr(const char *datr)
+{
+	std::string js = msg;
+	size_t p = js.find("SF7BW125");
+	return( js.replace(p, 8, datr) );
+}
+
+// The old decode of sendPacket() with ArduinoJson
+StaticJsonDocument<312> jsonBuffer;
+
+static int parseJson(char *js, struct LoraDown *d)
+{
+	if (deserializeJson(jsonBuffer, js)) return(-1);
+	JsonObject root = jsonBuffer.as<JsonObject>();
+
+	d->tmst = (uint32_t) root["txpk"]["tmst"].as<unsigned long>();
+	const char *data = root["txpk"]["data"];
+	uint8_t psize = root["txpk"]["size"];
+	const char *datr = root["txpk"]["datr"];
+	d->codr = (char *)(const char *) root["txpk"]["codr"];
+	d->modu = (char *)(const char *) root["txpk"]["modu"];
+	const char *time = root["txpk"]["time"];
+	d->ipol = root["txpk"]["ipol"];
+	d->imme = root["txpk"]["imme"];
+	d->powe = root["txpk"]["powe"];
+	d->prea = root["txpk"]["prea"];
+	d->ncrc = root["txpk"]["ncrc"];
+	d->rfch = root["txpk"]["rfch"];
+	if ((data == NULL) || (datr == NULL)) return(-1);
+	d->sf = atoi(datr+2);
+	int j; for (j=3; *(datr+j)!='W'; j++);
+	d->bw = atoi(datr+j+1);
+	d->size = psize + (time != NULL);
+	return(0);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_parse(void)
+{
+	struct LoraDown d;
+	struct txpk tx;
+	TEST_ASSERT_EQUAL(0, parse(msg, &d, &tx));
+	TEST_ASSERT_EQUAL_UINT32(1890991792, d.tmst);
+	TEST_ASSERT_EQUAL(7, d.sf);
+	TEST_ASSERT_EQUAL(125, d.bw);
+	TEST_ASSERT_TRUE(d.ipol);
+	TEST_ASSERT_EQUAL(0, d.imme);
+	TEST_ASSERT_EQUAL(14, d.powe);
+	TEST_ASSERT_EQUAL_STRING("4/5", d.codr);
+	TEST_ASSERT_EQUAL(1, d.cr);
+	TEST_ASSERT_EQUAL_STRING("LORA", d.modu);
+	TEST_ASSERT_EQUAL(18, tx.size);
+	TEST_ASSERT_EQUAL_UINT32(868100000, tx.freq);
+	TEST_ASSERT_EQUAL(24, tx.dataLen);
+	TEST_ASSERT_EQUAL_STRING_LEN("YCkEAgIABQABGmIwYX/kSn4Y", tx.data, 24);
+	TEST_ASSERT_NULL(tx.time);
+}
+
+// Keys in another order, white space and unknown members
+void test_order(void)
+{
+	struct LoraDown d;
+	struct txpk tx;
+	std::string js = "{ \"other\" : [1,{\"a\":\"}\"}], \"txpk\" : { \"datr\":\"SF12BW500\", \"xtra\":{\"b\":[]},"
+		" \"tmst\":42, \"imme\":true, \"data\":\"AAAA\", \"freq\":869.525 } }";
+	TEST_ASSERT_EQUAL(0, parse(js, &d, &tx));
+	TEST_ASSERT_EQUAL(12, d.sf);
+	TEST_ASSERT_EQUAL(500, d.bw);
+	TEST_ASSERT_EQUAL_UINT32(42, d.tmst);
+	TEST_ASSERT_EQUAL(1, d.imme);
+	TEST_ASSERT_EQUAL_UINT32(869525000, tx.freq);
+}
+
+// Only LoRa bandwidths of 125, 250 and 500 kHz are accepted
+void test_datr(void)
+{
+	struct LoraDown d;
+	struct txpk tx;
+	TEST_ASSERT_EQUAL(0, parse(withDatr("SF9BW250"), &d, &tx));
+	TEST_ASSERT_EQUAL(250, d.bw);
+	TEST_ASSERT_EQUAL(0, parse(withDatr("SF7BW500"), &d, &tx));
+
+	const char *bad[] = { "SF7BW62", "SF7BW1250", "SF7BW", "SF7BWx", "SF7", "SF13BW125",
+		"SF5BW125", "BW125", "50000", "SF7BW0", "SF7BW-125" };
+	for (auto b: bad) {
+		TEST_ASSERT_EQUAL_MESSAGE(-1, parse(withDatr(b), &d, &tx), b);
+	}
+}
+
+// codr "4/5" to "4/8" gives cr 1 to 4, without codr 4/5 is used
+void test_codr(void)
+{
+	struct LoraDown d;
+	struct txpk tx;
+	std::string js = msg;
+	size_t p = js.find("4/5");
+	for (int i=5; i<=8; i++) {
+		js[p+2] = '0' + i;
+		TEST_ASSERT_EQUAL(0, parse(js, &d, &tx));
+		TEST_ASSERT_EQUAL(i-4, d.cr);
+	}
+	TEST_ASSERT_EQUAL(0, parse("{\"txpk\":{\"datr\":\"SF7BW125\",\"data\":\"AAAA\"}}", &d, &tx));
+	TEST_ASSERT_EQUAL(1, d.cr);
+
+	const char *bad[] = { "4/4", "4/9", "5/5", "4/55", "4", "" };
+	for (auto b: bad) {
+		js = msg;
+		js.replace(p, 3, b);
+		TEST_ASSERT_EQUAL_MESSAGE(-1, parse(js, &d, &tx), b);
+	}
+}
+
+// Every truncated message and a message without data are refused
+void test_malformed(void)
+{
+	struct LoraDown d;
+	struct txpk tx;
+	std::string js = msg;
+	for (size_t n = 0; n < js.size(); n++) {
+		TEST_ASSERT_EQUAL(-1, parse(js.substr(0, n), &d, &tx));
+	}
+	TEST_ASSERT_EQUAL(-1, parse("{\"txpk\":{\"datr\":\"SF7BW125\"}}", &d, &tx));
+	TEST_ASSERT_EQUAL(-1, parse("{\"rxpk\":[]}", &d, &tx));
+	TEST_ASSERT_EQUAL(-1, parse("[]", &d, &tx));
+}
+
+// Parse time of txpkParse() and of the ArduinoJson path
+void test_bench(void)
+{
+	const int n = 200000;
+	struct LoraDown d;
+	struct txpk tx;
+	char buf[400];
+	size_t len = strlen(msg);
+	volatile uint32_t sink = 0;
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i=0; i<n; i++) {
+		memcpy(buf, msg, len + 1);
+		sink += txpkParse(buf, len, &d, &tx) + d.bw;
+	}
+	double tParse = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n;
+
+	t0 = std::chrono::steady_clock::now();
+	for (int i=0; i<n; i++) {
+		memcpy(buf, msg, len + 1);
+		sink += parseJson(buf, &d) + d.bw;
+	}
+	double tJson = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n;
+
+	char res[160];
+	snprintf(res, sizeof(res), "txpk of %u bytes: txpkParse %.0f nsec, ArduinoJson %.0f nsec (x%.1f)",
+		(unsigned) len, tParse, tJson, tJson / tParse);
+	TEST_MESSAGE(res);
+	TEST_ASSERT_EQUAL(125, d.bw);
+	(void) sink;
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_parse);
+	RUN_TEST(test_order);
+	RUN_TEST(test_datr);
+	RUN_TEST(test_codr);
+	RUN_TEST(test_malformed);
+	RUN_TEST(test_bench);
+	return UNITY_END();
+}